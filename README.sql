@@ -27,3 +27,21 @@ logging of traps.
 
 The schema must be loaded into MySQL before running snmptrapd.
 The schema can be found in dist/schema-snmptrapd.sql
+
+snmptrapd SQLite Logging
+------------------------
+
+When built with --with-sqlite, snmptrapd can log traps to a local
+SQLite database instead, which needs no server or schema setup:
+
+	# the database; the tables are created if needed
+	sqliteDatabase /var/lib/snmp/traps.db
+
+	# write when this many traps are queued ...
+	sqliteBatchSize 512
+
+	# ... or at the latest after this many seconds
+	sqliteFlushInterval 1
+
+The tables are the same as for MySQL, with the enumerated columns
+stored as text.
@@ -940,7 +940,8 @@ netsnmp_free_delegated_cache(netsnmp_delegated_cache *dcache)
 #ifndef NETSNMP_FEATURE_REMOVE_HANDLER_MARK_REQUESTS_AS_DELEGATED
 /** Sets a list of requests as delegated or not delegated.
  *  Sweeps through given chain of requests and sets 'delegated'
- *  flag accordingly to the isdelegaded parameter.
+ *  flag accordingly to the isdelegaded parameter.  Clearing the flag
+ *  reports the requests as completed (see netsnmp_request_completed()).
  *
  *  @param requests Request list.
  *  @param isdelegated New value of the 'delegated' flag.
@@ -950,7 +951,10 @@ netsnmp_handler_mark_requests_as_delegated(netsnmp_request_info *requests,
                                            int isdelegated)
 {
     while (requests) {
-        requests->delegated = isdelegated;
+        if (isdelegated == REQUEST_IS_NOT_DELEGATED)
+            netsnmp_request_completed(requests);
+        else
+            requests->delegated = isdelegated;
         requests = requests->next;
     }
 }
@@ -0,0 +1,1001 @@
+/*
+ * agent_inform_spool.c - durable queue for unacknowledged INFORMs
+ *
+ * Every INFORM sent to a sink is first appended to a memory-mapped spool
+ * file, and marked done once the sink acknowledges it.  A sink that does
+ * not answer is considered down: its later INFORMs are only appended to
+ * the spool, and the oldest one is sent again every
+ * informSpoolRetryInterval seconds.  Once that one is acknowledged, the
+ * others are replayed in the order they were spooled, with at most
+ * informSpoolReplayWindow of them outstanding at a time, before new ones
+ * are sent directly again.  As the spool is a file, what was not
+ * acknowledged before a restart is replayed after it, as soon as a
+ * notification (normally the coldStart) is sent to the same sink again.
+ *
+ * The spool is a log of records appended at its tail.  Records that are
+ * done, or pending for longer than informSpoolMaxAge, are skipped at its
+ * head, and the live ones are moved to the start of the file when the
+ * tail reaches its end.  If that does not make room, the oldest records
+ * are dropped.
+ *
+ * The records sent and not answered yet are indexed by request ID, so that
+ * an answer finds its record without walking the spool.  Only the parts
+ * of the file that changed are flushed, once a second.
+ *
+ * The numbers of notifications spooled, replayed, expired and dropped are
+ * kept in the spool header, and logged whenever a sink goes down or has
+ * caught up, and at shutdown.
+ */
+#include <net-snmp/net-snmp-config.h>
+
+#ifdef HAVE_SYS_MMAN_H
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#else
+#include <strings.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#include <time.h>
+
+#include <net-snmp/net-snmp-includes.h>
+#include <net-snmp/agent/net-snmp-agent-includes.h>
+#include "agent_inform_spool.h"
+
+#define SPOOL_MAGIC             "NSINFSP1"
+#define SPOOL_ALIGN(n)          (((n) + 7) & ~7U)
+#define SPOOL_HEADER_SIZE       SPOOL_ALIGN(sizeof(spool_header))
+#define SPOOL_MIN_SIZE          4096
+#define SPOOL_MAX_PDU           65536
+
+#define SPOOL_DEFAULT_REPLAY_WINDOW     10
+#define SPOOL_DEFAULT_RETRY_INTERVAL    10
+#define SPOOL_DEFAULT_MAX_AGE           86400
+
+#define SPOOL_INFLIGHT_BUCKETS  64
+
+/*
+ * record states
+ */
+#define SPOOL_PENDING           1       /* waiting to be sent */
+#define SPOOL_SENT              2       /* sent, no answer yet */
+#define SPOOL_DONE              3       /* acknowledged, expired or dropped */
+
+#define SPOOL_F_HELD            0x01    /* was not delivered at once */
+
+/*
+ * sink states
+ */
+#define SINK_UP                 0
+#define SINK_DOWN               1
+#define SINK_REPLAY             2
+
+typedef struct spool_header_s {
+    char            magic[8];
+    u_int           size;
+    u_int           head;       /* first record that may be live */
+    u_int           tail;       /* where the next record goes */
+    u_int           next_seq;
+    u_int           spooled;    /* counters, kept across restarts */
+    u_int           replayed;
+    u_int           expired;
+    u_int           dropped;
+} spool_header;
+
+typedef struct spool_record_s {
+    u_int           len;        /* of the whole record, aligned */
+    u_int           state;
+    u_int           flags;
+    u_int           seq;
+    u_int           key;        /* identifies the sink */
+    u_int           when;       /* time spooled */
+    u_int           context_len;
+    u_int           pdu_len;
+    int             reqid;      /* of the INFORM while it is sent */
+    /* followed by the context name and the encoded PDU */
+} spool_record;
+
+typedef struct spool_sink_s {
+    netsnmp_session *sess;      /* last session seen for the sink */
+    u_int           key;
+    int             state;
+    int             in_flight;
+    time_t          next_try;
+    u_int           replay_from;    /* its records before are not pending */
+    struct spool_sink_s *next;
+} spool_sink;
+
+/*
+ * a record sent and not answered yet
+ */
+typedef struct spool_inflight_s {
+    int             reqid;
+    u_int           off;        /* of the record, 0 once it is dropped */
+    spool_sink     *sink;
+    struct spool_inflight_s *next;
+} spool_inflight;
+
+/*
+ * configuration
+ */
+static char    *spool_file;
+static u_int    spool_size;
+static int      replay_window = SPOOL_DEFAULT_REPLAY_WINDOW;
+static int      retry_interval = SPOOL_DEFAULT_RETRY_INTERVAL;
+static int      max_age = SPOOL_DEFAULT_MAX_AGE;
+
+/*
+ * the open spool
+ */
+static char    *spool_path;
+static int      spool_fd = -1;
+static u_char  *spool_map;
+static u_char  *spool_scratch;
+static u_int    spool_alarm;
+static spool_sink *spool_sinks;
+static spool_inflight *spool_inflight_tab[SPOOL_INFLIGHT_BUCKETS];
+static int      spool_hdr_dirty;
+static u_int    spool_dirty_lo, spool_dirty_hi;        /* records changed */
+
+#define SPOOL_HDR               ((spool_header *) spool_map)
+#define SPOOL_REC(off)          ((spool_record *) (spool_map + (off)))
+#define SPOOL_OFF(rec)          ((u_int) ((u_char *) (rec) - spool_map))
+
+/*
+ * Note that len bytes of records at off have changed.
+ */
+static void
+spool_touch(u_int off, u_int len)
+{
+    if (spool_dirty_lo >= spool_dirty_hi) {
+        spool_dirty_lo = off;
+        spool_dirty_hi = off + len;
+        return;
+    }
+    if (off < spool_dirty_lo)
+        spool_dirty_lo = off;
+    if (off + len > spool_dirty_hi)
+        spool_dirty_hi = off + len;
+}
+
+#define SPOOL_TOUCH_REC(rec) \
+    spool_touch(SPOOL_OFF(rec), sizeof(spool_record))
+
+/*
+ * Start writing back what has changed since the last flush.
+ */
+static void
+spool_flush(void)
+{
+    u_int           page = (u_int) sysconf(_SC_PAGESIZE), start;
+
+    if (spool_hdr_dirty)
+        msync(spool_map, SPOOL_HEADER_SIZE, MS_ASYNC);
+    if (spool_dirty_hi > SPOOL_HDR->size)
+        spool_dirty_hi = SPOOL_HDR->size;
+    if (spool_dirty_lo < spool_dirty_hi) {
+        start = spool_dirty_lo - spool_dirty_lo % page;
+        msync(spool_map + start, spool_dirty_hi - start, MS_ASYNC);
+    }
+    spool_hdr_dirty = 0;
+    spool_dirty_lo = spool_dirty_hi = 0;
+}
+
+static u_int
+spool_hash(u_int h, const void *data, size_t len)
+{
+    const u_char   *p = (const u_char *) data;
+
+    while (len--)
+        h = (h ^ *p++) * 16777619U;
+    return h;
+}
+
+/*
+ * Identify a sink by what its notifications are sent with, so that it is
+ * recognised when its session is opened again.
+ */
+static u_int
+spool_sink_key(netsnmp_session *sess)
+{
+    netsnmp_transport *t = snmp_sess_transport(snmp_sess_pointer(sess));
+    u_int           h = 2166136261U;
+
+    h = spool_hash(h, &sess->version, sizeof(sess->version));
+    if (t) {
+        h = spool_hash(h, t->domain, t->domain_length * sizeof(oid));
+        h = spool_hash(h, t->remote, t->remote_length);
+    }
+    if (sess->version == SNMP_VERSION_3)
+        h = spool_hash(h, sess->securityName, sess->securityNameLen);
+    else
+        h = spool_hash(h, sess->community, sess->community_len);
+    return h ? h : 1;
+}
+
+static char    *
+spool_sink_name(netsnmp_session *sess)
+{
+    netsnmp_transport *t = snmp_sess_transport(snmp_sess_pointer(sess));
+    char           *name = NULL;
+
+    if (t)
+        name = netsnmp_transport_peer_string(t, t->remote, t->remote_length);
+    return name ? name : strdup("?");
+}
+
+static spool_sink *
+spool_find_sink(netsnmp_session *sess, u_int key)
+{
+    spool_sink     *sink;
+
+    for (sink = spool_sinks; sink; sink = sink->next)
+        if (sink->key == key) {
+            sink->sess = sess;
+            return sink;
+        }
+    return NULL;
+}
+
+static spool_inflight **
+spool_inflight_slot(int reqid)
+{
+    spool_inflight **slot;
+
+    slot = &spool_inflight_tab[(u_int) reqid % SPOOL_INFLIGHT_BUCKETS];
+    while (*slot && (*slot)->reqid != reqid)
+        slot = &(*slot)->next;
+    return slot;
+}
+
+/*
+ * Mark a record sent to a sink with request ID reqid.
+ */
+static int
+spool_track(spool_sink *sink, spool_record *rec, int reqid)
+{
+    spool_inflight *inf, **slot;
+
+    inf = SNMP_MALLOC_TYPEDEF(spool_inflight);
+    if (!inf)
+        return 0;
+    inf->reqid = reqid;
+    inf->off = (u_char *) rec - spool_map;
+    inf->sink = sink;
+    slot = &spool_inflight_tab[(u_int) reqid % SPOOL_INFLIGHT_BUCKETS];
+    inf->next = *slot;
+    *slot = inf;
+    rec->state = SPOOL_SENT;
+    rec->reqid = reqid;
+    SPOOL_TOUCH_REC(rec);
+    sink->in_flight++;
+    return 1;
+}
+
+/*
+ * Forget the record sent with request ID reqid.  Returns its record, or
+ * NULL if it was dropped, and sets *sinkp to its sink.  Returns NULL and
+ * leaves *sinkp alone if nothing was sent with reqid, e.g. because its
+ * answer was already seen.
+ */
+static spool_record *
+spool_untrack(int reqid, spool_sink **sinkp)
+{
+    spool_inflight *inf, **slot = spool_inflight_slot(reqid);
+    spool_record   *rec = NULL;
+
+    inf = *slot;
+    if (!inf)
+        return NULL;
+    *slot = inf->next;
+    inf->sink->in_flight--;
+    *sinkp = inf->sink;
+    if (inf->off) {
+        rec = SPOOL_REC(inf->off);
+        rec->reqid = 0;
+        SPOOL_TOUCH_REC(rec);
+    }
+    free(inf);
+    return rec;
+}
+
+/*
+ * Oldest record of a sink waiting to be sent at or after *from, or NULL.
+ */
+static spool_record *
+spool_next_pending(u_int key, u_int *from)
+{
+    spool_record   *rec;
+
+    if (*from < SPOOL_HDR->head)
+        *from = SPOOL_HDR->head;
+    for (; *from < SPOOL_HDR->tail; *from += rec->len) {
+        rec = SPOOL_REC(*from);
+        if (rec->key == key && rec->state == SPOOL_PENDING)
+            return rec;
+    }
+    return NULL;
+}
+
+/*
+ * Records have moved: search the pending ones of each sink from the head.
+ */
+static void
+spool_rewind(void)
+{
+    spool_sink     *sink;
+
+    for (sink = spool_sinks; sink; sink = sink->next)
+        sink->replay_from = 0;
+}
+
+static int
+spool_backlog(u_int key)
+{
+    u_int           off = 0;
+
+    return spool_next_pending(key, &off) != NULL;
+}
+
+/*
+ * Skip the records done at the head of the spool.
+ */
+static void
+spool_trim(void)
+{
+    spool_header   *hdr = SPOOL_HDR;
+    u_int           head = hdr->head;
+
+    while (hdr->head < hdr->tail && SPOOL_REC(hdr->head)->state == SPOOL_DONE)
+        hdr->head += SPOOL_REC(hdr->head)->len;
+    if (hdr->head >= hdr->tail) {
+        hdr->head = hdr->tail = SPOOL_HEADER_SIZE;
+        spool_rewind();
+    }
+    if (hdr->head != head)
+        spool_hdr_dirty = 1;
+}
+
+/*
+ * Move the live records to the start of the spool.
+ */
+static void
+spool_compact(void)
+{
+    spool_header   *hdr = SPOOL_HDR;
+    u_int           off, to = SPOOL_HEADER_SIZE, len, moved = 0;
+
+    for (off = hdr->head; off < hdr->tail; off += len) {
+        len = SPOOL_REC(off)->len;
+        if (SPOOL_REC(off)->state == SPOOL_DONE)
+            continue;
+        if (to != off) {
+            if (!moved)
+                moved = to;
+            if (SPOOL_REC(off)->state == SPOOL_SENT)
+                (*spool_inflight_slot(SPOOL_REC(off)->reqid))->off = to;
+            memmove(spool_map + to, spool_map + off, len);
+        }
+        to += len;
+    }
+    if (moved)
+        spool_touch(moved, to - moved);
+    hdr->head = SPOOL_HEADER_SIZE;
+    hdr->tail = to;
+    spool_hdr_dirty = 1;
+    spool_rewind();
+}
+
+/*
+ * Drop the oldest live record to make room.
+ */
+static int
+spool_drop_oldest(void)
+{
+    spool_header   *hdr = SPOOL_HDR;
+
+    spool_trim();
+    if (hdr->head >= hdr->tail)
+        return 0;
+    if (SPOOL_REC(hdr->head)->state == SPOOL_SENT)
+        (*spool_inflight_slot(SPOOL_REC(hdr->head)->reqid))->off = 0;
+    SPOOL_REC(hdr->head)->state = SPOOL_DONE;
+    SPOOL_TOUCH_REC(SPOOL_REC(hdr->head));
+    hdr->dropped++;
+    spool_hdr_dirty = 1;
+    spool_trim();
+    return 1;
+}
+
+static spool_record *
+spool_append(u_int key, netsnmp_pdu *pdu)
+{
+    spool_header   *hdr = SPOOL_HDR;
+    spool_record   *rec;
+    size_t          left = SPOOL_MAX_PDU, pdu_len, context_len, len;
+
+    if (snmp_pdu_build(pdu, spool_scratch, &left) == NULL) {
+        DEBUGMSGTL(("inform_spool", "cannot encode the notification\n"));
+        return NULL;
+    }
+    pdu_len = SPOOL_MAX_PDU - left;
+    context_len = pdu->contextName ? pdu->contextNameLen : 0;
+    len = SPOOL_ALIGN(sizeof(spool_record) + context_len + pdu_len);
+    if (len > hdr->size - SPOOL_HEADER_SIZE)
+        return NULL;
+
+    while (hdr->tail + len > hdr->size) {
+        spool_compact();
+        if (hdr->tail + len > hdr->size && !spool_drop_oldest())
+            return NULL;
+    }
+
+    rec = SPOOL_REC(hdr->tail);
+    memset(rec, 0, sizeof(*rec));
+    rec->state = SPOOL_PENDING;
+    rec->seq = hdr->next_seq++;
+    if (hdr->next_seq == 0)
+        hdr->next_seq = 1;
+    rec->key = key;
+    rec->when = (u_int) time(NULL);
+    rec->context_len = context_len;
+    rec->pdu_len = pdu_len;
+    if (context_len)
+        memcpy(rec + 1, pdu->contextName, context_len);
+    memcpy((u_char *) (rec + 1) + context_len, spool_scratch, pdu_len);
+    /*
+     * the length makes the record visible, so it goes last
+     */
+    rec->len = len;
+    hdr->tail += len;
+    spool_touch(SPOOL_OFF(rec), len);
+    spool_hdr_dirty = 1;
+    return rec;
+}
+
+/*
+ * Send a spooled notification again.
+ */
+static int
+spool_send(spool_sink *sink, spool_record *rec)
+{
+    netsnmp_pdu    *pdu;
+    u_char         *data = (u_char *) (rec + 1);
+    size_t          len = rec->pdu_len;
+
+    pdu = snmp_pdu_create(SNMP_MSG_INFORM);
+    if (!pdu)
+        return 0;
+    if (snmp_pdu_parse(pdu, data + rec->context_len, &len) != 0 ||
+        pdu->command != SNMP_MSG_INFORM) {
+        snmp_log(LOG_WARNING, "inform spool: dropping a damaged record\n");
+        snmp_free_pdu(pdu);
+        rec->state = SPOOL_DONE;
+        SPOOL_TOUCH_REC(rec);
+        SPOOL_HDR->dropped++;
+        spool_hdr_dirty = 1;
+        return 0;
+    }
+    if (rec->context_len) {
+        pdu->contextName = netsnmp_memdup_nt(data, rec->context_len,
+                                             &pdu->contextNameLen);
+    }
+    pdu->version = sink->sess->version;
+    pdu->reqid = snmp_get_next_reqid();
+    pdu->msgid = snmp_get_next_msgid();
+
+    if (!spool_track(sink, rec, pdu->reqid)) {
+        snmp_free_pdu(pdu);
+        return 0;
+    }
+    if (snmp_async_send(sink->sess, pdu, handle_inform_response,
+                        (void *) (size_t) rec->seq) == 0) {
+        snmp_sess_perror("snmpd: inform spool", sink->sess);
+        /*
+         * unless the send failure was already reported to
+         * handle_inform_response()
+         */
+        netsnmp_inform_spool_result(sink->sess, pdu->reqid,
+                                    (void *) (size_t) rec->seq, 0);
+        snmp_free_pdu(pdu);
+        return 0;
+    }
+    DEBUGMSGTL(("inform_spool", "resent record %u\n", rec->seq));
+    return 1;
+}
+
+/*
+ * Log the counters, and how many notifications are still to be delivered.
+ */
+static void
+spool_log_counters(void)
+{
+    spool_header   *hdr = SPOOL_HDR;
+    u_int           off, pending = 0;
+
+    for (off = hdr->head; off < hdr->tail; off += SPOOL_REC(off)->len)
+        if (SPOOL_REC(off)->state != SPOOL_DONE)
+            pending++;
+    snmp_log(LOG_INFO, "inform spool: %u spooled, %u replayed, "
+             "%u expired, %u dropped, %u pending\n", hdr->spooled,
+             hdr->replayed, hdr->expired, hdr->dropped, pending);
+}
+
+static void
+spool_sink_state(spool_sink *sink, int state)
+{
+    char           *name;
+
+    if (sink->state == state)
+        return;
+    sink->state = state;
+    name = spool_sink_name(sink->sess);
+    switch (state) {
+    case SINK_DOWN:
+        snmp_log(LOG_WARNING,
+                 "inform spool: %s does not answer, holding its notifications\n",
+                 name);
+        break;
+    case SINK_REPLAY:
+        snmp_log(LOG_INFO, "inform spool: %s answers again, replaying\n",
+                 name);
+        sink->replay_from = 0;
+        break;
+    default:
+        snmp_log(LOG_INFO, "inform spool: %s is up to date\n", name);
+    }
+    free(name);
+    if (state != SINK_REPLAY)
+        spool_log_counters();
+}
+
+/*
+ * Whether notifications can be sent to a sink.  A sink whose session has
+ * been closed, e.g. by a reconfiguration, waits for a notification to be
+ * sent to it again.
+ */
+static int
+spool_sink_usable(spool_sink *sink)
+{
+    return snmp_sess_pointer(sink->sess) &&
+        spool_sink_key(sink->sess) == sink->key;
+}
+
+/*
+ * Replay the backlog of a sink, keeping at most informSpoolReplayWindow
+ * notifications outstanding, and go back to sending directly once it has
+ * all been acknowledged.
+ */
+static void
+spool_replay(spool_sink *sink)
+{
+    spool_record   *rec;
+
+    while (sink->in_flight < replay_window) {
+        rec = spool_next_pending(sink->key, &sink->replay_from);
+        if (!rec)
+            break;
+        if (!spool_send(sink, rec) && rec->state == SPOOL_PENDING)
+            return;
+        if (sink->state != SINK_REPLAY)
+            return;
+    }
+    if (!sink->in_flight && !spool_next_pending(sink->key, &sink->replay_from))
+        spool_sink_state(sink, SINK_UP);
+}
+
+static void
+spool_tick(unsigned int clientreg, void *clientarg)
+{
+    spool_header   *hdr = SPOOL_HDR;
+    spool_record   *rec;
+    spool_sink     *sink;
+    time_t          now = time(NULL);
+    u_int           off;
+
+    /*
+     * the spool is in the order the records were added, so the expired
+     * ones are at its head
+     */
+    if (max_age > 0) {
+        for (off = hdr->head; off < hdr->tail; off += rec->len) {
+            rec = SPOOL_REC(off);
+            if ((u_int) now - rec->when < (u_int) max_age)
+                break;
+            if (rec->state == SPOOL_PENDING) {
+                rec->state = SPOOL_DONE;
+                SPOOL_TOUCH_REC(rec);
+                hdr->expired++;
+                spool_hdr_dirty = 1;
+            }
+        }
+    }
+    spool_trim();
+
+    for (sink = spool_sinks; sink; sink = sink->next) {
+        if (sink->state == SINK_UP || !spool_sink_usable(sink))
+            continue;
+        if (sink->state == SINK_REPLAY) {
+            spool_replay(sink);
+            continue;
+        }
+        if (sink->in_flight || now < sink->next_try)
+            continue;
+        sink->next_try = now + retry_interval;
+        off = 0;
+        rec = spool_next_pending(sink->key, &off);
+        if (rec)
+            spool_send(sink, rec);
+        else
+            spool_sink_state(sink, SINK_UP);
+    }
+
+    spool_flush();
+}
+
+/**
+ * Spools an INFORM about to be sent to a sink.
+ *
+ * @param sess  session of the sink
+ * @param pdu   the INFORM
+ * @param magic set to what to pass to handle_inform_response() when the
+ *              INFORM is sent
+ *
+ * @return 1 if the INFORM is held in the spool to be sent later, and 0 if
+ *         it should be sent now.
+ */
+int
+netsnmp_inform_spool_add(netsnmp_session *sess, netsnmp_pdu *pdu,
+                         void **magic)
+{
+    spool_sink     *sink;
+    spool_record   *rec;
+    u_int           key;
+
+    *magic = NULL;
+    if (!spool_map || pdu->command != SNMP_MSG_INFORM)
+        return 0;
+
+    key = spool_sink_key(sess);
+    sink = spool_find_sink(sess, key);
+    if (!sink) {
+        sink = SNMP_MALLOC_TYPEDEF(spool_sink);
+        if (!sink)
+            return 0;
+        sink->sess = sess;
+        sink->key = key;
+        sink->next = spool_sinks;
+        spool_sinks = sink;
+        /*
+         * what was spooled before a restart goes first
+         */
+        if (spool_backlog(key))
+            spool_sink_state(sink, SINK_DOWN);
+    }
+
+    rec = spool_append(key, pdu);
+    if (!rec)
+        return 0;
+    if (sink->state != SINK_UP) {
+        rec->flags |= SPOOL_F_HELD;
+        SPOOL_HDR->spooled++;
+        DEBUGMSGTL(("inform_spool", "holding record %u\n", rec->seq));
+        return 1;
+    }
+    if (!spool_track(sink, rec, pdu->reqid)) {
+        rec->state = SPOOL_DONE;
+        SPOOL_TOUCH_REC(rec);
+        return 0;
+    }
+    *magic = (void *) (size_t) rec->seq;
+    return 0;
+}
+
+/**
+ * Records whether a sink acknowledged a spooled INFORM.  Only the first
+ * result for a request counts, so that a failure reported both to the
+ * callback and by snmp_async_send() is not seen twice.
+ *
+ * @param sess  session of the sink
+ * @param reqid request ID the INFORM was sent with
+ * @param magic what netsnmp_inform_spool_add() returned for it
+ * @param acked whether the sink acknowledged it
+ */
+void
+netsnmp_inform_spool_result(netsnmp_session *sess, int reqid, void *magic,
+                            int acked)
+{
+    u_int           seq = (u_int) (size_t) magic;
+    spool_sink     *sink = NULL;
+    spool_record   *rec;
+
+    if (!spool_map || !seq || !sess)
+        return;
+
+    rec = spool_untrack(reqid, &sink);
+    if (!sink)
+        return;
+    sink->sess = sess;
+    DEBUGMSGTL(("inform_spool", "record %u %s\n", seq,
+                acked ? "acknowledged" : "not acknowledged"));
+
+    if (acked) {
+        if (rec && rec->state != SPOOL_DONE) {
+            if (rec->flags & SPOOL_F_HELD) {
+                SPOOL_HDR->replayed++;
+                spool_hdr_dirty = 1;
+            }
+            rec->state = SPOOL_DONE;
+            SPOOL_TOUCH_REC(rec);
+        }
+        if (sink->state == SINK_DOWN)
+            spool_sink_state(sink, SINK_REPLAY);
+        spool_trim();
+        /*
+         * keep the window full rather than wait for the next tick
+         */
+        if (sink->state == SINK_REPLAY && spool_sink_usable(sink))
+            spool_replay(sink);
+        return;
+    }
+
+    if (rec && rec->state == SPOOL_SENT) {
+        rec->state = SPOOL_PENDING;
+        if (!(rec->flags & SPOOL_F_HELD)) {
+            rec->flags |= SPOOL_F_HELD;
+            SPOOL_HDR->spooled++;
+            spool_hdr_dirty = 1;
+        }
+        SPOOL_TOUCH_REC(rec);
+    }
+    if (sink->state != SINK_DOWN) {
+        sink->next_try = time(NULL) + retry_interval;
+        spool_sink_state(sink, SINK_DOWN);
+    }
+}
+
+static void
+spool_close(void)
+{
+    spool_sink     *sink;
+    spool_inflight *inf;
+    int             i;
+
+    if (spool_alarm)
+        snmp_alarm_unregister(spool_alarm);
+    spool_alarm = 0;
+    if (spool_map) {
+        spool_log_counters();
+        msync(spool_map, SPOOL_HDR->size, MS_SYNC);
+        munmap(spool_map, SPOOL_HDR->size);
+        spool_map = NULL;
+    }
+    spool_hdr_dirty = 0;
+    spool_dirty_lo = spool_dirty_hi = 0;
+    if (spool_fd >= 0)
+        close(spool_fd);
+    spool_fd = -1;
+    SNMP_FREE(spool_path);
+    SNMP_FREE(spool_scratch);
+    for (i = 0; i < SPOOL_INFLIGHT_BUCKETS; i++) {
+        while ((inf = spool_inflight_tab[i]) != NULL) {
+            spool_inflight_tab[i] = inf->next;
+            free(inf);
+        }
+    }
+    while (spool_sinks) {
+        sink = spool_sinks;
+        spool_sinks = sink->next;
+        free(sink);
+    }
+}
+
+/*
+ * Check the records of a spool read from disk.  Returns the offset of its
+ * tail, after the last valid record.
+ */
+static u_int
+spool_check(u_char *map, u_int size)
+{
+    spool_header   *hdr = (spool_header *) map;
+    spool_record   *rec;
+    u_int           off;
+
+    if (memcmp(hdr->magic, SPOOL_MAGIC, sizeof(hdr->magic)) != 0 ||
+        hdr->size != size || hdr->head < SPOOL_HEADER_SIZE ||
+        hdr->tail > size || hdr->head > hdr->tail)
+        return 0;
+    for (off = hdr->head; off < hdr->tail; off += rec->len) {
+        rec = (spool_record *) (map + off);
+        if (rec->len < sizeof(*rec) || rec->len % 8 ||
+            rec->len > hdr->tail - off ||
+            sizeof(*rec) + rec->context_len + rec->pdu_len > rec->len)
+            break;
+        /*
+         * nothing is in flight after a restart
+         */
+        if (rec->state == SPOOL_SENT)
+            rec->state = SPOOL_PENDING;
+        rec->reqid = 0;
+    }
+    return off;
+}
+
+static u_char  *
+spool_map_file(int fd, u_int size)
+{
+    void           *map;
+
+    map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    return map == MAP_FAILED ? NULL : (u_char *) map;
+}
+
+static int
+spool_open(int majorID, int minorID, void *serverarg, void *clientarg)
+{
+    char            path[SNMP_MAXPATH];
+    struct stat     st;
+    spool_header   *hdr;
+    u_char         *map;
+    u_int           tail, old_size;
+
+    if (spool_file)
+        strlcpy(path, spool_file, sizeof(path));
+    else
+        snprintf(path, sizeof(path), "%s/inform-spool",
+                 get_persistent_directory());
+
+    if (spool_map && spool_size == SPOOL_HDR->size &&
+        strcmp(path, spool_path) == 0)
+        return SNMPERR_SUCCESS;
+    spool_close();
+    if (spool_size == 0)
+        return SNMPERR_SUCCESS;
+
+    mkdirhier(path, NETSNMP_AGENT_DIRECTORY_MODE, 1);
+    spool_fd = open(path, O_RDWR | O_CREAT, 0600);
+    if (spool_fd < 0 || fstat(spool_fd, &st) < 0) {
+        snmp_log(LOG_ERR, "inform spool: cannot open %s: %s\n", path,
+                 strerror(errno));
+        goto fail;
+    }
+
+    /*
+     * keep what an existing spool holds, and fit it into the new size
+     */
+    old_size = (u_int) st.st_size;
+    tail = 0;
+    if (old_size >= SPOOL_MIN_SIZE) {
+        map = spool_map_file(spool_fd, old_size);
+        if (map) {
+            tail = spool_check(map, old_size);
+            if (tail) {
+                spool_map = map;
+                SPOOL_HDR->tail = tail;
+                spool_compact();
+                while (SPOOL_HDR->tail > spool_size && spool_drop_oldest())
+                    spool_compact();
+                SPOOL_HDR->size = spool_size;
+                spool_map = NULL;
+            }
+            munmap(map, old_size);
+        }
+    }
+    if (ftruncate(spool_fd, spool_size) < 0 ||
+        (spool_map = spool_map_file(spool_fd, spool_size)) == NULL) {
+        snmp_log(LOG_ERR, "inform spool: cannot map %s: %s\n", path,
+                 strerror(errno));
+        goto fail;
+    }
+    hdr = SPOOL_HDR;
+    if (!tail) {
+        if (old_size)
+            snmp_log(LOG_WARNING, "inform spool: %s is not a valid spool, "
+                     "starting afresh\n", path);
+        memset(hdr, 0, SPOOL_HEADER_SIZE);
+        memcpy(hdr->magic, SPOOL_MAGIC, sizeof(hdr->magic));
+        hdr->size = spool_size;
+        hdr->head = hdr->tail = SPOOL_HEADER_SIZE;
+        hdr->next_seq = 1;
+        spool_hdr_dirty = 1;
+    }
+
+    spool_scratch = malloc(SPOOL_MAX_PDU);
+    spool_path = strdup(path);
+    if (!spool_scratch || !spool_path)
+        goto fail;
+    spool_alarm = snmp_alarm_register(1, SA_REPEAT, spool_tick, NULL);
+    DEBUGMSGTL(("inform_spool", "opened %s, %u bytes\n", path, spool_size));
+    return SNMPERR_SUCCESS;
+
+  fail:
+    spool_close();
+    return SNMPERR_SUCCESS;
+}
+
+static int
+spool_shutdown(int majorID, int minorID, void *serverarg, void *clientarg)
+{
+    spool_close();
+    return SNMPERR_SUCCESS;
+}
+
+static void
+spool_parse_size(const char *token, char *cptr)
+{
+    long            size = atol(cptr);
+
+    if (size < 0 || size > 0x40000000L) {
+        config_perror("invalid spool size");
+        return;
+    }
+    if (size && size < SPOOL_MIN_SIZE)
+        size = SPOOL_MIN_SIZE;
+    spool_size = SPOOL_ALIGN((u_int) size);
+}
+
+static void
+spool_parse_file(const char *token, char *cptr)
+{
+    SNMP_FREE(spool_file);
+    spool_file = strdup(cptr);
+}
+
+static void
+spool_parse_int(const char *token, char *cptr)
+{
+    int             val = atoi(cptr);
+
+    if (val < 0 || (val == 0 && strcmp(token, "informSpoolMaxAge") != 0)) {
+        config_perror("invalid value");
+        return;
+    }
+    if (strcmp(token, "informSpoolReplayWindow") == 0)
+        replay_window = val;
+    else if (strcmp(token, "informSpoolRetryInterval") == 0)
+        retry_interval = val;
+    else
+        max_age = val;
+}
+
+static void
+spool_free_config(void)
+{
+    SNMP_FREE(spool_file);
+    spool_size = 0;
+    replay_window = SPOOL_DEFAULT_REPLAY_WINDOW;
+    retry_interval = SPOOL_DEFAULT_RETRY_INTERVAL;
+    max_age = SPOOL_DEFAULT_MAX_AGE;
+}
+
+void
+netsnmp_inform_spool_init(void)
+{
+    register_app_config_handler("informSpoolSize", spool_parse_size,
+                                spool_free_config, "BYTES (0 disables)");
+    register_app_config_handler("informSpoolFile", spool_parse_file, NULL,
+                                "PATH");
+    register_app_config_handler("informSpoolReplayWindow", spool_parse_int,
+                                NULL, "NUMBER");
+    register_app_config_handler("informSpoolRetryInterval", spool_parse_int,
+                                NULL, "SECONDS");
+    register_app_config_handler("informSpoolMaxAge", spool_parse_int, NULL,
+                                "SECONDS (0 for no limit)");
+    snmp_register_callback(SNMP_CALLBACK_LIBRARY,
+                           SNMP_CALLBACK_POST_READ_CONFIG, spool_open, NULL);
+    snmp_register_callback(SNMP_CALLBACK_LIBRARY, SNMP_CALLBACK_SHUTDOWN,
+                           spool_shutdown, NULL);
+}
+
+#endif                          /* HAVE_SYS_MMAN_H */
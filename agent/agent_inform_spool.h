@@ -0,0 +1,20 @@
+#ifndef AGENT_INFORM_SPOOL_H
+#define AGENT_INFORM_SPOOL_H
+
+/*
+ * Durable queue of the INFORMs not yet acknowledged by their sink.
+ */
+#ifdef HAVE_SYS_MMAN_H
+void            netsnmp_inform_spool_init(void);
+int             netsnmp_inform_spool_add(netsnmp_session *sess,
+                                         netsnmp_pdu *pdu, void **magic);
+void            netsnmp_inform_spool_result(netsnmp_session *sess,
+                                            int reqid, void *magic,
+                                            int acked);
+#else
+#define netsnmp_inform_spool_init()
+#define netsnmp_inform_spool_add(sess, pdu, magic) (*(magic) = NULL, 0)
+#define netsnmp_inform_spool_result(sess, reqid, magic, acked)
+#endif
+
+#endif                          /* AGENT_INFORM_SPOOL_H */
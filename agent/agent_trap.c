@@ -63,6 +63,7 @@
 #include <net-snmp/agent/snmp_agent.h>
 #include <net-snmp/agent/agent_callbacks.h>
 #include "agent_global_vars.h"
+#include "agent_inform_spool.h"
 
 #include <net-snmp/agent/agent_module_config.h>
 #include <net-snmp/agent/mib_module_config.h>
@@ -144,6 +145,7 @@ int             snmp_enableauthentrapsset = 0;
 void
 init_traps(void)
 {
+    netsnmp_inform_spool_init();
 }
 
 static void
@@ -991,6 +993,15 @@ netsnmp_send_traps(int trap, int specific,
 	}
     }
 
+    /*
+     * Encode the varbinds once: the copy sent to each sink (here or by
+     *   the callbacks below) only builds its own header and wrapper.
+     */
+    if (template_v1pdu)
+        snmp_pdu_encode_varbinds(template_v1pdu);
+    if (template_v2pdu)
+        snmp_pdu_encode_varbinds(template_v2pdu);
+
     /*
      *  Now loop through the list of trap sinks
      *   and call the trap callback routines,
@@ -1117,6 +1128,7 @@ handle_inform_response(int op, netsnmp_session * session,
                 session->trap_stats->ack_last_rcvd = netsnmp_get_agent_uptime();
             }
 #endif /* NETSNMP_NO_TRAP_STATS */
+            netsnmp_inform_spool_result(session, reqid, magic, 1);
             break;
         } else {
             int type = session->s_snmp_errno ? session->s_snmp_errno :
@@ -1142,6 +1154,7 @@ handle_inform_response(int op, netsnmp_session * session,
             ++session->trap_stats->sec_err_count;
         }
 #endif /* NETSNMP_NO_TRAP_STATS */
+        netsnmp_inform_spool_result(session, reqid, magic, 0);
         break;
 
     case NETSNMP_CALLBACK_OP_TIMED_OUT:
@@ -1155,6 +1168,7 @@ handle_inform_response(int op, netsnmp_session * session,
                 netsnmp_get_agent_uptime();
         }
 #endif /* NETSNMP_NO_TRAP_STATS */
+        netsnmp_inform_spool_result(session, reqid, magic, 0);
         break;
 
     case NETSNMP_CALLBACK_OP_RESEND:
@@ -1173,6 +1187,7 @@ handle_inform_response(int op, netsnmp_session * session,
             ++session->trap_stats->sent_fail_count;
         }
 #endif /* NETSNMP_NO_TRAP_STATS */
+        netsnmp_inform_spool_result(session, reqid, magic, 0);
         break;
 
     default:
@@ -1197,6 +1212,7 @@ send_trap_to_sess(netsnmp_session * sess, netsnmp_pdu *template_pdu)
 {
     netsnmp_pdu    *pdu;
     int            result;
+    void           *magic = NULL;
 
     if (!sess || !template_pdu)
         return;
@@ -1235,6 +1251,7 @@ send_trap_to_sess(netsnmp_session * sess, netsnmp_pdu *template_pdu)
         return;
     }
 
+    snmp_pdu_share_varbind_encoding(pdu, template_pdu);
     pdu->sessid = sess->sessid; /* AgentX only ? */
     /*
      * RFC 3414 sayeth:
@@ -1266,8 +1283,13 @@ send_trap_to_sess(netsnmp_session * sess, netsnmp_pdu *template_pdu)
          || template_pdu->command == AGENTX_MSG_NOTIFY
 #endif
        ) {
+        if (netsnmp_inform_spool_add(sess, pdu, &magic)) {
+            /** held in the spool until the sink answers again */
+            snmp_free_pdu(pdu);
+            return;
+        }
         result =
-            snmp_async_send(sess, pdu, &handle_inform_response, NULL);
+            snmp_async_send(sess, pdu, &handle_inform_response, magic);
     } else {
         if ((sess->version == SNMP_VERSION_3) &&
                 (pdu->command == SNMP_MSG_TRAP2) &&
@@ -1284,6 +1306,7 @@ send_trap_to_sess(netsnmp_session * sess, netsnmp_pdu *template_pdu)
 
     if (result == 0) {
         snmp_sess_perror("snmpd: send_trap", sess);
+        netsnmp_inform_spool_result(sess, pdu->reqid, magic, 0);
         snmp_free_pdu(pdu);
         /** trap stats for failure handled in callback */
     } else {
@@ -72,10 +72,10 @@ netsnmp_bulk_to_next_fix_requests(netsnmp_request_info *requests)
             request->requestvb->type = ASN_PRIV_RETRY;
             /*
              * if inclusive == 2, it was set in check_getnext_results for
-             * the previous requestvb. Now that we've moved on, clear it.
+             * the previous requestvb; any other inclusive search was
+             * satisfied by it.  Now that we've moved on, clear it.
              */
-            if (2 == request->inclusive)
-                request->inclusive = 0;
+            request->inclusive = 0;
         }
     }
 }
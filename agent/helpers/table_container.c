@@ -139,6 +139,14 @@ typedef struct container_table_data_s {
  *    request. The agent will notice this unsatisfied request, and attempt to
  *    pass it to the next appropriate handler.
  *
+ *    For GET-BULK requests, if every handler below this one has the
+ *    MIB_HANDLER_BULK_CELLS flag set (and the key type is netsnmp index),
+ *    the remaining repetitions are filled from successive rows in the same
+ *    pass, and the sub-handlers are called once with a MODE_GET request for
+ *    each cell, instead of once per repetition.  Helpers may set the flag,
+ *    but it is up to the table's own handler to opt in.  A handler which
+ *    delegates a cell anyway gets batching turned off.
+ *
  *  SET
  *    If the handler did not register with the HANDLER_CAN_NOT_CREATE flag
  *    set in the registration modes, it is assumed that this is a row
@@ -168,6 +176,13 @@ _find_next_row(netsnmp_container *c,
                netsnmp_table_request_info *tblreq,
                void * key);
 
+static int
+_container_table_bulk_cells(netsnmp_mib_handler *handler,
+                            netsnmp_handler_registration *reginfo,
+                            netsnmp_agent_request_info *agtreq_info,
+                            netsnmp_request_info *requests,
+                            container_table_data *tad);
+
 /**********************************************************************
  **********************************************************************
  *                                                                    *
@@ -787,6 +802,9 @@ _container_table_handler(netsnmp_mib_handler *handler,
                 DEBUGMSGTL(("table_container",
                             "next handler returned %d\n", rc));
             }
+            else
+                rc = _container_table_bulk_cells(handler, reginfo,
+                                                 agtreq_info, requests, tad);
 
             agtreq_info->mode = oldmode; /* restore saved mode */
         }
@@ -794,6 +812,258 @@ _container_table_handler(netsnmp_mib_handler *handler,
 
     return rc;
 }
+
+/**********************************************************************
+ **********************************************************************
+ *                                                                    *
+ *                                                                    *
+ * GETBULK cell batching                                              *
+ *                                                                    *
+ *                                                                    *
+ **********************************************************************
+ **********************************************************************/
+/*
+ * GETBULK requests reach us as a series of GETNEXT passes (via the
+ * bulk_to_next helper), and each pass normally fills a single repetition
+ * per varbind. If every handler below us can deal with independent cell
+ * requests (MIB_HANDLER_BULK_CELLS), we walk the container from the row
+ * just returned and fill the remaining repetitions in the same pass, with
+ * a single call to the lower handlers.
+ *
+ * Anything unusual (exceptions, errors, view or range boundaries) simply
+ * ends the batch for that varbind; the regular GETNEXT processing picks
+ * up from the last filled repetition on the next pass.
+ *
+ * The cells are answered in varbinds of their own and copied to the PDU
+ * afterwards, so that a handler which delegates one despite its flag
+ * cannot write to the PDU, or to the cells, once they are gone.
+ */
+typedef struct bulk_cell_s {
+    netsnmp_request_info        request;
+    netsnmp_table_request_info  table_info;
+    netsnmp_request_info       *owner;
+    netsnmp_index              *row;
+    netsnmp_variable_list      *vb;     /* in the PDU */
+    netsnmp_variable_list       answer;
+} bulk_cell;
+
+static int
+_chain_can_bulk(netsnmp_mib_handler *handler)
+{
+    for (handler = handler->next; handler; handler = handler->next)
+        if (!(handler->flags & MIB_HANDLER_BULK_CELLS))
+            return 0;
+    return 1;
+}
+
+/*
+ * A handler below delegated a cell: stop batching for this table.
+ */
+static void
+_chain_stop_bulk(netsnmp_mib_handler *handler,
+                 netsnmp_handler_registration *reginfo)
+{
+    snmp_log(LOG_ERR, "table_container: a handler of %s delegated a GETBULK "
+             "cell, no longer batching its repetitions\n",
+             reginfo->handlerName ? reginfo->handlerName : "?");
+    for (handler = handler->next; handler; handler = handler->next)
+        handler->flags &= ~MIB_HANDLER_BULK_CELLS;
+}
+
+NETSNMP_STATIC_INLINE int
+_bulk_cell_done(netsnmp_request_info *request)
+{
+    switch (request->requestvb->type) {
+    case ASN_NULL:
+    case ASN_PRIV_RETRY:
+    case SNMP_NOSUCHOBJECT:
+    case SNMP_NOSUCHINSTANCE:
+    case SNMP_ENDOFMIBVIEW:
+        return 0;
+    }
+    return (SNMP_ERR_NOERROR == request->status) && !request->delegated;
+}
+
+static int
+_container_table_bulk_cells(netsnmp_mib_handler *handler,
+                            netsnmp_handler_registration *reginfo,
+                            netsnmp_agent_request_info *agtreq_info,
+                            netsnmp_request_info *requests,
+                            container_table_data *tad)
+{
+    netsnmp_request_info       *request;
+    netsnmp_table_request_info *tblreq_info, next_col;
+    netsnmp_variable_list      *vb;
+    netsnmp_index              *row;
+    netsnmp_pdu                *pdu = NULL;
+    bulk_cell                  *cells = NULL, *cell;
+    size_t                      count = 0, max = 0, i, rough_size;
+    unsigned int                colnum;
+    int                         rc, k, filled, delegated = 0;
+
+    if ((TABLE_CONTAINER_KEY_NETSNMP_INDEX != tad->key_type) ||
+        !_chain_can_bulk(handler))
+        return SNMP_ERR_NOERROR;
+    if (agtreq_info->asp)
+        pdu = agtreq_info->asp->pdu;
+    if ((NULL == pdu) || (SNMP_MSG_GETBULK != pdu->command))
+        return SNMP_ERR_NOERROR;
+
+    /*
+     * build cell requests for the remaining repetitions of each varbind
+     */
+    for (request = requests; request; request = request->next) {
+        if ((request->repeat <= 0) || request->processed ||
+            !_bulk_cell_done(request))
+            continue;
+        tblreq_info = netsnmp_extract_table_info(request);
+        row = netsnmp_container_table_row_extract(request);
+        if ((NULL == tblreq_info) || (NULL == row))
+            continue;
+
+        colnum = tblreq_info->colnum;
+        vb = request->requestvb;
+        rough_size = vb->name_length + vb->val_len;
+        for (k = 0; k < request->repeat; ++k) {
+            vb = vb->next_variable;
+            if (NULL == vb)
+                break;
+
+            row = CONTAINER_NEXT(tad->table, row);
+            if (NULL == row) {
+                /** end of column, wrap to the first row of the next one */
+                next_col.colnum = colnum;
+                next_col.reg_info = tblreq_info->reg_info;
+                colnum = netsnmp_table_next_column(&next_col);
+                if (0 == colnum)
+                    break;
+                row = CONTAINER_FIRST(tad->table);
+                if (NULL == row)
+                    break;
+            }
+
+            if (count == max) {
+                bulk_cell *tmp;
+                max = max ? max * 2 : 16;
+                tmp = realloc(cells, max * sizeof(bulk_cell));
+                if (NULL == tmp) {
+                    snmp_log(LOG_ERR, "malloc failed for bulk cells\n");
+                    max = count;
+                    break;
+                }
+                cells = tmp;
+            }
+            cell = &cells[count];
+            memset(cell, 0x0, sizeof(*cell));
+            cell->owner = request;
+            cell->vb = vb;
+            cell->table_info.reg_info = tblreq_info->reg_info;
+            cell->table_info.number_indexes = tblreq_info->number_indexes;
+            cell->table_info.colnum = colnum;
+            cell->table_info.index_oid_len = row->len;
+            memcpy(cell->table_info.index_oid, row->oids,
+                   row->len * sizeof(oid));
+            cell->request.requestvb = vb;
+            cell->request.agent_req_info = request->agent_req_info;
+            cell->request.range_end = request->range_end;
+            cell->request.range_end_len = request->range_end_len;
+            cell->request.index = request->index;
+            cell->request.subtree = request->subtree;
+            netsnmp_table_build_oid_from_index(reginfo, &cell->request,
+                                               &cell->table_info);
+
+            rough_size += vb->name_length;
+            if ((snmp_oid_compare(vb->name, vb->name_length,
+                                  request->range_end,
+                                  request->range_end_len) >= 0) ||
+                (rough_size > pdu->msgMaxSize) ||
+                (in_a_view(vb->name, &vb->name_length, pdu,
+                           ASN_NULL) != VACM_SUCCESS)) {
+                /** leave this one for the regular getnext processing */
+                vb->type = ASN_NULL;
+                break;
+            }
+
+            cell->table_info.indexes =
+                snmp_clone_varbind(tblreq_info->indexes);
+            netsnmp_update_variable_list_from_index(&cell->table_info);
+            cell->row = row;
+            ++count;
+        }
+    }
+
+    if (0 == count) {
+        SNMP_FREE(cells);
+        return SNMP_ERR_NOERROR;
+    }
+
+    /*
+     * link the cells and add their data (now that the array won't move)
+     * and let the lower handlers fill them all in one go.
+     */
+    for (i = 0; i < count; ++i) {
+        cell = &cells[i];
+        snmp_set_var_objid(&cell->answer, cell->vb->name,
+                           cell->vb->name_length);
+        cell->answer.type = ASN_NULL;
+        cell->request.requestvb = &cell->answer;
+        cell->request.prev = i ? &cells[i - 1].request : NULL;
+        cell->request.next = (i + 1 < count) ? &cells[i + 1].request : NULL;
+        netsnmp_request_add_list_data(&cell->request,
+            netsnmp_create_data_list(TABLE_HANDLER_NAME,
+                                     &cell->table_info, NULL));
+        netsnmp_request_add_list_data(&cell->request,
+            netsnmp_create_data_list(TABLE_CONTAINER_ROW, cell->row, NULL));
+        netsnmp_request_add_list_data(&cell->request,
+            netsnmp_create_data_list(TABLE_CONTAINER_CONTAINER,
+                                     tad->table, NULL));
+    }
+    DEBUGMSGTL(("table_container:bulk", "filling %" NETSNMP_PRIz "d cells\n",
+                count));
+    rc = netsnmp_call_next_handler(handler, reginfo, agtreq_info,
+                                   &cells[0].request);
+    for (i = 0; i < count; ++i)
+        if (cells[i].request.delegated)
+            delegated = 1;
+    netsnmp_assert(!delegated);
+    if (delegated)
+        _chain_stop_bulk(handler, reginfo);
+
+    /*
+     * advance each varbind past its successfully filled cells. The
+     * first cell which wasn't filled (and any after it) is reset, and
+     * will be retried by the regular getnext processing.
+     */
+    for (i = 0; i < count; ) {
+        request = cells[i].owner;
+        for (filled = 1; i < count && cells[i].owner == request; ++i) {
+            cell = &cells[i];
+            if (filled && !delegated && (SNMP_ERR_NOERROR == rc) &&
+                _bulk_cell_done(&cell->request)) {
+                snmp_set_var_typed_value(cell->vb, cell->answer.type,
+                                         cell->answer.val.string,
+                                         cell->answer.val_len);
+                request->requestvb = cell->vb;
+                --request->repeat;
+            } else {
+                filled = 0;
+                snmp_set_var_typed_value(cell->vb, ASN_NULL, NULL, 0);
+            }
+            /*
+             * what was delegated may still be answered: leave it be
+             */
+            if (delegated)
+                continue;
+            netsnmp_free_request_data_sets(&cell->request);
+            snmp_free_varbind(cell->table_info.indexes);
+            snmp_free_var_internals(&cell->answer);
+        }
+    }
+    if (!delegated)
+        free(cells);
+
+    return SNMP_ERR_NOERROR;
+}
 /** @endcond */
 
 
@@ -56,6 +56,12 @@ netsnmp_feature_require(table_container_row_remove);
  *  for or accept data for.  Complex GETNEXT handling is greatly
  *  simplified in this case.
  *
+ *  The tdata handler itself can take part in filling the repetitions of
+ *  a GETBULK request in a single pass (see MIB_HANDLER_BULK_CELLS), but
+ *  this only happens for a table whose own handler sets that flag too,
+ *  i.e. one that answers each cell of a MODE_GET request on its own and
+ *  never delegates.
+ *
  *  @{
  */
 
@@ -337,7 +343,7 @@ netsnmp_get_tdata_handler(netsnmp_tdata *table)
     ret = netsnmp_create_handler(TABLE_TDATA_NAME,
                                _netsnmp_tdata_helper_handler);
     if (ret) {
-        ret->flags |= MIB_HANDLER_AUTO_NEXT;
+        ret->flags |= MIB_HANDLER_AUTO_NEXT | MIB_HANDLER_BULK_CELLS;
         ret->myvoid = (void *) table;
     }
     return ret;
@@ -10,6 +10,12 @@
 #include "utilities/execute.h"
 #include "struct.h"
 
+#ifdef HAVE_SYS_WAIT_H
+#include <sys/wait.h>
+#endif
+#include <signal.h>
+#include <errno.h>
+
 #ifndef USING_UCD_SNMP_EXTENSIBLE_MODULE
 #include "util_funcs/header_simple_table.h"
 #include "mibdefs.h"
@@ -24,6 +30,29 @@ netsnmp_feature_require(insert_table_row);
 
 oid  ns_extend_oid[]    = { 1, 3, 6, 1, 4, 1, 8072, 1, 3, 2 };
 
+#define EXTEND_OUTPUT_MAX  (1024*100)
+
+#if defined(USING_UTILITIES_EXECUTE_MODULE) && defined(HAVE_EXECV) && \
+    !defined(NETSNMP_FEATURE_REMOVE_FD_EVENT_MANAGER)
+#define EXTEND_ASYNC
+/*
+ * Commands of 'extend -async' entries run in the background.  Those
+ *   running are kept on one list, those waiting for a free slot on another.
+ */
+static int             extend_max_running = 4;
+static int             extend_num_running = 0;
+static netsnmp_extend *extend_running     = NULL;
+static netsnmp_extend *extend_queue       = NULL;
+static unsigned int    extend_tick_alarm  = 0;
+static unsigned int    extend_start_alarm = 0;
+
+static void _extend_run_start(netsnmp_extend *extension);
+static void _extend_run_request(netsnmp_extend *extension);
+static void _extend_run_stop(netsnmp_extend *extension);
+static void _extend_run_scheduled(unsigned int clientreg, void *clientarg);
+static void _extend_run_startup(unsigned int clientreg, void *clientarg);
+#endif
+
 typedef struct extend_registration_block_s {
     netsnmp_table_data *dinfo;
     oid                *root_oid;
@@ -307,6 +336,11 @@ void init_extend( void )
     snmpd_register_config_handler("exec2", extend_parse_config, NULL, NULL);
     snmpd_register_config_handler("sh2",   extend_parse_config, NULL, NULL);
     snmpd_register_config_handler("execFix2", extend_parse_config, NULL, NULL);
+#ifdef EXTEND_ASYNC
+    snmpd_register_config_handler("extendMaxRunning",
+                                  extend_parse_max_running, NULL,
+                                  "number");
+#endif
     (void)_register_extend( ns_extend_oid, OID_LENGTH(ns_extend_oid));
 
 #ifndef USING_UCD_SNMP_EXTENSIBLE_MODULE
@@ -342,6 +376,74 @@ shutdown_extend(void)
          *
          *************************/
 
+/*
+ * Take over the (nul-terminated) output of a command, and pick it apart
+ *   into separate lines.
+ */
+static int
+_extend_set_output(netsnmp_extend *extension, char *out_buf, int out_len)
+{
+    char *cp;
+    char *line_buf[ 1024 ];
+
+    if (out_len > 0 && out_buf[out_len - 1] == '\n')
+        out_buf[--out_len] = '\0';	/* Strip trailing newline */
+    extension->output   = strdup( out_buf );
+    if (extension->output == NULL) {
+        return -1;
+    }
+    extension->out_len  = out_len;
+    /*
+     * Now we need to pick the output apart into separate lines.
+     * Start by counting how many lines we've got, and keeping
+     * track of where each line starts in a static buffer
+     */
+    extension->numlines = 1;
+    line_buf[ 0 ] = extension->output;
+    for (cp=extension->output; *cp; cp++) {
+        if (*cp == '\n') {
+            if (extension->numlines >=
+                sizeof(line_buf) / sizeof(line_buf[0])) {
+                break;
+            }
+            line_buf[ extension->numlines++ ] = cp+1;
+        }
+    }
+    if ( extension->numlines > 1 ) {
+        extension->lines = calloc(extension->numlines, sizeof(char *));
+        if (extension->lines)
+            memcpy(extension->lines, line_buf,
+                   sizeof(char *) * extension->numlines);
+    } else {
+        extension->lines = &extension->output;
+    }
+    return 0;
+}
+
+static void
+_extend_free_output(netsnmp_extend *extension)
+{
+    if (extension->output) {
+        SNMP_FREE(extension->output);
+        extension->output = NULL;
+    }
+    if ( extension->numlines > 1 ) {
+        SNMP_FREE(extension->lines);
+    }
+    extension->lines  = NULL;
+    extension->out_len  = 0;
+    extension->numlines = 0;
+}
+
+static void
+_extend_command_line(netsnmp_extend *extension, char *cmd_buf, int cmd_len)
+{
+    if ( extension->args )
+        snprintf( cmd_buf, cmd_len, "%s %s", extension->command, extension->args );
+    else 
+        snprintf( cmd_buf, cmd_len, "%s", extension->command );
+}
+
 int
 extend_load_cache(netsnmp_cache *cache, void *magic)
 {
@@ -349,59 +451,40 @@ extend_load_cache(netsnmp_cache *cache, void *magic)
     NETSNMP_LOGONCE((LOG_WARNING,"support for run_exec_command not available\n"));
     return -1;
 #else
-    int  out_len = 1024*100;
-    char out_buf[ 1024*100 ];
+    int  out_len = EXTEND_OUTPUT_MAX;
+    char out_buf[ EXTEND_OUTPUT_MAX ];
     int  cmd_len = 255*2 + 2;	/* 2 * DisplayStrings */
     char cmd_buf[ 255*2 + 2 ];
     int  ret;
-    char *cp;
-    char *line_buf[ 1024 ];
     netsnmp_extend *extension = (netsnmp_extend *)magic;
 
     if (!magic)
         return -1;
+#ifdef EXTEND_ASYNC
+    if ((extension->flags & NS_EXTEND_FLAGS_ASYNC) &&
+        !(extension->flags & NS_EXTEND_FLAGS_WRITEABLE)) {
+        /*
+         * Serve the output of the last completed run, and start
+         *   another one in the background - unless the command
+         *   runs to a fixed schedule (and has got going already).
+         */
+        DEBUGMSGTL(( "nsExtendTable:cache", "load %s (async)\n",
+                     extension->token ));
+        if (!extension->run_interval || !extension->output)
+            _extend_run_request(extension);
+        return extension->output ? 0 : -1;
+    }
+#endif
     DEBUGMSGTL(( "nsExtendTable:cache", "load %s", extension->token ));
-    if ( extension->args )
-        snprintf( cmd_buf, cmd_len, "%s %s", extension->command, extension->args );
-    else 
-        snprintf( cmd_buf, cmd_len, "%s", extension->command );
+    _extend_command_line(extension, cmd_buf, cmd_len);
     if ( extension->flags & NS_EXTEND_FLAGS_SHELL )
         ret = run_shell_command( cmd_buf, extension->input, out_buf, &out_len);
     else
         ret = run_exec_command(  cmd_buf, extension->input, out_buf, &out_len);
     DEBUGMSG(( "nsExtendTable:cache", ": %s : %d\n", cmd_buf, ret));
     if (ret >= 0) {
-        if (out_len > 0 && out_buf[out_len - 1] == '\n')
-            out_buf[--out_len] = '\0';	/* Strip trailing newline */
-        extension->output   = strdup( out_buf );
-	if (extension->output == NULL) {
-	    return -1;
-	}
-        extension->out_len  = out_len;
-        /*
-         * Now we need to pick the output apart into separate lines.
-         * Start by counting how many lines we've got, and keeping
-         * track of where each line starts in a static buffer
-         */
-        extension->numlines = 1;
-        line_buf[ 0 ] = extension->output;
-        for (cp=extension->output; *cp; cp++) {
-            if (*cp == '\n') {
-                if (extension->numlines >=
-                    sizeof(line_buf) / sizeof(line_buf[0])) {
-                    break;
-                }
-                line_buf[ extension->numlines++ ] = cp+1;
-            }
-        }
-        if ( extension->numlines > 1 ) {
-            extension->lines = calloc(extension->numlines, sizeof(char *));
-            if (extension->lines)
-                memcpy(extension->lines, line_buf,
-                       sizeof(char *) * extension->numlines);
-        } else {
-            extension->lines = &extension->output;
-        }
+        if (_extend_set_output(extension, out_buf, out_len) < 0)
+            return -1;
     }
     extension->result = ret;
     return ret;
@@ -415,19 +498,304 @@ extend_free_cache(netsnmp_cache *cache, void *magic)
     if (!magic)
         return;
 
+    /*
+     * Background runs keep their output until the next one completes
+     */
+    if ((extension->flags & NS_EXTEND_FLAGS_ASYNC) &&
+        !(extension->flags & NS_EXTEND_FLAGS_WRITEABLE))
+        return;
     DEBUGMSGTL(( "nsExtendTable:cache", "free %s\n", extension->token ));
-    if (extension->output) {
-        SNMP_FREE(extension->output);
-        extension->output = NULL;
+    _extend_free_output(extension);
+}
+
+
+#ifdef EXTEND_ASYNC
+        /*************************
+         *
+         *  Running commands in the background
+         *
+         *************************/
+
+void
+extend_parse_max_running(const char *token, char *cptr)
+{
+    int n = atoi(cptr);
+
+    if (n < 1) {
+        config_perror("extendMaxRunning must be at least 1");
+        return;
     }
-    if ( extension->numlines > 1 ) {
-        SNMP_FREE(extension->lines);
+    extend_max_running = n;
+}
+
+static time_t
+_extend_now(void)
+{
+    struct timeval now;
+
+    netsnmp_get_monotonic_clock(&now);
+    return now.tv_sec;
+}
+
+static void
+_extend_run_unlink(netsnmp_extend **list, netsnmp_extend *extension)
+{
+    for (; *list; list = &(*list)->run_next) {
+        if (*list == extension) {
+            *list = extension->run_next;
+            break;
+        }
     }
-    extension->lines  = NULL;
-    extension->out_len  = 0;
-    extension->numlines = 0;
+    extension->run_next = NULL;
 }
 
+static void
+_extend_run_kill(netsnmp_extend *extension)
+{
+    if (kill(-extension->run_pid, SIGKILL) < 0)
+        kill(extension->run_pid, SIGKILL);
+    if (extension->run_fd >= 0) {
+        unregister_readfd(extension->run_fd);
+        close(extension->run_fd);
+        extension->run_fd = -1;
+    }
+}
+
+/*
+ * Take a command off the list of those running
+ */
+static void
+_extend_run_finish(netsnmp_extend *extension)
+{
+    if (extension->run_fd >= 0) {
+        unregister_readfd(extension->run_fd);
+        close(extension->run_fd);
+        extension->run_fd = -1;
+    }
+    _extend_run_unlink(&extend_running, extension);
+    extend_num_running--;
+    extension->flags &= ~(NS_EXTEND_FLAGS_RUNNING | NS_EXTEND_FLAGS_KILLED);
+    extension->run_pid = 0;
+    SNMP_FREE(extension->run_buf);
+    extension->run_len = 0;
+    if (!extend_running && extend_tick_alarm) {
+        snmp_alarm_unregister(extend_tick_alarm);
+        extend_tick_alarm = 0;
+    }
+}
+
+static void
+_extend_run_next(void)
+{
+    netsnmp_extend *extension;
+
+    while (extend_queue && extend_num_running < extend_max_running) {
+        extension = extend_queue;
+        extend_queue = extension->run_next;
+        extension->run_next = NULL;
+        extension->flags &= ~NS_EXTEND_FLAGS_QUEUED;
+        _extend_run_start(extension);
+    }
+}
+
+/*
+ * A command has exited (or has been killed): publish its output
+ */
+static void
+_extend_run_done(netsnmp_extend *extension, int status)
+{
+    DEBUGMSGTL(( "nsExtendTable:run", "%s done: %d (%d bytes)\n",
+                 extension->token, status, extension->run_len ));
+    if (extension->flags & NS_EXTEND_FLAGS_KILLED) {
+        snmp_log(LOG_WARNING,
+                 "extend %s: command killed after %d seconds\n",
+                 extension->token, extension->run_timeout);
+        extension->result = -1;
+    } else {
+        _extend_free_output(extension);
+        extension->run_buf[extension->run_len] = '\0';
+        if (_extend_set_output(extension, extension->run_buf,
+                               extension->run_len) < 0 || status < 0)
+            extension->result = -1;
+        else if (extension->flags & NS_EXTEND_FLAGS_SHELL)
+            extension->result = status;	/* as run_shell_command() */
+        else
+            extension->result = WEXITSTATUS(status);
+        /*
+         * The cache timeout counts from when the output is available
+         */
+        if (extension->output) {
+            extension->cache->valid   = 1;
+            extension->cache->expired = 0;
+            netsnmp_set_monotonic_marker(&extension->cache->timestampM);
+        }
+    }
+    _extend_run_finish(extension);
+    _extend_run_next();
+}
+
+static void
+_extend_run_reap(netsnmp_extend *extension)
+{
+    int status = 0;
+    int rc;
+
+    rc = waitpid(extension->run_pid, &status, WNOHANG);
+    if (rc == 0)
+        return;                 /* still running */
+    _extend_run_done(extension, rc < 0 ? -1 : status);
+}
+
+static void
+_extend_run_read(int fd, void *data)
+{
+    netsnmp_extend *extension = (netsnmp_extend *)data;
+    ssize_t count;
+
+    count = read(fd, extension->run_buf + extension->run_len,
+                 EXTEND_OUTPUT_MAX - 1 - extension->run_len);
+    if (count < 0 && (errno == EAGAIN || errno == EINTR))
+        return;
+    if (count > 0) {
+        extension->run_len += count;
+        if (extension->run_len < EXTEND_OUTPUT_MAX - 1)
+            return;
+    }
+    /*
+     * End of the output (or no room for more): the command should
+     *   be exiting about now.  If it isn't, the tick will reap it.
+     */
+    unregister_readfd(fd);
+    close(fd);
+    extension->run_fd = -1;
+    _extend_run_reap(extension);
+}
+
+/*
+ * Once a second while commands are running: enforce their time limits,
+ *   and reap those which closed their output without exiting straight away.
+ */
+static void
+_extend_run_tick(unsigned int clientreg, void *clientarg)
+{
+    netsnmp_extend *extension, *next;
+    time_t now = _extend_now();
+
+    for (extension = extend_running; extension; extension = next) {
+        next = extension->run_next;
+        if (extension->run_timeout > 0 &&
+            !(extension->flags & NS_EXTEND_FLAGS_KILLED) &&
+            now - extension->run_start >= extension->run_timeout) {
+            DEBUGMSGTL(( "nsExtendTable:run", "%s timed out\n",
+                         extension->token ));
+            _extend_run_kill(extension);
+            extension->flags |= NS_EXTEND_FLAGS_KILLED;
+        }
+        if (extension->run_fd < 0)
+            _extend_run_reap(extension);
+    }
+}
+
+static void
+_extend_run_start(netsnmp_extend *extension)
+{
+    char cmd_buf[ 255*2 + 2 ];
+    int  pid, fd = -1;
+
+    _extend_command_line(extension, cmd_buf, sizeof(cmd_buf));
+    extension->run_buf = malloc(EXTEND_OUTPUT_MAX);
+    if (!extension->run_buf) {
+        extension->result = -1;
+        return;
+    }
+    pid = start_exec_command(cmd_buf, extension->input,
+                             extension->flags & NS_EXTEND_FLAGS_SHELL, &fd);
+    if (pid < 0) {
+        SNMP_FREE(extension->run_buf);
+        extension->result = -1;
+        return;
+    }
+    DEBUGMSGTL(( "nsExtendTable:run", "%s started: %s (%d)\n",
+                 extension->token, cmd_buf, pid ));
+    extension->run_pid   = pid;
+    extension->run_fd    = fd;
+    extension->run_len   = 0;
+    extension->run_start = _extend_now();
+    extension->flags    |= NS_EXTEND_FLAGS_RUNNING;
+    extension->run_next  = extend_running;
+    extend_running       = extension;
+    extend_num_running++;
+    if (!extend_tick_alarm)
+        extend_tick_alarm = snmp_alarm_register(1, SA_REPEAT,
+                                                _extend_run_tick, NULL);
+    if (register_readfd(fd, _extend_run_read, extension) != FD_REGISTERED_OK) {
+        _extend_run_kill(extension);
+        extension->flags |= NS_EXTEND_FLAGS_KILLED;
+    }
+}
+
+/*
+ * Run a command in the background, as soon as there's a free slot
+ */
+static void
+_extend_run_request(netsnmp_extend *extension)
+{
+    netsnmp_extend **qp;
+
+    if (extension->flags & (NS_EXTEND_FLAGS_RUNNING | NS_EXTEND_FLAGS_QUEUED))
+        return;
+    for (qp = &extend_queue; *qp; qp = &(*qp)->run_next)
+        ;
+    *qp = extension;
+    extension->run_next = NULL;
+    extension->flags |= NS_EXTEND_FLAGS_QUEUED;
+    _extend_run_next();
+}
+
+static void
+_extend_run_scheduled(unsigned int clientreg, void *clientarg)
+{
+    _extend_run_request((netsnmp_extend *)clientarg);
+}
+
+/*
+ * Get the first output of all background commands once the agent is up
+ *   (and running as the process which will reap them).
+ */
+static void
+_extend_run_startup(unsigned int clientreg, void *clientarg)
+{
+    extend_registration_block *eptr;
+    netsnmp_extend *extension;
+
+    extend_start_alarm = 0;
+    for (eptr = ereg_head; eptr; eptr = eptr->next)
+        for (extension = eptr->ehead; extension; extension = extension->next)
+            if ((extension->flags & NS_EXTEND_FLAGS_ASYNC) &&
+                (extension->flags & NS_EXTEND_FLAGS_ACTIVE) &&
+                !(extension->flags & NS_EXTEND_FLAGS_WRITEABLE))
+                _extend_run_request(extension);
+}
+
+static void
+_extend_run_stop(netsnmp_extend *extension)
+{
+    if (extension->run_alarm) {
+        snmp_alarm_unregister(extension->run_alarm);
+        extension->run_alarm = 0;
+    }
+    if (extension->flags & NS_EXTEND_FLAGS_QUEUED) {
+        _extend_run_unlink(&extend_queue, extension);
+        extension->flags &= ~NS_EXTEND_FLAGS_QUEUED;
+    }
+    if (extension->flags & NS_EXTEND_FLAGS_RUNNING) {
+        _extend_run_kill(extension);
+        waitpid(extension->run_pid, NULL, 0);
+        _extend_run_finish(extension);
+    }
+}
+#endif /* EXTEND_ASYNC */
+
 
         /*************************
          *
@@ -464,11 +832,15 @@ _free_extension( netsnmp_extend *extension, extend_registration_block *ereg )
         netsnmp_table_data_remove_and_delete_row( ereg->dinfo, extension->row);
     }
 
+#ifdef EXTEND_ASYNC
+    _extend_run_stop(extension);
+#endif
     SNMP_FREE( extension->token );
     if (extension->cache) {
         netsnmp_cache_remove(extension->cache);
         netsnmp_cache_free(extension->cache);
     }
+    _extend_free_output(extension);
     SNMP_FREE( extension->command );
     SNMP_FREE( extension->args  );
     SNMP_FREE( extension->input );
@@ -494,6 +866,7 @@ _new_extension( char *exec_name, int exec_flags, extend_registration_block *ereg
         return NULL;
     extension->token    = strdup( exec_name );
     extension->flags    = exec_flags;
+    extension->run_fd   = -1;
     extension->cache    = netsnmp_cache_create( 0, extend_load_cache,
                                                    extend_free_cache, NULL, 0 );
     if (extension->cache)
@@ -557,24 +930,34 @@ extend_parse_config(const char *token, char *cptr)
     int  flags;
     int cache_timeout = 0;
     int exec_type = NS_EXTEND_ETYPE_EXEC;
+    int async = 0, run_timeout = 0, run_interval = 0;
 
     cptr = copy_nword(cptr, exec_name, sizeof(exec_name));
-    if (strcmp(exec_name, "-cacheTime") == 0) {
-        char cache_timeout_str[32];
-
-        cptr = copy_nword(cptr, cache_timeout_str, sizeof(cache_timeout_str));
-        /* If atoi can't do the conversion, it returns 0 */
-        cache_timeout = atoi(cache_timeout_str);
-        cptr = copy_nword(cptr, exec_name, sizeof(exec_name));
-    }
-    if (strcmp(exec_name, "-execType") == 0) {
-        char exec_type_str[16];
-
-        cptr = copy_nword(cptr, exec_type_str, sizeof(exec_type_str));
-        if (strcmp(exec_type_str, "sh") == 0)
-            exec_type = NS_EXTEND_ETYPE_SHELL;
-        else
-            exec_type = NS_EXTEND_ETYPE_EXEC;
+    for (;;) {
+        char option_str[32];
+
+        if (strcmp(exec_name, "-cacheTime") == 0) {
+            cptr = copy_nword(cptr, option_str, sizeof(option_str));
+            /* If atoi can't do the conversion, it returns 0 */
+            cache_timeout = atoi(option_str);
+        } else if (strcmp(exec_name, "-execType") == 0) {
+            cptr = copy_nword(cptr, option_str, sizeof(option_str));
+            if (strcmp(option_str, "sh") == 0)
+                exec_type = NS_EXTEND_ETYPE_SHELL;
+            else
+                exec_type = NS_EXTEND_ETYPE_EXEC;
+        } else if (strcmp(exec_name, "-async") == 0) {
+            async = 1;
+        } else if (strcmp(exec_name, "-timeout") == 0) {
+            cptr = copy_nword(cptr, option_str, sizeof(option_str));
+            run_timeout = atoi(option_str);
+            async = 1;
+        } else if (strcmp(exec_name, "-interval") == 0) {
+            cptr = copy_nword(cptr, option_str, sizeof(option_str));
+            run_interval = atoi(option_str);
+            async = 1;
+        } else
+            break;
         cptr = copy_nword(cptr, exec_name, sizeof(exec_name));
     }
     if ( *exec_name == '.' ) {
@@ -626,6 +1009,24 @@ extend_parse_config(const char *token, char *cptr)
             extension->args = strdup( cptr );
         if (cache_timeout != 0)
             extension->cache->timeout = cache_timeout;
+        if (async) {
+#ifdef EXTEND_ASYNC
+            extension->flags       |= NS_EXTEND_FLAGS_ASYNC;
+            extension->run_timeout  = run_timeout;
+            extension->run_interval = run_interval;
+            if (!(flags & NS_EXTEND_FLAGS_WRITEABLE)) {
+                if (run_interval > 0)
+                    extension->run_alarm =
+                        snmp_alarm_register(run_interval, SA_REPEAT,
+                                            _extend_run_scheduled, extension);
+                if (!extend_start_alarm)
+                    extend_start_alarm =
+                        snmp_alarm_register(0, 0, _extend_run_startup, NULL);
+            }
+#else
+            config_pwarn("background runs are not supported - running synchronously");
+#endif
+        }
     } else {
         snmp_log(LOG_ERR, "Failed to register extend entry '%s' - possibly duplicate name.\n", exec_name );
         return;
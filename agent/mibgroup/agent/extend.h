@@ -21,6 +21,15 @@ typedef struct netsnmp_extend_s {
     int      result;
 
     int      flags;
+    int      run_timeout;       /* background runs: limit (seconds) */
+    int      run_interval;      /*   fixed schedule (seconds)       */
+    int      run_pid;
+    int      run_fd;
+    char    *run_buf;
+    int      run_len;
+    time_t   run_start;
+    unsigned int run_alarm;
+    struct netsnmp_extend_s *run_next;
     netsnmp_cache     *cache;
     netsnmp_table_row *row;
     netsnmp_table_data *dinfo;
@@ -33,6 +42,7 @@ Netsnmp_Node_Handler handle_nsExtendConfigTable;
 Netsnmp_Node_Handler handle_nsExtendOutput1Table;
 Netsnmp_Node_Handler handle_nsExtendOutput2Table;
 void                 extend_parse_config(const char*, char*);
+void                 extend_parse_max_running(const char*, char*);
 
 #define COLUMN_EXTCFG_COMMAND	2
 #define COLUMN_EXTCFG_ARGS	3
@@ -61,6 +71,10 @@ void                 extend_parse_config(const char*, char*);
 #define NS_EXTEND_FLAGS_SHELL       0x02
 #define NS_EXTEND_FLAGS_WRITEABLE   0x04
 #define NS_EXTEND_FLAGS_CONFIG      0x08
+#define NS_EXTEND_FLAGS_ASYNC       0x10
+#define NS_EXTEND_FLAGS_RUNNING     0x20
+#define NS_EXTEND_FLAGS_QUEUED      0x40
+#define NS_EXTEND_FLAGS_KILLED      0x80
 
 #define NS_EXTEND_ETYPE_EXEC    1
 #define NS_EXTEND_ETYPE_SHELL   2
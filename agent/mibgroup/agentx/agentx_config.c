@@ -35,6 +35,19 @@ agentx_parse_agentx_socket(const char *token, char *cptr)
     netsnmp_ds_set_string(NETSNMP_DS_APPLICATION_ID, NETSNMP_DS_AGENT_X_SOCKET, cptr);
 }
 
+void
+agentx_parse_agentx_window(const char *token, char *cptr)
+{
+    int x = atoi(cptr);
+    DEBUGMSGTL(("agentx/config/window", "%s\n", cptr));
+    if (x < 0) {
+        config_perror("Invalid window size");
+        return;
+    }
+    netsnmp_ds_set_int(NETSNMP_DS_APPLICATION_ID,
+                       NETSNMP_DS_AGENT_AGENTX_WINDOW, x);
+}
+
 /* ---------------------------------------------------------------------
  *
  * Master agent
@@ -203,6 +216,10 @@ agentx_config_init(void)
     agentx_register_config_handler("agentxsocket",
                                   agentx_parse_agentx_socket, NULL,
                                   "AgentX bind address");
+    /* no limit on the requests in progress by default */
+    agentx_register_config_handler("agentxWindow",
+                                  agentx_parse_agentx_window, NULL,
+                                  "AgentX requests in progress at once");
 
 #ifdef USING_AGENTX_MASTER_MODULE
     /*
@@ -10,6 +10,8 @@ extern          "C" {
     void            agentx_parse_master(const char *token, char *cptr);
     void            agentx_parse_agentx_socket(const char *token,
                                                char *cptr);
+    void            agentx_parse_agentx_window(const char *token,
+                                               char *cptr);
     void            agentx_config_init(void);
 
 #ifdef __cplusplus
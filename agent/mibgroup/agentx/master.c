@@ -48,6 +48,7 @@
 #include <net-snmp/agent/net-snmp-agent-includes.h>
 #include "snmpd.h"
 #include "agentx/protocol.h"
+#include "agentx/master.h"
 #include "agentx/master_admin.h"
 
 netsnmp_feature_require(handler_mark_requests_as_delegated);
@@ -207,7 +208,11 @@ real_init_master(void)
             }
         } else {
 #ifdef NETSNMP_TRANSPORT_UNIX_DOMAIN
-            if (t->domain == netsnmp_UnixDomain && t->local != NULL) {
+            if ((t->domain == netsnmp_UnixDomain
+#ifdef NETSNMP_TRANSPORT_SHMRING_DOMAIN
+                 || t->domain == netsnmp_ShmRingDomain
+#endif
+                ) && t->local != NULL) {
                 /*
                  * Apply any settings to the ownership/permissions of the
                  * AgentX socket
@@ -293,6 +298,485 @@ netsnmp_delete_delegated_box(netsnmp_refcnt_void * box)
 }
 
 
+/*
+ * Count the requests of a GETBULK that still want more than one answer.
+ * These are sent to the subagent as the repeaters of an AgentX GetBulk,
+ * after the requests that want a single answer (the non-repeaters).
+ */
+static int
+agentx_bulk_repeaters(netsnmp_request_info *requests, long *max_rep)
+{
+    netsnmp_request_info *request;
+    int             r = 0;
+
+    if (max_rep)
+        *max_rep = 0;
+    for (request = requests; request; request = request->next) {
+        if (request->repeat <= 0)
+            continue;
+        r++;
+        if (max_rep && request->repeat + 1 > *max_rep)
+            *max_rep = request->repeat + 1;
+    }
+    return r;
+}
+
+/*
+ * Find the request which was sent as the idx'th (counting from 1)
+ * varbind of an AgentX PDU.
+ */
+static netsnmp_request_info *
+agentx_request_at(netsnmp_request_info *requests, int bulk, int idx)
+{
+    netsnmp_request_info *request;
+    int             pass;
+
+    for (pass = bulk ? 0 : 1; pass < 2; pass++)
+        for (request = requests; request; request = request->next) {
+            if (bulk && (request->repeat > 0) != pass)
+                continue;
+            if (--idx == 0)
+                return request;
+        }
+    return NULL;
+}
+
+/*
+ * Copy one varbind of a subagent response into the request it answers
+ */
+static void
+agentx_set_request_var(netsnmp_request_info *request,
+                       netsnmp_variable_list *var)
+{
+    DEBUGMSGTL(("agentx/master",
+                "  handle_agentx_response: processing: "));
+    DEBUGMSGOID(("agentx/master", var->name, var->name_length));
+    DEBUGMSG(("agentx/master", "\n"));
+    if (netsnmp_ds_get_boolean(NETSNMP_DS_APPLICATION_ID, NETSNMP_DS_AGENT_VERBOSE)) {
+        DEBUGMSGTL(("agentx/master", "    >> "));
+        DEBUGMSGVAR(("agentx/master", var));
+        DEBUGMSG(("agentx/master", "\n"));
+    }
+
+    /*
+     * update the oid in the original request 
+     */
+    if (var->type != SNMP_ENDOFMIBVIEW) {
+        snmp_set_var_typed_value(request->requestvb, var->type,
+                                 var->val.string, var->val_len);
+        snmp_set_var_objid(request->requestvb, var->name,
+                           var->name_length);
+    }
+    netsnmp_request_completed(request);
+}
+
+/*
+ * Point a request at the registration its answer came from, or at the
+ * last one of its (widened) search range when the subagent found
+ * nothing there, so that the agent carries on from the right place.
+ */
+static void
+agentx_set_request_subtree(netsnmp_request_info *request, int exhausted)
+{
+    netsnmp_subtree *tp;
+
+    for (tp = request->subtree; tp; tp = tp->next)
+        if (tp->end_a == request->range_end ||
+            (!exhausted &&
+             snmp_oid_compare(request->requestvb->name,
+                              request->requestvb->name_length,
+                              tp->end_a, tp->end_len) < 0)) {
+            request->subtree = tp;
+            break;
+        }
+}
+
+/*
+ * Split the response to an AgentX GetBulk back into the requests.
+ *
+ * The non-repeaters come first, followed by rows holding one
+ * repetition of every repeater.  The first row is treated like the
+ * answer to a GETNEXT; the later ones fill the following bulk slots
+ * of each repeater for as long as the answers stay in its range.
+ * Returns 0 if the response holds less than a GETNEXT's worth.
+ */
+static int
+agentx_got_bulk_response(netsnmp_request_info *requests,
+                         netsnmp_variable_list *vars)
+{
+    netsnmp_request_info *request;
+    netsnmp_variable_list *var = vars, *col, *v;
+    int             r, i, j;
+
+    r = agentx_bulk_repeaters(requests, NULL);
+
+    for (request = requests; request; request = request->next) {
+        if (request->repeat > 0)
+            continue;
+        if (!var)
+            return 0;
+        agentx_set_request_var(request, var);
+        agentx_set_request_subtree(request,
+                                   var->type == SNMP_ENDOFMIBVIEW);
+        var = var->next_variable;
+    }
+
+    for (col = var, i = 0; i < r; i++, col = col->next_variable)
+        if (!col)
+            return 0;
+
+    for (request = requests, col = var; request && col;
+         request = request->next) {
+        if (request->repeat <= 0)
+            continue;
+        agentx_set_request_var(request, col);
+
+        for (v = col;;) {
+            for (j = 0; j < r && v; j++)
+                v = v->next_variable;
+            if (!v || request->repeat <= 0 ||
+                !request->requestvb->next_variable ||
+                request->requestvb->type == ASN_NULL ||
+                request->requestvb->type == ASN_PRIV_RETRY ||
+                v->type == SNMP_ENDOFMIBVIEW ||
+                v->type == SNMP_NOSUCHOBJECT ||
+                v->type == SNMP_NOSUCHINSTANCE ||
+                snmp_oid_compare(v->name, v->name_length,
+                                 request->requestvb->name,
+                                 request->requestvb->name_length) <= 0 ||
+                snmp_oid_compare(v->name, v->name_length,
+                                 request->range_end,
+                                 request->range_end_len) >= 0)
+                break;
+            request->repeat--;
+            request->requestvb = request->requestvb->next_variable;
+            agentx_set_request_var(request, v);
+            request->inclusive = 0;
+        }
+        agentx_set_request_subtree(request,
+                                   col->type == SNMP_ENDOFMIBVIEW);
+        col = col->next_variable;
+    }
+    return 1;
+}
+
+/*
+ * Bookkeeping for each subagent connection: the read requests not answered
+ * yet, those held back while the window (agentXWindow) is full, and the
+ * statistics logged when the session closes.  Held back requests are
+ * queued per manager and the managers are served round robin, so that
+ * one busy manager cannot starve the others.
+ */
+struct agentx_pending {
+    long            reqid;
+    struct timeval  sent;
+    struct agentx_pending *next;
+};
+
+struct agentx_queued {
+    netsnmp_pdu    *pdu;
+    netsnmp_refcnt_void *cb_data_box;
+    struct agentx_queued *next;
+};
+
+struct agentx_flow {
+    void           *addr;       /* transport address of the manager */
+    size_t          addr_len;
+    struct agentx_queued *head, *tail;
+    struct agentx_flow *next;
+};
+
+struct agentx_subagent {
+    netsnmp_session *session;
+    long            sessid;
+    char           *descr;
+    struct agentx_pending *pending;
+    struct agentx_flow *flows;
+    unsigned int    outstanding, max_outstanding;
+    unsigned int    queued, max_queued;
+    u_long          requests, responses, failures, dropped;
+    uint64_t        latency_total;      /* microseconds */
+    u_long          latency_max;
+    struct agentx_subagent *next;
+};
+static struct agentx_subagent *subagents = NULL;
+
+static struct agentx_subagent *
+agentx_subagent_get(netsnmp_session *ax_session)
+{
+    struct agentx_subagent *sa;
+
+    for (sa = subagents; sa; sa = sa->next)
+        if (sa->session == ax_session)
+            return sa;
+    sa = SNMP_MALLOC_STRUCT(agentx_subagent);
+    if (sa) {
+        sa->session = ax_session;
+        if (ax_session->subsession) {
+            sa->sessid = ax_session->subsession->sessid;
+            if (ax_session->subsession->securityName)
+                sa->descr = strdup(ax_session->subsession->securityName);
+        }
+        sa->next = subagents;
+        subagents = sa;
+    }
+    return sa;
+}
+
+/*
+ * Forget about an answered (or failed) request, and return the subagent
+ * it was sent to.
+ */
+static struct agentx_subagent *
+agentx_subagent_answered(long reqid, int operation)
+{
+    struct agentx_subagent *sa;
+    struct agentx_pending *p, **prevNext;
+    struct timeval  now, diff;
+    u_long          us;
+
+    for (sa = subagents; sa; sa = sa->next) {
+        for (prevNext = &sa->pending; (p = *prevNext); prevNext = &p->next) {
+            if (p->reqid != reqid)
+                continue;
+            *prevNext = p->next;
+            sa->outstanding--;
+            if (operation == NETSNMP_CALLBACK_OP_RECEIVED_MESSAGE) {
+                netsnmp_get_monotonic_clock(&now);
+                NETSNMP_TIMERSUB(&now, &p->sent, &diff);
+                us = diff.tv_sec * 1000000UL + diff.tv_usec;
+                sa->responses++;
+                sa->latency_total += us;
+                if (us > sa->latency_max)
+                    sa->latency_max = us;
+            } else
+                sa->failures++;
+            free(p);
+            return sa;
+        }
+    }
+    return NULL;
+}
+
+static int
+agentx_subagent_send(struct agentx_subagent *sa, netsnmp_pdu *pdu,
+                     netsnmp_refcnt_void *cb_data_box)
+{
+    struct agentx_pending *p;
+    int             reqid;
+
+    reqid = snmp_async_send_cp(sa->session, pdu, agentx_got_response,
+                               cb_data_box, 1);
+    if (reqid == 0)
+        return 0;
+    sa->requests++;
+    p = SNMP_MALLOC_STRUCT(agentx_pending);
+    if (p) {
+        p->reqid = reqid;
+        netsnmp_get_monotonic_clock(&p->sent);
+        p->next = sa->pending;
+        sa->pending = p;
+        if (++sa->outstanding > sa->max_outstanding)
+            sa->max_outstanding = sa->outstanding;
+    }
+    return reqid;
+}
+
+static void
+agentx_subagent_enqueue(struct agentx_subagent *sa,
+                        netsnmp_agent_session *asp, netsnmp_pdu *pdu,
+                        netsnmp_refcnt_void *cb_data_box)
+{
+    struct agentx_flow *flow, **prevNext;
+    struct agentx_queued *q;
+    netsnmp_delegated_cache *cache;
+    void           *addr = asp->pdu ? asp->pdu->transport_data : NULL;
+    size_t          addr_len = addr ? asp->pdu->transport_data_length : 0;
+
+    for (prevNext = &sa->flows; (flow = *prevNext); prevNext = &flow->next)
+        if (flow->addr_len == addr_len &&
+            (addr_len == 0 || memcmp(flow->addr, addr, addr_len) == 0))
+            break;
+    q = SNMP_MALLOC_STRUCT(agentx_queued);
+    if (!q)
+        goto fail;
+    if (!flow) {
+        flow = SNMP_MALLOC_STRUCT(agentx_flow);
+        if (!flow || (addr_len && !(flow->addr = netsnmp_memdup(addr,
+                                                              addr_len)))) {
+            free(flow);
+            free(q);
+            goto fail;
+        }
+        flow->addr_len = addr_len;
+        *prevNext = flow;
+    }
+    q->pdu = pdu;
+    q->cb_data_box = cb_data_box;
+    if (flow->tail)
+        flow->tail->next = q;
+    else
+        flow->head = q;
+    flow->tail = q;
+    if (++sa->queued > sa->max_queued)
+        sa->max_queued = sa->queued;
+    DEBUGMSGTL(("agentx/master/window", "queued request for session %ld, "
+                "%u outstanding, %u queued\n", sa->sessid,
+                sa->outstanding, sa->queued));
+    return;
+
+  fail:
+    cache = cb_data_box->val;
+    netsnmp_handler_mark_requests_as_delegated(cache->requests,
+                                               REQUEST_IS_NOT_DELEGATED);
+    netsnmp_set_request_error(cache->reqinfo, cache->requests,
+                              SNMP_ERR_GENERR);
+    snmp_free_pdu(pdu);
+    netsnmp_free_delegated_cache(cache);
+    netsnmp_delete_delegated_box(cb_data_box);
+}
+
+/*
+ * Release a request which will not be sent after all.  If its manager
+ * is still waiting for it, the request fails.
+ */
+static void
+agentx_subagent_drop(netsnmp_refcnt_void *cb_data_box, netsnmp_pdu *pdu)
+{
+    netsnmp_delegated_cache *cache = cb_data_box->val;
+
+    if (netsnmp_handler_check_cache(cache)) {
+        netsnmp_handler_mark_requests_as_delegated(cache->requests,
+                                                   REQUEST_IS_NOT_DELEGATED);
+        netsnmp_set_request_error(cache->reqinfo, cache->requests,
+                                  SNMP_ERR_GENERR);
+    }
+    snmp_free_pdu(pdu);
+    netsnmp_free_delegated_cache(cache);
+    netsnmp_delete_delegated_box(cb_data_box);
+}
+
+/*
+ * Send held back requests while the window of the subagent allows,
+ * taking one from each manager in turn.
+ */
+static void
+agentx_subagent_run_queue(struct agentx_subagent *sa)
+{
+    int             window = netsnmp_ds_get_int(NETSNMP_DS_APPLICATION_ID,
+                                                NETSNMP_DS_AGENT_AGENTX_WINDOW);
+    struct agentx_flow *flow, **tail;
+    struct agentx_queued *q;
+
+    while ((flow = sa->flows) &&
+           (window <= 0 || sa->outstanding < (unsigned int) window)) {
+        q = flow->head;
+        flow->head = q->next;
+        sa->queued--;
+        sa->flows = flow->next;
+        if (flow->head) {
+            flow->next = NULL;
+            for (tail = &sa->flows; *tail; tail = &(*tail)->next)
+                ;
+            *tail = flow;
+        } else {
+            free(flow->addr);
+            free(flow);
+        }
+
+        if (!netsnmp_handler_check_cache(q->cb_data_box->val)) {
+            DEBUGMSGTL(("agentx/master/window", "request for session %ld "
+                        "no longer wanted\n", sa->sessid));
+            sa->dropped++;
+            agentx_subagent_drop(q->cb_data_box, q->pdu);
+        } else if (agentx_subagent_send(sa, q->pdu, q->cb_data_box) == 0) {
+            /*
+             * agentx_got_response() has failed the request, and closing
+             * the session may have freed sa
+             */
+            snmp_free_pdu(q->pdu);
+            free(q);
+            return;
+        }
+        free(q);
+    }
+}
+
+/*
+ * Send a read request to a subagent, or hold it back while the subagent
+ * already has agentXWindow requests to answer.
+ */
+static void
+agentx_send_read(netsnmp_session *ax_session, netsnmp_agent_session *asp,
+                 netsnmp_pdu *pdu, netsnmp_refcnt_void *cb_data_box)
+{
+    int             window = netsnmp_ds_get_int(NETSNMP_DS_APPLICATION_ID,
+                                                NETSNMP_DS_AGENT_AGENTX_WINDOW);
+    struct agentx_subagent *sa = agentx_subagent_get(ax_session);
+
+    if (!sa) {
+        if (snmp_async_send_cp(ax_session, pdu, agentx_got_response,
+                               cb_data_box, 1) == 0)
+            snmp_free_pdu(pdu);
+        return;
+    }
+    if (window > 0 &&
+        (sa->flows || sa->outstanding >= (unsigned int) window)) {
+        agentx_subagent_enqueue(sa, asp, pdu, cb_data_box);
+        return;
+    }
+    if (agentx_subagent_send(sa, pdu, cb_data_box) == 0)
+        snmp_free_pdu(pdu);
+}
+
+/*
+ * A subagent session has gone: fail what was held back for it and log
+ * how it fared.
+ */
+void
+agentx_master_session_closed(netsnmp_session *ax_session)
+{
+    struct agentx_subagent *sa, **prevNext;
+    struct agentx_pending *p;
+    struct agentx_flow *flow;
+    struct agentx_queued *q;
+
+    for (prevNext = &subagents; (sa = *prevNext); prevNext = &sa->next)
+        if (sa->session == ax_session)
+            break;
+    if (!sa)
+        return;
+    *prevNext = sa->next;
+
+    while ((p = sa->pending)) {
+        sa->pending = p->next;
+        free(p);
+    }
+    while ((flow = sa->flows)) {
+        sa->flows = flow->next;
+        while ((q = flow->head)) {
+            flow->head = q->next;
+            sa->dropped++;
+            agentx_subagent_drop(q->cb_data_box, q->pdu);
+            free(q);
+        }
+        free(flow->addr);
+        free(flow);
+    }
+
+    snmp_log(LOG_INFO, "AgentX subagent %ld (%s): %lu requests, "
+             "%lu responses, %lu failed, %lu dropped, "
+             "at most %u outstanding and %u queued, "
+             "latency %lu us average, %lu us max\n",
+             sa->sessid, sa->descr ? sa->descr : "",
+             sa->requests, sa->responses, sa->failures, sa->dropped,
+             sa->max_outstanding, sa->max_queued,
+             sa->responses ? (u_long) (sa->latency_total / sa->responses) : 0,
+             sa->latency_max);
+    free(sa->descr);
+    free(sa);
+}
+
         /*
          * Handle the response from an AgentX subagent,
          *   merging the answers back into the original query
@@ -304,9 +788,22 @@ agentx_got_response(int operation,
 {
     netsnmp_refcnt_void *cache_box = magic;
     netsnmp_delegated_cache *cache = cache_box ? cache_box->val : NULL;
-    int             i, ret;
+    int             bulk, ret;
     netsnmp_request_info *requests, *request;
     netsnmp_variable_list *var;
+    struct agentx_subagent *sa;
+
+    if (operation != NETSNMP_CALLBACK_OP_RESEND) {
+        /*
+         * One request less in flight, which may let a held back one go.
+         * Do this whatever the outcome: a failed request whose manager
+         * has gone leaves the session open, and nothing else would
+         * restart the queue.
+         */
+        sa = agentx_subagent_answered(reqid, operation);
+        if (sa)
+            agentx_subagent_run_queue(sa);
+    }
 
     cache = netsnmp_handler_check_cache(cache);
     if (!cache) {
@@ -432,21 +929,21 @@ agentx_got_response(int operation,
             err = pdu->errstat;
         }
 
+        /*
+         * Mark the varbind generating the error.  Note that the AgentX
+         * errindex may not match the position in the original SNMP PDU
+         * (request->index), and GetBulk sends the non-repeaters first.
+         */
+        bulk = cache->reqinfo->mode == MODE_GETBULK &&
+            agentx_bulk_repeaters(requests, NULL) > 0;
+        request = agentx_request_at(requests, bulk, pdu->errindex);
         ret = 0;
-        for (request = requests, i = 1; request;
-             request = request->next, i++) {
-            if (i == pdu->errindex) {
-                /*
-                 * Mark this varbind as the one generating the error.
-                 * Note that the AgentX errindex may not match the
-                 * position in the original SNMP PDU (request->index)
-                 */
-                netsnmp_set_request_error(cache->reqinfo, request,
-                                          err);
-                ret = 1;
-            }
-            request->delegated = REQUEST_IS_NOT_DELEGATED;
+        if (request) {
+            netsnmp_set_request_error(cache->reqinfo, request, err);
+            ret = 1;
         }
+        for (request = requests; request; request = request->next)
+            netsnmp_request_completed(request);
         if (!ret) {
             /*
              * ack, unknown, mark the first one
@@ -466,40 +963,25 @@ agentx_got_response(int operation,
          */
         DEBUGMSGTL(("agentx/master",
                     "agentx_got_response() beginning...\n"));
-        for (var = pdu->variables, request = requests; request && var;
-             request = request->next, var = var->next_variable) {
-            /*
-             * Otherwise, process successful requests
-             */
-            DEBUGMSGTL(("agentx/master",
-                        "  handle_agentx_response: processing: "));
-            DEBUGMSGOID(("agentx/master", var->name, var->name_length));
-            DEBUGMSG(("agentx/master", "\n"));
-            if (netsnmp_ds_get_boolean(NETSNMP_DS_APPLICATION_ID, NETSNMP_DS_AGENT_VERBOSE)) {
-                DEBUGMSGTL(("agentx/master", "    >> "));
-                DEBUGMSGVAR(("agentx/master", var));
-                DEBUGMSG(("agentx/master", "\n"));
-            }
-
-            /*
-             * update the oid in the original request 
-             */
-            if (var->type != SNMP_ENDOFMIBVIEW) {
-                snmp_set_var_typed_value(request->requestvb, var->type,
-                                         var->val.string, var->val_len);
-                snmp_set_var_objid(request->requestvb, var->name,
-                                   var->name_length);
-            }
-            request->delegated = REQUEST_IS_NOT_DELEGATED;
+        if (cache->reqinfo->mode == MODE_GETBULK &&
+            agentx_bulk_repeaters(requests, NULL) > 0) {
+            ret = agentx_got_bulk_response(requests, pdu->variables);
+        } else {
+            for (var = pdu->variables, request = requests; request && var;
+                 request = request->next, var = var->next_variable)
+                agentx_set_request_var(request, var);
+            ret = !request && !var;
         }
 
-        if (request || var) {
+        if (!ret) {
             /*
              * ack, this is bad.  The # of varbinds don't match and
              * there is no way to fix the problem 
              */
             snmp_log(LOG_ERR,
                      "response to agentx request illegal.  bailing out.\n");
+            for (request = requests; request; request = request->next)
+                netsnmp_request_completed(request);
             netsnmp_set_request_error(cache->reqinfo, requests,
                                       SNMP_ERR_GENERR);
         }
@@ -511,7 +993,7 @@ agentx_got_response(int operation,
          * mark set requests as handled 
          */
         for (request = requests; request; request = request->next) {
-            request->delegated = REQUEST_IS_NOT_DELEGATED;
+            netsnmp_request_completed(request);
         }
     }
     DEBUGMSGTL(("agentx/master",
@@ -522,6 +1004,100 @@ agentx_got_response(int operation,
 }
 
 
+/*
+ * Subagents often register each scalar or table separately, which would
+ * stop a GetBulk at the end of every such registration.  Widen the
+ * search range of a request over the registrations of the same session
+ * that directly follow the one it falls in.
+ */
+static void
+agentx_extend_range(netsnmp_request_info *request,
+                    netsnmp_session *ax_session)
+{
+    netsnmp_subtree *tp = request->subtree;
+
+    if (!tp || snmp_oid_compare(request->range_end, request->range_end_len,
+                                tp->end_a, tp->end_len) != 0)
+        return;
+    while (tp->next && tp->next->reginfo && tp->next->reginfo->handler &&
+           tp->next->reginfo->handler->access_method ==
+           agentx_master_handler &&
+           tp->next->reginfo->handler->myvoid == ax_session &&
+           snmp_oid_compare(tp->next->start_a, tp->next->start_len,
+                            tp->end_a, tp->end_len) == 0)
+        tp = tp->next;
+    request->range_end = tp->end_a;
+    request->range_end_len = tp->end_len;
+}
+
+/*
+ * Add the varbind of one request to the AgentX PDU sent for it
+ */
+static void
+agentx_add_request_var(netsnmp_pdu *pdu, netsnmp_request_info *request)
+{
+    size_t nlen = request->requestvb->name_length;
+    oid   *nptr = request->requestvb->name;
+    
+    DEBUGMSGTL(("agentx/master","request for variable ("));
+    DEBUGMSGOID(("agentx/master", nptr, nlen));
+    DEBUGMSG(("agentx/master", ")\n"));
+
+    if (pdu->command == AGENTX_MSG_GETNEXT ||
+        pdu->command == AGENTX_MSG_GETBULK) {
+
+        if (snmp_oid_compare(nptr, nlen, request->subtree->start_a,
+                             request->subtree->start_len) < 0) {
+            DEBUGMSGTL(("agentx/master","inexact request preceding region ("));
+            DEBUGMSGOID(("agentx/master", request->subtree->start_a,
+                         request->subtree->start_len));
+            DEBUGMSG(("agentx/master", ")\n"));
+            nptr = request->subtree->start_a;
+            nlen = request->subtree->start_len;
+            request->inclusive = 1;
+        }
+
+        if (request->inclusive) {
+            DEBUGMSGTL(("agentx/master", "INCLUSIVE varbind "));
+            DEBUGMSGOID(("agentx/master", nptr, nlen));
+            DEBUGMSG(("agentx/master", " scoped to "));
+            DEBUGMSGOID(("agentx/master", request->range_end,
+                         request->range_end_len));
+            DEBUGMSG(("agentx/master", "\n"));
+            snmp_pdu_add_variable(pdu, nptr, nlen, ASN_PRIV_INCL_RANGE,
+                                  (u_char *) request->range_end,
+                                  request->range_end_len *
+                                  sizeof(oid));
+            request->inclusive = 0;
+        } else {
+            DEBUGMSGTL(("agentx/master", "EXCLUSIVE varbind "));
+            DEBUGMSGOID(("agentx/master", nptr, nlen));
+            DEBUGMSG(("agentx/master", " scoped to "));
+            DEBUGMSGOID(("agentx/master", request->range_end,
+                         request->range_end_len));
+            DEBUGMSG(("agentx/master", "\n"));
+            snmp_pdu_add_variable(pdu, nptr, nlen, ASN_PRIV_EXCL_RANGE,
+                                  (u_char *) request->range_end,
+                                  request->range_end_len *
+                                  sizeof(oid));
+        }
+    } else {
+        snmp_pdu_add_variable(pdu, request->requestvb->name,
+                              request->requestvb->name_length,
+                              request->requestvb->type,
+                              request->requestvb->val.string,
+                              request->requestvb->val_len);
+    }
+
+    /*
+     * mark the request as delayed 
+     */
+    if (pdu->command != AGENTX_MSG_CLEANUPSET)
+        netsnmp_request_delegate(request);
+    else
+        netsnmp_request_completed(request);
+}
+
 /*
  *
  * AgentX State diagram.  [mode] = internal mode it's mapped from:
@@ -542,12 +1118,13 @@ agentx_master_handler(netsnmp_mib_handler *handler,
                       netsnmp_request_info *requests)
 {
     netsnmp_session *ax_session = (netsnmp_session *) handler->myvoid;
-    netsnmp_request_info *request = requests;
+    netsnmp_request_info *request;
     netsnmp_pdu    *pdu;
     void           *cb_data;
     void           *cb_data_box;
     snmp_callback  callback;
-    int            result;
+    int            result, repeaters;
+    long           max_rep;
 
     DEBUGMSGTL(("agentx/master",
                 "agentx master handler starting, mode = 0x%02x\n",
@@ -570,8 +1147,26 @@ agentx_master_handler(netsnmp_mib_handler *handler,
         pdu = snmp_pdu_create(AGENTX_MSG_GETNEXT);
         break;
 
-    case MODE_GETBULK:         /* WWWXXX */
-        pdu = snmp_pdu_create(AGENTX_MSG_GETNEXT);
+    case MODE_GETBULK:
+        /*
+         * Forward the whole bulk to the subagent at once.  Once no
+         * request wants more than one answer, a GETNEXT does the job.
+         */
+        repeaters = agentx_bulk_repeaters(requests, &max_rep);
+        if (repeaters > 0) {
+            pdu = snmp_pdu_create(AGENTX_MSG_GETBULK);
+            if (pdu) {
+                pdu->non_repeaters = 0;
+                for (request = requests; request; request = request->next)
+                    if (request->repeat <= 0)
+                        pdu->non_repeaters++;
+                pdu->max_repetitions = max_rep > 0xffff ? 0xffff : max_rep;
+                DEBUGMSGTL(("agentx/master", "forwarding getbulk, "
+                            "non-repeaters %ld, max-repetitions %ld\n",
+                            pdu->non_repeaters, pdu->max_repetitions));
+            }
+        } else
+            pdu = snmp_pdu_create(AGENTX_MSG_GETNEXT);
         break;
 
 #ifndef NETSNMP_NO_WRITE_SUPPORT
@@ -623,76 +1218,23 @@ agentx_master_handler(netsnmp_mib_handler *handler,
     if (ax_session->subsession->flags & AGENTX_MSG_FLAG_NETWORK_BYTE_ORDER)
         pdu->flags |= AGENTX_MSG_FLAG_NETWORK_BYTE_ORDER;
 
-    while (request) {
-
-        size_t nlen = request->requestvb->name_length;
-        oid   *nptr = request->requestvb->name;
-        
-        DEBUGMSGTL(("agentx/master","request for variable ("));
-        DEBUGMSGOID(("agentx/master", nptr, nlen));
-        DEBUGMSG(("agentx/master", ")\n"));
-        
+    if (pdu->command == AGENTX_MSG_GETBULK) {
         /*
-         * loop through all the requests and create agentx ones out of them 
+         * the non-repeaters go first, followed by the repeaters 
          */
-
-        if (reqinfo->mode == MODE_GETNEXT || reqinfo->mode == MODE_GETBULK) {
-
-            if (snmp_oid_compare(nptr, nlen, request->subtree->start_a,
-                                 request->subtree->start_len) < 0) {
-                DEBUGMSGTL(("agentx/master","inexact request preceding region ("));
-                DEBUGMSGOID(("agentx/master", request->subtree->start_a,
-                             request->subtree->start_len));
-                DEBUGMSG(("agentx/master", ")\n"));
-                nptr = request->subtree->start_a;
-                nlen = request->subtree->start_len;
-                request->inclusive = 1;
+        for (request = requests; request; request = request->next)
+            if (request->repeat <= 0) {
+                agentx_extend_range(request, ax_session);
+                agentx_add_request_var(pdu, request);
             }
-
-            if (request->inclusive) {
-                DEBUGMSGTL(("agentx/master", "INCLUSIVE varbind "));
-                DEBUGMSGOID(("agentx/master", nptr, nlen));
-                DEBUGMSG(("agentx/master", " scoped to "));
-                DEBUGMSGOID(("agentx/master", request->range_end,
-                             request->range_end_len));
-                DEBUGMSG(("agentx/master", "\n"));
-                snmp_pdu_add_variable(pdu, nptr, nlen, ASN_PRIV_INCL_RANGE,
-                                      (u_char *) request->range_end,
-                                      request->range_end_len *
-                                      sizeof(oid));
-                request->inclusive = 0;
-            } else {
-                DEBUGMSGTL(("agentx/master", "EXCLUSIVE varbind "));
-                DEBUGMSGOID(("agentx/master", nptr, nlen));
-                DEBUGMSG(("agentx/master", " scoped to "));
-                DEBUGMSGOID(("agentx/master", request->range_end,
-                             request->range_end_len));
-                DEBUGMSG(("agentx/master", "\n"));
-                snmp_pdu_add_variable(pdu, nptr, nlen, ASN_PRIV_EXCL_RANGE,
-                                      (u_char *) request->range_end,
-                                      request->range_end_len *
-                                      sizeof(oid));
+        for (request = requests; request; request = request->next)
+            if (request->repeat > 0) {
+                agentx_extend_range(request, ax_session);
+                agentx_add_request_var(pdu, request);
             }
-        } else {
-            snmp_pdu_add_variable(pdu, request->requestvb->name,
-                                  request->requestvb->name_length,
-                                  request->requestvb->type,
-                                  request->requestvb->val.string,
-                                  request->requestvb->val_len);
-        }
-
-        /*
-         * mark the request as delayed 
-         */
-        if (pdu->command != AGENTX_MSG_CLEANUPSET)
-            request->delegated = REQUEST_IS_DELEGATED;
-        else
-            request->delegated = REQUEST_IS_NOT_DELEGATED;
-
-        /*
-         * next... 
-         */
-        request = request->next;
+    } else {
+        for (request = requests; request; request = request->next)
+            agentx_add_request_var(pdu, request);
     }
 
     /*
@@ -716,6 +1258,12 @@ agentx_master_handler(netsnmp_mib_handler *handler,
      */
     DEBUGMSGTL(("agentx/master", "sending pdu (req=0x%x,trans=0x%x,sess=0x%x)\n",
                 (unsigned)pdu->reqid, (unsigned)pdu->transid, (unsigned)pdu->sessid));
+    if (pdu->command == AGENTX_MSG_GET ||
+        pdu->command == AGENTX_MSG_GETNEXT ||
+        pdu->command == AGENTX_MSG_GETBULK) {
+        agentx_send_read(ax_session, reqinfo->asp, pdu, cb_data_box);
+        return SNMP_ERR_NOERROR;
+    }
     result = snmp_async_send_cp(ax_session, pdu, callback, cb_data_box, 1);
     if (result == 0) {
         snmp_free_pdu(pdu);
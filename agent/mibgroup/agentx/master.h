@@ -12,5 +12,8 @@ config_require(agentx/agentx_config);
      Netsnmp_Node_Handler agentx_master_handler;
 void agentx_register_session(netsnmp_session *session);
 void agentx_unregister_session(netsnmp_session *session);
+int agentx_got_response(int operation, netsnmp_session *session, int reqid,
+                        netsnmp_pdu *pdu, void *magic);
+void agentx_master_session_closed(netsnmp_session *ax_session);
 
 #endif                          /* _AGENTX_MASTER_H */
@@ -151,6 +151,7 @@ close_agentx_session(netsnmp_session * session, int sessid)
             }
         }
                 
+        agentx_master_session_closed(session);
         unregister_mibs_by_session(session);
         unregister_index_by_session(session);
         unregister_sysORTable_by_session(session);
@@ -75,6 +75,7 @@ typedef struct _net_snmpsubagent_magic_s {
     int             original_command;
     netsnmp_session *session;
     netsnmp_variable_list *ovars;
+    long            non_repeaters;
 } ns_subagent_magic;
 
 struct agent_netsnmp_set_info {
@@ -94,6 +95,21 @@ static struct agent_netsnmp_set_info *Sets = NULL;
 
 netsnmp_session *agentx_callback_sess = NULL;
 
+/*
+ * Read requests from the master agent wait here while agentXWindow of
+ * them are already in progress.
+ */
+struct subagent_held_request {
+    netsnmp_pdu    *pdu;
+    ns_subagent_magic *smagic;
+    struct subagent_held_request *next;
+};
+static struct subagent_held_request *held_requests = NULL;
+static struct subagent_held_request **held_tail = &held_requests;
+static unsigned int requests_in_progress = 0;
+static void     subagent_start_request(netsnmp_pdu *pdu,
+                                       ns_subagent_magic *smagic);
+
 int
 subagent_startup(int majorID, int minorID,
                              void *serverarg, void *clientarg)
@@ -387,11 +403,9 @@ handle_agentx_packet(int operation, netsnmp_session * session, int reqid,
         break;
 
     case AGENTX_MSG_GETBULK:
-        /*
-         * WWWXXX 
-         */
         DEBUGMSGTL(("agentx/subagent", "  -> getbulk\n"));
         pdu->command = SNMP_MSG_GETBULK;
+        smagic->non_repeaters = pdu->non_repeaters;
 
         /*
          * We have to save a copy of the original variable list here because
@@ -525,6 +539,10 @@ handle_agentx_packet(int operation, netsnmp_session * session, int reqid,
     internal_pdu->contextNameLen = internal_pdu->community_len;
     internal_pdu->community = NULL;
     internal_pdu->community_len = 0;
+    if (mycallback == handle_subagent_response) {
+        subagent_start_request(internal_pdu, smagic);
+        return 1;
+    }
     result = snmp_async_send(agentx_callback_sess, internal_pdu, mycallback,
                     retmagic);
     if (result == 0) {
@@ -533,6 +551,76 @@ handle_agentx_packet(int operation, netsnmp_session * session, int reqid,
     return 1;
 }
 
+static void
+subagent_send_request(netsnmp_pdu *pdu, ns_subagent_magic *smagic)
+{
+    if (snmp_async_send(agentx_callback_sess, pdu, handle_subagent_response,
+                        smagic) == 0) {
+        snmp_free_pdu(pdu);
+        return;
+    }
+    requests_in_progress++;
+}
+
+/*
+ * Start processing a read request from the master agent, unless the
+ * window is full.
+ */
+static void
+subagent_start_request(netsnmp_pdu *pdu, ns_subagent_magic *smagic)
+{
+    int             window = netsnmp_ds_get_int(NETSNMP_DS_APPLICATION_ID,
+                                                NETSNMP_DS_AGENT_AGENTX_WINDOW);
+    struct subagent_held_request *held;
+
+    if (window <= 0 ||
+        (!held_requests && requests_in_progress < (unsigned int) window)) {
+        subagent_send_request(pdu, smagic);
+        return;
+    }
+    held = SNMP_MALLOC_STRUCT(subagent_held_request);
+    if (!held) {
+        snmp_free_varbind(smagic->ovars);
+        free(smagic);
+        snmp_free_pdu(pdu);
+        return;
+    }
+    DEBUGMSGTL(("agentx/subagent", "holding request back, %u in progress\n",
+                requests_in_progress));
+    held->pdu = pdu;
+    held->smagic = smagic;
+    *held_tail = held;
+    held_tail = &held->next;
+}
+
+/*
+ * A read request has completed: start the next held back ones, skipping
+ * those of a master agent session which has gone meanwhile.
+ */
+static void
+subagent_request_done(void)
+{
+    int             window = netsnmp_ds_get_int(NETSNMP_DS_APPLICATION_ID,
+                                                NETSNMP_DS_AGENT_AGENTX_WINDOW);
+    struct subagent_held_request *held;
+
+    if (requests_in_progress)
+        requests_in_progress--;
+    while ((held = held_requests) &&
+           (window <= 0 || requests_in_progress < (unsigned int) window)) {
+        held_requests = held->next;
+        if (!held_requests)
+            held_tail = &held_requests;
+        if (snmp_sess_pointer(held->smagic->session) == NULL) {
+            snmp_free_varbind(held->smagic->ovars);
+            free(held->smagic);
+            snmp_free_pdu(held->pdu);
+        } else
+            subagent_send_request(held->pdu, held->smagic);
+        free(held);
+    }
+}
+
 static int
 _invalid_op_and_magic(int op, ns_subagent_magic *smagic)
 {
@@ -553,14 +641,59 @@ _invalid_op_and_magic(int op, ns_subagent_magic *smagic)
     return invalid;
 }
 
+/*
+ * Replace a getNext answer found outside the search range the master
+ * agent asked for (u) by endOfMibView.
+ */
+static void
+subagent_scope_var(netsnmp_variable_list *u, netsnmp_variable_list *v)
+{
+    int             rc;
+
+    if (snmp_oid_compare
+        (u->val.objid, u->val_len / sizeof(oid), nullOid,
+         nullOidLen/sizeof(oid)) != 0) {
+        /*
+         * The master agent requested scoping for this variable.  
+         */
+        rc = snmp_oid_compare(v->name, v->name_length,
+                              u->val.objid,
+                              u->val_len / sizeof(oid));
+        DEBUGMSGTL(("agentx/subagent", "result "));
+        DEBUGMSGOID(("agentx/subagent", v->name, v->name_length));
+        DEBUGMSG(("agentx/subagent", " scope to "));
+        DEBUGMSGOID(("agentx/subagent",
+                     u->val.objid, u->val_len / sizeof(oid)));
+        DEBUGMSG(("agentx/subagent", " result %d\n", rc));
+
+        if (rc >= 0) {
+            /*
+             * The varbind is out of scope.  From RFC2741, p. 66: "If
+             * the subagent cannot locate an appropriate variable,
+             * v.name is set to the starting OID, and the VarBind is
+             * set to `endOfMibView'".  
+             */
+            snmp_set_var_objid(v, u->name, u->name_length);
+            snmp_set_var_typed_value(v, SNMP_ENDOFMIBVIEW, NULL, 0);
+            DEBUGMSGTL(("agentx/subagent",
+                        "scope violation -- return endOfMibView\n"));
+        }
+    } else {
+        DEBUGMSGTL(("agentx/subagent", "unscoped var\n"));
+    }
+}
+
 int
 handle_subagent_response(int op, netsnmp_session * session, int reqid,
                          netsnmp_pdu *pdu, void *magic)
 {
     ns_subagent_magic *smagic = (ns_subagent_magic *) magic;
-    netsnmp_variable_list *u = NULL, *v = NULL;
+    netsnmp_variable_list *u = NULL, *v = NULL, *r = NULL;
     int             rc = 0;
 
+    if (smagic && op != NETSNMP_CALLBACK_OP_RESEND)
+        subagent_request_done();
+
     if (_invalid_op_and_magic(op, magic)) {
         return 1;
     }
@@ -588,46 +721,27 @@ handle_subagent_response(int op, netsnmp_session * session, int reqid,
                     "do getNext scope processing %p %p\n", smagic->ovars,
                     pdu->variables));
         for (u = smagic->ovars, v = pdu->variables; u != NULL && v != NULL;
-             u = u->next_variable, v = v->next_variable) {
-            if (snmp_oid_compare
-                (u->val.objid, u->val_len / sizeof(oid), nullOid,
-                 nullOidLen/sizeof(oid)) != 0) {
-                /*
-                 * The master agent requested scoping for this variable.  
-                 */
-                rc = snmp_oid_compare(v->name, v->name_length,
-                                      u->val.objid,
-                                      u->val_len / sizeof(oid));
-                DEBUGMSGTL(("agentx/subagent", "result "));
-                DEBUGMSGOID(("agentx/subagent", v->name, v->name_length));
-                DEBUGMSG(("agentx/subagent", " scope to "));
-                DEBUGMSGOID(("agentx/subagent",
-                             u->val.objid, u->val_len / sizeof(oid)));
-                DEBUGMSG(("agentx/subagent", " result %d\n", rc));
-
-                if (rc >= 0) {
-                    /*
-                     * The varbind is out of scope.  From RFC2741, p. 66: "If
-                     * the subagent cannot locate an appropriate variable,
-                     * v.name is set to the starting OID, and the VarBind is
-                     * set to `endOfMibView'".  
-                     */
-                    snmp_set_var_objid(v, u->name, u->name_length);
-                    snmp_set_var_typed_value(v, SNMP_ENDOFMIBVIEW, NULL, 0);
-                    DEBUGMSGTL(("agentx/subagent",
-                                "scope violation -- return endOfMibView\n"));
-                }
-            } else {
-                DEBUGMSGTL(("agentx/subagent", "unscoped var\n"));
-            }
+             u = u->next_variable, v = v->next_variable)
+            subagent_scope_var(u, v);
+    } else if (smagic->original_command == AGENTX_MSG_GETBULK) {
+        /*
+         * The response holds the non-repeaters followed by rows of
+         * repetitions, each scoped by its repeater's search range.
+         */
+        DEBUGMSGTL(("agentx/subagent",
+                    "do getBulk scope processing %p %p\n", smagic->ovars,
+                    pdu->variables));
+        for (rc = 0, u = smagic->ovars, v = pdu->variables;
+             rc < smagic->non_repeaters && u != NULL && v != NULL;
+             rc++, u = u->next_variable, v = v->next_variable)
+            subagent_scope_var(u, v);
+        for (r = u; u != NULL && v != NULL; v = v->next_variable) {
+            subagent_scope_var(u, v);
+            if ((u = u->next_variable) == NULL)
+                u = r;
         }
     }
 
-    /*
-     * XXXJBPN: similar for GETBULK but the varbinds can get re-ordered I
-     * think which makes it er more difficult.  
-     */
-
     if (smagic->ovars != NULL) {
         snmp_free_varbind(smagic->ovars);
     }
@@ -195,19 +195,16 @@ _mteTrigger_failure( /* int error, */ const char *msg )
     return;
 }
 
+static void _mteTrigger_sample(struct mteTrigger *entry,
+                               netsnmp_variable_list *var,
+                               netsnmp_variable_list *sysUT);
+
 void
 mteTrigger_run( unsigned int reg, void *clientarg)
 {
     struct mteTrigger *entry = (struct mteTrigger *)clientarg;
-    netsnmp_variable_list *var, *vtmp;
-    netsnmp_variable_list *vp1, *vp1_prev;
-    netsnmp_variable_list *vp2, *vp2_prev;
-    netsnmp_variable_list *dvar = NULL;
-    netsnmp_variable_list *dv1  = NULL, *dv2 = NULL;
-    netsnmp_variable_list sysUT_var;
-    int  cmp = 0, n, n2;
-    long value;
-    const char *reason;
+    netsnmp_variable_list *var;
+    int  n;
 
     if (!entry) {
         snmp_alarm_unregister( reg );
@@ -258,6 +255,27 @@ mteTrigger_run( unsigned int reg, void *clientarg)
         snmp_free_varbind(var);
         return;
     }
+    _mteTrigger_sample( entry, var, NULL );
+}
+
+/*
+ * Evaluate a trigger against the value(s) just retrieved.
+ *   This takes over the 'var' list, and uses the sysUpTime.0 value
+ *   provided (if any) rather than retrieving it again.
+ */
+static void
+_mteTrigger_sample(struct mteTrigger *entry, netsnmp_variable_list *var,
+                   netsnmp_variable_list *sysUT)
+{
+    netsnmp_variable_list *vtmp;
+    netsnmp_variable_list *vp1, *vp1_prev;
+    netsnmp_variable_list *vp2, *vp2_prev;
+    netsnmp_variable_list *dvar = NULL;
+    netsnmp_variable_list *dv1  = NULL, *dv2 = NULL;
+    netsnmp_variable_list sysUT_var;
+    int  cmp = 0, n, n2;
+    long value;
+    const char *reason;
 
     /*
      * ... canonicalise the results (to simplify later comparisons)...
@@ -546,8 +564,12 @@ mteTrigger_run( unsigned int reg, void *clientarg)
      */
     DEBUGMSGTL(("disman:event:delta", "retrieve sysUpTime.0\n"));
     memset( &sysUT_var, 0, sizeof( netsnmp_variable_list ));
-    snmp_set_var_objid( &sysUT_var, _sysUpTime_instance, _sysUpTime_inst_len );
-    netsnmp_query_get(  &sysUT_var, entry->session );
+    if (sysUT) {
+        snmp_clone_var( sysUT, &sysUT_var );
+    } else {
+        snmp_set_var_objid( &sysUT_var, _sysUpTime_instance, _sysUpTime_inst_len );
+        netsnmp_query_get(  &sysUT_var, entry->session );
+    }
 
     if (( entry->mteTriggerTest & MTE_TRIGGER_BOOLEAN   ) ||
         ( entry->mteTriggerTest & MTE_TRIGGER_THRESHOLD )) {
@@ -1133,27 +1155,394 @@ mteTrigger_run( unsigned int reg, void *clientarg)
     }
 }
 
+    /* ===================================================
+     *
+     * Sampling the monitored values: triggers with the same
+     *   frequency (and equivalent sessions) are sampled together,
+     *   retrieving each monitored subtree once for all of them.
+     *
+     * =================================================== */
+
+struct mteSampler {
+    u_long             frequency;
+    netsnmp_session   *session;
+    unsigned int       alarm;
+    int                count;       /* triggers using this sampler */
+    struct mteSampler *next;
+};
+static struct mteSampler *mteSamplers;
+
+    /*
+     * A value to be retrieved on behalf of one or more triggers:
+     *   a subtree to walk, or a single instance to get.
+     */
+struct mteSample {
+    oid                   *name;
+    size_t                 name_len;
+    int                    walk;
+    int                    status;
+    netsnmp_variable_list *var;
+};
+
+struct mteSampleItem {
+    struct mteTrigger *entry;
+    int                order;       /* position in the trigger table */
+    int                sample;      /* index into the mteSample array */
+};
+
+#define MTE_SAMPLE_GETS  32         /* instances retrieved per request */
+
+    /*
+     * Do two (internal query) sessions give the same access?
+     */
+static int
+_mteSampler_session_match(netsnmp_session *a, netsnmp_session *b)
+{
+    if (a == b)
+        return 1;
+    if (!a || !b)
+        return 0;
+    return (a->version         == b->version         &&
+            a->securityModel   == b->securityModel   &&
+            a->securityLevel   == b->securityLevel   &&
+            a->securityNameLen == b->securityNameLen &&
+            (!a->securityNameLen ||
+             !memcmp(a->securityName, b->securityName, a->securityNameLen)) &&
+            a->contextNameLen  == b->contextNameLen  &&
+            (!a->contextNameLen ||
+             !memcmp(a->contextName, b->contextName, a->contextNameLen)) &&
+            a->community_len   == b->community_len   &&
+            (!a->community_len ||
+             !memcmp(a->community, b->community, a->community_len)));
+}
+
+static int
+_mteSampler_item_compare(const void *p1, const void *p2)
+{
+    const struct mteSampleItem *i1 = (const struct mteSampleItem *)p1;
+    const struct mteSampleItem *i2 = (const struct mteSampleItem *)p2;
+    int cmp;
+
+    cmp = snmp_oid_compare(i1->entry->mteTriggerValueID,
+                           i1->entry->mteTriggerValueID_len,
+                           i2->entry->mteTriggerValueID,
+                           i2->entry->mteTriggerValueID_len);
+    if (cmp)
+        return cmp;
+    /* wildcarded before exact, so that the walk covers both */
+    return (i2->entry->flags & MTE_TRIGGER_FLAG_VWILD) -
+           (i1->entry->flags & MTE_TRIGGER_FLAG_VWILD);
+}
+
+static int
+_mteSampler_item_order(const void *p1, const void *p2)
+{
+    return ((const struct mteSampleItem *)p1)->order -
+           ((const struct mteSampleItem *)p2)->order;
+}
+
+    /*
+     * Copy a single varbind, or an empty one for the given OID
+     */
+static netsnmp_variable_list *
+_mteSampler_copy(netsnmp_variable_list *vp, oid *name, size_t name_len,
+                 u_char type)
+{
+    netsnmp_variable_list *next, *copy;
+
+    if (!vp) {
+        copy = SNMP_MALLOC_TYPEDEF( netsnmp_variable_list );
+        if (copy) {
+            snmp_set_var_objid( copy, name, name_len );
+            copy->type = type;
+        }
+        return copy;
+    }
+    next = vp->next_variable;
+    vp->next_variable = NULL;
+    copy = snmp_clone_varbind( vp );
+    vp->next_variable = next;
+    return copy;
+}
+
+static void
+_mteSampler_get_one(struct mteSample *sample, netsnmp_session *session)
+{
+    sample->var = _mteSampler_copy(NULL, sample->name, sample->name_len, 0);
+    sample->status = sample->var ? netsnmp_query_get( sample->var, session )
+                                 : SNMP_ERR_GENERR;
+}
+
+    /*
+     * Retrieve the instances to get, several to a request where the
+     *   session allows this (SNMPv1 would drop any failed varbinds).
+     */
+static void
+_mteSampler_get(struct mteSample **gets, int ngets, netsnmp_session *session)
+{
+    netsnmp_variable_list *list, *vp, *next;
+    int i, k, n, rc, chunk;
+
+    chunk = (session && session->version != SNMP_VERSION_1) ?
+                MTE_SAMPLE_GETS : 1;
+    for (i = 0; i < ngets; i += n) {
+        n = SNMP_MIN(chunk, ngets - i);
+        if (n == 1) {
+            _mteSampler_get_one(gets[i], session);
+            continue;
+        }
+        list = NULL;
+        for (k = 0; k < n; k++)
+            snmp_varlist_add_variable(&list, gets[i+k]->name,
+                                      gets[i+k]->name_len, ASN_NULL, NULL, 0);
+        rc = list ? netsnmp_query_get( list, session ) : SNMP_ERR_GENERR;
+        /*
+         * A failed varbind is dropped from the request and the rest
+         *   retried, so check that the results match what was asked for.
+         */
+        for (k = 0, vp = list; rc == SNMP_ERR_NOERROR && k < n;
+             k++, vp = vp->next_variable) {
+            if (!vp || snmp_oid_compare(vp->name, vp->name_length,
+                                        gets[i+k]->name, gets[i+k]->name_len))
+                rc = SNMP_ERR_GENERR;
+        }
+        if (rc != SNMP_ERR_NOERROR) {
+            snmp_free_varbind(list);
+            for (k = 0; k < n; k++)
+                _mteSampler_get_one(gets[i+k], session);
+            continue;
+        }
+        for (k = 0, vp = list; k < n; k++, vp = next) {
+            next = vp->next_variable;
+            vp->next_variable = NULL;
+            gets[i+k]->var    = vp;
+            gets[i+k]->status = SNMP_ERR_NOERROR;
+        }
+    }
+}
+
+    /*
+     * Build the list of values for one trigger from those retrieved
+     */
+static netsnmp_variable_list *
+_mteSampler_values(struct mteTrigger *entry, struct mteSample *sample)
+{
+    netsnmp_variable_list *var = NULL, *last = NULL, *vp, *copy;
+    oid    *name     = entry->mteTriggerValueID;
+    size_t  name_len = entry->mteTriggerValueID_len;
+
+    if (!sample->walk)
+        return _mteSampler_copy(sample->var, name, name_len, 0);
+
+    for (vp = sample->var; vp; vp = vp->next_variable) {
+        if (entry->flags & MTE_TRIGGER_FLAG_VWILD) {
+            if (snmp_oidtree_compare(name, name_len,
+                                     vp->name, vp->name_length) != 0)
+                continue;
+        } else if (snmp_oid_compare(name, name_len,
+                                    vp->name, vp->name_length) != 0)
+            continue;
+        copy = _mteSampler_copy(vp, NULL, 0, 0);
+        if (!copy)
+            break;
+        if (last)
+            last->next_variable = copy;
+        else
+            var = copy;
+        last = copy;
+    }
+    /*
+     * Nothing there: as a walk (or get) of this OID on its own would report
+     */
+    if (!var)
+        var = _mteSampler_copy(NULL, name, name_len,
+                               (entry->flags & MTE_TRIGGER_FLAG_VWILD) ?
+                                   0 : SNMP_NOSUCHINSTANCE);
+    return var;
+}
+
+static void
+_mteSampler_run(unsigned int reg, void *clientarg)
+{
+    struct mteSampler    *sampler = (struct mteSampler *)clientarg;
+    struct mteSampleItem *items;
+    struct mteSample     *samples, **gets;
+    struct mteTrigger    *entry, *last;
+    netsnmp_tdata_row    *row;
+    netsnmp_variable_list sysUT_var, *var;
+    int  nitems = 0, nsamples = 0, ngets = 0, i;
+
+    if (netsnmp_processing_set) {
+        DEBUGMSGTL(("disman:event:trigger:monitor",
+                    "Skipping triggers while netsnmp_processing_set\n"));
+        return;
+    }
+
+    items   = calloc(sampler->count, sizeof(struct mteSampleItem));
+    samples = calloc(sampler->count, sizeof(struct mteSample));
+    gets    = calloc(sampler->count, sizeof(struct mteSample *));
+    if (!items || !samples || !gets) {
+        _mteTrigger_failure("failed to allocate mteTrigger samples");
+        goto done;
+    }
+    for (row = netsnmp_tdata_row_first(trigger_table_data);
+         row && nitems < sampler->count;
+         row = netsnmp_tdata_row_next(trigger_table_data, row)) {
+        entry = (struct mteTrigger *)row->data;
+        if (entry->sampler != sampler ||
+            !(entry->flags & MTE_TRIGGER_FLAG_ENABLED ) ||
+            !(entry->flags & MTE_TRIGGER_FLAG_ACTIVE  ) ||
+            !(entry->flags & MTE_TRIGGER_FLAG_VALID  ))
+            continue;
+        items[nitems].entry = entry;
+        items[nitems].order = nitems;
+        nitems++;
+    }
+    if (!nitems)
+        goto done;
+
+    /*
+     * Work out what to retrieve: in OID order, anything within a
+     *   wildcarded OID comes from the walk of that subtree.
+     */
+    qsort(items, nitems, sizeof(struct mteSampleItem),
+          _mteSampler_item_compare);
+    last = NULL;
+    for (i = 0; i < nitems; i++) {
+        entry = items[i].entry;
+        if (last && snmp_oidtree_compare(last->mteTriggerValueID,
+                                         last->mteTriggerValueID_len,
+                                         entry->mteTriggerValueID,
+                                         entry->mteTriggerValueID_len) == 0 &&
+            ((last->flags & MTE_TRIGGER_FLAG_VWILD) ||
+             (!(entry->flags & MTE_TRIGGER_FLAG_VWILD) &&
+              entry->mteTriggerValueID_len == last->mteTriggerValueID_len))) {
+            items[i].sample = nsamples - 1;
+            continue;
+        }
+        last = entry;
+        samples[nsamples].name     = entry->mteTriggerValueID;
+        samples[nsamples].name_len = entry->mteTriggerValueID_len;
+        samples[nsamples].walk = !!(entry->flags & MTE_TRIGGER_FLAG_VWILD);
+        items[i].sample = nsamples++;
+    }
+    DEBUGMSGTL(("disman:event:trigger:monitor",
+                "Sampling %d trigger(s) every %lu seconds: %d value(s)\n",
+                nitems, sampler->frequency, nsamples));
+
+    /*
+     * ... retrieve them...
+     */
+    for (i = 0; i < nsamples; i++) {
+        if (!samples[i].walk) {
+            gets[ngets++] = &samples[i];
+            continue;
+        }
+        samples[i].var = _mteSampler_copy(NULL, samples[i].name,
+                                          samples[i].name_len, 0);
+        samples[i].status = samples[i].var ?
+            netsnmp_query_walk( samples[i].var, sampler->session ) :
+            SNMP_ERR_GENERR;
+    }
+    _mteSampler_get(gets, ngets, sampler->session);
+    memset( &sysUT_var, 0, sizeof( netsnmp_variable_list ));
+    snmp_set_var_objid( &sysUT_var, _sysUpTime_instance, _sysUpTime_inst_len );
+    netsnmp_query_get(  &sysUT_var, sampler->session );
+
+    /*
+     * ... and evaluate each trigger in turn.
+     */
+    qsort(items, nitems, sizeof(struct mteSampleItem),
+          _mteSampler_item_order);
+    for (i = 0; i < nitems; i++) {
+        entry = items[i].entry;
+        if (samples[items[i].sample].status != SNMP_ERR_NOERROR) {
+            DEBUGMSGTL(( "disman:event:trigger:monitor",
+                         "Trigger query (%s) failed: %d\n",
+                         entry->mteTName, samples[items[i].sample].status));
+            _mteTrigger_failure( "failed to run mteTrigger query" );
+            continue;
+        }
+        var = _mteSampler_values(entry, &samples[items[i].sample]);
+        if (!var) {
+            _mteTrigger_failure("failed to create mteTrigger query varbind");
+            continue;
+        }
+        DEBUGMSGTL(( "disman:event:trigger:monitor", "Running trigger (%s)\n",
+                     entry->mteTName));
+        _mteTrigger_sample(entry, var, &sysUT_var);
+    }
+    snmp_free_var_internals(&sysUT_var);
+
+done:
+    if (samples)
+        for (i = 0; i < nsamples; i++)
+            snmp_free_varbind(samples[i].var);
+    free(gets);
+    free(samples);
+    free(items);
+}
+
+static void
+_mteSampler_join(struct mteTrigger *entry)
+{
+    struct mteSampler *sampler;
+
+    for (sampler = mteSamplers; sampler; sampler = sampler->next)
+        if (sampler->frequency == entry->mteTriggerFrequency &&
+            _mteSampler_session_match(sampler->session, entry->session))
+            break;
+    if (!sampler) {
+        sampler = SNMP_MALLOC_TYPEDEF(struct mteSampler);
+        if (!sampler)
+            return;
+        sampler->frequency = entry->mteTriggerFrequency;
+        sampler->session   = entry->session;
+        sampler->alarm     = snmp_alarm_register(sampler->frequency,
+                                                 SA_REPEAT,
+                                                 _mteSampler_run, sampler);
+        sampler->next      = mteSamplers;
+        mteSamplers        = sampler;
+    }
+    sampler->count++;
+    entry->sampler = sampler;
+}
+
+static void
+_mteSampler_leave(struct mteTrigger *entry)
+{
+    struct mteSampler *sampler = entry->sampler, **prev;
+
+    if (!sampler)
+        return;
+    entry->sampler = NULL;
+    if (--sampler->count > 0)
+        return;
+    snmp_alarm_unregister(sampler->alarm);
+    for (prev = &mteSamplers; *prev; prev = &(*prev)->next)
+        if (*prev == sampler) {
+            *prev = sampler->next;
+            break;
+        }
+    SNMP_FREE(sampler);
+}
+
 void
 mteTrigger_enable( struct mteTrigger *entry )
 {
     if (!entry)
         return;
 
-    if (entry->alarm) {
-        /* XXX - or explicitly call mteTrigger_disable ?? */
-        snmp_alarm_unregister( entry->alarm );
-        entry->alarm = 0;
-    }
+    /* XXX - or explicitly call mteTrigger_disable ?? */
+    _mteSampler_leave( entry );
 
     if (entry->mteTriggerFrequency) {
         /*
-         * register once to run ASAP, and another to run
-         * at the trigger frequency
+         * register once to run ASAP, and then sample this
+         * along with the other triggers of the same frequency
          */
         snmp_alarm_register(0, 0, mteTrigger_run, entry );
-        entry->alarm = snmp_alarm_register(
-                           entry->mteTriggerFrequency, SA_REPEAT,
-                           mteTrigger_run, entry );
+        _mteSampler_join( entry );
     }
 }
 
@@ -1163,11 +1552,8 @@ mteTrigger_disable( struct mteTrigger *entry )
     if (!entry)
         return;
 
-    if (entry->alarm) {
-        snmp_alarm_unregister( entry->alarm );
-        entry->alarm = 0;
-        /* XXX - perhaps release any previous results */
-    }
+    _mteSampler_leave( entry );
+    /* XXX - perhaps release any previous results */
 }
 
 long _mteTrigger_MaxCount = 0;
@@ -85,6 +85,8 @@ extern size_t _sysUpTime_inst_len;
 #define MTE_STR1_LEN	32
 #define MTE_STR2_LEN	255
 
+struct mteSampler;
+
 /*
  * Data structure for a (combined) trigger row.  Covers delta samples,
  *   and all types (Existence, Boolean and Threshold) of trigger.
@@ -162,7 +164,7 @@ struct mteTrigger {
      *  Additional fields for operation of the Trigger tables:
      *     monitoring...
      */
-    unsigned int    alarm;
+    struct mteSampler *sampler;
     long            sysUpTime;
     netsnmp_variable_list *old_results;
     netsnmp_variable_list *old_deltaDs;
@@ -40,6 +40,8 @@ init_expErrorTable(void)
                                             expErrorTable_oid,
                                             expErrorTable_oid_len,
                                             HANDLER_CAN_RWRITE);
+    if (error_table_reg)
+        error_table_reg->handler->flags |= MIB_HANDLER_BULK_CELLS;
 
     error_table_info = SNMP_MALLOC_TYPEDEF(netsnmp_table_registration_info);
     netsnmp_table_helper_add_indexes(error_table_info,
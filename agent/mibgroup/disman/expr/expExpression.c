@@ -8,6 +8,7 @@
 #include <net-snmp/agent/net-snmp-agent-includes.h>
 #include "disman/expr/expExpression.h"
 #include "disman/expr/expObject.h"
+#include "disman/expr/expValue.h"
 
 netsnmp_tdata *expr_table_data;
 
@@ -150,6 +151,7 @@ expExpression_removeEntry(netsnmp_tdata_row *row)
             snmp_free_varbind(entry->pvars);
             entry->pvars = NULL;
         }
+        expValue_freeExpression(entry);
         SNMP_FREE(entry);
     }
 }
@@ -322,6 +324,7 @@ expExpression_enable( struct expExpression *entry )
         entry->alarm = 0;
     }
 
+    expValue_compileExpression( entry );
     if (entry->expDeltaInterval) {
         entry->alarm = snmp_alarm_register(
                            entry->expDeltaInterval, SA_REPEAT,
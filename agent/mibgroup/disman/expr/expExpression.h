@@ -3,6 +3,8 @@
 
 #include "disman/expr/exp_enum.h"
 
+struct expProgram;
+
     /*
      * Flags relating to the expression table ....
      */
@@ -55,6 +57,7 @@ struct expExpression {
     unsigned int    alarm;
     netsnmp_session *session;
     netsnmp_variable_list *pvars;  /* expPrefix values */
+    struct expProgram *program;    /* compiled expExpression */
     long            sysUpTime;
     long            count;
     long            flags;
@@ -13,6 +13,7 @@
 #include "utilities/iquery.h"
 #include "disman/expr/expExpression.h"
 #include "disman/expr/expExpressionTable.h"
+#include "disman/expr/expValue.h"
 
 netsnmp_feature_require(iquery);
 netsnmp_feature_require(table_tdata);
@@ -47,6 +48,9 @@ init_expExpressionTable(void)
                                             expExpressionTable_oid,
                                             expExpressionTable_oid_len,
                                             HANDLER_CAN_RWRITE);
+    /* reads come straight from the entry, so GETBULK can batch cells */
+    if (expr_table_reg)
+        expr_table_reg->handler->flags |= MIB_HANDLER_BULK_CELLS;
 
     expr_table_info = SNMP_MALLOC_TYPEDEF(netsnmp_table_registration_info);
     netsnmp_table_helper_add_indexes(expr_table_info,
@@ -338,6 +342,7 @@ expExpressionTable_handler(netsnmp_mib_handler *handler,
                 memcpy(entry->expExpression,
                        request->requestvb->val.string,
                        request->requestvb->val_len);
+                expValue_freeExpression(entry);
                 break;
             case COLUMN_EXPEXPRESSIONVALUETYPE:
                 entry->expValueType = *request->requestvb->val.integer;
@@ -10,6 +10,7 @@
 #include "disman/expr/expExpression.h"
 
 netsnmp_tdata *expObject_table_data;
+u_long         expObject_serial;
 
     /*
      * Initializes the container for the expression object table,
@@ -94,6 +95,7 @@ expObject_createRow( const char *expOwner, const char *expName, long expIndex, i
      * ... and insert the row into the table container.
      */
     netsnmp_tdata_add_row(expObject_table_data, row);
+    expObject_serial++;
     return row;
 }
 
@@ -109,6 +111,7 @@ expObject_removeEntry(netsnmp_tdata_row * row)
         return;                 /* Nothing to remove */
     entry = (struct expObject *)
         netsnmp_tdata_remove_and_delete_row(expObject_table_data, row);
+    expObject_serial++;
     if (entry) {
         if (entry->vars      ) snmp_free_varbind( entry->vars      );
         if (entry->old_vars  ) snmp_free_varbind( entry->old_vars  );
@@ -220,7 +223,7 @@ _expObject_buildList( oid *root, size_t root_len, size_t prefix_len,
             /*
              * ... and set the OID using the template suffix
              */
-            for ( i=0; i <= vp1->name_length - prefix_len; i++)
+            for ( i=0; i < vp1->name_length - prefix_len; i++)
                 name[ root_len+i ] = vp1->name[ prefix_len+i ];
             snmp_set_var_objid( vp2, name, root_len+i );
         }
@@ -342,4 +345,5 @@ expObject_getData( struct expExpression  *expr, struct expObject  *obj )
             snmp_free_varbind( obj->cvars );
         obj->cvars = var;
     }
+    obj->serial++;
 }
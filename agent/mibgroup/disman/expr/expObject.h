@@ -51,6 +51,7 @@ struct expObject {
     netsnmp_variable_list  *vars, *old_vars;
     netsnmp_variable_list *dvars, *old_dvars;
     netsnmp_variable_list *cvars, *old_cvars;
+    u_long          serial;          /* bumped when the values change */
 
     long            flags;
 };
@@ -60,6 +61,7 @@ struct expObject {
    * and initialisation routine to create this.
    */
 extern netsnmp_tdata *expObject_table_data;
+extern u_long         expObject_serial;   /* bumped on row creation/removal */
 void             init_expObject_table_data(void);
 
 /*
@@ -43,6 +43,8 @@ init_expObjectTable(void)
                                             expObjectTable_oid,
                                             expObjectTable_oid_len,
                                             HANDLER_CAN_RWRITE);
+    if (object_table_reg)
+        object_table_reg->handler->flags |= MIB_HANDLER_BULK_CELLS;
 
     object_table_info = SNMP_MALLOC_TYPEDEF(netsnmp_table_registration_info);
     netsnmp_table_helper_add_indexes(object_table_info,
@@ -16,718 +16,813 @@
 
 #include <ctype.h>
 
-void _expValue_setError( struct expExpression *exp, int reason,
-                         oid *suffix, size_t suffix_len,
-                         netsnmp_variable_list *var);
 
+    /*
+     * Each expression is compiled (once) into a sequence of instructions
+     *   for a simple stack machine, in postfix order, with every $n
+     *   parameter resolved to the corresponding expObject entry.
+     * Evaluating an instance of the expression just runs through this
+     *   list, using a fixed-size stack of (integer) values.
+     */
+#define EXP_INSN_INTEGER     1    /* push an integer constant           */
+#define EXP_INSN_CONSTANT    2    /* push a string or OID constant      */
+#define EXP_INSN_PARAM       3    /* push the value of a parameter      */
+#define EXP_INSN_UNARY       4    /* apply a unary operator (-, !, ~)   */
+#define EXP_INSN_BINARY      5    /* apply a binary operator            */
+
+#define EXP_STACK_DEPTH     32
 
-#define ASN_PRIV_OPERATOR    (ASN_PRIVATE | 0x0f)
-#define ASN_PRIV_FUNCTION    (ASN_PRIVATE | 0x0e)
+struct expInsn {
+    int                    code;
+    int                    pos;     /* position in expExpression (from 1) */
+    long                   value;   /* constant, parameter or operator    */
+    netsnmp_variable_list *var;     /* string or OID constant             */
+};
+
+    /*
+     * Parallel positions in the lists of values for an expObject.
+     */
+struct expCursor {
+    netsnmp_variable_list *val, *oval, *dd, *odd, *cond;
+};
+
+struct expParam {
+    long                   index;   /* expObjectIndex */
+    struct expObject      *obj;
+    /*
+     * Instance of a wildcarded object used most recently
+     *   (instances are usually evaluated in order)
+     */
+    struct expCursor       cursor;
+    u_long                 serial;
+};
+
+struct expProgram {
+    struct expInsn        *insns;
+    int                    ninsns;
+    struct expParam       *params;
+    int                    nparams;
+    netsnmp_variable_list *consts;  /* string and OID constants */
+    u_long                 serial;  /* expObject_serial when resolved */
+    int                    error;   /* expErrorCode from compilation */
+    int                    errpos;
+};
+
+struct expCompiler {
+    struct expProgram     *prog;
+    const char            *text;
+    const char            *cp;
+    int                    maxinsns;
+    int                    depth;
+};
+
+struct expItem {
+    long                   value;
+    int                    type;
+    int                    numeric;
+    netsnmp_variable_list *var;     /* value as retrieved (if unchanged) */
+};
 
-int ops[128];   /* mapping from operator characters to numeric
-                   tokens (ordered by priority). */
 
 void
 init_expValue(void)
 {
 DEBUGMSGTL(("disman:expr:eval", "Init expValue"));
-        /* Single-character operators */
-    ops['+'] = EXP_OPERATOR_ADD;
-    ops['-'] = EXP_OPERATOR_SUBTRACT;
-    ops['*'] = EXP_OPERATOR_MULTIPLY;
-    ops['/'] = EXP_OPERATOR_DIVIDE;
-    ops['%'] = EXP_OPERATOR_REMAINDER;
-    ops['^'] = EXP_OPERATOR_BITXOR;
-    ops['~'] = EXP_OPERATOR_BITNEGATE;
-    ops['|'] = EXP_OPERATOR_BITOR;
-    ops['&'] = EXP_OPERATOR_BITAND;
-    ops['!'] = EXP_OPERATOR_NOT;
-    ops['<'] = EXP_OPERATOR_LESS;
-    ops['>'] = EXP_OPERATOR_GREAT;
-
-                                         /*
-                                          * Arbitrary offsets, chosen so
-                                          * the three blocks don't overlap.
-                                          */
-        /* "X=" operators */
-    ops['='+20] = EXP_OPERATOR_EQUAL;
-    ops['!'+20] = EXP_OPERATOR_NOTEQ;
-    ops['<'+20] = EXP_OPERATOR_LESSEQ;
-    ops['>'+20] = EXP_OPERATOR_GREATEQ;
-
-        /* "XX" operators */
-    ops['|'-30] = EXP_OPERATOR_OR;
-    ops['&'-30] = EXP_OPERATOR_AND;
-    ops['<'-30] = EXP_OPERATOR_LSHIFT;
-    ops['>'-30] = EXP_OPERATOR_RSHIFT;
+}
+
+
+    /* ===================================================
+     *
+     * Compiling an expression
+     *
+     * =================================================== */
+
+static int
+_expCompile_error( struct expCompiler *c, int code, const char *pos )
+{
+    if (!c->prog->error) {
+        DEBUGMSGTL(("disman:expr:compile", "Error %d at '%s'\n", code, pos));
+        c->prog->error  = code;
+        c->prog->errpos = pos - c->text + 1;
+    }
+    return -1;
+}
+
+static void
+_expCompile_skip( struct expCompiler *c )
+{
+    while (isspace(*c->cp & 0xFF))
+        c->cp++;
+}
+
+static int
+_expCompile_emit( struct expCompiler *c, int code, const char *pos,
+                  long value, netsnmp_variable_list *var )
+{
+    struct expProgram *prog = c->prog;
+    struct expInsn    *insn;
+
+    if (prog->ninsns == c->maxinsns) {
+        insn = (struct expInsn *)realloc(prog->insns,
+                                 (c->maxinsns + 16) * sizeof(struct expInsn));
+        if (!insn)
+            return _expCompile_error(c, EXPERRCODE_RESOURCE, pos);
+        prog->insns   = insn;
+        c->maxinsns  += 16;
+    }
+    switch (code) {
+    case EXP_INSN_INTEGER:
+    case EXP_INSN_CONSTANT:
+    case EXP_INSN_PARAM:
+        if (++c->depth > EXP_STACK_DEPTH)
+            return _expCompile_error(c, EXPERRCODE_RESOURCE, pos);
+        break;
+    case EXP_INSN_BINARY:
+        c->depth--;
+        break;
+    }
+    insn = &prog->insns[ prog->ninsns++ ];
+    insn->code  = code;
+    insn->pos   = pos - c->text + 1;
+    insn->value = value;
+    insn->var   = var;
+    return 0;
 }
 
     /*
-     * Insert the value of the specified object parameter,
-     * using the instance 'suffix' for wildcarded objects.
+     * Return the parameter slot for object $index, adding a new one
+     *   if this is the first reference to it.
      */
-netsnmp_variable_list *
-_expValue_evalParam( netsnmp_variable_list *expIdx, int param,
-                     oid *suffix, size_t suffix_len )
+static int
+_expCompile_param( struct expCompiler *c, long index, const char *pos )
 {
-    netsnmp_variable_list *var = NULL;
-    struct expObject  *obj;
-    netsnmp_variable_list *val_var  = NULL, *oval_var = NULL;  /* values  */
-    netsnmp_variable_list *dd_var   = NULL,  *odd_var = NULL;  /* deltaDs */
-    netsnmp_variable_list *cond_var = NULL;               /* conditionals */
-    int n;
+    struct expProgram *prog = c->prog;
+    struct expParam   *param;
+    int i;
+
+    for (i = 0; i < prog->nparams; i++)
+        if (prog->params[i].index == index)
+            return i;
+    param = (struct expParam *)realloc(prog->params,
+                                 (prog->nparams + 1) * sizeof(struct expParam));
+    if (!param)
+        return _expCompile_error(c, EXPERRCODE_RESOURCE, pos);
+    prog->params = param;
+    param = &prog->params[ prog->nparams ];
+    memset(param, 0, sizeof(struct expParam));
+    param->index = index;
+    return prog->nparams++;
+}
 
     /*
-     * Retrieve the expObject entry for the requested parameter.
+     * Recognise a binary operator, returning the operator and its length
      */
-    if (!expIdx || !expIdx->next_variable ||
-                 !expIdx->next_variable->next_variable ) {
-        return NULL;
+static int
+_expCompile_operator( const char *cp, int *len )
+{
+    *len = 1;
+    switch (*cp) {
+    case '+':   return EXP_OPERATOR_ADD;
+    case '-':   return EXP_OPERATOR_SUBTRACT;
+    case '*':   return EXP_OPERATOR_MULTIPLY;
+    case '/':   return EXP_OPERATOR_DIVIDE;
+    case '%':   return EXP_OPERATOR_REMAINDER;
+    case '^':   return EXP_OPERATOR_BITXOR;
+    case '|':
+        if (cp[1] != '|')
+            return EXP_OPERATOR_BITOR;
+        *len = 2;
+        return EXP_OPERATOR_OR;
+    case '&':
+        if (cp[1] != '&')
+            return EXP_OPERATOR_BITAND;
+        *len = 2;
+        return EXP_OPERATOR_AND;
+    case '<':
+        *len = 2;
+        if (cp[1] == '=')
+            return EXP_OPERATOR_LESSEQ;
+        if (cp[1] == '<')
+            return EXP_OPERATOR_LSHIFT;
+        *len = 1;
+        return EXP_OPERATOR_LESS;
+    case '>':
+        *len = 2;
+        if (cp[1] == '=')
+            return EXP_OPERATOR_GREATEQ;
+        if (cp[1] == '>')
+            return EXP_OPERATOR_RSHIFT;
+        *len = 1;
+        return EXP_OPERATOR_GREAT;
+    case '=':
+        *len = 2;
+        return (cp[1] == '=') ? EXP_OPERATOR_EQUAL : 0;
+    case '!':
+        *len = 2;
+        return (cp[1] == '=') ? EXP_OPERATOR_NOTEQ : 0;
     }
-    var = SNMP_MALLOC_TYPEDEF( netsnmp_variable_list );
-    if (!var) {
-        return NULL;
+    return 0;
+}
+
+    /*
+     * Binary operators follow the usual C precedence rules
+     */
+static int
+_expCompile_priority( int op )
+{
+    switch (op) {
+    case EXP_OPERATOR_MULTIPLY:
+    case EXP_OPERATOR_DIVIDE:
+    case EXP_OPERATOR_REMAINDER:  return 10;
+    case EXP_OPERATOR_ADD:
+    case EXP_OPERATOR_SUBTRACT:   return 9;
+    case EXP_OPERATOR_LSHIFT:
+    case EXP_OPERATOR_RSHIFT:     return 8;
+    case EXP_OPERATOR_LESS:
+    case EXP_OPERATOR_LESSEQ:
+    case EXP_OPERATOR_GREAT:
+    case EXP_OPERATOR_GREATEQ:    return 7;
+    case EXP_OPERATOR_EQUAL:
+    case EXP_OPERATOR_NOTEQ:      return 6;
+    case EXP_OPERATOR_BITAND:     return 5;
+    case EXP_OPERATOR_BITXOR:     return 4;
+    case EXP_OPERATOR_BITOR:      return 3;
+    case EXP_OPERATOR_AND:        return 2;
+    case EXP_OPERATOR_OR:         return 1;
+    }
+    return 0;
+}
+
+static int _expCompile_expr( struct expCompiler *c, int priority );
+
+static int
+_expCompile_primary( struct expCompiler *c )
+{
+    const char *pos = c->cp;
+    const char *end;
+    char       *ep;
+    char        buf[ EXP_STR3_LEN+1 ];
+    oid         name[ MAX_OID_LEN ];
+    netsnmp_variable_list *var;
+    size_t      len;
+    long        n;
+    int         i;
+
+    switch (*pos) {
+    case '$':
+        /*
+         * Object parameter
+         */
+        if (!isdigit(pos[1] & 0xFF))
+            return _expCompile_error(c, EXPERRCODE_SYNTAX, pos);
+        n = strtol(pos+1, &ep, 10);
+        c->cp = ep;
+        i = _expCompile_param(c, n, pos);
+        if (i < 0)
+            return -1;
+        return _expCompile_emit(c, EXP_INSN_PARAM, pos, i, NULL);
+
+    case '(':
+        /*
+         * Parenthesised sub-expression
+         */
+        c->cp++;
+        if (_expCompile_expr(c, 1) < 0)
+            return -1;
+        _expCompile_skip(c);
+        if (*c->cp != ')')
+            return _expCompile_error(c, EXPERRCODE_PARENTHESIS, pos);
+        c->cp++;
+        return 0;
+
+    case '"':
+        /*
+         * String constant
+         */
+        len = 0;
+        for (end = pos+1; *end && *end != '"'; end++) {
+            if (*end == '\\' && end[1])
+                end++;
+            buf[len++] = *end;
+        }
+        if (*end != '"')
+            return _expCompile_error(c, EXPERRCODE_SYNTAX, pos);
+        c->cp = end+1;
+        var = snmp_varlist_add_variable(&c->prog->consts, NULL, 0,
+                                        ASN_OCTET_STR, (u_char *)buf, len);
+        if (!var)
+            return _expCompile_error(c, EXPERRCODE_RESOURCE, pos);
+        return _expCompile_emit(c, EXP_INSN_CONSTANT, pos, 0, var);
     }
 
-    *expIdx->next_variable->next_variable->val.integer = param;
-    obj = (struct expObject *)
+    if (isdigit(*pos & 0xFF) ||
+        (*pos == '.' && isdigit(pos[1] & 0xFF))) {
+        n = strtol(pos, &ep, 10);
+        end = ep;
+        if (*pos != '.' && (*end != '.' || !isdigit(end[1] & 0xFF))) {
+            /*
+             * Integer constant
+             */
+            c->cp = end;
+            return _expCompile_emit(c, EXP_INSN_INTEGER, pos, n, NULL);
+        }
+        /*
+         * OID constant
+         */
+        end = (*pos == '.') ? pos+1 : pos;
+        for (i = 0; ; i++) {
+            if (i == MAX_OID_LEN)
+                return _expCompile_error(c, EXPERRCODE_SYNTAX, pos);
+            name[i] = strtoul(end, &ep, 10);
+            end = ep;
+            if (*end != '.' || !isdigit(end[1] & 0xFF))
+                break;
+            end++;
+        }
+        c->cp = end;
+        var = snmp_varlist_add_variable(&c->prog->consts, NULL, 0,
+                                        ASN_OBJECT_ID, (u_char *)name,
+                                        (i+1) * sizeof(oid));
+        if (!var)
+            return _expCompile_error(c, EXPERRCODE_RESOURCE, pos);
+        return _expCompile_emit(c, EXP_INSN_CONSTANT, pos, 0, var);
+    }
+
+    if (isalpha(*pos & 0xFF)) {
+        /*
+         * Function call.  The value type is set by expExpressionValueType,
+         *   so counter32() and counter64() just pass their argument through.
+         *   XXX - the other functions aren't implemented yet.
+         */
+        for (end = pos; isalnum(*end & 0xFF); end++)
+            ;
+        if (end - pos != 9 || (strncmp(pos, "counter32", 9) &&
+                               strncmp(pos, "counter64", 9))) {
+            DEBUGMSGTL(("disman:expr:compile", "Unsupported function '%.*s'\n",
+                        (int)(end - pos), pos));
+            return _expCompile_error(c, EXPERRCODE_FUNCTION, pos);
+        }
+        c->cp = end;
+        _expCompile_skip(c);
+        if (*c->cp != '(')
+            return _expCompile_error(c, EXPERRCODE_SYNTAX, c->cp);
+        c->cp++;
+        if (_expCompile_expr(c, 1) < 0)
+            return -1;
+        _expCompile_skip(c);
+        if (*c->cp != ')')
+            return _expCompile_error(c, EXPERRCODE_PARENTHESIS, pos);
+        c->cp++;
+        return 0;
+    }
+
+    /*
+     * A missing operand, or an unrecognised character
+     */
+    if (*pos == '\0' || *pos == ')' || _expCompile_operator(pos, &i))
+        return _expCompile_error(c, EXPERRCODE_SYNTAX, pos);
+    return _expCompile_error(c, EXPERRCODE_OPERATOR, pos);
+}
+
+static int
+_expCompile_unary( struct expCompiler *c )
+{
+    const char *pos;
+    int op, n;
+
+    _expCompile_skip(c);
+    pos = c->cp;
+    switch (*pos) {
+    case '-':
+        op = EXP_OPERATOR_SUBTRACT;
+        break;
+    case '~':
+        op = EXP_OPERATOR_BITNEGATE;
+        break;
+    case '!':
+        if (pos[1] != '=') {
+            op = EXP_OPERATOR_NOT;
+            break;
+        }
+        NETSNMP_FALLTHROUGH;
+    default:
+        return _expCompile_primary(c);
+    }
+    c->cp++;
+    n = c->prog->ninsns;
+    if (_expCompile_unary(c) < 0)
+        return -1;
+    if (op == EXP_OPERATOR_SUBTRACT && c->prog->ninsns == n+1 &&
+        c->prog->insns[n].code == EXP_INSN_INTEGER) {
+        /*
+         * Negative constant
+         */
+        c->prog->insns[n].value = -c->prog->insns[n].value;
+        c->prog->insns[n].pos   = pos - c->text + 1;
+        return 0;
+    }
+    return _expCompile_emit(c, EXP_INSN_UNARY, pos, op, NULL);
+}
+
+    /*
+     * Compile a (sub-)expression, stopping at the first
+     *   binary operator of lower priority.
+     */
+static int
+_expCompile_expr( struct expCompiler *c, int priority )
+{
+    const char *pos;
+    int op, len, p;
+
+    if (_expCompile_unary(c) < 0)
+        return -1;
+    for (;;) {
+        _expCompile_skip(c);
+        pos = c->cp;
+        op  = _expCompile_operator(pos, &len);
+        p   = _expCompile_priority(op);
+        if (!op || p < priority)
+            return 0;
+        c->cp += len;
+        if (_expCompile_expr(c, p+1) < 0 ||
+            _expCompile_emit(c, EXP_INSN_BINARY, pos, op, NULL) < 0)
+            return -1;
+    }
+}
+
+    /*
+     * Look up the expObject entries for the parameters of an expression
+     */
+static void
+_expValue_resolve( struct expExpression *exp, struct expProgram *prog )
+{
+    netsnmp_variable_list owner_var, name_var, param_var;
+    struct expParam *param;
+    int i;
+
+    memset(&owner_var, 0, sizeof(netsnmp_variable_list));
+    memset(&name_var,  0, sizeof(netsnmp_variable_list));
+    memset(&param_var, 0, sizeof(netsnmp_variable_list));
+    snmp_set_var_typed_value( &owner_var, ASN_OCTET_STR,
+                  (u_char*)exp->expOwner, strlen(exp->expOwner));
+    snmp_set_var_typed_value( &name_var,  ASN_OCTET_STR,
+                  (u_char*)exp->expName,  strlen(exp->expName));
+    owner_var.next_variable = &name_var;
+    name_var.next_variable  = &param_var;
+
+    for (i = 0; i < prog->nparams; i++) {
+        param = &prog->params[i];
+        snmp_set_var_typed_integer( &param_var, ASN_INTEGER, param->index );
+        param->obj = (struct expObject *)
                netsnmp_tdata_row_entry(
-                   netsnmp_tdata_row_get_byidx( expObject_table_data, expIdx ));
+                   netsnmp_tdata_row_get_byidx( expObject_table_data,
+                                                &owner_var ));
+        memset(&param->cursor, 0, sizeof(struct expCursor));
+    }
+    prog->serial = expObject_serial;
+}
+
+void
+expValue_compileExpression( struct expExpression *exp )
+{
+    struct expCompiler c;
+
+    if (!exp)
+        return;
+    expValue_freeExpression( exp );
+
+    memset(&c, 0, sizeof(c));
+    c.prog = SNMP_MALLOC_TYPEDEF( struct expProgram );
+    if (!c.prog)
+        return;
+    c.text = c.cp = exp->expExpression;
+    if (_expCompile_expr(&c, 1) == 0) {
+        /*
+         * Anything left over is an error
+         */
+        _expCompile_skip(&c);
+        if (*c.cp == ')')
+            _expCompile_error(&c, EXPERRCODE_PARENTHESIS, c.cp);
+        else if (*c.cp)
+            _expCompile_error(&c, EXPERRCODE_SYNTAX, c.cp);
+    }
+    _expValue_resolve( exp, c.prog );
+    exp->program = c.prog;
+    DEBUGMSGTL(("disman:expr:compile",
+                "(%s, %s): %d instructions, %d parameters, error %d\n",
+                exp->expOwner, exp->expName, c.prog->ninsns,
+                c.prog->nparams, c.prog->error));
+}
+
+void
+expValue_freeExpression( struct expExpression *exp )
+{
+    if (!exp || !exp->program)
+        return;
+    SNMP_FREE( exp->program->insns );
+    SNMP_FREE( exp->program->params );
+    snmp_free_varbind( exp->program->consts );
+    SNMP_FREE( exp->program );
+}
+
+
+    /* ===================================================
+     *
+     * Evaluating an expression
+     *
+     * =================================================== */
+
+static int
+_expValue_number( netsnmp_variable_list *var, long *value )
+{
+    if (!var->val.integer)
+        return 0;
+    switch (var->type) {
+    case ASN_INTEGER:
+    case ASN_COUNTER:
+    case ASN_GAUGE:
+    case ASN_TIMETICKS:
+    case ASN_UINTEGER:
+        *value = *var->val.integer;
+        return 1;
+    case ASN_COUNTER64:
+        *value = (long)(((u_long)var->val.counter64->high << 16 << 16) |
+                        var->val.counter64->low);
+        return 1;
+    }
+    return 0;
+}
+
+static void
+_expCursor_first( struct expObject *obj, struct expCursor *cur )
+{
+    memset(cur, 0, sizeof(struct expCursor));
+    cur->val = obj->vars;
+    if ( obj->expObjectSampleType != EXPSAMPLETYPE_ABSOLUTE )
+        cur->oval = obj->old_vars;
+    if ( obj->flags & EXP_OBJ_FLAG_DWILD ) {
+        cur->dd   = obj->dvars;
+        cur->odd  = obj->old_dvars;
+    }
+    if ( obj->flags & EXP_OBJ_FLAG_CWILD )
+        cur->cond = obj->cvars;
+}
+
+static void
+_expCursor_next( struct expCursor *cur )
+{
+    cur->val = cur->val->next_variable;
+    if (cur->oval)
+        cur->oval = cur->oval->next_variable;
+    if (cur->dd)
+        cur->dd   = cur->dd->next_variable;
+    if (cur->odd)
+        cur->odd  = cur->odd->next_variable;
+    if (cur->cond)
+        cur->cond = cur->cond->next_variable;
+}
+
+    /*
+     * Find the instance of a wildcarded object matching 'suffix'.
+     * This relies on the various varbind lists being set up with
+     *   exactly the same entries, so they can be walked in parallel.
+     * The search starts from the most recently used instance.
+     */
+static netsnmp_variable_list *
+_expValue_findInstance( struct expParam *param,
+                        oid *suffix, size_t suffix_len,
+                        struct expCursor *cur )
+{
+    struct expObject *obj = param->obj;
+    struct expCursor  start;
+    size_t n = obj->expObjectID_len;
+    int pass;
+
+    if (param->cursor.val && param->serial == obj->serial)
+        start = param->cursor;
+    else
+        _expCursor_first( obj, &start );
+
+    *cur = start;
+    for (pass = 0; pass < 2; pass++) {
+        for (; cur->val; _expCursor_next( cur )) {
+            if (pass && cur->val == start.val)
+                return NULL;
+            if (cur->val->name_length >= n &&
+                !snmp_oid_compare( cur->val->name+n, cur->val->name_length-n,
+                                   suffix, suffix_len )) {
+                param->cursor = *cur;
+                param->serial = obj->serial;
+                return cur->val;
+            }
+        }
+        _expCursor_first( obj, cur );
+    }
+    return NULL;
+}
+
+    /*
+     * Push the value of the specified object parameter,
+     * using the instance 'suffix' for wildcarded objects.
+     */
+static int
+_expValue_evalParam( struct expParam *param,
+                     oid *suffix, size_t suffix_len, struct expItem *item )
+{
+    struct expObject      *obj = param->obj;
+    struct expCursor       cur;
+    netsnmp_variable_list *val_var;
+    long old;
+
     if (!obj) {
         /*
          * No such parameter configured for this expression
          */
-        snmp_set_var_typed_integer( var, ASN_INTEGER, EXPERRCODE_INDEX );
-        var->type = ASN_NULL;
-        return var;
+        return EXPERRCODE_INDEX;
     }
     if ( obj->expObjectSampleType != EXPSAMPLETYPE_ABSOLUTE &&
          obj->old_vars == NULL ) {
         /*
          * Can't calculate delta values until the second pass
          */
-        snmp_set_var_typed_integer( var, ASN_INTEGER, EXPERRCODE_RESOURCE );
-        var->type = ASN_NULL;
-        return var;
+        return EXPERRCODE_RESOURCE;
     }
 
-
-    /*
-     * For a wildcarded object, search for the matching suffix.
-     */
-    val_var = obj->vars;
+    memset(&cur, 0, sizeof(cur));
     if ( obj->flags & EXP_OBJ_FLAG_OWILD ) {
         if ( !suffix ) {
             /*
-             * If there's no suffix to match against, throw an error.
              * An exact expression with a wildcarded object is invalid.
              *   XXX - Or just use first entry?
              */
-            snmp_set_var_typed_integer( var, ASN_INTEGER, EXPERRCODE_INDEX );
-            var->type = ASN_NULL;
-            return var;
-        }
-        /*
-         * Otherwise, we'll walk *all* wildcarded values in parallel.
-         * This relies on the various varbind lists being set up with
-         *   exactly the same entries.  A little extra preparation
-         *   during the data gathering simplifies things significantly!
-         */
-        if ( obj->expObjectSampleType != EXPSAMPLETYPE_ABSOLUTE )
-            oval_var = obj->old_vars;
-        if ( obj->flags & EXP_OBJ_FLAG_DWILD ) {
-            dd_var   = obj->dvars;
-            odd_var  = obj->old_dvars;
-        }
-        if ( obj->flags & EXP_OBJ_FLAG_CWILD )
-            cond_var = obj->cvars;
-       
-        n = obj->expObjectID_len;
-        while ( val_var ) {
-            if ( snmp_oid_compare( val_var->name+n, val_var->name_length-n,
-                                   suffix, suffix_len ))
-                break;
-            val_var = val_var->next_variable;
-            if (oval_var)
-                oval_var = oval_var->next_variable;
-            if (dd_var) {
-                dd_var   =  dd_var->next_variable;
-                odd_var  = odd_var->next_variable;
-            }
-            if (cond_var)
-                cond_var = cond_var->next_variable;
+            return EXPERRCODE_INDEX;
         }
-
-    }
+        val_var = _expValue_findInstance( param, suffix, suffix_len, &cur );
+    } else
+        val_var = obj->vars;
     if (!val_var) {
         /*
          * No matching entry
          */
-        snmp_set_var_typed_integer( var, ASN_INTEGER, EXPERRCODE_INDEX );
-        var->type = ASN_NULL;
-        return var;
+        return EXPERRCODE_INDEX;
     }
         /*
          * Set up any non-wildcarded values - some
          *   of which may be null. That's fine.
          */
-    if (!oval_var)
-        oval_var = obj->old_vars;
-    if (!dd_var) {
-        dd_var   = obj->dvars;
-        odd_var  = obj->old_dvars;
+    if (!cur.oval)
+        cur.oval = obj->old_vars;
+    if (!cur.dd) {
+        cur.dd   = obj->dvars;
+        cur.odd  = obj->old_dvars;
     }
-    if (!cond_var)
-        cond_var = obj->cvars;
-    
+    if (!cur.cond)
+        cur.cond = obj->cvars;
 
-    /*
-     * ... and return the appropriate value.
-     */
     if (obj->expObjCond_len &&
-        (!cond_var || *cond_var->val.integer == 0)) {
+        (!cur.cond || !cur.cond->val.integer || *cur.cond->val.integer == 0)) {
         /*
          * expObjectConditional says no
          */
-        snmp_set_var_typed_integer( var, ASN_INTEGER, EXPERRCODE_INDEX );
-        var->type = ASN_NULL;
-        return var;
+        return EXPERRCODE_INDEX;
     }
-    if (dd_var && odd_var &&
-        *dd_var->val.integer != *odd_var->val.integer) {
+    if (cur.dd && cur.odd && cur.dd->val.integer && cur.odd->val.integer &&
+        *cur.dd->val.integer != *cur.odd->val.integer) {
         /*
          * expObjectDeltaD says no
          */
-        snmp_set_var_typed_integer( var, ASN_INTEGER, EXPERRCODE_INDEX );
-        var->type = ASN_NULL;
-        return var;
+        return EXPERRCODE_INDEX;
     }
 
     /*
      * XXX - May need to check sysUpTime discontinuities
      *            (unless this is handled earlier....)
      */
+    item->var     = NULL;
+    item->numeric = 1;
     switch ( obj->expObjectSampleType ) {
     case EXPSAMPLETYPE_ABSOLUTE:
-        snmp_clone_var( val_var, var );
+        item->var     = val_var;
+        item->type    = val_var->type;
+        item->numeric = _expValue_number( val_var, &item->value );
         break;
     case EXPSAMPLETYPE_DELTA:
-        snmp_set_var_typed_integer( var, ASN_INTEGER /* or UNSIGNED? */,
-                              *val_var->val.integer - *oval_var->val.integer );
+        if (!cur.oval)
+            return EXPERRCODE_RESOURCE;
+        if (!_expValue_number( val_var, &item->value ) ||
+            !_expValue_number( cur.oval, &old ))
+            return EXPERRCODE_TYPE;
+        item->type  = ASN_INTEGER;  /* or UNSIGNED? */
+        item->value = (long)((u_long)item->value - (u_long)old);
         break;
     case EXPSAMPLETYPE_CHANGED:
-        if ( val_var->val_len != oval_var->val_len )
-            n = 1;
-        else if (memcmp( val_var->val.string, oval_var->val.string,
-                                               val_var->val_len ) != 0 )
-            n = 1;
-        else
-            n = 0;
-        snmp_set_var_typed_integer( var, ASN_UNSIGNED, n );
+        if (!cur.oval)
+            return EXPERRCODE_RESOURCE;
+        item->type  = ASN_UNSIGNED;
+        item->value = ( val_var->val_len != cur.oval->val_len ||
+                        memcmp( val_var->val.string, cur.oval->val.string,
+                                val_var->val_len ) != 0 );
+        break;
+    default:
+        return EXPERRCODE_TYPE;
     }
-    return var;
-}
-
-
-    /*
-     * Utility routine to parse (and skip over) an integer constant
-     */
-int
-_expParse_integer( char *start, char **end ) {
-    int n;
-    char *cp;
-
-    n = atoi(start);
-    for (cp=start; *cp; cp++)
-        if (!isdigit(*cp & 0xFF))
-            break;
-    *end = cp;
-    return n;
+    return 0;
 }
 
-netsnmp_variable_list *
-_expValue_evalOperator(netsnmp_variable_list *left, 
-                       netsnmp_variable_list *op, 
-                       netsnmp_variable_list *right) {
-    int n;
-
-    if (left->val.integer == NULL || right->val.integer == NULL) {
-	return right;
-    }
-    switch( *op->val.integer ) {
-    case EXP_OPERATOR_ADD:
-        n = *left->val.integer + *right->val.integer; break;
+static int
+_expValue_evalUnary( int op, struct expItem *item )
+{
+    if (!item->numeric)
+        return EXPERRCODE_TYPE;
+    switch (op) {
     case EXP_OPERATOR_SUBTRACT:
-        n = *left->val.integer - *right->val.integer; break;
-    case EXP_OPERATOR_MULTIPLY:
-        n = *left->val.integer * *right->val.integer; break;
-    case EXP_OPERATOR_DIVIDE:
-        n = *left->val.integer / *right->val.integer; break;
-    case EXP_OPERATOR_REMAINDER:
-        n = *left->val.integer % *right->val.integer; break;
-    case EXP_OPERATOR_BITXOR:
-        n = *left->val.integer ^ *right->val.integer; break;
+        item->value = (long)(0UL - (u_long)item->value); break;
     case EXP_OPERATOR_BITNEGATE:
-        n = 99; /* *left->val.integer ~ *right->val.integer; */ break;
-    case EXP_OPERATOR_BITOR:
-        n = *left->val.integer | *right->val.integer; break;
-    case EXP_OPERATOR_BITAND:
-        n = *left->val.integer & *right->val.integer; break;
+        item->value = ~item->value;                      break;
     case EXP_OPERATOR_NOT:
-        n = 99; /* *left->val.integer ! *right->val.integer; */ break;
-    case EXP_OPERATOR_LESS:
-        n = *left->val.integer < *right->val.integer; break;
-    case EXP_OPERATOR_GREAT:
-        n = *left->val.integer > *right->val.integer; break;
-    case EXP_OPERATOR_EQUAL:
-        n = *left->val.integer == *right->val.integer; break;
-    case EXP_OPERATOR_NOTEQ:
-        n = *left->val.integer != *right->val.integer; break;
-    case EXP_OPERATOR_LESSEQ:
-        n = *left->val.integer <= *right->val.integer; break;
-    case EXP_OPERATOR_GREATEQ:
-        n = *left->val.integer >= *right->val.integer; break;
-    case EXP_OPERATOR_OR:
-        n = *left->val.integer || *right->val.integer; break;
-    case EXP_OPERATOR_AND:
-        n = *left->val.integer && *right->val.integer; break;
-    case EXP_OPERATOR_LSHIFT:
-        n = *left->val.integer << *right->val.integer; break;
-    case EXP_OPERATOR_RSHIFT:
-        n = *left->val.integer >> *right->val.integer; break;
-        break;
+        item->value = !item->value;                      break;
     default:
-        left->next_variable = NULL;
-        snmp_free_var(left);
-        right->next_variable = NULL;
-        snmp_free_var(right);
-
-        snmp_set_var_typed_integer( op, ASN_INTEGER, EXPERRCODE_OPERATOR );
-        op->type = ASN_NULL;
-        return op;
+        return EXPERRCODE_OPERATOR;
     }
-
-    /* XXX */
-    left->next_variable = NULL;
-    snmp_free_var(left);
-    op->next_variable = NULL;
-    snmp_free_var(op);
-    snmp_set_var_typed_integer( right, ASN_INTEGER, n );
-    return right;
+    item->type = ASN_INTEGER;
+    item->var  = NULL;
+    return 0;
 }
 
-netsnmp_variable_list *
-_expValue_evalFunction(netsnmp_variable_list *func) {
-    netsnmp_variable_list *params = func->next_variable;
-    /* XXX */
-	func->next_variable = params->next_variable;
-    params->next_variable = NULL;
-    snmp_free_var(params);
-    snmp_set_var_typed_integer( func, ASN_INTEGER, 99 );
-    return func;
-}
-
-netsnmp_variable_list *_expValue_evalExpr2(netsnmp_variable_list *exprAlDente);
-netsnmp_variable_list *
-_expValue_evalExpr(  netsnmp_variable_list *expIdx,
-                     char *exprRaw, char **exprEnd,
-                     oid *suffix, size_t suffix_len )
+static int
+_expValue_evalOperator( int op, struct expItem *left, struct expItem *right )
 {
-    netsnmp_variable_list *exprAlDente = NULL;
-    netsnmp_variable_list *vtail = NULL;
-    char *cp1, *cp2;
-    netsnmp_variable_list *var = NULL;
-    int   i, n;
-    int   neg = 0;
-    oid   oid_buf[MAX_OID_LEN];
-
-    DEBUGMSGTL(("disman:expr:eval1", "Evaluating '%s'\n", exprRaw));
-    if (!expIdx || !exprRaw)
-        return NULL;
-
-    /*
-     * The expression is evaluated in two stages.
-     * First, we simplify ("parboil") the raw expression,
-     *   tokenizing it into a sequence of varbind values, inserting
-     *   object parameters, and (recursively) evaluating any
-     *   parenthesised sub-expressions or function arguments.
-     */
-
-    for (cp1=exprRaw; cp1 && *cp1; ) {
-        switch (*cp1) {
-        case '$':
-            /*
-             * Locate the appropriate instance of the specified
-             * parameter, and insert the corresponding value.
-             */
-            n   = _expParse_integer( cp1+1, &cp1 );
-            var = _expValue_evalParam( expIdx, n, suffix, suffix_len );
-            if ( var && var->type == ASN_NULL ) {
-                DEBUGMSGTL(("disman:expr:eval", "Invalid parameter '%d'\n", n));
-                /* Note position of failure in expression */
-                var->data = (void *)(cp1 - exprRaw);
-                snmp_free_var(exprAlDente);
-		*exprEnd = cp1;
-                return var;
-            } else {
-                if (vtail)
-                   vtail->next_variable = var;
-                else
-                   exprAlDente = var;
-                vtail = var;
-                var   = NULL;
-            }
-            break;
-        case '(':
-            /*
-             * Recursively evaluate the sub-expression
-             */
-            var = _expValue_evalExpr( expIdx, cp1+1, &cp2,
-                                      suffix, suffix_len );
-            if ( var && var->type == ASN_NULL ) {
-                /* Adjust position of failure */
-                var->data = (void *)(cp1 - exprRaw + (uintptr_t)var->data);
-                return var;
-            } else if (*cp2 != ')') {
-                snmp_free_var(exprAlDente);
-                DEBUGMSGTL(("disman:expr:eval", "Unbalanced parenthesis\n"));
-                snmp_set_var_typed_integer( var, ASN_INTEGER,
-                                            EXPERRCODE_PARENTHESIS );
-                var->type = ASN_NULL;
-                var->data = (void *)(cp2 - exprRaw);
-		*exprEnd = cp1;
-                return var;
-            } else {
-                if (vtail)
-                   vtail->next_variable = var;
-                else
-                   exprAlDente = var;
-                vtail = var;
-                var   = NULL;
-                cp1   = cp2+1;   /* Skip to end of sub-expression */
-            }
-            break;
-        case ')':
-        case ',':
-            /*
-             * End of current (sub-)expression
-             * Note the end-position, and evaluate
-             *  the parboiled list of tokens.
-             */
-            *exprEnd = cp1;
-            var = _expValue_evalExpr2( exprAlDente );
-            return var;
-
-            /* === Constants === */
-        case '.':   /* OID */
-            i = 0;
-            memset( oid_buf, 0, sizeof(oid_buf));
-            while ( cp1 && *cp1 == '.' ) {
-                n = _expParse_integer( cp1+1, &cp2 );
-OID:
-                oid_buf[i++] = n;
-                cp1 = cp2;
-            }
-            var = snmp_varlist_add_variable( &exprAlDente, NULL, 0,
-                                             ASN_OBJECT_ID,
-                                             (u_char*)oid_buf, i*sizeof(oid));
-            break;
-DIGIT:
-        case '0':
-        case '1':
-        case '2':
-        case '3':
-        case '4':
-        case '5':
-        case '6':
-        case '7':
-        case '8':
-        case '9':
-            n = _expParse_integer( cp1, &cp2 );
-            if ( cp2 && *cp2 == '.' ) {
-                i = 0;
-                memset( oid_buf, 0, sizeof(oid_buf));
-                goto OID;
-            }
-            if ( neg )
-                n = -n;
-            var = snmp_varlist_add_variable( &exprAlDente, NULL, 0,
-                                             ASN_INTEGER,
-                                             (u_char*)&n, sizeof(n));
-            vtail = var;
-            var   = NULL;
-            neg   = 0;
-            cp1   = cp2;
-            break;
-
-        case '"':   /* String Constant */
-            for ( cp2 = cp1+1; *cp2; cp2++ ) {
-                if ( *cp2 == '"' )
-                    break;
-                if ( *cp2 == '\\' && *(cp2+1) == '"' )
-                    cp2++;
-            }
-            if ( *cp2 != '"' ) {
-                /*
-                 * Unterminated string
-                 */
-                DEBUGMSGTL(("disman:expr:eval", "Unterminated string\n"));
-                snmp_set_var_typed_integer( var, ASN_INTEGER,
-                                            EXPERRCODE_SYNTAX );
-                var->type = ASN_NULL;
-                var->data = (void *)(cp2 - exprRaw);
-                return var;
-            }
-            n = cp2 - cp1;  
-            var = snmp_varlist_add_variable( &exprAlDente, NULL, 0,
-                                             ASN_OCTET_STR,
-                                             (u_char*)cp1+1, n);
-            vtail = var;
-            var   = NULL;
-            break;
+    long   l = left->value, r = right->value;
+    u_long ul = l, ur = r;
+    netsnmp_variable_list *lv = left->var, *rv = right->var;
 
-
-            /* === Operators === */
-        case '-':
-            /*
-             * Could be a unary minus....
-             */
-            if (!vtail || vtail->type == ASN_PRIV_OPERATOR) {
-                neg = 1;
-                goto DIGIT;
-            }
-            /* 
-             * ... or a (single-character) binary operator.
-             */
-            NETSNMP_FALLTHROUGH;
-        case '+':
-        case '*':
-        case '/':
-        case '%':
-        case '^':
-        case '~':
-            if ( !vtail ) {
-                /*
-                 * Can't start an expression with a binary operator
-                 */
-                DEBUGMSGTL(("disman:expr:eval", "Initial binary operator\n"));
-                snmp_set_var_typed_integer( var, ASN_INTEGER,
-                                            EXPERRCODE_SYNTAX );
-                var->type = ASN_NULL;
-                var->data = (void *)(cp1 - exprRaw);
-		*exprEnd = cp1;
-                return var;
-            }
-            n = ops[ *cp1 & 0xFF ];
-            DEBUGMSGTL(("disman:expr:eval", "Binary operator %c (%d)\n", *cp1, n));
-            var = snmp_varlist_add_variable( &exprAlDente, NULL, 0,
-                                             ASN_INTEGER,
-                                             (u_char*)&n, sizeof(n));
-            var->type = ASN_PRIV_OPERATOR;
-            vtail = var;
-            cp1++;
-            break;
-
-            /* 
-             * Multi-character binary operators
-             */
-        case '&':
-        case '|':
-        case '!':
-        case '>':
-        case '<':
-        case '=':
-            if ( !vtail ) {
-                /*
-                 * Can't start an expression with a binary operator
-                 */
-                DEBUGMSGTL(("disman:expr:eval", "Initial binary operator\n"));
-                snmp_set_var_typed_integer( var, ASN_INTEGER,
-                                            EXPERRCODE_SYNTAX );
-                var->type = ASN_NULL;
-                var->data = (void *)(cp1 - exprRaw);
-		*exprEnd = cp1;
-                return var;
-            }
-            if ( *(cp1+1) == '=' )
-                n = ops[ *cp1++ + 20];
-            else if ( *(cp1+1) == *cp1 )
-                n = ops[ *cp1++ - 30];
-            else
-                n = ops[ *cp1 & 0xFF ];
-            var = snmp_varlist_add_variable( &exprAlDente, NULL, 0,
-                                             ASN_INTEGER,
-                                             (u_char*)&n, sizeof(n));
-            var->type = ASN_PRIV_OPERATOR;
-            vtail = var;
-            cp1++;
-            break;
-
-            /* === Functions === */
-        case 'a':    /* average/arraySection */
-        case 'c':    /* counter32/counter64  */
-        case 'e':    /*    exists            */
-        case 'm':    /* maximum/minimum      */
-        case 'o':    /* oidBegins/Ends/Contains    */
-        case 's':    /* sum / string{B,E,C}  */
-            var = snmp_varlist_add_variable( &exprAlDente, NULL, 0,
-                                             ASN_OCTET_STR,
-                                             (u_char*)cp1, 3 );
-                                                   /* XXX */
-            var->type = ASN_PRIV_FUNCTION;
-            vtail = var;
-            while (*cp1 >= 'a' && *cp1 <= 'z')
-              cp1++;
-            break;
-
-        default:
-            if (isalpha( *cp1 & 0xFF )) {
-                /*
-                 * Unrecognised function call ?
-                 */
-                DEBUGMSGTL(("disman:expr:eval", "Unrecognised function '%s'\n", cp1));
-                snmp_set_var_typed_integer( var, ASN_INTEGER,
-                                            EXPERRCODE_FUNCTION );
-                var->type = ASN_NULL;
-                var->data = (void *)(cp1 - exprRaw);
-		*exprEnd = cp1;
-                return var;
-            }
-            else if (!isspace( *cp1 & 0xFF )) {
-                /*
-                 * Unrecognised operator ?
-                 */
-                DEBUGMSGTL(("disman:expr:eval", "Unrecognised operator '%c'\n", *cp1));
-                snmp_set_var_typed_integer( var, ASN_INTEGER,
-                                            EXPERRCODE_OPERATOR );
-                var->type = ASN_NULL;
-                var->data = (void *)(cp1 - exprRaw);
-		*exprEnd = cp1;
-                return var;
-            }
-            cp1++;
-            break;
-        }
+    if (!left->numeric || !right->numeric) {
+        /*
+         * Strings and OIDs can only be compared for equality
+         */
+        if ((op != EXP_OPERATOR_EQUAL && op != EXP_OPERATOR_NOTEQ) ||
+            left->numeric || right->numeric || !lv || !rv)
+            return EXPERRCODE_TYPE;
+        l = ( lv->type == rv->type && lv->val_len == rv->val_len &&
+              memcmp( lv->val.string, rv->val.string, lv->val_len ) == 0 );
+        if (op == EXP_OPERATOR_NOTEQ)
+            l = !l;
+    } else switch (op) {
+    case EXP_OPERATOR_ADD:       l = (long)(ul + ur);   break;
+    case EXP_OPERATOR_SUBTRACT:  l = (long)(ul - ur);   break;
+    case EXP_OPERATOR_MULTIPLY:  l = (long)(ul * ur);   break;
+    case EXP_OPERATOR_DIVIDE:
+    case EXP_OPERATOR_REMAINDER:
+        if (r == 0)
+            return EXPERRCODE_DIVZERO;
+        if (r == -1)    /* avoid overflow */
+            l = (op == EXP_OPERATOR_DIVIDE) ? (long)(0UL - ul) : 0;
+        else
+            l = (op == EXP_OPERATOR_DIVIDE) ? l / r : l % r;
+        break;
+    case EXP_OPERATOR_BITXOR:    l = l ^ r;             break;
+    case EXP_OPERATOR_BITOR:     l = l | r;             break;
+    case EXP_OPERATOR_BITAND:    l = l & r;             break;
+    case EXP_OPERATOR_LESS:      l = l <  r;            break;
+    case EXP_OPERATOR_GREAT:     l = l >  r;            break;
+    case EXP_OPERATOR_EQUAL:     l = l == r;            break;
+    case EXP_OPERATOR_NOTEQ:     l = l != r;            break;
+    case EXP_OPERATOR_LESSEQ:    l = l <= r;            break;
+    case EXP_OPERATOR_GREATEQ:   l = l >= r;            break;
+    case EXP_OPERATOR_OR:        l = l || r;            break;
+    case EXP_OPERATOR_AND:       l = l && r;            break;
+    case EXP_OPERATOR_LSHIFT:
+    case EXP_OPERATOR_RSHIFT:
+        if (r < 0 || r >= (long)(8 * sizeof(long)))
+            l = (op == EXP_OPERATOR_RSHIFT && l < 0) ? -1 : 0;
+        else
+            l = (op == EXP_OPERATOR_LSHIFT) ? (long)(ul << r) : l >> r;
+        break;
+    default:
+        return EXPERRCODE_OPERATOR;
     }
-
-    /*
-     * ... then we evaluate the resulting simplified ("al dente")
-     *   expression, in the usual manner.
-     */
-    *exprEnd = cp1;
-    var = _expValue_evalExpr2( exprAlDente );
-    DEBUGMSGTL(( "disman:expr:eval1", "Evaluated to "));
-    DEBUGMSGVAR(("disman:expr:eval1", var));
-    DEBUGMSG((   "disman:expr:eval1", "\n"));
-/*  snmp_free_var(exprAlDente); XXX - Crashes */
-    return var;
+    left->value   = l;
+    left->type    = ASN_INTEGER;
+    left->numeric = 1;
+    left->var     = NULL;
+    return 0;
 }
 
-netsnmp_variable_list *
-_expValue_evalExpr2( netsnmp_variable_list *exprAlD )
+static void
+_expValue_setError( struct expExpression *exp, int reason, int index,
+                    oid *suffix, size_t suffix_len )
 {
-    netsnmp_variable_list *stack = NULL;
-    netsnmp_variable_list *lval, *rval, *op;
-    netsnmp_variable_list *vp, *vp1  = NULL;
-
-    DEBUGIF(( "disman:expr:eval2")) {
-        for (vp = exprAlD; vp; vp=vp->next_variable) {
-            if ( vp->type == ASN_PRIV_OPERATOR )
-                DEBUGMSGTL(( "disman:expr:eval2", "Operator %ld\n",
-                                                  *vp->val.integer));
-            else if ( vp->type == ASN_PRIV_FUNCTION )
-                DEBUGMSGTL(( "disman:expr:eval2", "Function %s\n",
-                                                   vp->val.string));
-            else {
-                DEBUGMSGTL(( "disman:expr:eval2", "Operand "));
-                DEBUGMSGVAR(("disman:expr:eval2", vp));
-                DEBUGMSG((   "disman:expr:eval2", "\n"));
-            }
-        }
-    }
-    
-    for (vp = exprAlD; vp; vp=vp1) {
-        vp1 = vp->next_variable;
-        if ( vp->type == ASN_PRIV_OPERATOR ) {
-            /* Must *always* follow a value */
-            if ( !stack || stack->type == ASN_PRIV_OPERATOR ) {
-                snmp_set_var_typed_integer( vp, ASN_INTEGER,
-                                            EXPERRCODE_SYNTAX );
-                vp->type = ASN_NULL;
-                snmp_free_var( stack );
-                return vp;
-            }
-            /*
-             * Evaluate any higher priority operators
-             *  already on the stack....
-             */
-            while ( stack->next_variable &&
-                    stack->next_variable->type == ASN_PRIV_OPERATOR &&
-                  (*stack->next_variable->val.integer > *vp->val.integer)) {
-                 rval = stack;
-                 op   = stack->next_variable;
-                 lval = op->next_variable;
-                 stack = lval->next_variable;
-
-                 rval = _expValue_evalOperator( lval, op, rval );
-                 rval->next_variable = stack;
-                 stack = rval;
-            }
-            /*
-             * ... and then push this operator onto the stack.
-             */
-            vp->next_variable = stack;
-            stack = vp;
-        } else if ( vp->type == ASN_PRIV_FUNCTION ) {
-            /* Must be first, or follow an operator */
-            if ( stack && stack->type != ASN_PRIV_OPERATOR ) {
-                snmp_set_var_typed_integer( vp, ASN_INTEGER,
-                                            EXPERRCODE_SYNTAX );
-                vp->type = ASN_NULL;
-                snmp_free_var( stack );
-                return vp;
-            }
-            /*
-             * Evaluate this function (consuming the
-             *   appropriate parameters from the token 
-             *   list), and push the result onto the stack.
-             */
-            vp = _expValue_evalFunction( vp );
-            vp1 = vp->next_variable;
-            vp->next_variable = stack;
-            stack = vp;
-        } else {
-            /* Must be first, or follow an operator */
-            if ( stack && stack->type != ASN_PRIV_OPERATOR ) {
-                snmp_set_var_typed_integer( vp, ASN_INTEGER,
-                                            EXPERRCODE_SYNTAX );
-                vp->type = ASN_NULL;
-                snmp_free_var( stack );
-                return vp;
-            }
-            /*
-             * Push this value onto the stack
-             */
-            vp->next_variable = stack;
-            stack = vp;
-        }
-    }
-
-    /*
-     * Now evaluate whatever's left on the stack
-     *   and return the final result.
-     */
-    while ( stack && stack->next_variable ) {
-        rval = stack;
-        op   = stack->next_variable;
-        lval = op->next_variable;
-        stack = lval->next_variable;
-
-        rval = _expValue_evalOperator( lval, op, rval );
-        rval->next_variable = stack;
-        stack = rval;
-    }
-    return stack;
+    if (!exp)
+        return;
+    DEBUGMSGTL(("disman:expr:eval", "(%s, %s): error %d at %d\n",
+                exp->expOwner, exp->expName, reason, index));
+    exp->expErrorCount++;
+ /* exp->expErrorTime  = NOW; */
+    exp->expErrorIndex = index;
+    exp->expErrorCode  = reason;
+    memset( exp->expErrorInstance, 0, sizeof(exp->expErrorInstance));
+    memcpy( exp->expErrorInstance, suffix, suffix_len * sizeof(oid));
+    exp->expErrorInst_len = suffix_len;
 }
 
 /* =============
@@ -737,11 +832,11 @@ netsnmp_variable_list *
 expValue_evaluateExpression( struct expExpression *exp,
                              oid *suffix, size_t suffix_len )
 {
-    char exprRaw[     EXP_STR3_LEN+1 ];
+    struct expItem     stack[ EXP_STACK_DEPTH ];
+    struct expProgram *prog;
+    struct expInsn    *insn = NULL;
     netsnmp_variable_list *var;
-    netsnmp_variable_list owner_var, name_var, param_var;
-    int n;
-    char *cp;
+    int i, sp = 0, err = 0;
 
     if (!exp)
         return NULL;
@@ -752,82 +847,77 @@ expValue_evaluateExpression( struct expExpression *exp,
      */
     expExpression_getData(0, exp);
 
-    /* 
-     * Set up a varbind list containing the various index values
-     *   (including a placeholder for expObjectIndex).
-     *
-     * This saves having to construct the same index list repeatedly
-     */
-    memset(&owner_var, 0, sizeof(netsnmp_variable_list));
-    memset(&name_var,  0, sizeof(netsnmp_variable_list));
-    memset(&param_var, 0, sizeof(netsnmp_variable_list));
-    snmp_set_var_typed_value( &owner_var, ASN_OCTET_STR,
-                  (u_char*)exp->expOwner, strlen(exp->expOwner));
-    snmp_set_var_typed_value( &name_var,  ASN_OCTET_STR,
-                  (u_char*)exp->expName,  strlen(exp->expName));
-    n = 99; /* dummy value */
-    snmp_set_var_typed_value( &param_var, ASN_INTEGER,
-                             (u_char*)&n, sizeof(n));
-    owner_var.next_variable = &name_var;
-    name_var.next_variable  = &param_var;
-
-    /*
-     * Make a working copy of the expression, and evaluate it.
-     */
-    memset(exprRaw, 0,                  sizeof(exprRaw));
-    memcpy(exprRaw, exp->expExpression, sizeof(exprRaw));
+    if (!exp->program)
+        expValue_compileExpression( exp );
+    prog = exp->program;
+    if (!prog) {
+        _expValue_setError( exp, EXPERRCODE_RESOURCE, 0, suffix, suffix_len );
+        return NULL;
+    }
+    if (prog->error) {
+        _expValue_setError( exp, prog->error, prog->errpos,
+                            suffix, suffix_len );
+        return NULL;
+    }
+    if (prog->serial != expObject_serial)
+        _expValue_resolve( exp, prog );
 
-    var = _expValue_evalExpr( &owner_var, exprRaw, &cp, suffix, suffix_len );
     /*
-     * Check for any problems, and record the appropriate error
+     * Run through the compiled expression
+     *   (the compiler has checked the stack depth)
      */
-    if (!cp || *cp != '\0') {
-        /*
-         * When we had finished, there was a lot
-         * of bricks^Wcharacters left over....
-         */
-        _expValue_setError( exp, EXPERRCODE_SYNTAX, suffix, suffix_len, var );
-        return NULL;
+    for (i = 0; i < prog->ninsns && !err; i++) {
+        insn = &prog->insns[i];
+        switch (insn->code) {
+        case EXP_INSN_INTEGER:
+            stack[sp].value   = insn->value;
+            stack[sp].type    = ASN_INTEGER;
+            stack[sp].numeric = 1;
+            stack[sp].var     = NULL;
+            sp++;
+            break;
+        case EXP_INSN_CONSTANT:
+            stack[sp].value   = 0;
+            stack[sp].type    = insn->var->type;
+            stack[sp].numeric = 0;
+            stack[sp].var     = insn->var;
+            sp++;
+            break;
+        case EXP_INSN_PARAM:
+            err = _expValue_evalParam( &prog->params[ insn->value ],
+                                       suffix, suffix_len, &stack[sp++] );
+            break;
+        case EXP_INSN_UNARY:
+            err = _expValue_evalUnary( insn->value, &stack[sp-1] );
+            break;
+        case EXP_INSN_BINARY:
+            sp--;
+            err = _expValue_evalOperator( insn->value,
+                                          &stack[sp-1], &stack[sp] );
+            break;
+        }
     }
-    if (!var) {
-        /* Shouldn't happen */
-        _expValue_setError( exp, EXPERRCODE_RESOURCE, suffix, suffix_len, NULL );
+    if (err) {
+        _expValue_setError( exp, err, insn->pos, suffix, suffix_len );
         return NULL;
     }
-    if (var->type == ASN_NULL) {
-        /*
-         * Error explicitly reported from the evaluation routines.
-         */
-        _expValue_setError( exp, *(var->val.integer), suffix, suffix_len, var );
+    if (sp != 1) {
+        /* Shouldn't happen */
+        _expValue_setError( exp, EXPERRCODE_RESOURCE, 0, suffix, suffix_len );
         return NULL;
     }
-    if (0 /* COMPARE var->type WITH exp->expValueType */ ) {
-        /*
-         * XXX - Check to see whether the returned type (ASN_XXX)
-         *       is compatible with the requested type (an enum)
-         */
 
-        /* If not, throw an error */
-        _expValue_setError( exp, EXPERRCODE_TYPE, suffix, suffix_len, var );
+    var = SNMP_MALLOC_TYPEDEF( netsnmp_variable_list );
+    if (!var) {
+        _expValue_setError( exp, EXPERRCODE_RESOURCE, 0, suffix, suffix_len );
         return NULL;
     }
+    if (stack[0].var)
+        snmp_clone_var( stack[0].var, var );
+    else
+        snmp_set_var_typed_integer( var, stack[0].type, stack[0].value );
+    DEBUGMSGTL(( "disman:expr:eval1", "Evaluated to "));
+    DEBUGMSGVAR(("disman:expr:eval1", var));
+    DEBUGMSG((   "disman:expr:eval1", "\n"));
     return var;
 }
-
-void
-_expValue_setError( struct expExpression *exp, int reason,
-                    oid *suffix, size_t suffix_len,
-                    netsnmp_variable_list *var)
-{
-    if (!exp)
-        return;
-    exp->expErrorCount++;
- /* exp->expErrorTime  = NOW; */
-    exp->expErrorIndex = ( var && var->data ? (uintptr_t)var->data : 0 );
-    exp->expErrorCode  = reason;
-    memset( exp->expErrorInstance, 0, sizeof(exp->expErrorInstance));
-    memcpy( exp->expErrorInstance, suffix, suffix_len * sizeof(oid));
-    exp->expErrorInst_len = suffix_len;
-    if (var) var->data = NULL;
-    snmp_free_var( var );
-}
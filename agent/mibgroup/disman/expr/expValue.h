@@ -5,6 +5,8 @@
 #include "disman/expr/expExpression.h"
 
 void              init_expValue(void);
+void              expValue_compileExpression( struct expExpression *exp );
+void              expValue_freeExpression(    struct expExpression *exp );
 netsnmp_variable_list *
 expValue_evaluateExpression( struct expExpression *exp,
                              oid *suffix, size_t suffix_len );
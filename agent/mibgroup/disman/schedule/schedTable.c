@@ -50,6 +50,9 @@ init_schedTable(void)
                                             schedTable_oid,
                                             schedTable_oid_len,
                                             HANDLER_CAN_RWRITE);
+    /* each column is read straight from the entry, so GETBULK can batch */
+    if (reg)
+        reg->handler->flags |= MIB_HANDLER_BULK_CELLS;
 
     table_info = SNMP_MALLOC_TYPEDEF(netsnmp_table_registration_info);
     netsnmp_table_helper_add_indexes(table_info,
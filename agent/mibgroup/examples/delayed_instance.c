@@ -73,9 +73,9 @@ delayed_instance_handler(netsnmp_mib_handler *handler,
     default:
         /*
          * mark this variable as something that can't be handled now.
-         * We'll answer it later. 
+         * We'll answer it later, and tell the agent when we have. 
          */
-        requests->delegated = 1;
+        netsnmp_request_delegate(requests);
 
         /*
          * register an alarm to update the results at a later
@@ -146,9 +146,10 @@ return_delayed_response(unsigned int clientreg, void *clientarg)
 
     /*
      * mention that it's no longer delegated, and we've now answered
-     * the query (which we'll do down below). 
+     * the query (which we'll do down below).  The agent picks the
+     * request up again once we return. 
      */
-    requests->delegated = 0;
+    netsnmp_request_completed(requests);
 
     switch (cache->reqinfo->mode) {
         /*
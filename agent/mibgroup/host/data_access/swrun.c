@@ -24,6 +24,8 @@
 #include <pcre.h>
 #endif
 
+netsnmp_feature_require(container_merge);
+
 netsnmp_feature_child_of(software_running, libnetsnmpmibs);
 
 netsnmp_feature_child_of(swrun_max_processes, software_running);
@@ -43,6 +45,11 @@ static netsnmp_container *swrun_container = NULL;
  * local static prototypes
  */
 static void _swrun_entry_release(void* entry, void *unused);
+static int  _swrun_entry_update(void *live, void *fresh, void *unused);
+
+static const netsnmp_container_merge_ops _swrun_merge_ops = {
+    _swrun_entry_update, NULL, _swrun_entry_release, _swrun_entry_release
+};
 
 /**
  * initialization
@@ -179,7 +186,31 @@ swrun_count_processes_by_name( char *name )
 static int
 _cache_load( netsnmp_cache *cache,  void *magic )
 {
-    netsnmp_swrun_container_load( swrun_container, 0 );
+    netsnmp_container *fresh;
+
+    /*
+     * load into a scratch container, then merge the results into the
+     * live container, so that entries for processes which are still
+     * running are kept (and only updated) instead of being reallocated.
+     */
+    fresh = netsnmp_container_find("swrun_load:table_container");
+    if (NULL == fresh) {
+        snmp_log(LOG_ERR, "could not create swrun load container\n");
+        return -1;
+    }
+    fresh->container_name = strdup("swrun load container");
+    if (NULL == netsnmp_swrun_container_load(fresh,
+                                             NETSNMP_SWRUN_ALL_OR_NONE)) {
+        /*
+         * keep the current table rather than merging an empty one
+         */
+        netsnmp_swrun_container_free(fresh, NETSNMP_SWRUN_NOFLAGS);
+        return -1;
+    }
+    if (0 != netsnmp_container_merge(swrun_container, fresh,
+                                     &_swrun_merge_ops, NULL, NULL))
+        netsnmp_swrun_container_free_items(fresh);
+    netsnmp_swrun_container_free(fresh, NETSNMP_SWRUN_DONT_FREE_ITEMS);
     return 0;
 }
 
@@ -204,7 +235,9 @@ netsnmp_swrun_cache(void)
                            _cache_load,  _cache_free,
                            hrSWRunTable_oid, hrSWRunTable_oid_len);
         if (swrun_cache)
-            swrun_cache->flags = NETSNMP_CACHE_DONT_INVALIDATE_ON_SET;
+            swrun_cache->flags = NETSNMP_CACHE_DONT_INVALIDATE_ON_SET |
+                                 NETSNMP_CACHE_DONT_FREE_BEFORE_LOAD |
+                                 NETSNMP_CACHE_DONT_FREE_EXPIRED;
     }
     return swrun_cache;
 }
@@ -244,7 +277,8 @@ netsnmp_swrun_container(void)
  * @param load_flags flags to modify behaviour. Examples:
  *                   NETSNMP_SWRUN_ALL_OR_NONE
  *
- * @retval NULL  error
+ * @retval NULL  error. With NETSNMP_SWRUN_ALL_OR_NONE, a container
+ *               passed in is emptied but not freed.
  * @retval !NULL pointer to container
  */
 netsnmp_container*
@@ -273,6 +307,7 @@ netsnmp_swrun_container_load(netsnmp_container* user_container, u_int load_flags
             DEBUGMSGTL(("swrun:container:load",
                         " discarding partial results\n"));
             netsnmp_swrun_container_free_items(container);
+            container = NULL;
         }
     }
 
@@ -386,6 +421,47 @@ _swrun_entry_release(void *entry, void *context)
     netsnmp_swrun_entry_free(entry);
 }
 
+/**
+ * merge callback: copy column values from a freshly loaded entry.
+ * hrSWRunIndex and hrSWRunID identify the process and do not change
+ * while it runs, so only the other columns are compared.
+ */
+static int
+_swrun_entry_update(void *live, void *fresh, void *unused)
+{
+    netsnmp_swrun_entry *old_entry = live, *new_entry = fresh;
+    int changed = 0;
+
+#define SWRUN_UPDATE(f) do {                                            \
+        if (old_entry->f != new_entry->f) {                             \
+            old_entry->f = new_entry->f;                                \
+            changed = 1;                                                \
+        }                                                               \
+    } while (0)
+#define SWRUN_UPDATE_STRING(f) do {                                     \
+        if (old_entry->f##_len != new_entry->f##_len ||                 \
+            memcmp(old_entry->f, new_entry->f, new_entry->f##_len)) {   \
+            memcpy(old_entry->f, new_entry->f, new_entry->f##_len);     \
+            old_entry->f[new_entry->f##_len] = '\0';                    \
+            old_entry->f##_len = new_entry->f##_len;                    \
+            changed = 1;                                                \
+        }                                                               \
+    } while (0)
+
+    SWRUN_UPDATE_STRING(hrSWRunName);
+    SWRUN_UPDATE_STRING(hrSWRunPath);
+    SWRUN_UPDATE_STRING(hrSWRunParameters);
+    SWRUN_UPDATE(hrSWRunType);
+    SWRUN_UPDATE(hrSWRunStatus);
+    SWRUN_UPDATE(hrSWRunPerfCPU);
+    SWRUN_UPDATE(hrSWRunPerfMem);
+
+#undef SWRUN_UPDATE_STRING
+#undef SWRUN_UPDATE
+
+    return changed;
+}
+
 
 #ifdef TEST
 int main(int argc, char *argv[])
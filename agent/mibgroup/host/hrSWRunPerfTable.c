@@ -64,6 +64,8 @@ initialize_table_hrSWRunPerfTable(void)
                  MYTABLE "\n");
         goto bail;
     }
+    /* cells are independent, let container_table batch GETBULK rows */
+    reg->handler->flags |= MIB_HANDLER_BULK_CELLS;
 
     table_info = SNMP_MALLOC_TYPEDEF(netsnmp_table_registration_info);
     if (NULL == table_info) {
@@ -15,15 +15,11 @@
 #include <net-snmp/agent/ds_agent.h>
 #include <net-snmp/agent/instance.h>
 #include <net-snmp/agent/table.h>
-#include <net-snmp/agent/table_data.h>
-#include <net-snmp/agent/table_dataset.h>
 #include "net-snmp/agent/sysORTable.h"
 #include "notification_log.h"
 
 netsnmp_feature_require(register_ulong_instance_context);
 netsnmp_feature_require(register_read_only_counter32_instance_context);
-netsnmp_feature_require(delete_table_data_set);
-netsnmp_feature_require(table_dataset);
 netsnmp_feature_require(date_n_time);
 
 /*
@@ -62,68 +58,90 @@ static u_long   num_deleted = 0;
 static u_long   max_logged = 1000;      /* goes against the mib default of infinite */
 static u_long   max_age = 1440; /* 1440 = 24 hours, which is the mib default */
 
-static netsnmp_table_data_set *nlmLogTable;
-static netsnmp_table_data_set *nlmLogVarTable;
+static netsnmp_handler_registration *nlmLogTable_reg;
+static netsnmp_handler_registration *nlmLogVarTable_reg;
 
 static oid nlm_module_oid[] = { SNMP_OID_MIB2, 92 }; /* NOTIFICATION-LOG-MIB::notificationLogMIB */
 
+/*
+ * Only the "default" log is kept: nlmLogName as an index.
+ */
+static const oid nlm_default_name[] = { 7, 'd', 'e', 'f', 'a', 'u', 'l', 't' };
+#define NLM_NAME_LEN OID_LENGTH(nlm_default_name)
+
+/*
+ * Each logged notification is a single allocation: the fixed
+ * nlmLogTable columns, followed by the variable length ones and the
+ * (supported) varbinds, packed back to back.
+ */
+struct nlm_record {
+    u_long          index;          /* nlmLogIndex */
+    u_long          time;           /* nlmLogTime */
+    u_char          date[11];       /* nlmLogDateAndTime */
+    u_char          date_len;
+    u_char          taddr[6];       /* nlmLogEngineTAddress, if UDP */
+    u_char          taddr_len;
+    u_char          has_domain;     /* nlmLogEngineTDomain */
+    u_short         domain_len;     /* subids */
+    u_short         notifid_len;    /* subids, 0 if no snmpTrapOID */
+    u_short         engineid_len;
+    u_short         ctxengine_len;
+    u_short         ctxname_len;
+    u_short         vbcount;
+};
+
+struct nlm_varbind {
+    u_short         index;          /* nlmLogVariableIndex */
+    u_short         name_len;       /* subids */
+    u_char          type;
+    u_int           val_len;
+};
+
+#define NLM_ALIGN(n) (((n) + sizeof(u_long) - 1) & ~(sizeof(u_long) - 1))
+
+#define NLM_DOMAIN(r)    ((oid *)((u_char *)(r) + \
+                                  NLM_ALIGN(sizeof(struct nlm_record))))
+#define NLM_NOTIFID(r)   (NLM_DOMAIN(r) + (r)->domain_len)
+#define NLM_ENGINEID(r)  ((u_char *)(NLM_NOTIFID(r) + (r)->notifid_len))
+#define NLM_CTXENGINE(r) (NLM_ENGINEID(r) + (r)->engineid_len)
+#define NLM_CTXNAME(r)   (NLM_CTXENGINE(r) + (r)->ctxengine_len)
+#define NLM_FIRST_VB(r)  ((struct nlm_varbind *)((u_char *)(r) + \
+                  NLM_ALIGN((NLM_CTXNAME(r) + (r)->ctxname_len) - \
+                            (u_char *)(r))))
+
+#define NLM_VB_NAME(v)   ((oid *)((u_char *)(v) + \
+                                  NLM_ALIGN(sizeof(struct nlm_varbind))))
+#define NLM_VB_VALUE(v)  ((u_char *)NLM_VB_NAME(v) + \
+                          NLM_ALIGN((v)->name_len * sizeof(oid)))
+#define NLM_NEXT_VB(v)   ((struct nlm_varbind *)(NLM_VB_VALUE(v) + \
+                                                 NLM_ALIGN((v)->val_len)))
+#define NLM_VB_SIZE(name_len, val_len) \
+    (NLM_ALIGN(sizeof(struct nlm_varbind)) + \
+     NLM_ALIGN((name_len) * sizeof(oid)) + NLM_ALIGN(val_len))
+
+/*
+ * The log itself: a ring of nlm_cap slots, holding nlm_count
+ * notifications from the oldest one at nlm_head.  Their nlmLogIndex
+ * values are consecutive, so a row is found without searching.  The
+ * ring grows on demand up to nlmConfigGlobalEntryLimit.
+ */
+static struct nlm_record **nlm_ring;
+static u_long   nlm_cap, nlm_head, nlm_count;
+
+#define NLM_RECORD(pos) (nlm_ring[(nlm_head + (pos)) % nlm_cap])
+
 static void
-netsnmp_notif_log_remove_oldest(int count)
+netsnmp_notif_log_remove_oldest(u_long count)
 {
-    netsnmp_table_row *deleterow, *tmprow, *deletevarrow;
-    
-    DEBUGMSGTL(("notification_log", "deleting %d log entry(s)\n", count));
-
-    deleterow = netsnmp_table_data_set_get_first_row(nlmLogTable);
-    for (; count && deleterow; deleterow = tmprow, --count) {
-        /*
-         * delete contained varbinds
-         * xxx-rks: note that this assumes that only the default
-         * log is used (ie for the first nlmLogTable row, the
-         * first nlmLogVarTable rows will be the right ones).
-         * the right thing to do would be to do a find based on
-         * the nlmLogTable oid.
-         */
-        DEBUGMSGTL(("9:notification_log", "  deleting notification\n"));
-        DEBUGIF("9:notification_log") {
-            DEBUGMSGTL(("9:notification_log",
-                        " base oid:"));
-            DEBUGMSGOID(("9:notification_log", deleterow->index_oid,
-                         deleterow->index_oid_len));
-            DEBUGMSG(("9:notification_log", "\n"));
-        }
-        deletevarrow = netsnmp_table_data_set_get_first_row(nlmLogVarTable);
-        for (; deletevarrow; deletevarrow = tmprow) {
-
-            tmprow = netsnmp_table_data_set_get_next_row(nlmLogVarTable,
-                                                          deletevarrow);
-            
-            DEBUGIF("9:notification_log") {
-                DEBUGMSGTL(("9:notification_log",
-                            "         :"));
-                DEBUGMSGOID(("9:notification_log", deletevarrow->index_oid,
-                             deletevarrow->index_oid_len));
-                DEBUGMSG(("9:notification_log", "\n"));
-            }
-            if ((deleterow->index_oid_len == deletevarrow->index_oid_len - 1) &&
-                snmp_oid_compare(deleterow->index_oid,
-                                 deleterow->index_oid_len,
-                                 deletevarrow->index_oid,
-                                 deleterow->index_oid_len) == 0) {
-                DEBUGMSGTL(("9:notification_log", "    deleting varbind\n"));
-                netsnmp_table_dataset_remove_and_delete_row(nlmLogVarTable,
-                                                             deletevarrow);
-            }
-            else
-                break;
-        }
-        
-        /*
-         * delete the master row 
-         */
-        tmprow = netsnmp_table_data_set_get_next_row(nlmLogTable, deleterow);
-        netsnmp_table_dataset_remove_and_delete_row(nlmLogTable,
-                                                     deleterow);
+    DEBUGMSGTL(("notification_log", "deleting %lu log entry(s)\n", count));
+
+    for (; count && nlm_count; --count) {
+        DEBUGMSGTL(("9:notification_log", "  deleting notification %lu\n",
+                    nlm_ring[nlm_head]->index));
+        free(nlm_ring[nlm_head]);
+        nlm_ring[nlm_head] = NULL;
+        nlm_head = (nlm_head + 1) % nlm_cap;
+        nlm_count--;
         num_deleted++;
     }
     /** should have deleted all of them */
@@ -133,27 +151,19 @@ netsnmp_notif_log_remove_oldest(int count)
 static void
 check_log_size(unsigned int clientreg, void *clientarg)
 {
-    netsnmp_table_row *row;
-    netsnmp_table_data_set_storage *data;
     u_long          count = 0;
     u_long          uptime;
 
     uptime = netsnmp_get_agent_uptime();
 
-    if (!nlmLogTable || !nlmLogTable->table )  {
-        DEBUGMSGTL(("notification_log", "missing log table\n"));
-        return;
-    }
-
     /*
      * check max allowed count
      */
-    count = netsnmp_table_set_num_rows(nlmLogTable);
     DEBUGMSGTL(("notification_log",
                 "logged notifications %lu; max %lu\n",
-                    count, max_logged));
-    if (count > max_logged) {
-        count = count - max_logged;
+                    nlm_count, max_logged));
+    if (nlm_count > max_logged) {
+        count = nlm_count - max_logged;
         DEBUGMSGTL(("notification_log", "removing %lu extra notifications\n",
                     count));
         netsnmp_notif_log_remove_oldest(count);
@@ -164,17 +174,9 @@ check_log_size(unsigned int clientreg, void *clientarg)
      */
     if (0 == max_age)
         return;
-    count = 0;
-    for (row = netsnmp_table_data_set_get_first_row(nlmLogTable);
-         row;
-         row = netsnmp_table_data_set_get_next_row(nlmLogTable, row)) {
-
-        data = (netsnmp_table_data_set_storage *) row->data;
-        data = netsnmp_table_data_set_find_column(data, COLUMN_NLMLOGTIME);
-
-        if (uptime < ((u_long)(*(data->data.integer) + max_age * 100 * 60)))
+    for (count = 0; count < nlm_count; ++count) {
+        if (uptime < NLM_RECORD(count)->time + max_age * 100 * 60)
             break;
-        ++count;
     }
 
     if (count) {
@@ -184,6 +186,357 @@ check_log_size(unsigned int clientreg, void *clientarg)
     }
 }
 
+/*
+ * Add a notification to the log, making room for it first.  Returns 0
+ * on success; on failure rec is freed.
+ */
+static int
+nlm_append(struct nlm_record *rec)
+{
+    struct nlm_record **ring;
+    u_long          cap, i;
+
+    if (nlm_count >= max_logged)
+        netsnmp_notif_log_remove_oldest(nlm_count - max_logged + 1);
+
+    if (nlm_count == nlm_cap) {
+        cap = nlm_cap ? 2 * nlm_cap : 16;
+        if (cap > max_logged)
+            cap = max_logged;
+        ring = calloc(cap, sizeof(*ring));
+        if (!ring) {
+            snmp_log(LOG_ERR, "notification log: out of memory\n");
+            free(rec);
+            return -1;
+        }
+        for (i = 0; i < nlm_count; i++)
+            ring[i] = NLM_RECORD(i);
+        free(nlm_ring);
+        nlm_ring = ring;
+        nlm_cap = cap;
+        nlm_head = 0;
+        DEBUGMSGTL(("notification_log", "log capacity %lu\n", cap));
+    }
+    nlm_ring[(nlm_head + nlm_count) % nlm_cap] = rec;
+    nlm_count++;
+    return 0;
+}
+
+/*
+ * Locate the notification named by the instance part of a request
+ * (exact), or the first one that can follow it.  For
+ * nlmLogVariableTable (var), *vbidx is set to the nlmLogVariableIndex
+ * to look for, or to look beyond in the first notification returned.
+ * Returns its position in the log, or nlm_count if there is none.
+ */
+static u_long
+nlm_locate(const oid *inst, size_t inst_len, int exact, int var,
+           u_long *vbidx)
+{
+    u_long          first, pos;
+    int             cmp;
+
+    *vbidx = 0;
+    if (!nlm_count)
+        return nlm_count;
+    first = nlm_ring[nlm_head]->index;
+
+    cmp = snmp_oid_compare(inst, SNMP_MIN(inst_len, NLM_NAME_LEN),
+                           nlm_default_name, NLM_NAME_LEN);
+    if (exact) {
+        if (cmp || inst_len != NLM_NAME_LEN + (var ? 2 : 1) ||
+            inst[NLM_NAME_LEN] < first ||
+            inst[NLM_NAME_LEN] - first >= nlm_count)
+            return nlm_count;
+        if (var)
+            *vbidx = inst[NLM_NAME_LEN + 1];
+        return inst[NLM_NAME_LEN] - first;
+    }
+
+    if (cmp > 0)
+        return nlm_count;
+    if (cmp < 0 || inst_len == NLM_NAME_LEN || inst[NLM_NAME_LEN] < first)
+        return 0;
+
+    pos = inst[NLM_NAME_LEN] - first;
+    if (!var)
+        pos++;                  /* this one is before or at inst */
+    else if (inst_len > NLM_NAME_LEN + 1)
+        *vbidx = inst[NLM_NAME_LEN + 1];
+    return SNMP_MIN(pos, nlm_count);
+}
+
+/*
+ * The instance part of a request for column colnum, if it has one.
+ */
+static const oid *
+nlm_instance(netsnmp_handler_registration *reginfo,
+             netsnmp_variable_list *vb, u_long colnum, size_t *len)
+{
+    size_t          prefix_len = reginfo->rootoid_len + 2;
+
+    *len = 0;
+    if (vb->name_length < prefix_len ||
+        snmp_oid_compare(vb->name, reginfo->rootoid_len,
+                         reginfo->rootoid, reginfo->rootoid_len) != 0 ||
+        vb->name[prefix_len - 2] != 1 || vb->name[prefix_len - 1] != colnum)
+        return NULL;
+    *len = vb->name_length - prefix_len;
+    return vb->name + prefix_len;
+}
+
+/*
+ * Point a GETNEXT varbind at the row found for it.
+ */
+static void
+nlm_set_name(netsnmp_handler_registration *reginfo,
+             netsnmp_variable_list *vb, u_long colnum,
+             struct nlm_record *rec, struct nlm_varbind *v)
+{
+    oid             name[MAX_OID_LEN];
+    size_t          len = reginfo->rootoid_len;
+
+    memcpy(name, reginfo->rootoid, len * sizeof(oid));
+    name[len++] = 1;
+    name[len++] = colnum;
+    memcpy(name + len, nlm_default_name, sizeof(nlm_default_name));
+    len += NLM_NAME_LEN;
+    name[len++] = rec->index;
+    if (v)
+        name[len++] = v->index;
+    snmp_set_var_objid(vb, name, len);
+}
+
+/*
+ * Fill in column colnum of nlmLogTable from rec, if it has a value.
+ */
+static int
+nlm_log_column(netsnmp_variable_list *vb, struct nlm_record *rec,
+               u_long colnum)
+{
+    switch (colnum) {
+    case COLUMN_NLMLOGTIME:
+        snmp_set_var_typed_integer(vb, ASN_TIMETICKS, rec->time);
+        break;
+    case COLUMN_NLMLOGDATEANDTIME:
+        snmp_set_var_typed_value(vb, ASN_OCTET_STR, rec->date, rec->date_len);
+        break;
+    case COLUMN_NLMLOGENGINEID:
+        snmp_set_var_typed_value(vb, ASN_OCTET_STR, NLM_ENGINEID(rec),
+                                 rec->engineid_len);
+        break;
+    case COLUMN_NLMLOGENGINETADDRESS:
+        if (!rec->taddr_len)
+            return 0;
+        snmp_set_var_typed_value(vb, ASN_OCTET_STR, rec->taddr,
+                                 rec->taddr_len);
+        break;
+    case COLUMN_NLMLOGENGINETDOMAIN:
+        if (!rec->has_domain)
+            return 0;
+        snmp_set_var_typed_value(vb, ASN_OBJECT_ID,
+                                 (const u_char *) NLM_DOMAIN(rec),
+                                 rec->domain_len * sizeof(oid));
+        break;
+    case COLUMN_NLMLOGCONTEXTENGINEID:
+        snmp_set_var_typed_value(vb, ASN_OCTET_STR, NLM_CTXENGINE(rec),
+                                 rec->ctxengine_len);
+        break;
+    case COLUMN_NLMLOGCONTEXTNAME:
+        snmp_set_var_typed_value(vb, ASN_OCTET_STR, NLM_CTXNAME(rec),
+                                 rec->ctxname_len);
+        break;
+    case COLUMN_NLMLOGNOTIFICATIONID:
+        if (!rec->notifid_len)
+            return 0;
+        snmp_set_var_typed_value(vb, ASN_OBJECT_ID,
+                                 (const u_char *) NLM_NOTIFID(rec),
+                                 rec->notifid_len * sizeof(oid));
+        break;
+    default:
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * The nlmLogVariableTable column holding values of the given type,
+ * and the matching nlmLogVariableValueType, or 0 if it can't be logged.
+ */
+static int
+nlm_value_column(u_char type, long *valuetype)
+{
+    switch (type) {
+    case ASN_COUNTER:
+        *valuetype = 1;
+        return COLUMN_NLMLOGVARIABLECOUNTER32VAL;
+    case ASN_UNSIGNED:
+        *valuetype = 2;
+        return COLUMN_NLMLOGVARIABLEUNSIGNED32VAL;
+    case ASN_TIMETICKS:
+        *valuetype = 3;
+        return COLUMN_NLMLOGVARIABLETIMETICKSVAL;
+    case ASN_INTEGER:
+        *valuetype = 4;
+        return COLUMN_NLMLOGVARIABLEINTEGER32VAL;
+    case ASN_IPADDRESS:
+        *valuetype = 5;
+        return COLUMN_NLMLOGVARIABLEIPADDRESSVAL;
+    case ASN_OCTET_STR:
+        *valuetype = 6;
+        return COLUMN_NLMLOGVARIABLEOCTETSTRINGVAL;
+    case ASN_OBJECT_ID:
+        *valuetype = 7;
+        return COLUMN_NLMLOGVARIABLEOIDVAL;
+    case ASN_COUNTER64:
+        *valuetype = 8;
+        return COLUMN_NLMLOGVARIABLECOUNTER64VAL;
+    case ASN_OPAQUE:
+        *valuetype = 9;
+        return COLUMN_NLMLOGVARIABLEOPAQUEVAL;
+    default:
+        return 0;
+    }
+}
+
+/*
+ * Fill in column colnum of nlmLogVariableTable from v, if it has a value.
+ */
+static int
+nlm_var_column(netsnmp_variable_list *vb, struct nlm_varbind *v,
+               u_long colnum)
+{
+    long            valuetype = 0;
+    u_long          valcol = nlm_value_column(v->type, &valuetype);
+
+    if (colnum == COLUMN_NLMLOGVARIABLEID)
+        snmp_set_var_typed_value(vb, ASN_OBJECT_ID,
+                                 (const u_char *) NLM_VB_NAME(v),
+                                 v->name_len * sizeof(oid));
+    else if (colnum == COLUMN_NLMLOGVARIABLEVALUETYPE)
+        snmp_set_var_typed_integer(vb, ASN_INTEGER, valuetype);
+    else if (colnum == valcol)
+        snmp_set_var_typed_value(vb, v->type, NLM_VB_VALUE(v), v->val_len);
+    else
+        return 0;
+    return 1;
+}
+
+static int
+nlmLogTable_handler(netsnmp_mib_handler *handler,
+                    netsnmp_handler_registration *reginfo,
+                    netsnmp_agent_request_info *reqinfo,
+                    netsnmp_request_info *requests)
+{
+    netsnmp_request_info       *request;
+    netsnmp_table_request_info *tinfo;
+    struct nlm_record          *rec;
+    const oid      *inst;
+    size_t          inst_len;
+    u_long          pos, vbidx;
+
+    for (request = requests; request; request = request->next) {
+        if (request->processed)
+            continue;
+        tinfo = netsnmp_extract_table_info(request);
+        inst = nlm_instance(reginfo, request->requestvb, tinfo->colnum,
+                            &inst_len);
+
+        switch (reqinfo->mode) {
+        case MODE_GET:
+            pos = nlm_locate(inst, inst_len, 1, 0, &vbidx);
+            if (pos >= nlm_count ||
+                !nlm_log_column(request->requestvb, NLM_RECORD(pos),
+                                tinfo->colnum))
+                netsnmp_set_request_error(reqinfo, request,
+                                          SNMP_NOSUCHINSTANCE);
+            break;
+
+        case MODE_GETNEXT:
+            for (pos = nlm_locate(inst, inst_len, 0, 0, &vbidx);
+                 pos < nlm_count; pos++) {
+                rec = NLM_RECORD(pos);
+                if (nlm_log_column(request->requestvb, rec, tinfo->colnum)) {
+                    nlm_set_name(reginfo, request->requestvb, tinfo->colnum,
+                                 rec, NULL);
+                    break;
+                }
+            }
+            if (pos >= nlm_count)
+                netsnmp_set_request_error(reqinfo, request,
+                                          SNMP_ENDOFMIBVIEW);
+            break;
+        }
+    }
+    return SNMP_ERR_NOERROR;
+}
+
+static int
+nlmLogVariableTable_handler(netsnmp_mib_handler *handler,
+                            netsnmp_handler_registration *reginfo,
+                            netsnmp_agent_request_info *reqinfo,
+                            netsnmp_request_info *requests)
+{
+    netsnmp_request_info       *request;
+    netsnmp_table_request_info *tinfo;
+    struct nlm_record          *rec;
+    struct nlm_varbind         *v;
+    const oid      *inst;
+    size_t          inst_len;
+    u_long          pos, vbidx, i;
+    int             found;
+
+    for (request = requests; request; request = request->next) {
+        if (request->processed)
+            continue;
+        tinfo = netsnmp_extract_table_info(request);
+        inst = nlm_instance(reginfo, request->requestvb, tinfo->colnum,
+                            &inst_len);
+
+        found = 0;
+        switch (reqinfo->mode) {
+        case MODE_GET:
+            pos = nlm_locate(inst, inst_len, 1, 1, &vbidx);
+            if (pos < nlm_count) {
+                rec = NLM_RECORD(pos);
+                for (i = 0, v = NLM_FIRST_VB(rec); i < rec->vbcount;
+                     i++, v = NLM_NEXT_VB(v)) {
+                    if (v->index == vbidx) {
+                        found = nlm_var_column(request->requestvb, v,
+                                               tinfo->colnum);
+                        break;
+                    }
+                }
+            }
+            if (!found)
+                netsnmp_set_request_error(reqinfo, request,
+                                          SNMP_NOSUCHINSTANCE);
+            break;
+
+        case MODE_GETNEXT:
+            for (pos = nlm_locate(inst, inst_len, 0, 1, &vbidx);
+                 !found && pos < nlm_count; pos++, vbidx = 0) {
+                rec = NLM_RECORD(pos);
+                for (i = 0, v = NLM_FIRST_VB(rec); i < rec->vbcount;
+                     i++, v = NLM_NEXT_VB(v)) {
+                    if (v->index > vbidx &&
+                        nlm_var_column(request->requestvb, v,
+                                       tinfo->colnum)) {
+                        nlm_set_name(reginfo, request->requestvb,
+                                     tinfo->colnum, rec, v);
+                        found = 1;
+                        break;
+                    }
+                }
+            }
+            if (!found)
+                netsnmp_set_request_error(reqinfo, request,
+                                          SNMP_ENDOFMIBVIEW);
+            break;
+        }
+    }
+    return SNMP_ERR_NOERROR;
+}
 
 /** Initialize the nlmLogVariableTable table by defining its contents and how it's structured */
 static void
@@ -193,153 +546,27 @@ initialize_table_nlmLogVariableTable(const char * context)
         { 1, 3, 6, 1, 2, 1, 92, 1, 3, 2 };
     size_t          nlmLogVariableTable_oid_len =
         OID_LENGTH(nlmLogVariableTable_oid);
-    netsnmp_table_data_set *table_set;
-    netsnmp_handler_registration *reginfo;
-
-    /*
-     * create the table structure itself 
-     */
-    table_set = netsnmp_create_table_data_set("nlmLogVariableTable");
-    nlmLogVarTable = table_set;
-    nlmLogVarTable->table->store_indexes = 1;
-
-    /***************************************************
-     * Adding indexes
-     */
-    /*
-     * declaring the nlmLogName index
-     */
-    DEBUGMSGTL(("initialize_table_nlmLogVariableTable",
-                "adding index nlmLogName of type ASN_OCTET_STR to table nlmLogVariableTable\n"));
-    netsnmp_table_dataset_add_index(table_set, ASN_OCTET_STR);
-    /*
-     * declaring the nlmLogIndex index
-     */
-    DEBUGMSGTL(("initialize_table_nlmLogVariableTable",
-                "adding index nlmLogIndex of type ASN_UNSIGNED to table nlmLogVariableTable\n"));
-    netsnmp_table_dataset_add_index(table_set, ASN_UNSIGNED);
-    /*
-     * declaring the nlmLogVariableIndex index
-     */
-    DEBUGMSGTL(("initialize_table_nlmLogVariableTable",
-                "adding index nlmLogVariableIndex of type ASN_UNSIGNED to table nlmLogVariableTable\n"));
-    netsnmp_table_dataset_add_index(table_set, ASN_UNSIGNED);
-
-    /*
-     * adding column nlmLogVariableID of type ASN_OBJECT_ID and access of
-     * ReadOnly 
-     */
-    DEBUGMSGTL(("initialize_table_nlmLogVariableTable",
-                "adding column nlmLogVariableID (#2) of type ASN_OBJECT_ID to table nlmLogVariableTable\n"));
-    netsnmp_table_set_add_default_row(table_set, COLUMN_NLMLOGVARIABLEID,
-                                      ASN_OBJECT_ID, 0, NULL, 0);
-    /*
-     * adding column nlmLogVariableValueType of type ASN_INTEGER and
-     * access of ReadOnly 
-     */
-    DEBUGMSGTL(("initialize_table_nlmLogVariableTable",
-                "adding column nlmLogVariableValueType (#3) of type ASN_INTEGER to table nlmLogVariableTable\n"));
-    netsnmp_table_set_add_default_row(table_set,
-                                      COLUMN_NLMLOGVARIABLEVALUETYPE,
-                                      ASN_INTEGER, 0, NULL, 0);
-    /*
-     * adding column nlmLogVariableCounter32Val of type ASN_COUNTER and
-     * access of ReadOnly 
-     */
-    DEBUGMSGTL(("initialize_table_nlmLogVariableTable",
-                "adding column nlmLogVariableCounter32Val (#4) of type ASN_COUNTER to table nlmLogVariableTable\n"));
-    netsnmp_table_set_add_default_row(table_set,
-                                      COLUMN_NLMLOGVARIABLECOUNTER32VAL,
-                                      ASN_COUNTER, 0, NULL, 0);
-    /*
-     * adding column nlmLogVariableUnsigned32Val of type ASN_UNSIGNED and
-     * access of ReadOnly 
-     */
-    DEBUGMSGTL(("initialize_table_nlmLogVariableTable",
-                "adding column nlmLogVariableUnsigned32Val (#5) of type ASN_UNSIGNED to table nlmLogVariableTable\n"));
-    netsnmp_table_set_add_default_row(table_set,
-                                      COLUMN_NLMLOGVARIABLEUNSIGNED32VAL,
-                                      ASN_UNSIGNED, 0, NULL, 0);
-    /*
-     * adding column nlmLogVariableTimeTicksVal of type ASN_TIMETICKS and
-     * access of ReadOnly 
-     */
-    DEBUGMSGTL(("initialize_table_nlmLogVariableTable",
-                "adding column nlmLogVariableTimeTicksVal (#6) of type ASN_TIMETICKS to table nlmLogVariableTable\n"));
-    netsnmp_table_set_add_default_row(table_set,
-                                      COLUMN_NLMLOGVARIABLETIMETICKSVAL,
-                                      ASN_TIMETICKS, 0, NULL, 0);
-    /*
-     * adding column nlmLogVariableInteger32Val of type ASN_INTEGER and
-     * access of ReadOnly 
-     */
-    DEBUGMSGTL(("initialize_table_nlmLogVariableTable",
-                "adding column nlmLogVariableInteger32Val (#7) of type ASN_INTEGER to table nlmLogVariableTable\n"));
-    netsnmp_table_set_add_default_row(table_set,
-                                      COLUMN_NLMLOGVARIABLEINTEGER32VAL,
-                                      ASN_INTEGER, 0, NULL, 0);
-    /*
-     * adding column nlmLogVariableOctetStringVal of type ASN_OCTET_STR
-     * and access of ReadOnly 
-     */
-    DEBUGMSGTL(("initialize_table_nlmLogVariableTable",
-                "adding column nlmLogVariableOctetStringVal (#8) of type ASN_OCTET_STR to table nlmLogVariableTable\n"));
-    netsnmp_table_set_add_default_row(table_set,
-                                      COLUMN_NLMLOGVARIABLEOCTETSTRINGVAL,
-                                      ASN_OCTET_STR, 0, NULL, 0);
-    /*
-     * adding column nlmLogVariableIpAddressVal of type ASN_IPADDRESS and
-     * access of ReadOnly 
-     */
-    DEBUGMSGTL(("initialize_table_nlmLogVariableTable",
-                "adding column nlmLogVariableIpAddressVal (#9) of type ASN_IPADDRESS to table nlmLogVariableTable\n"));
-    netsnmp_table_set_add_default_row(table_set,
-                                      COLUMN_NLMLOGVARIABLEIPADDRESSVAL,
-                                      ASN_IPADDRESS, 0, NULL, 0);
-    /*
-     * adding column nlmLogVariableOidVal of type ASN_OBJECT_ID and access 
-     * of ReadOnly 
-     */
-    DEBUGMSGTL(("initialize_table_nlmLogVariableTable",
-                "adding column nlmLogVariableOidVal (#10) of type ASN_OBJECT_ID to table nlmLogVariableTable\n"));
-    netsnmp_table_set_add_default_row(table_set,
-                                      COLUMN_NLMLOGVARIABLEOIDVAL,
-                                      ASN_OBJECT_ID, 0, NULL, 0);
-    /*
-     * adding column nlmLogVariableCounter64Val of type ASN_COUNTER64 and
-     * access of ReadOnly 
-     */
-    DEBUGMSGTL(("initialize_table_nlmLogVariableTable",
-                "adding column nlmLogVariableCounter64Val (#11) of type ASN_COUNTER64 to table nlmLogVariableTable\n"));
-    netsnmp_table_set_add_default_row(table_set,
-                                      COLUMN_NLMLOGVARIABLECOUNTER64VAL,
-                                      ASN_COUNTER64, 0, NULL, 0);
-    /*
-     * adding column nlmLogVariableOpaqueVal of type ASN_OPAQUE and access 
-     * of ReadOnly 
-     */
-    DEBUGMSGTL(("initialize_table_nlmLogVariableTable",
-                "adding column nlmLogVariableOpaqueVal (#12) of type ASN_OPAQUE to table nlmLogVariableTable\n"));
-    netsnmp_table_set_add_default_row(table_set,
-                                      COLUMN_NLMLOGVARIABLEOPAQUEVAL,
-                                      ASN_OPAQUE, 0, NULL, 0);
-
-    /*
-     * registering the table with the master agent 
-     */
-    /*
-     * note: if you don't need a subhandler to deal with any aspects of
-     * the request, change nlmLogVariableTable_handler to "NULL" 
-     */
-    reginfo =
-        netsnmp_create_handler_registration ("nlmLogVariableTable",
-                                             NULL,
-                                             nlmLogVariableTable_oid,
-                                             nlmLogVariableTable_oid_len,
-                                             HANDLER_CAN_RWRITE);
+    netsnmp_table_registration_info *table_info;
+
+    nlmLogVarTable_reg =
+        netsnmp_create_handler_registration("nlmLogVariableTable",
+                                            nlmLogVariableTable_handler,
+                                            nlmLogVariableTable_oid,
+                                            nlmLogVariableTable_oid_len,
+                                            HANDLER_CAN_RONLY);
     if (NULL != context)
-        reginfo->contextName = strdup(context);
-    netsnmp_register_table_data_set(reginfo, table_set, NULL);
+        nlmLogVarTable_reg->contextName = strdup(context);
+
+    table_info = SNMP_MALLOC_TYPEDEF(netsnmp_table_registration_info);
+    netsnmp_table_helper_add_indexes(table_info,
+                                     ASN_OCTET_STR, /* nlmLogName */
+                                     ASN_UNSIGNED,  /* nlmLogIndex */
+                                     ASN_UNSIGNED,  /* nlmLogVariableIndex */
+                                     0);
+    table_info->min_column = COLUMN_NLMLOGVARIABLEID;
+    table_info->max_column = COLUMN_NLMLOGVARIABLEOPAQUEVAL;
+
+    netsnmp_register_table(nlmLogVarTable_reg, table_info);
 }
 
 /** Initialize the nlmLogTable table by defining its contents and how it's structured */
@@ -348,113 +575,26 @@ initialize_table_nlmLogTable(const char * context)
 {
     static oid      nlmLogTable_oid[] = { 1, 3, 6, 1, 2, 1, 92, 1, 3, 1 };
     size_t          nlmLogTable_oid_len = OID_LENGTH(nlmLogTable_oid);
-    netsnmp_handler_registration *reginfo;
-
-    /*
-     * create the table structure itself 
-     */
-    nlmLogTable = netsnmp_create_table_data_set("nlmLogTable");
-
-    /***************************************************
-     * Adding indexes
-     */
-    /*
-     * declaring the nlmLogIndex index
-     */
-    DEBUGMSGTL(("initialize_table_nlmLogTable",
-                "adding index nlmLogName of type ASN_OCTET_STR to table nlmLogTable\n"));
-    netsnmp_table_dataset_add_index(nlmLogTable, ASN_OCTET_STR);
-
-    DEBUGMSGTL(("initialize_table_nlmLogTable",
-                "adding index nlmLogIndex of type ASN_UNSIGNED to table nlmLogTable\n"));
-    netsnmp_table_dataset_add_index(nlmLogTable, ASN_UNSIGNED);
-
-    /*
-     * adding column nlmLogTime of type ASN_TIMETICKS and access of
-     * ReadOnly 
-     */
-    DEBUGMSGTL(("initialize_table_nlmLogTable",
-                "adding column nlmLogTime (#2) of type ASN_TIMETICKS to table nlmLogTable\n"));
-    netsnmp_table_set_add_default_row(nlmLogTable, COLUMN_NLMLOGTIME,
-                                      ASN_TIMETICKS, 0, NULL, 0);
-    /*
-     * adding column nlmLogDateAndTime of type ASN_OCTET_STR and access of 
-     * ReadOnly 
-     */
-    DEBUGMSGTL(("initialize_table_nlmLogTable",
-                "adding column nlmLogDateAndTime (#3) of type ASN_OCTET_STR to table nlmLogTable\n"));
-    netsnmp_table_set_add_default_row(nlmLogTable,
-                                      COLUMN_NLMLOGDATEANDTIME,
-                                      ASN_OCTET_STR, 0, NULL, 0);
-    /*
-     * adding column nlmLogEngineID of type ASN_OCTET_STR and access of
-     * ReadOnly 
-     */
-    DEBUGMSGTL(("initialize_table_nlmLogTable",
-                "adding column nlmLogEngineID (#4) of type ASN_OCTET_STR to table nlmLogTable\n"));
-    netsnmp_table_set_add_default_row(nlmLogTable, COLUMN_NLMLOGENGINEID,
-                                      ASN_OCTET_STR, 0, NULL, 0);
-    /*
-     * adding column nlmLogEngineTAddress of type ASN_OCTET_STR and access 
-     * of ReadOnly 
-     */
-    DEBUGMSGTL(("initialize_table_nlmLogTable",
-                "adding column nlmLogEngineTAddress (#5) of type ASN_OCTET_STR to table nlmLogTable\n"));
-    netsnmp_table_set_add_default_row(nlmLogTable,
-                                      COLUMN_NLMLOGENGINETADDRESS,
-                                      ASN_OCTET_STR, 0, NULL, 0);
-    /*
-     * adding column nlmLogEngineTDomain of type ASN_OBJECT_ID and access
-     * of ReadOnly 
-     */
-    DEBUGMSGTL(("initialize_table_nlmLogTable",
-                "adding column nlmLogEngineTDomain (#6) of type ASN_OBJECT_ID to table nlmLogTable\n"));
-    netsnmp_table_set_add_default_row(nlmLogTable,
-                                      COLUMN_NLMLOGENGINETDOMAIN,
-                                      ASN_OBJECT_ID, 0, NULL, 0);
-    /*
-     * adding column nlmLogContextEngineID of type ASN_OCTET_STR and
-     * access of ReadOnly 
-     */
-    DEBUGMSGTL(("initialize_table_nlmLogTable",
-                "adding column nlmLogContextEngineID (#7) of type ASN_OCTET_STR to table nlmLogTable\n"));
-    netsnmp_table_set_add_default_row(nlmLogTable,
-                                      COLUMN_NLMLOGCONTEXTENGINEID,
-                                      ASN_OCTET_STR, 0, NULL, 0);
-    /*
-     * adding column nlmLogContextName of type ASN_OCTET_STR and access of 
-     * ReadOnly 
-     */
-    DEBUGMSGTL(("initialize_table_nlmLogTable",
-                "adding column nlmLogContextName (#8) of type ASN_OCTET_STR to table nlmLogTable\n"));
-    netsnmp_table_set_add_default_row(nlmLogTable,
-                                      COLUMN_NLMLOGCONTEXTNAME,
-                                      ASN_OCTET_STR, 0, NULL, 0);
-    /*
-     * adding column nlmLogNotificationID of type ASN_OBJECT_ID and access 
-     * of ReadOnly 
-     */
-    DEBUGMSGTL(("initialize_table_nlmLogTable",
-                "adding column nlmLogNotificationID (#9) of type ASN_OBJECT_ID to table nlmLogTable\n"));
-    netsnmp_table_set_add_default_row(nlmLogTable,
-                                      COLUMN_NLMLOGNOTIFICATIONID,
-                                      ASN_OBJECT_ID, 0, NULL, 0);
+    netsnmp_table_registration_info *table_info;
 
-    /*
-     * registering the table with the master agent 
-     */
-    /*
-     * note: if you don't need a subhandler to deal with any aspects of
-     * the request, change nlmLogTable_handler to "NULL" 
-     */
-    reginfo =
-        netsnmp_create_handler_registration("nlmLogTable", NULL,
+    nlmLogTable_reg =
+        netsnmp_create_handler_registration("nlmLogTable",
+                                            nlmLogTable_handler,
                                             nlmLogTable_oid,
                                             nlmLogTable_oid_len,
-                                            HANDLER_CAN_RWRITE);
+                                            HANDLER_CAN_RONLY);
     if (NULL != context)
-        reginfo->contextName = strdup(context);
-    netsnmp_register_table_data_set(reginfo, nlmLogTable, NULL);
+        nlmLogTable_reg->contextName = strdup(context);
+
+    table_info = SNMP_MALLOC_TYPEDEF(netsnmp_table_registration_info);
+    netsnmp_table_helper_add_indexes(table_info,
+                                     ASN_OCTET_STR, /* nlmLogName */
+                                     ASN_UNSIGNED,  /* nlmLogIndex */
+                                     0);
+    table_info->min_column = COLUMN_NLMLOGTIME;
+    table_info->max_column = COLUMN_NLMLOGNOTIFICATIONID;
+
+    netsnmp_register_table(nlmLogTable_reg, table_info);
 
     /*
      * hmm...  5 minutes seems like a reasonable time to check for out
@@ -568,8 +708,8 @@ shutdown_notification_log(void)
 {
     max_logged = 0;
     check_log_size(0, NULL);
-    netsnmp_delete_table_data_set(nlmLogTable);
-    nlmLogTable = NULL;
+    SNMP_FREE(nlm_ring);
+    nlm_cap = nlm_head = 0;
 
     UNREGISTER_SYSOR_ENTRY(nlm_module_oid);
 }
@@ -577,56 +717,79 @@ shutdown_notification_log(void)
 void
 log_notification(netsnmp_pdu *pdu, netsnmp_transport *transport)
 {
-    long            tmpl;
-    netsnmp_table_row *row;
-
     static u_long   default_num = 0;
 
     static oid      snmptrapoid[] = { 1, 3, 6, 1, 6, 3, 1, 1, 4, 1, 0 };
     size_t          snmptrapoid_len = OID_LENGTH(snmptrapoid);
-    netsnmp_variable_list *vptr;
+    netsnmp_variable_list *vptr, *notifid = NULL;
+    struct nlm_record *rec;
+    struct nlm_varbind *v;
     u_char         *logdate;
-    size_t          logdate_size;
+    size_t          logdate_size, size;
     time_t          timetnow;
+    long            valuetype;
 
     u_long          vbcount = 0;
-    u_long          tmpul;
-    int             col;
     netsnmp_pdu    *orig_pdu = pdu;
 
-    if (!nlmLogVarTable
+    if (!nlmLogTable_reg
         || netsnmp_ds_get_boolean(NETSNMP_DS_APPLICATION_ID,
                                   NETSNMP_DS_APP_DONT_LOG)) {
         return;
     }
 
     DEBUGMSGTL(("notification_log", "logging something\n"));
-    row = netsnmp_create_table_data_row();
 
     ++num_received;
-    default_num++;
+
+    if (0 == max_logged) {
+        /*
+         * nothing is kept: bumped straight away
+         */
+        num_deleted++;
+        return;
+    }
+
+    if (pdu->command == SNMP_MSG_TRAP)
+	pdu = convert_v1pdu_to_v2(orig_pdu);
 
     /*
-     * indexes to the table 
+     * size the record
      */
-    netsnmp_table_row_add_index(row, ASN_OCTET_STR, "default",
-                                strlen("default"));
-    netsnmp_table_row_add_index(row, ASN_UNSIGNED, &default_num,
-                                sizeof(default_num));
+    size = NLM_ALIGN(sizeof(struct nlm_record)) +
+        pdu->securityEngineIDLen + pdu->contextEngineIDLen +
+        pdu->contextNameLen;
+    if (transport)
+        size += transport->domain_length * sizeof(oid);
+    for (vptr = pdu->variables; vptr; vptr = vptr->next_variable) {
+        if (snmp_oid_compare(snmptrapoid, snmptrapoid_len,
+                             vptr->name, vptr->name_length) == 0)
+            notifid = vptr;
+        else if (nlm_value_column(vptr->type, &valuetype))
+            size += NLM_VB_SIZE(vptr->name_length, vptr->val_len);
+    }
+    if (notifid)
+        size += notifid->val_len;
+    size = NLM_ALIGN(size);
+
+    rec = calloc(1, size);
+    if (!rec) {
+        snmp_log(LOG_ERR, "notification log: out of memory\n");
+        if (pdu != orig_pdu)
+            snmp_free_pdu( pdu );
+        return;
+    }
 
     /*
-     * add the data 
+     * nlmLogTable columns.  nlm_locate() relies on the logged indexes
+     * being consecutive, so default_num only moves once rec is stored.
      */
-    tmpl = netsnmp_get_agent_uptime();
-    netsnmp_set_row_column(row, COLUMN_NLMLOGTIME, ASN_TIMETICKS,
-                           &tmpl, sizeof(tmpl));
+    rec->index = default_num + 1;
+    rec->time = netsnmp_get_agent_uptime();
     time(&timetnow);
     logdate = date_n_time(&timetnow, &logdate_size);
-    netsnmp_set_row_column(row, COLUMN_NLMLOGDATEANDTIME, ASN_OCTET_STR,
-                           logdate, logdate_size);
-    netsnmp_set_row_column(row, COLUMN_NLMLOGENGINEID, ASN_OCTET_STR,
-                           pdu->securityEngineID,
-                           pdu->securityEngineIDLen);
+    rec->date_len = SNMP_MIN(logdate_size, sizeof(rec->date));
+    memcpy(rec->date, logdate, rec->date_len);
     if (transport && transport->domain == netsnmpUDPDomain) {
         /*
          * check for the udp domain 
@@ -634,136 +797,68 @@ log_notification(netsnmp_pdu *pdu, netsnmp_transport *transport)
         struct sockaddr_in *addr =
             (struct sockaddr_in *) pdu->transport_data;
         if (addr) {
-            char            buf[sizeof(in_addr_t) +
-                                sizeof(addr->sin_port)];
             in_addr_t       locaddr = htonl(addr->sin_addr.s_addr);
             u_short         portnum = htons(addr->sin_port);
-            memcpy(buf, &locaddr, sizeof(in_addr_t));
-            memcpy(buf + sizeof(in_addr_t), &portnum,
+            memcpy(rec->taddr, &locaddr, sizeof(in_addr_t));
+            memcpy(rec->taddr + sizeof(in_addr_t), &portnum,
                    sizeof(addr->sin_port));
-            netsnmp_set_row_column(row, COLUMN_NLMLOGENGINETADDRESS,
-                                   ASN_OCTET_STR, buf,
-                                   sizeof(in_addr_t) +
-                                   sizeof(addr->sin_port));
+            rec->taddr_len = sizeof(in_addr_t) + sizeof(addr->sin_port);
         }
     }
-    if (transport)
-        netsnmp_set_row_column(row, COLUMN_NLMLOGENGINETDOMAIN,
-                               ASN_OBJECT_ID,
-                               transport->domain,
-                               sizeof(oid) * transport->domain_length);
-    netsnmp_set_row_column(row, COLUMN_NLMLOGCONTEXTENGINEID,
-                           ASN_OCTET_STR, pdu->contextEngineID,
-                           pdu->contextEngineIDLen);
-    netsnmp_set_row_column(row, COLUMN_NLMLOGCONTEXTNAME, ASN_OCTET_STR,
-                           pdu->contextName, pdu->contextNameLen);
+    if (transport) {
+        rec->has_domain = 1;
+        rec->domain_len = transport->domain_length;
+        memcpy(NLM_DOMAIN(rec), transport->domain,
+               rec->domain_len * sizeof(oid));
+    }
+    if (notifid) {
+        rec->notifid_len = notifid->val_len / sizeof(oid);
+        memcpy(NLM_NOTIFID(rec), notifid->val.objid,
+               rec->notifid_len * sizeof(oid));
+    }
+    rec->engineid_len = pdu->securityEngineIDLen;
+    if (rec->engineid_len)
+        memcpy(NLM_ENGINEID(rec), pdu->securityEngineID, rec->engineid_len);
+    rec->ctxengine_len = pdu->contextEngineIDLen;
+    if (rec->ctxengine_len)
+        memcpy(NLM_CTXENGINE(rec), pdu->contextEngineID,
+               rec->ctxengine_len);
+    rec->ctxname_len = pdu->contextNameLen;
+    if (rec->ctxname_len)
+        memcpy(NLM_CTXNAME(rec), pdu->contextName, rec->ctxname_len);
 
-    if (pdu->command == SNMP_MSG_TRAP)
-	pdu = convert_v1pdu_to_v2(orig_pdu);
+    /*
+     * nlmLogVariableTable rows, packed behind it
+     */
+    v = NLM_FIRST_VB(rec);
     for (vptr = pdu->variables; vptr; vptr = vptr->next_variable) {
         if (snmp_oid_compare(snmptrapoid, snmptrapoid_len,
-                             vptr->name, vptr->name_length) == 0) {
-            netsnmp_set_row_column(row, COLUMN_NLMLOGNOTIFICATIONID,
-                                   ASN_OBJECT_ID, vptr->val.string,
-                                   vptr->val_len);
-        } else {
-            netsnmp_table_row *myrow;
-            myrow = netsnmp_create_table_data_row();
-
-            /*
-             * indexes to the table 
-             */
-            netsnmp_table_row_add_index(myrow, ASN_OCTET_STR, "default",
-                                        strlen("default"));
-            netsnmp_table_row_add_index(myrow, ASN_UNSIGNED, &default_num,
-                                        sizeof(default_num));
-            vbcount++;
-            netsnmp_table_row_add_index(myrow, ASN_UNSIGNED, &vbcount,
-                                        sizeof(vbcount));
-
-            /*
-             * OID 
-             */
-            netsnmp_set_row_column(myrow, COLUMN_NLMLOGVARIABLEID,
-                                   ASN_OBJECT_ID, vptr->name,
-                                   vptr->name_length * sizeof(oid));
-
-            /*
-             * value 
-             */
-            switch (vptr->type) {
-            case ASN_OBJECT_ID:
-                tmpul = 7;
-                col = COLUMN_NLMLOGVARIABLEOIDVAL;
-                break;
-
-            case ASN_INTEGER:
-                tmpul = 4;
-                col = COLUMN_NLMLOGVARIABLEINTEGER32VAL;
-                break;
-
-            case ASN_UNSIGNED:
-                tmpul = 2;
-                col = COLUMN_NLMLOGVARIABLEUNSIGNED32VAL;
-                break;
-
-            case ASN_COUNTER:
-                tmpul = 1;
-                col = COLUMN_NLMLOGVARIABLECOUNTER32VAL;
-                break;
-
-            case ASN_TIMETICKS:
-                tmpul = 3;
-                col = COLUMN_NLMLOGVARIABLETIMETICKSVAL;
-                break;
-
-            case ASN_OCTET_STR:
-                tmpul = 6;
-                col = COLUMN_NLMLOGVARIABLEOCTETSTRINGVAL;
-                break;
-
-            case ASN_IPADDRESS:
-                tmpul = 5;
-                col = COLUMN_NLMLOGVARIABLEIPADDRESSVAL;
-                break;
-
-            case ASN_COUNTER64:
-                tmpul = 8;
-                col = COLUMN_NLMLOGVARIABLECOUNTER64VAL;
-                break;
-
-            case ASN_OPAQUE:
-                tmpul = 9;
-                col = COLUMN_NLMLOGVARIABLEOPAQUEVAL;
-                break;
-
-            default:
-                /*
-                 * unsupported 
-                 */
-                DEBUGMSGTL(("notification_log",
-                            "skipping type %d\n", vptr->type));
-                (void)netsnmp_table_dataset_delete_row(myrow);
-                continue;
-            }
-            netsnmp_set_row_column(myrow, COLUMN_NLMLOGVARIABLEVALUETYPE,
-                                   ASN_INTEGER, & tmpul,
-                                   sizeof(tmpul));
-            netsnmp_set_row_column(myrow, col, vptr->type,
-                                   vptr->val.string, vptr->val_len);
+                             vptr->name, vptr->name_length) == 0)
+            continue;
+        vbcount++;
+        if (!nlm_value_column(vptr->type, &valuetype)) {
             DEBUGMSGTL(("notification_log",
-                        "adding a row to the variables table\n"));
-            netsnmp_table_dataset_add_row(nlmLogVarTable, myrow);
+                        "skipping type %d\n", vptr->type));
+            continue;
         }
+        v->index = vbcount;
+        v->type = vptr->type;
+        v->name_len = vptr->name_length;
+        memcpy(NLM_VB_NAME(v), vptr->name, v->name_len * sizeof(oid));
+        v->val_len = vptr->val_len;
+        if (v->val_len)
+            memcpy(NLM_VB_VALUE(v), vptr->val.string, v->val_len);
+        rec->vbcount++;
+        v = NLM_NEXT_VB(v);
     }
 
     if (pdu != orig_pdu)
         snmp_free_pdu( pdu );
 
-    /*
-     * store the row 
-     */
-    netsnmp_table_dataset_add_row(nlmLogTable, row);
+    DEBUGMSGTL(("notification_log", "notification %lu: %lu bytes\n",
+                rec->index, (u_long)size));
+    if (nlm_append(rec) == 0)
+        default_num++;
 
     check_log_size(0, NULL);
     DEBUGMSGTL(("notification_log", "done logging something\n"));
@@ -32,6 +32,9 @@
 
 #include <signal.h>
 #include <errno.h>
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
 
 #include <net-snmp/net-snmp-includes.h>
 #include <net-snmp/agent/net-snmp-agent-includes.h>
@@ -60,6 +63,88 @@ static void     check_persist_pipes(unsigned clientreg, void *clientarg);
 static void     destruct_persist_pipes(void);
 static int      write_persist_pipe(int iindex, const char *data);
 
+#if !defined(WIN32) && !defined(NETSNMP_FEATURE_REMOVE_FD_EVENT_MANAGER)
+#define PASS_PERSIST_V2
+#endif
+
+#ifdef PASS_PERSIST_V2
+/*
+ * Protocol 2: every command carries an id and all the varbinds of a request
+ * for the registration, several commands may be outstanding on a helper,
+ * and the pipes are served by the event loop, the requests being delegated
+ * meanwhile.  A registration may have a pool of helpers.
+ */
+#define PERSIST2_TIMEOUT        5       /* seconds for a helper to answer */
+#define PERSIST2_MAX_INPUT      (1024 * 1024)
+#define PERSIST2_PREFETCH       "pass_persist2"
+
+enum { PERSIST2_GET, PERSIST2_GETNEXT, PERSIST2_GETBULK, PERSIST2_SET };
+
+struct persist2_varbind {
+    netsnmp_request_info *request;
+    oid             name[MAX_OID_LEN];  /* as sent to the helper */
+    size_t          name_len;
+};
+
+struct persist2_command {
+    u_int           id;
+    int             verb;
+    int             count;
+    time_t          deadline;
+    netsnmp_delegated_cache *cache;
+    struct persist2_varbind *vbs;
+    struct persist2_command *next;
+};
+
+struct persist2_helper {
+    struct persist2_passthru *pass;
+    netsnmp_pid_t   pid;
+    int             fdIn;
+    int             fdOut;
+    int             ready;      /* has answered the PING */
+    int             writing;    /* waits for fdOut to be writable */
+    char           *in;
+    size_t          in_len, in_size;
+    char           *out;
+    size_t          out_len, out_size;
+    int             outstanding;
+    struct persist2_command *commands;
+};
+
+struct persist2_passthru {
+    oid             miboid[MIBMAX];
+    size_t          miblen;
+    int             priority;
+    char           *command;
+    int             nhelpers;
+    struct persist2_helper *helpers;
+    struct persist2_passthru *next;
+};
+
+/*
+ * What a getbulk command returned beyond the current repetition, kept
+ * with the request for the following ones.
+ */
+struct persist2_prefetch {
+    struct persist2_passthru *pass;
+    oid            *from;
+    size_t          from_len;
+    netsnmp_variable_list *var;
+    struct persist2_prefetch *next;
+};
+
+static struct persist2_passthru *persist2passthrus;
+static unsigned persist2_alarm_id;
+static u_int    persist2_next_id;
+
+static void     persist2_parse_config(char *cptr, long priority,
+                                      int nhelpers);
+static void     persist2_free_config(void);
+static void     close_persist2_helper(struct persist2_helper *h);
+static int      persist2_check_helper(struct persist2_helper *h);
+static Netsnmp_Node_Handler persist2_handler;
+#endif /* PASS_PERSIST_V2 */
+
 /*
  * the relocatable extensible commands variables 
  */
@@ -91,6 +176,9 @@ shutdown_pass_persist(void)
 
     /* Close any open pipes. */
     destruct_persist_pipes();
+#ifdef PASS_PERSIST_V2
+    persist2_free_config();
+#endif
 }
 
 
@@ -134,7 +222,7 @@ pass_persist_parse_config(const char *token, char *cptr)
     struct extensible **ppass = &persistpassthrus, **etmp, *ptmp;
     char           *tcptr, *endopt;
     int             i;
-    long int        priority;
+    long int        priority, version = 1, nhelpers = 1;
 
     /*
      * options
@@ -159,6 +247,26 @@ pass_persist_parse_config(const char *token, char *cptr)
 	cptr = endopt;
 	cptr = skip_white(cptr);
 	break;
+      case 'v':
+	/* protocol version */
+	cptr = skip_white(cptr + 1);
+	version = strtol(cptr, &endopt, 0);
+	if (endopt == cptr || (version != 1 && version != 2)) {
+	  config_perror("protocol version must be 1 or 2");
+	  return;
+	}
+	cptr = skip_white(endopt);
+	break;
+      case 'n':
+	/* number of helper processes */
+	cptr = skip_white(cptr + 1);
+	nhelpers = strtol(cptr, &endopt, 0);
+	if (endopt == cptr || nhelpers < 1 || nhelpers > 32) {
+	  config_perror("number of helpers must be between 1 and 32");
+	  return;
+	}
+	cptr = skip_white(endopt);
+	break;
       default:
 	config_perror("unknown option for pass directive");
 	return;
@@ -174,6 +282,18 @@ pass_persist_parse_config(const char *token, char *cptr)
         config_perror("second token is not a OID");
         return;
     }
+    if (version == 2) {
+#ifdef PASS_PERSIST_V2
+        persist2_parse_config(cptr, priority, nhelpers);
+#else
+        config_perror("pass_persist protocol 2 is not supported here");
+#endif
+        return;
+    }
+    if (nhelpers != 1) {
+        config_perror("a pool of helpers needs protocol 2 (-v 2)");
+        return;
+    }
     numpersistpassthrus++;
 
     while (*ppass != NULL)
@@ -261,6 +381,9 @@ pass_persist_free_config(void)
     }
     persistpassthrus = NULL;
     numpersistpassthrus = 0;
+#ifdef PASS_PERSIST_V2
+    persist2_free_config();
+#endif
 }
 
 #ifdef USING_SINGLE_COMMON_PASSPERSIST_INSTANCE
@@ -553,6 +676,13 @@ static int process_stopped(int idx)
 static void check_persist_pipes(unsigned clientreg, void *clientarg)
 {
     int             i;
+#ifdef PASS_PERSIST_V2
+    struct persist2_passthru *pass;
+
+    for (pass = persist2passthrus; pass; pass = pass->next)
+        for (i = 0; i < pass->nhelpers; i++)
+            persist2_check_helper(&pass->helpers[i]);
+#endif
 
     if (!persist_pipes)
         return;
@@ -745,3 +875,785 @@ close_persist_pipe(int iindex)
     }
 
 }
+
+#ifdef PASS_PERSIST_V2
+static void
+persist2_parse_config(char *cptr, long priority, int nhelpers)
+{
+    struct persist2_passthru *pass, **ppass;
+    netsnmp_handler_registration *reginfo;
+    char           *tcptr;
+    int             i;
+
+    pass = SNMP_MALLOC_TYPEDEF(struct persist2_passthru);
+    if (!pass)
+        return;
+    pass->priority = priority;
+    pass->miblen = parse_miboid(cptr, pass->miboid);
+    while (isdigit((unsigned char)(*cptr)) || *cptr == '.')
+        cptr++;
+    cptr = skip_white(cptr);
+    if (cptr == NULL) {
+        config_perror("No command specified on pass_persist line");
+        free(pass);
+        return;
+    }
+    for (tcptr = cptr; *tcptr != 0 && *tcptr != '#' && *tcptr != ';';
+         tcptr++);
+    pass->command = netsnmp_memdup_nt(cptr, tcptr - cptr, NULL);
+    pass->nhelpers = nhelpers;
+    pass->helpers = calloc(nhelpers, sizeof(*pass->helpers));
+    if (!pass->command || !pass->helpers) {
+        free(pass->command);
+        free(pass->helpers);
+        free(pass);
+        return;
+    }
+    for (i = 0; i < nhelpers; i++) {
+        pass->helpers[i].pass = pass;
+        pass->helpers[i].pid = NETSNMP_NO_SUCH_PROCESS;
+        pass->helpers[i].fdIn = pass->helpers[i].fdOut = -1;
+    }
+
+    reginfo = netsnmp_create_handler_registration("pass_persist",
+                                                  persist2_handler,
+                                                  pass->miboid, pass->miblen,
+                                                  HANDLER_CAN_RWRITE);
+    if (!reginfo) {
+        free(pass->command);
+        free(pass->helpers);
+        free(pass);
+        return;
+    }
+    reginfo->priority = priority;
+    reginfo->handler->myvoid = pass;
+    if (netsnmp_register_handler(reginfo) != MIB_REGISTERED_OK) {
+        config_perror("cannot register the pass_persist OID");
+        free(pass->command);
+        free(pass->helpers);
+        free(pass);
+        return;
+    }
+
+    for (ppass = &persist2passthrus; *ppass; ppass = &(*ppass)->next);
+    *ppass = pass;
+}
+
+static void
+persist2_free_config(void)
+{
+    struct persist2_passthru *pass;
+    int             i;
+
+    while ((pass = persist2passthrus) != NULL) {
+        persist2passthrus = pass->next;
+        unregister_mib_priority(pass->miboid, pass->miblen, pass->priority);
+        for (i = 0; i < pass->nhelpers; i++)
+            close_persist2_helper(&pass->helpers[i]);
+        free(pass->helpers);
+        free(pass->command);
+        free(pass);
+    }
+    if (persist2_alarm_id) {
+        snmp_alarm_unregister(persist2_alarm_id);
+        persist2_alarm_id = 0;
+    }
+}
+
+/*
+ * Complete the requests of a command.  If the helper did not answer,
+ * GET and SET requests fail and GETNEXT requests move on to the next
+ * registration.
+ */
+static void
+persist2_finish(struct persist2_command *cmd, int answered)
+{
+    netsnmp_delegated_cache *cache = netsnmp_handler_check_cache(cmd->cache);
+    int             i;
+
+    if (cache) {
+        for (i = 0; i < cmd->count; i++) {
+            netsnmp_request_completed(cmd->vbs[i].request);
+            if (!answered &&
+                (cmd->verb == PERSIST2_GET || cmd->verb == PERSIST2_SET))
+                netsnmp_set_request_error(cache->reqinfo,
+                                          cmd->vbs[i].request,
+                                          SNMP_ERR_GENERR);
+        }
+        if (cache->reqinfo->mode == MODE_GETBULK)
+            netsnmp_bulk_to_next_fix_requests(cache->requests);
+    } else
+        DEBUGMSGTL(("ucd-snmp/pass_persist",
+                    "command %u is no longer valid\n", cmd->id));
+    netsnmp_free_delegated_cache(cmd->cache);
+    free(cmd->vbs);
+    free(cmd);
+}
+
+static void
+close_persist2_helper(struct persist2_helper *h)
+{
+    struct persist2_command *cmd;
+
+    if (h->fdIn >= 0) {
+        unregister_readfd(h->fdIn);
+        close(h->fdIn);
+        h->fdIn = -1;
+    }
+    if (h->fdOut >= 0) {
+        if (h->writing)
+            unregister_writefd(h->fdOut);
+        close(h->fdOut);
+        h->fdOut = -1;
+    }
+    if (h->pid != NETSNMP_NO_SUCH_PROCESS) {
+#ifdef HAVE_SIGNAL
+        (void)kill(h->pid, SIGKILL);
+#endif
+#ifdef HAVE_WAITPID
+        waitpid(h->pid, NULL, 0);
+#endif
+        h->pid = NETSNMP_NO_SUCH_PROCESS;
+    }
+    h->ready = h->writing = 0;
+    SNMP_FREE(h->in);
+    SNMP_FREE(h->out);
+    h->in_len = h->in_size = h->out_len = h->out_size = 0;
+
+    while ((cmd = h->commands) != NULL) {
+        h->commands = cmd->next;
+        persist2_finish(cmd, 0);
+    }
+    h->outstanding = 0;
+}
+
+/*
+ * Close a helper whose process has stopped.
+ */
+static int
+persist2_check_helper(struct persist2_helper *h)
+{
+#ifdef HAVE_WAITPID
+    if (h->pid != NETSNMP_NO_SUCH_PROCESS &&
+        waitpid(h->pid, NULL, WNOHANG) > 0) {
+        snmp_log(LOG_INFO, "pass_persist: %s stopped - closing pipe\n",
+                 h->pass->command);
+        h->pid = NETSNMP_NO_SUCH_PROCESS;
+        close_persist2_helper(h);
+        return 1;
+    }
+#endif
+    return 0;
+}
+
+static void
+persist2_check_timeouts(unsigned clientreg, void *clientarg)
+{
+    struct persist2_passthru *pass;
+    struct persist2_helper *h;
+    struct persist2_command *cmd;
+    time_t          now = time(NULL);
+    int             i, outstanding = 0;
+
+    for (pass = persist2passthrus; pass; pass = pass->next) {
+        for (i = 0; i < pass->nhelpers; i++) {
+            h = &pass->helpers[i];
+            for (cmd = h->commands; cmd; cmd = cmd->next)
+                if (cmd->deadline <= now)
+                    break;
+            if (cmd) {
+                snmp_log(LOG_WARNING, "pass_persist: %s did not answer "
+                         "in %d seconds - closing pipe\n", pass->command,
+                         PERSIST2_TIMEOUT);
+                close_persist2_helper(h);
+            }
+            outstanding += h->outstanding;
+        }
+    }
+    if (!outstanding) {
+        snmp_alarm_unregister(persist2_alarm_id);
+        persist2_alarm_id = 0;
+    }
+}
+
+/*
+ * Write what is queued for a helper, as far as its pipe takes it.
+ * Returns 0 if the helper is gone.
+ */
+static int
+persist2_flush(struct persist2_helper *h)
+{
+    ssize_t         n;
+
+    while (h->out_len > 0) {
+        n = write(h->fdOut, h->out, h->out_len);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN)
+                return 0;
+            break;
+        }
+        memmove(h->out, h->out + n, h->out_len - n);
+        h->out_len -= n;
+    }
+    return 1;
+}
+
+static void
+persist2_writable(int fd, void *clientarg)
+{
+    struct persist2_helper *h = (struct persist2_helper *) clientarg;
+
+    if (!persist2_flush(h)) {
+        DEBUGMSGTL(("ucd-snmp/pass_persist", "write to %s failed\n",
+                    h->pass->command));
+        close_persist2_helper(h);
+    } else if (h->out_len == 0) {
+        unregister_writefd(h->fdOut);
+        h->writing = 0;
+    }
+}
+
+static int
+persist2_send(struct persist2_helper *h, const char *data, size_t len)
+{
+    char           *out;
+
+    if (h->out_len + len > h->out_size) {
+        out = realloc(h->out, h->out_len + len + SNMP_MAXBUF);
+        if (!out)
+            return 0;
+        h->out = out;
+        h->out_size = h->out_len + len + SNMP_MAXBUF;
+    }
+    memcpy(h->out + h->out_len, data, len);
+    h->out_len += len;
+    if (h->writing)
+        return 1;
+    if (!persist2_flush(h))
+        return 0;
+    if (h->out_len > 0) {
+        register_writefd(h->fdOut, persist2_writable, h);
+        h->writing = 1;
+    }
+    return 1;
+}
+
+static void     persist2_readable(int fd, void *clientarg);
+
+static int
+open_persist2_helper(struct persist2_helper *h)
+{
+    int             fdIn, fdOut;
+    netsnmp_pid_t   pid;
+
+    if (0 == get_exec_pipes(h->pass->command, &fdIn, &fdOut, &pid) ||
+        pid == NETSNMP_NO_SUCH_PROCESS) {
+        DEBUGMSGTL(("ucd-snmp/pass_persist", "cannot start %s\n",
+                    h->pass->command));
+        return 0;
+    }
+    h->pid = pid;
+    h->fdIn = fdIn;
+    h->fdOut = fdOut;
+    fcntl(fdIn, F_SETFL, fcntl(fdIn, F_GETFL) | O_NONBLOCK);
+    fcntl(fdOut, F_SETFL, fcntl(fdOut, F_GETFL) | O_NONBLOCK);
+    register_readfd(fdIn, persist2_readable, h);
+    /*
+     * commands may follow the PING at once
+     */
+    if (!persist2_send(h, "PING 2\n", 7)) {
+        close_persist2_helper(h);
+        return 0;
+    }
+    DEBUGMSGTL(("ucd-snmp/pass_persist", "started %s, pid %d\n",
+                h->pass->command, (int) pid));
+    return 1;
+}
+
+/*
+ * The least busy helper of a registration, started if needed.
+ */
+static struct persist2_helper *
+persist2_pick_helper(struct persist2_passthru *pass)
+{
+    struct persist2_helper *best = NULL, *idle = NULL;
+    int             i;
+
+    for (i = 0; i < pass->nhelpers; i++) {
+        if (pass->helpers[i].pid == NETSNMP_NO_SUCH_PROCESS) {
+            if (!idle)
+                idle = &pass->helpers[i];
+        } else if (!best ||
+                   pass->helpers[i].outstanding < best->outstanding)
+            best = &pass->helpers[i];
+    }
+    if (idle && (!best || best->outstanding > 0) &&
+        open_persist2_helper(idle))
+        return idle;
+    return best;
+}
+
+/*
+ * Copy a line of the input into buf, with its newline.  Returns 0 if the
+ * line is not complete yet.
+ */
+struct persist2_cursor {
+    char           *pos;
+    char           *end;
+};
+
+static int
+persist2_getline(struct persist2_cursor *cur, char *buf, size_t size)
+{
+    char           *nl = memchr(cur->pos, '\n', cur->end - cur->pos);
+    size_t          len;
+
+    if (!nl)
+        return 0;
+    len = nl + 1 - cur->pos;
+    if (len >= size) {
+        memcpy(buf, cur->pos, size - 2);
+        buf[size - 2] = '\n';
+        buf[size - 1] = '\0';
+    } else {
+        memcpy(buf, cur->pos, len);
+        buf[len] = '\0';
+    }
+    cur->pos = nl + 1;
+    return 1;
+}
+
+/*
+ * Parse a varbind returned by a helper into var.
+ */
+static int
+persist2_parse_varbind(netsnmp_variable_list *var, char *name, char *type,
+                       char *value)
+{
+    struct variable vp;
+    oid             newname[MAX_OID_LEN];
+    int             newlen;
+    size_t          val_len;
+    u_char         *val;
+
+    newlen = parse_miboid(name, newname);
+    if (newlen <= 0)
+        return 0;
+    val = netsnmp_internal_pass_parse(type, value, &val_len, &vp);
+    if (!val)
+        return 0;
+    snmp_set_var_objid(var, newname, newlen);
+    snmp_set_var_typed_value(var, vp.type, val, val_len);
+    return 1;
+}
+
+static void
+persist2_free_prefetch(void *data)
+{
+    struct persist2_prefetch **head = (struct persist2_prefetch **) data;
+    struct persist2_prefetch *p;
+
+    while ((p = *head) != NULL) {
+        *head = p->next;
+        free(p->from);
+        snmp_free_var(p->var);
+        free(p);
+    }
+    free(head);
+}
+
+static void
+persist2_add_prefetch(netsnmp_agent_request_info *reqinfo,
+                      struct persist2_passthru *pass, const oid *from,
+                      size_t from_len, netsnmp_variable_list *var)
+{
+    struct persist2_prefetch **head, *p;
+
+    head = netsnmp_agent_get_list_data(reqinfo, PERSIST2_PREFETCH);
+    if (!head) {
+        head = calloc(1, sizeof(*head));
+        if (!head)
+            return;
+        netsnmp_agent_add_list_data(reqinfo,
+                                    netsnmp_create_data_list(PERSIST2_PREFETCH,
+                                        head, persist2_free_prefetch));
+    }
+    p = SNMP_MALLOC_TYPEDEF(struct persist2_prefetch);
+    if (!p)
+        return;
+    p->pass = pass;
+    p->from = snmp_duplicate_objid(from, from_len);
+    p->from_len = from_len;
+    p->var = snmp_clone_varbind(var);
+    p->next = *head;
+    *head = p;
+}
+
+/*
+ * Answer a GETNEXT from what a previous getbulk command returned.
+ */
+static int
+persist2_use_prefetch(netsnmp_agent_request_info *reqinfo,
+                      struct persist2_passthru *pass, const oid *name,
+                      size_t name_len, netsnmp_variable_list *vb)
+{
+    struct persist2_prefetch **head, **pp, *p;
+
+    head = netsnmp_agent_get_list_data(reqinfo, PERSIST2_PREFETCH);
+    if (!head)
+        return 0;
+    for (pp = head; (p = *pp) != NULL; pp = &p->next) {
+        if (p->pass == pass &&
+            snmp_oid_compare(p->from, p->from_len, name, name_len) == 0) {
+            snmp_set_var_objid(vb, p->var->name, p->var->name_length);
+            snmp_set_var_typed_value(vb, p->var->type, p->var->val.string,
+                                     p->var->val_len);
+            *pp = p->next;
+            free(p->from);
+            snmp_free_var(p->var);
+            free(p);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Process the reply to a command at the cursor, or just check that it is
+ * complete if apply is 0.  Returns 1 if the reply is complete, 0 if more
+ * input is needed and -1 on a protocol error.
+ */
+static int
+persist2_reply(struct persist2_helper *h, struct persist2_cursor *cur,
+               int apply)
+{
+    char            name[SNMP_MAXBUF], type[SNMP_MAXBUF], value[SNMP_MAXBUF];
+    struct persist2_command *cmd, **pcmd;
+    netsnmp_delegated_cache *cache = NULL;
+    netsnmp_variable_list var, *vb;
+    oid             prev[MAX_OID_LEN];
+    size_t          prev_len;
+    u_int           id;
+    int             n, i, j, k, err;
+
+    if (!persist2_getline(cur, name, sizeof(name)))
+        return 0;
+    if (sscanf(name, "%u %d", &id, &n) != 2)
+        return -1;
+    for (pcmd = &h->commands; (cmd = *pcmd) != NULL; pcmd = &cmd->next)
+        if (cmd->id == id)
+            break;
+    if (!cmd || n != cmd->count)
+        return -1;
+    if (apply)
+        cache = netsnmp_handler_check_cache(cmd->cache);
+    memset(&var, 0, sizeof(var));
+
+    for (i = 0; i < n; i++) {
+        vb = cmd->vbs[i].request->requestvb;
+        switch (cmd->verb) {
+        case PERSIST2_SET:
+            if (!persist2_getline(cur, name, sizeof(name)))
+                return 0;
+            if (cache) {
+                err = netsnmp_internal_pass_str_to_errno(name);
+                if (err != SNMP_ERR_NOERROR)
+                    netsnmp_set_request_error(cache->reqinfo,
+                                              cmd->vbs[i].request, err);
+            }
+            break;
+
+        case PERSIST2_GETBULK:
+            if (!persist2_getline(cur, name, sizeof(name)))
+                return 0;
+            k = atoi(name);
+            if (k < 0)
+                return -1;
+            memcpy(prev, cmd->vbs[i].name, cmd->vbs[i].name_len * sizeof(oid));
+            prev_len = cmd->vbs[i].name_len;
+            for (j = 0; j < k; j++) {
+                if (!persist2_getline(cur, name, sizeof(name)) ||
+                    !persist2_getline(cur, type, sizeof(type)) ||
+                    !persist2_getline(cur, value, sizeof(value)))
+                    return 0;
+                /*
+                 * the values must follow each other, or the rest is
+                 * ignored
+                 */
+                if (!cache || prev_len == 0 ||
+                    !persist2_parse_varbind(&var, name, type, value) ||
+                    snmp_oid_compare(var.name, var.name_length,
+                                     prev, prev_len) <= 0) {
+                    prev_len = 0;
+                    continue;
+                }
+                if (j == 0) {
+                    snmp_set_var_objid(vb, var.name, var.name_length);
+                    snmp_set_var_typed_value(vb, var.type, var.val.string,
+                                             var.val_len);
+                } else
+                    persist2_add_prefetch(cache->reqinfo, h->pass, prev,
+                                          prev_len, &var);
+                memcpy(prev, var.name, var.name_length * sizeof(oid));
+                prev_len = var.name_length;
+            }
+            break;
+
+        default:
+            if (!persist2_getline(cur, name, sizeof(name)))
+                return 0;
+            if (!strncmp(name, "NONE", 4)) {
+                if (cache && cmd->verb == PERSIST2_GET)
+                    netsnmp_set_request_error(cache->reqinfo,
+                                              cmd->vbs[i].request,
+                                              SNMP_NOSUCHINSTANCE);
+                break;
+            }
+            if (!persist2_getline(cur, type, sizeof(type)) ||
+                !persist2_getline(cur, value, sizeof(value)))
+                return 0;
+            if (!cache)
+                break;
+            if (!persist2_parse_varbind(&var, name, type, value)) {
+                if (cmd->verb == PERSIST2_GET)
+                    netsnmp_set_request_error(cache->reqinfo,
+                                              cmd->vbs[i].request,
+                                              SNMP_ERR_GENERR);
+                break;
+            }
+            if (cmd->verb == PERSIST2_GETNEXT) {
+                if (snmp_oid_compare(var.name, var.name_length,
+                                     cmd->vbs[i].name,
+                                     cmd->vbs[i].name_len) <= 0)
+                    break;      /* would loop */
+                snmp_set_var_objid(vb, var.name, var.name_length);
+            }
+            snmp_set_var_typed_value(vb, var.type, var.val.string,
+                                     var.val_len);
+        }
+        snmp_reset_var_buffers(&var);
+    }
+
+    if (apply) {
+        *pcmd = cmd->next;
+        h->outstanding--;
+        persist2_finish(cmd, 1);
+    }
+    return 1;
+}
+
+static void
+persist2_readable(int fd, void *clientarg)
+{
+    struct persist2_helper *h = (struct persist2_helper *) clientarg;
+    struct persist2_cursor cur;
+    char            line[SNMP_MAXBUF], *in, *start;
+    ssize_t         n;
+    int             ret;
+
+    if (h->in_size - h->in_len < SNMP_MAXBUF) {
+        if (h->in_size >= PERSIST2_MAX_INPUT) {
+            snmp_log(LOG_ERR, "pass_persist: %s sent a reply too long - "
+                     "closing pipe\n", h->pass->command);
+            close_persist2_helper(h);
+            return;
+        }
+        in = realloc(h->in, h->in_size + SNMP_MAXBUF);
+        if (!in)
+            return;
+        h->in = in;
+        h->in_size += SNMP_MAXBUF;
+    }
+    n = read(fd, h->in + h->in_len, h->in_size - h->in_len);
+    if (n <= 0) {
+        if (n < 0 && (errno == EINTR || errno == EAGAIN))
+            return;
+        DEBUGMSGTL(("ucd-snmp/pass_persist", "%s closed its output\n",
+                    h->pass->command));
+        close_persist2_helper(h);
+        return;
+    }
+    h->in_len += n;
+
+    cur.pos = h->in;
+    cur.end = h->in + h->in_len;
+    while (cur.pos < cur.end) {
+        start = cur.pos;
+        if (!h->ready) {
+            if (!persist2_getline(&cur, line, sizeof(line)))
+                break;
+            if (strncmp(line, "PONG 2", 6)) {
+                snmp_log(LOG_ERR, "pass_persist: %s does not speak "
+                         "protocol 2 - closing pipe\n", h->pass->command);
+                close_persist2_helper(h);
+                return;
+            }
+            h->ready = 1;
+            continue;
+        }
+        ret = persist2_reply(h, &cur, 0);
+        if (ret == 0)
+            break;
+        if (ret < 0) {
+            snmp_log(LOG_ERR, "pass_persist: invalid reply from %s - "
+                     "closing pipe\n", h->pass->command);
+            close_persist2_helper(h);
+            return;
+        }
+        cur.pos = start;
+        persist2_reply(h, &cur, 1);
+    }
+    h->in_len = cur.end - cur.pos;
+    memmove(h->in, cur.pos, h->in_len);
+}
+
+/*
+ * Append to a command, growing the buffer as needed.
+ */
+static int
+persist2_append(char **buf, size_t *buf_len, size_t *out_len,
+                const char *str)
+{
+    return snmp_strcat((u_char **) buf, buf_len, out_len, 1,
+                       (const u_char *) str);
+}
+
+static int
+persist2_handler(netsnmp_mib_handler *handler,
+                 netsnmp_handler_registration *reginfo,
+                 netsnmp_agent_request_info *reqinfo,
+                 netsnmp_request_info *requests)
+{
+    static const char *verbs[] = { "get", "getnext", "getbulk", "set" };
+    struct persist2_passthru *pass =
+        (struct persist2_passthru *) handler->myvoid;
+    struct persist2_helper *h;
+    struct persist2_command *cmd;
+    struct persist2_varbind *v;
+    netsnmp_request_info *request;
+    netsnmp_variable_list *vb;
+    char           *buf = NULL, line[SNMP_MAXBUF];
+    size_t          buf_len = 0, out_len = 0;
+    int             verb, count = 0, reps = 0, rtest, ok;
+
+    switch (reqinfo->mode) {
+    case MODE_GET:
+        verb = PERSIST2_GET;
+        break;
+    case MODE_GETNEXT:
+        verb = PERSIST2_GETNEXT;
+        if (reqinfo->asp && reqinfo->asp->pdu &&
+            reqinfo->asp->pdu->command == SNMP_MSG_GETBULK)
+            verb = PERSIST2_GETBULK;
+        break;
+#ifndef NETSNMP_NO_WRITE_SUPPORT
+    case MODE_SET_ACTION:
+        verb = PERSIST2_SET;
+        break;
+#endif /* !NETSNMP_NO_WRITE_SUPPORT */
+    default:
+        return SNMP_ERR_NOERROR;
+    }
+
+    for (request = requests; request; request = request->next)
+        if (!request->processed)
+            count++;
+    cmd = SNMP_MALLOC_TYPEDEF(struct persist2_command);
+    if (cmd)
+        cmd->vbs = calloc(count ? count : 1, sizeof(*cmd->vbs));
+    if (!cmd || !cmd->vbs) {
+        SNMP_FREE(cmd);
+        netsnmp_set_request_error(reqinfo, requests, SNMP_ERR_GENERR);
+        return SNMP_ERR_NOERROR;
+    }
+    cmd->verb = verb;
+
+    /*
+     * the OIDs to ask for; a GETNEXT before the subtree asks for its root
+     */
+    for (request = requests; request; request = request->next) {
+        if (request->processed)
+            continue;
+        vb = request->requestvb;
+        v = &cmd->vbs[cmd->count];
+        rtest = snmp_oidtree_compare(vb->name, vb->name_length,
+                                     pass->miboid, pass->miblen);
+        if (verb != PERSIST2_GET && verb != PERSIST2_SET &&
+            (pass->miblen >= vb->name_length || rtest < 0)) {
+            memcpy(v->name, pass->miboid, pass->miblen * sizeof(oid));
+            v->name_len = pass->miblen;
+        } else {
+            memcpy(v->name, vb->name, vb->name_length * sizeof(oid));
+            v->name_len = vb->name_length;
+        }
+        if (verb == PERSIST2_GETBULK &&
+            persist2_use_prefetch(reqinfo, pass, v->name, v->name_len, vb))
+            continue;
+        v->request = request;
+        if (verb == PERSIST2_GETBULK && request->repeat + 1 > reps)
+            reps = request->repeat + 1;
+        cmd->count++;
+    }
+    if (cmd->count == 0) {
+        free(cmd->vbs);
+        free(cmd);
+        return SNMP_ERR_NOERROR;
+    }
+
+    h = persist2_pick_helper(pass);
+    if (!h) {
+        free(cmd->vbs);
+        free(cmd);
+        if (verb == PERSIST2_GET || verb == PERSIST2_SET)
+            netsnmp_set_request_error(reqinfo, requests, SNMP_ERR_GENERR);
+        return SNMP_ERR_NOERROR;
+    }
+
+    cmd->id = ++persist2_next_id;
+    if (verb == PERSIST2_GETBULK)
+        snprintf(line, sizeof(line), "%u getbulk %d %d\n", cmd->id,
+                 cmd->count, reps);
+    else
+        snprintf(line, sizeof(line), "%u %s %d\n", cmd->id, verbs[verb],
+                 cmd->count);
+    ok = persist2_append(&buf, &buf_len, &out_len, line);
+    for (v = cmd->vbs; ok && v < cmd->vbs + cmd->count; v++) {
+        snprint_mib_oid(line, sizeof(line) - 1, v->name, v->name_len);
+        strcat(line, "\n");
+        ok = persist2_append(&buf, &buf_len, &out_len, line);
+#ifndef NETSNMP_NO_WRITE_SUPPORT
+        if (ok && verb == PERSIST2_SET) {
+            vb = v->request->requestvb;
+            netsnmp_internal_pass_set_format(line, vb->val.string, vb->type,
+                                             vb->val_len);
+            ok = persist2_append(&buf, &buf_len, &out_len, line) &&
+                persist2_append(&buf, &buf_len, &out_len, "\n");
+        }
+#endif /* !NETSNMP_NO_WRITE_SUPPORT */
+    }
+    DEBUGMSGTL(("ucd-snmp/pass_persist", "persistpass-sending:\n%s",
+                buf ? buf : ""));
+
+    for (v = cmd->vbs; v < cmd->vbs + cmd->count; v++)
+        netsnmp_request_delegate(v->request);
+    cmd->cache = netsnmp_create_delegated_cache(handler, reginfo, reqinfo,
+                                                requests, pass);
+    cmd->deadline = time(NULL) + PERSIST2_TIMEOUT;
+    cmd->next = h->commands;
+    h->commands = cmd;
+    h->outstanding++;
+    if (!persist2_alarm_id)
+        persist2_alarm_id = snmp_alarm_register(1, SA_REPEAT,
+                                                persist2_check_timeouts,
+                                                NULL);
+    if (!ok || !persist2_send(h, buf, out_len)) {
+        DEBUGMSGTL(("ucd-snmp/pass_persist", "cannot write to %s\n",
+                    pass->command));
+        close_persist2_helper(h);
+    }
+    free(buf);
+    return SNMP_ERR_NOERROR;
+}
+#endif /* PASS_PERSIST_V2 */
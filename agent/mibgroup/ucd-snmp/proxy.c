@@ -504,7 +504,7 @@ proxy_handler(netsnmp_mib_handler *handler,
                               request->requestvb->type,
                               request->requestvb->val.string,
                               request->requestvb->val_len);
-        request->delegated = 1;
+        netsnmp_request_delegate(request);
         request = request->next;
     }
 
@@ -647,7 +647,7 @@ proxy_got_response(int operation, netsnmp_session * sess, int reqid,
             DEBUGMSGTL(("proxy", "got response... "));
             DEBUGMSGOID(("proxy", var->name, var->name_length));
             DEBUGMSG(("proxy", "\n"));
-            request->delegated = 0;
+            netsnmp_request_completed(request);
 
             /*
              * Check the response oid is legitimate,
@@ -451,3 +451,102 @@ run_exec_command(const char *command, const char *input,
     return run_shell_command( command, input, output, out_len );
 #endif
 }
+
+/**
+ * Start a command without waiting for it to finish.
+ *
+ * @command: Command to run.
+ * @input:   Data to send to stdin. May be NULL.
+ * @shell:   Run the command through /bin/sh rather than calling execv().
+ * @fd:      The read end of a non-blocking pipe carrying the output of
+ *           the command is stored in *@fd.
+ *
+ * The command is started in a process group of its own, so that it can be
+ * killed together with its children.  The caller reads the output from
+ * *@fd, closes it and collects the exit status with waitpid().
+ *
+ * @return the process ID of the command; -1 if the command could not
+ *           be started.
+ */
+int
+start_exec_command(const char *command, const char *input, int shell,
+                   int *fd)
+{
+#ifdef HAVE_EXECV
+    int ipipe[2];
+    int opipe[2];
+    int i;
+    int pid;
+    char **argv;
+    int argc;
+
+    DEBUGMSGTL(("run:exec", "starting '%s'\n", command));
+    if (pipe(ipipe) < 0) {
+        snmp_log_perror("pipe");
+        return -1;
+    }
+    if (pipe(opipe) < 0) {
+        snmp_log_perror("pipe");
+        close(ipipe[0]);
+        close(ipipe[1]);
+        return -1;
+    }
+    if ((pid = fork()) == 0) {
+        /*
+         * Child process: as in run_exec_command(), except that the
+         *   shell variant leaves stderr alone (like popen() does)
+         */
+        if (dup2(ipipe[0], STDIN_FILENO) < 0 ||
+            dup2(opipe[1], STDOUT_FILENO) < 0 ||
+            (!shell && dup2(STDOUT_FILENO, STDERR_FILENO) < 0))
+            exit(1);
+        close(ipipe[0]);
+        close(ipipe[1]);
+        close(opipe[0]);
+        close(opipe[1]);
+        netsnmp_close_fds(2);
+#ifdef HAVE_SETSID
+        setsid();
+#endif
+
+        if (shell) {
+            execl("/bin/sh", "sh", "-c", command, (char *) NULL);
+            exit(127);
+        }
+        argv = tokenize_exec_command(command, &argc);
+        if (!argv)
+            exit(1);
+        execv(argv[0], argv);
+        snmp_log_perror(argv[0]);
+        for (i = 0; i < argc; i++)
+            free(argv[i]);
+        free(argv);
+        exit(1);
+    } else if (pid < 0) {
+        snmp_log_perror("fork");
+        close(ipipe[0]);
+        close(ipipe[1]);
+        close(opipe[0]);
+        close(opipe[1]);
+        return -1;
+    }
+
+    /*
+     * Parent process.  The input is at most a DisplayString, so it
+     *   fits into the pipe without blocking.
+     */
+    close(ipipe[0]);
+    close(opipe[1]);
+    if (input && write(ipipe[1], input, strlen(input)) < 0)
+        snmp_log_perror("write() to input pipe");
+    close(ipipe[1]);
+#ifdef O_NONBLOCK
+    fcntl(opipe[0], F_SETFL, fcntl(opipe[0], F_GETFL) | O_NONBLOCK);
+#endif
+    *fd = opipe[0];
+    DEBUGMSGTL(("run:exec", "  started child %d\n", pid));
+    return pid;
+#else
+    return -1;
+#endif
+}
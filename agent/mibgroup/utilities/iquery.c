@@ -130,6 +130,9 @@ void init_iquery(void){
     netsnmp_ds_register_premib(ASN_OCTET_STR, type, "iquerySecName",
                                NETSNMP_DS_APPLICATION_ID,
                                NETSNMP_DS_AGENT_INTERNAL_SECNAME);
+    netsnmp_ds_register_premib(ASN_BOOLEAN, type, "iqueryDirect",
+                               NETSNMP_DS_APPLICATION_ID,
+                               NETSNMP_DS_AGENT_INTERNAL_DIRECT);
 
     snmpd_register_config_handler("iqueryVersion",
                                    netsnmp_parse_iqueryVersion, NULL,
@@ -146,6 +149,8 @@ void init_iquery(void){
     netsnmp_ds_set_int(NETSNMP_DS_APPLICATION_ID,
                        NETSNMP_DS_AGENT_INTERNAL_SECLEVEL, SNMP_SEC_LEVEL_AUTHNOPRIV);
 
+    netsnmp_query_set_direct_handler(netsnmp_agent_direct_query);
+
     snmp_register_callback(SNMP_CALLBACK_LIBRARY, 
                            SNMP_CALLBACK_POST_PREMIB_READ_CONFIG,
                            _init_default_iquery_session, NULL);
@@ -232,6 +237,9 @@ netsnmp_session *netsnmp_iquery_session(char* secName,   int   version,
         }
         ss->myvoid = (void *)netsnmp_check_outstanding_agent_requests;
         ss->flags |= SNMP_FLAGS_RESP_CALLBACK | SNMP_FLAGS_DONT_PROBE;
+        if (netsnmp_ds_get_boolean(NETSNMP_DS_APPLICATION_ID,
+                                   NETSNMP_DS_AGENT_INTERNAL_DIRECT))
+            ss->flags |= SNMP_FLAGS_DIRECT_QUERY;
     }
 #endif
 
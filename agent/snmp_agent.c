@@ -363,6 +363,12 @@ static agent_nsap *agent_nsap_list = NULL;
 netsnmp_agent_session *netsnmp_processing_set = NULL;
 netsnmp_agent_session *agent_delegated_list = NULL;
 netsnmp_agent_session *netsnmp_agent_queued_list = NULL;
+static netsnmp_agent_session *agent_delegated_tail = NULL;
+/*
+ * sessions with requests reported by netsnmp_request_completed()
+ */
+static netsnmp_agent_session *agent_completed_list = NULL;
+static netsnmp_agent_session *agent_completed_tail = NULL;
 
 
 int             handle_pdu(netsnmp_agent_session *asp);
@@ -1555,8 +1561,12 @@ shutdown_master_agent(void)
 }
 
 
-netsnmp_agent_session *
-init_agent_snmp_session(netsnmp_session * session, netsnmp_pdu *pdu)
+/*
+ * Set up an agent session for pdu (and orig_pdu), taking them over.
+ */
+static netsnmp_agent_session *
+_new_agent_session(netsnmp_session *session, netsnmp_pdu *pdu,
+                   netsnmp_pdu *orig_pdu)
 {
     netsnmp_agent_session *asp = calloc(1, sizeof(netsnmp_agent_session));
 
@@ -1566,12 +1576,8 @@ init_agent_snmp_session(netsnmp_session * session, netsnmp_pdu *pdu)
 
     DEBUGMSGTL(("snmp_agent","agent_sesion %8p created\n", asp));
     asp->session = session;
-    asp->pdu = snmp_clone_pdu(pdu);
-    if (!asp->pdu)
-        goto err;
-    asp->orig_pdu = snmp_clone_pdu(pdu);
-    if (!asp->orig_pdu)
-        goto err;
+    asp->pdu = pdu;
+    asp->orig_pdu = orig_pdu;
     asp->rw = READ;
     asp->exact = TRUE;
     asp->next = NULL;
@@ -1587,12 +1593,22 @@ init_agent_snmp_session(netsnmp_session * session, netsnmp_pdu *pdu)
                 asp, asp->reqinfo));
 
     return asp;
+}
 
-err:
-    snmp_free_pdu(asp->orig_pdu);
-    snmp_free_pdu(asp->pdu);
-    free(asp);
-    return NULL;
+netsnmp_agent_session *
+init_agent_snmp_session(netsnmp_session * session, netsnmp_pdu *pdu)
+{
+    netsnmp_pdu    *copy = snmp_clone_pdu(pdu);
+    netsnmp_pdu    *orig = snmp_clone_pdu(pdu);
+    netsnmp_agent_session *asp = NULL;
+
+    if (copy && orig)
+        asp = _new_agent_session(session, copy, orig);
+    if (!asp) {
+        snmp_free_pdu(orig);
+        snmp_free_pdu(copy);
+    }
+    return asp;
 }
 
 void
@@ -1655,15 +1671,60 @@ netsnmp_check_for_delegated(netsnmp_agent_session *asp)
     return 0;
 }
 
+/*
+ * Does any delegated request of asp have to be polled, rather than being
+ * reported by netsnmp_request_completed()?
+ */
+static int
+_delegated_needs_poll(netsnmp_agent_session *asp)
+{
+    int             i;
+    netsnmp_request_info *request;
+
+    for (i = 0; i <= asp->treecache_num; i++) {
+        for (request = asp->treecache[i].requests_begin; request;
+             request = request->next) {
+            if (request->delegated &&
+                request->delegated != REQUEST_IS_DELEGATED_NOTIFY)
+                return 1;
+        }
+    }
+    return 0;
+}
+
 int
 netsnmp_check_delegated_chain_for(netsnmp_agent_session *asp)
 {
-    netsnmp_agent_session *asptmp;
-    for (asptmp = agent_delegated_list; asptmp; asptmp = asptmp->next) {
-        if (asptmp == asp)
-            return 1;
+    return (asp->flags & SNMP_AGENT_FLAGS_DELEGATED) != 0;
+}
+
+/*
+ * Sessions which have to be polled are kept at the head of the delegated
+ * list, the others are appended to it.
+ */
+static void
+_add_delegated(netsnmp_agent_session *asp)
+{
+    asp->flags |= SNMP_AGENT_FLAGS_DELEGATED;
+    if (_delegated_needs_poll(asp)) {
+        asp->flags |= SNMP_AGENT_FLAGS_POLL_DELEGATED;
+        asp->delegated_prev = NULL;
+        asp->next = agent_delegated_list;
+        if (agent_delegated_list)
+            agent_delegated_list->delegated_prev = asp;
+        else
+            agent_delegated_tail = asp;
+        agent_delegated_list = asp;
+    } else {
+        asp->flags &= ~SNMP_AGENT_FLAGS_POLL_DELEGATED;
+        asp->next = NULL;
+        asp->delegated_prev = agent_delegated_tail;
+        if (agent_delegated_tail)
+            agent_delegated_tail->next = asp;
+        else
+            agent_delegated_list = asp;
+        agent_delegated_tail = asp;
     }
-    return 0;
 }
 
 int
@@ -1674,9 +1735,10 @@ netsnmp_check_for_delegated_and_add(netsnmp_agent_session *asp)
             /*
              * add to delegated request chain 
              */
-            asp->next = agent_delegated_list;
-            agent_delegated_list = asp;
-            DEBUGMSGTL(("snmp_agent", "delegate session == %8p\n", asp));
+            _add_delegated(asp);
+            DEBUGMSGTL(("snmp_agent", "delegate session == %8p%s\n", asp,
+                        asp->flags & SNMP_AGENT_FLAGS_POLL_DELEGATED ?
+                        " (polled)" : ""));
         }
         return 1;
     }
@@ -1687,28 +1749,92 @@ int
 netsnmp_remove_from_delegated(netsnmp_agent_session *asp)
 {
     netsnmp_agent_session *curr, *prev = NULL;
-    
-    for (curr = agent_delegated_list; curr; prev = curr, curr = curr->next) {
-        /*
-         * is this us?
-         */
-        if (curr != asp)
-            continue;
-        
-        /*
-         * remove from queue 
-         */
+
+    if (!netsnmp_check_delegated_chain_for(asp))
+        return 0;
+
+    /*
+     * remove from queue 
+     */
+    if (asp->delegated_prev != NULL)
+        asp->delegated_prev->next = asp->next;
+    else
+        agent_delegated_list = asp->next;
+    if (asp->next != NULL)
+        asp->next->delegated_prev = asp->delegated_prev;
+    else
+        agent_delegated_tail = asp->delegated_prev;
+    asp->next = asp->delegated_prev = NULL;
+    asp->flags &= ~(SNMP_AGENT_FLAGS_DELEGATED |
+                    SNMP_AGENT_FLAGS_POLL_DELEGATED);
+
+    if (asp->flags & SNMP_AGENT_FLAGS_COMPLETED) {
+        for (curr = agent_completed_list; curr != asp;
+             prev = curr, curr = curr->completed_next)
+            ;
         if (prev != NULL)
-            prev->next = asp->next;
+            prev->completed_next = asp->completed_next;
         else
-            agent_delegated_list = asp->next;
+            agent_completed_list = asp->completed_next;
+        if (agent_completed_tail == asp)
+            agent_completed_tail = prev;
+        asp->completed_next = NULL;
+        asp->flags &= ~SNMP_AGENT_FLAGS_COMPLETED;
+    }
 
-        DEBUGMSGTL(("snmp_agent", "remove delegated session == %8p\n", asp));
+    DEBUGMSGTL(("snmp_agent", "remove delegated session == %8p\n", asp));
 
-        return 1;
-    }
+    return 1;
+}
 
-    return 0;
+/*
+ * Queue a delegated session to be looked at on the next pass of
+ * netsnmp_check_delegated_requests().
+ */
+static void
+_queue_completed(netsnmp_agent_session *asp)
+{
+    if ((asp->flags & (SNMP_AGENT_FLAGS_DELEGATED |
+                       SNMP_AGENT_FLAGS_COMPLETED)) !=
+        SNMP_AGENT_FLAGS_DELEGATED)
+        return;
+    asp->flags |= SNMP_AGENT_FLAGS_COMPLETED;
+    asp->completed_next = NULL;
+    if (agent_completed_tail)
+        agent_completed_tail->completed_next = asp;
+    else
+        agent_completed_list = asp;
+    agent_completed_tail = asp;
+}
+
+/** Delegate a request, to be answered later.
+ *  Unlike setting request->delegated, the handler promises to report the
+ *  answer with netsnmp_request_completed() (or by setting an error on
+ *  the request), so that the agent does not have to poll the request.
+ *
+ *  @param request the request being delegated
+ */
+void
+netsnmp_request_delegate(netsnmp_request_info *request)
+{
+    request->delegated = REQUEST_IS_DELEGATED_NOTIFY;
+}
+
+/** Report that a delegated request has been answered.
+ *  The agent session it belongs to is resumed by the next call of
+ *  netsnmp_check_outstanding_agent_requests(), once all of its delegated
+ *  requests are done.
+ *
+ *  @param request the request answered
+ */
+void
+netsnmp_request_completed(netsnmp_request_info *request)
+{
+    if (!request || !request->delegated)
+        return;
+    request->delegated = REQUEST_IS_NOT_DELEGATED;
+    if (request->agent_req_info && request->agent_req_info->asp)
+        _queue_completed(request->agent_req_info->asp);
 }
 
 /*
@@ -1750,6 +1876,7 @@ netsnmp_remove_delegated_requests_for_session(netsnmp_session *sess)
         }
         if (count) {
             asp->flags |= SNMP_AGENT_FLAGS_CANCEL_IN_PROGRESS;
+            _queue_completed(asp);
             total_count += count;
         }
     }
@@ -1906,6 +2033,17 @@ netsnmp_wrap_up_request(netsnmp_agent_session *asp, int status)
         netsnmp_processing_set = NULL;
     }
 
+    /*
+     * internal queries answered in-process have nobody to send a
+     * response to: netsnmp_agent_direct_query() collects the results.
+     */
+    if (asp->flags & SNMP_AGENT_FLAGS_DIRECT) {
+        if (status != 0 && asp->status == 0)
+            asp->status = status;
+        asp->flags |= SNMP_AGENT_FLAGS_DIRECT_DONE;
+        return 1;
+    }
+
     if (asp->pdu) {
         const int command = asp->pdu->command;
 
@@ -2249,6 +2387,141 @@ handle_snmp_packet(int op, netsnmp_session * session, int reqid,
     return rc;
 }
 
+/*
+ * Run the event loop until a delegated internal query has completed.
+ * Like snmp_synch_response(), alarms are left for the main loop.
+ */
+static void
+_direct_query_wait(netsnmp_agent_session *asp)
+{
+    int                  numfds, count, block;
+    netsnmp_large_fd_set readfds;
+    netsnmp_large_fd_set writefds;
+    netsnmp_large_fd_set exceptfds;
+    struct timeval       timeout, *tvp;
+
+    netsnmp_large_fd_set_init(&readfds, FD_SETSIZE);
+    netsnmp_large_fd_set_init(&writefds, FD_SETSIZE);
+    netsnmp_large_fd_set_init(&exceptfds, FD_SETSIZE);
+
+    while (!(asp->flags & SNMP_AGENT_FLAGS_DIRECT_DONE)) {
+        numfds = 0;
+        NETSNMP_LARGE_FD_ZERO(&readfds);
+        NETSNMP_LARGE_FD_ZERO(&writefds);
+        NETSNMP_LARGE_FD_ZERO(&exceptfds);
+        block = NETSNMP_SNMPBLOCK;
+        tvp = &timeout;
+        timerclear(tvp);
+        snmp_sess_select_info2_flags(NULL, &numfds, &readfds, tvp, &block,
+                                     NETSNMP_SELECT_NOALARMS);
+        if (block == 1)
+            tvp = NULL;
+#ifndef NETSNMP_FEATURE_REMOVE_FD_EVENT_MANAGER
+        netsnmp_external_event_info2(&numfds, &readfds, &writefds,
+                                     &exceptfds);
+#endif /* NETSNMP_FEATURE_REMOVE_FD_EVENT_MANAGER */
+
+        count = netsnmp_large_fd_set_select(numfds, &readfds, &writefds,
+                                            &exceptfds, tvp);
+        if (count > 0) {
+#ifndef NETSNMP_FEATURE_REMOVE_FD_EVENT_MANAGER
+            netsnmp_dispatch_external_events2(&count, &readfds, &writefds,
+                                              &exceptfds);
+#endif /* NETSNMP_FEATURE_REMOVE_FD_EVENT_MANAGER */
+            snmp_read2(&readfds);
+        } else if (count == 0) {
+            snmp_timeout();
+        } else if (errno != EINTR) {
+            snmp_log_perror("direct query: select");
+            /*
+             * give up on the outstanding requests rather than spin
+             */
+            netsnmp_remove_from_delegated(asp);
+            netsnmp_wrap_up_request(asp, SNMP_ERR_GENERR);
+            break;
+        }
+
+        netsnmp_check_outstanding_agent_requests();
+    }
+
+    netsnmp_large_fd_set_cleanup(&readfds);
+    netsnmp_large_fd_set_cleanup(&writefds);
+    netsnmp_large_fd_set_cleanup(&exceptfds);
+}
+
+/**
+ * Answer an internal GET or GETNEXT query in-process: the varbinds of
+ * the caller are passed down the handler chain as they are, without
+ * building, cloning and parsing PDUs on a callback session, and the
+ * results land in place.  SNMPv1/v2c sessions, SETs and requests that
+ * fail access control keep using the normal path.
+ *
+ * @return 1 if the query was answered, with the SNMP error status in
+ *         *status, or 0 if it should be sent on the session instead.
+ */
+int
+netsnmp_agent_direct_query(netsnmp_session *ss, netsnmp_variable_list *list,
+                           int command, int *status)
+{
+    netsnmp_agent_session *asp;
+    netsnmp_pdu    *pdu;
+    netsnmp_variable_list *vb, *ovb, *orig = NULL;
+
+    if ((command != SNMP_MSG_GET && command != SNMP_MSG_GETNEXT) ||
+        ss->version != SNMP_VERSION_3 || netsnmp_processing_set)
+        return 0;
+
+    pdu = snmp_pdu_create(command);
+    if (!pdu)
+        return 0;
+    pdu->version = ss->version;
+    pdu->securityModel = ss->securityModel;
+    pdu->securityLevel = ss->securityLevel;
+    if (ss->securityName) {
+        pdu->securityName = netsnmp_memdup(ss->securityName,
+                                           ss->securityNameLen + 1);
+        pdu->securityNameLen = ss->securityNameLen;
+    }
+    if (ss->contextName) {
+        pdu->contextName = netsnmp_memdup(ss->contextName,
+                                          ss->contextNameLen + 1);
+        pdu->contextNameLen = ss->contextNameLen;
+    }
+    pdu->transid = snmp_get_next_transid();
+    pdu->variables = list;
+
+    if (check_access(pdu) != 0 ||
+        (asp = _new_agent_session(ss, pdu, NULL)) == NULL) {
+        pdu->variables = NULL;
+        snmp_free_pdu(pdu);
+        return 0;
+    }
+    asp->flags |= SNMP_AGENT_FLAGS_DIRECT;
+    DEBUGMSGTL(("snmp_agent", "direct query, asp = %8p\n", asp));
+
+    /*
+     * a GETNEXT past the end of the view reports the requested OID
+     */
+    if (command == SNMP_MSG_GETNEXT)
+        orig = snmp_clone_varbind(list);
+
+    netsnmp_handle_request(asp, SNMP_ERR_NOERROR);
+    if (!(asp->flags & SNMP_AGENT_FLAGS_DIRECT_DONE))
+        _direct_query_wait(asp);
+
+    for (vb = list, ovb = orig; vb && ovb;
+         vb = vb->next_variable, ovb = ovb->next_variable) {
+        if (vb->type == SNMP_ENDOFMIBVIEW)
+            snmp_set_var_objid(vb, ovb->name, ovb->name_length);
+    }
+    snmp_free_varbind(orig);
+
+    *status = asp->status;
+    asp->pdu->variables = NULL;
+    free_agent_snmp_session(asp);
+    return 1;
+}
+
 netsnmp_request_info *
 netsnmp_add_varbind_to_cache(netsnmp_agent_session *asp, int vbcount,
                              netsnmp_variable_list * varbind_ptr,
@@ -3020,48 +3293,53 @@ handle_var_requests(netsnmp_agent_session *asp)
     return final_status;
 }
 
-void
-netsnmp_check_delegated_requests(void)
+static void
+_resume_delegated(netsnmp_agent_session *asp)
 {
-    netsnmp_agent_session *asp, *prev_asp = NULL, *next_asp = NULL;
+    /*
+     * we're done with this one, remove from queue 
+     */
+    netsnmp_remove_from_delegated(asp);
 
-    for (asp = agent_delegated_list; asp; asp = next_asp) {
-        next_asp = asp->next;   /* save in case we clean up asp */
-        if (!netsnmp_check_for_delegated(asp)) {
+    /*
+     * check request status
+     */
+    netsnmp_check_all_requests_status(asp, 0);
 
-            /*
-             * we're done with this one, remove from queue 
-             */
-            if (prev_asp != NULL)
-                prev_asp->next = asp->next;
-            else
-                agent_delegated_list = asp->next;
-            asp->next = NULL;
+    /*
+     * continue processing or finish up 
+     */
+    check_delayed_request(asp);
+}
 
-            /*
-             * check request status
-             */
-            netsnmp_check_all_requests_status(asp, 0);
-            
-            /*
-             * continue processing or finish up 
-             */
-            check_delayed_request(asp);
+void
+netsnmp_check_delegated_requests(void)
+{
+    netsnmp_agent_session *asp, *next_asp;
 
-            /*
-             * if head was removed, don't drop it if it
-             * was it re-queued
-             */
-            if ((prev_asp == NULL) && (agent_delegated_list == asp)) {
-                prev_asp = asp;
-            }
-        } else {
+    /*
+     * sessions with requests reported as completed
+     */
+    while ((asp = agent_completed_list) != NULL) {
+        agent_completed_list = asp->completed_next;
+        if (agent_completed_list == NULL)
+            agent_completed_tail = NULL;
+        asp->completed_next = NULL;
+        asp->flags &= ~SNMP_AGENT_FLAGS_COMPLETED;
+        if (!netsnmp_check_for_delegated(asp))
+            _resume_delegated(asp);
+    }
 
-            /*
-             * asp is still on the queue
-             */
-            prev_asp = asp;
-        }
+    /*
+     * sessions whose handlers clear request->delegated by themselves,
+     * at the head of the list
+     */
+    for (asp = agent_delegated_list;
+         asp && (asp->flags & SNMP_AGENT_FLAGS_POLL_DELEGATED);
+         asp = next_asp) {
+        next_asp = asp->next;   /* save in case we clean up asp */
+        if (!netsnmp_check_for_delegated(asp))
+            _resume_delegated(asp);
     }
 }
 
@@ -3175,17 +3453,7 @@ check_delayed_request(netsnmp_agent_session *asp)
             break;
         }
         handle_getnext_loop(asp);
-        if (netsnmp_check_for_delegated(asp) &&
-            netsnmp_check_transaction_id(asp->pdu->transid) !=
-            SNMPERR_SUCCESS) {
-            /*
-             * add to delegated request chain 
-             */
-            if (!netsnmp_check_delegated_chain_for(asp)) {
-                asp->next = agent_delegated_list;
-                agent_delegated_list = asp;
-            }
-        }
+        netsnmp_check_for_delegated_and_add(asp);
         break;
 
 #ifndef NETSNMP_NO_WRITE_SUPPORT
@@ -3291,6 +3559,20 @@ check_getnext_results(netsnmp_agent_session *asp)
                      */
                     snmp_set_var_typed_value(request->requestvb,
                                              ASN_PRIV_RETRY, NULL, 0);
+                } else if (asp->mode == SNMP_MSG_GETBULK &&
+                           request->repeat > 0 &&
+                           request->requestvb->next_variable) {
+                    /*
+                     * the GET answered the first repetition of a GETBULK,
+                     * search for the next ones after it. 
+                     */
+                    request->repeat--;
+                    snmp_set_var_objid(request->requestvb->next_variable,
+                                       request->requestvb->name,
+                                       request->requestvb->name_length);
+                    request->requestvb = request->requestvb->next_variable;
+                    request->requestvb->type = ASN_PRIV_RETRY;
+                    request->inclusive = 0;
                 }
             }
 
@@ -3893,7 +4175,7 @@ _request_set_error(netsnmp_request_info *request, int mode, int error_value)
         return SNMPERR_NO_VARS;
 
     request->processed = 1;
-    request->delegated = REQUEST_IS_NOT_DELEGATED;
+    netsnmp_request_completed(request);
 
     switch (error_value) {
     case SNMP_NOSUCHOBJECT:
@@ -56,6 +56,7 @@ SOFTWARE.
 #endif
 #include <stdio.h>
 #include <ctype.h>
+#include <errno.h>
 #ifdef HAVE_NETDB_H
 #include <netdb.h>
 #endif
@@ -72,6 +73,35 @@ SOFTWARE.
 oid             objid_mib[] = { 1, 3, 6, 1, 2, 1 };
 int             numprinted = 0;
 int             reps = 10, non_reps = 0;
+int             nranges = 1, max_inflight = 8;
+
+/*
+ * Parallel walk state (-CP).  The subtree is cut into ranges
+ * [start, end) which are walked concurrently, one outstanding GETBULK
+ * per range.  Results of a range are buffered until all ranges before it
+ * have been printed, so the output is in the same order as a sequential
+ * walk.
+ */
+#define MAX_RANGES	64
+
+#define RANGE_IDLE	0
+#define RANGE_WAITING	1
+#define RANGE_DONE	2
+
+struct walk_range {
+    int             state;
+    oid             name[MAX_OID_LEN];  /* last OID received */
+    size_t          name_length;
+    oid             end[MAX_OID_LEN];   /* first OID of the next range */
+    size_t          end_length;         /* 0 for the last range */
+    netsnmp_variable_list *head, *tail; /* results not printed yet */
+};
+
+static struct walk_range *ranges;
+static oid     *walk_root;
+static size_t   walk_rootlen;
+static int      inflight, out_range, walk_aborted, walk_exitval, walk_eom;
+static int      walk_status;
 
 void
 usage(void)
@@ -90,6 +120,10 @@ usage(void)
     fprintf(stderr,
             "\t\t\t  p:       print the number of variables found\n");
     fprintf(stderr, "\t\t\t  r<NUM>:  set max-repeaters to <NUM>\n");
+    fprintf(stderr,
+            "\t\t\t  P<NUM>:  walk the subtree as <NUM> ranges in parallel\n");
+    fprintf(stderr,
+            "\t\t\t  O<NUM>:  with P, allow at most <NUM> outstanding requests\n");
 }
 
 static void
@@ -114,6 +148,348 @@ snmp_get_and_print(netsnmp_session * ss, oid * theoid, size_t theoid_len)
     }
 }
 
+static int
+in_subtree(const oid * name, size_t name_length)
+{
+    return name_length >= walk_rootlen &&
+        memcmp(walk_root, name, walk_rootlen * sizeof(oid)) == 0;
+}
+
+/*
+ * Find the points at which to cut the subtree into (at most) wanted
+ * ranges.  Starting at the root, the children of a node are found with
+ * one GETNEXT each, skipping over the subtree of the previous child;
+ * while a node has a single child (e.g. a table and its entry) we
+ * descend into it.  The ranges are then cut at evenly spaced children of
+ * the first node that branches, which for a table are its columns and for
+ * a single column the first index sub-identifier.
+ *
+ * The cut points only affect how evenly the work is spread: the ranges
+ * are contiguous, so every OID in the subtree belongs to exactly one of
+ * them whatever the probes found.
+ *
+ * Returns the number of ranges, or -1 if the agent could not be queried.
+ */
+static int
+split_subtree(netsnmp_session * ss, int wanted)
+{
+    oid             prefix[MAX_OID_LEN], probe[MAX_OID_LEN];
+    size_t          prefix_length, probe_length;
+    oid             arcs[MAX_RANGES * 8];
+    int             cuts[MAX_RANGES * 8];
+    int             nchildren, ncuts, leaf, i, j;
+    netsnmp_pdu    *pdu, *response;
+    netsnmp_variable_list *vars;
+    int             status;
+
+    memmove(prefix, walk_root, walk_rootlen * sizeof(oid));
+    prefix_length = walk_rootlen;
+
+    for (;;) {
+        nchildren = ncuts = leaf = 0;
+        memmove(probe, prefix, prefix_length * sizeof(oid));
+        probe_length = prefix_length;
+
+        while (nchildren < wanted * 8) {
+            pdu = snmp_pdu_create(SNMP_MSG_GETNEXT);
+            snmp_add_null_var(pdu, probe, probe_length);
+            status = snmp_synch_response(ss, pdu, &response);
+            if (status == STAT_TIMEOUT) {
+                fprintf(stderr, "Timeout: No Response from %s\n",
+                        ss->peername);
+                walk_status = status;
+                return -1;
+            } else if (status != STAT_SUCCESS) {
+                snmp_sess_perror("snmpbulkwalk", ss);
+                walk_status = status;
+                if (response)
+                    snmp_free_pdu(response);
+                return -1;
+            }
+            vars = response->variables;
+            if (response->errstat != SNMP_ERR_NOERROR || vars == NULL ||
+                vars->type == SNMP_ENDOFMIBVIEW ||
+                vars->type == SNMP_NOSUCHOBJECT ||
+                vars->type == SNMP_NOSUCHINSTANCE ||
+                vars->name_length <= prefix_length ||
+                memcmp(prefix, vars->name,
+                       prefix_length * sizeof(oid)) != 0) {
+                /*
+                 * no more children; errors are left for the walk itself
+                 * to report
+                 */
+                snmp_free_pdu(response);
+                break;
+            }
+            arcs[nchildren] = vars->name[prefix_length];
+            /*
+             * A GETBULK starting at prefix.arc would skip an instance
+             * that is exactly prefix.arc, so such a child is never used
+             * as a cut point.
+             */
+            leaf = (vars->name_length == prefix_length + 1);
+            if (nchildren > 0 && !leaf)
+                cuts[ncuts++] = nchildren;
+            nchildren++;
+            snmp_free_pdu(response);
+
+            if (arcs[nchildren - 1] >= MAX_SUBID)
+                break;
+            probe[prefix_length] = arcs[nchildren - 1] + 1;
+            probe_length = prefix_length + 1;
+        }
+
+        if (nchildren == 1 && !leaf && prefix_length + 1 < MAX_OID_LEN) {
+            prefix[prefix_length++] = arcs[0];
+            continue;
+        }
+        break;
+    }
+
+    if (wanted > ncuts + 1)
+        wanted = ncuts + 1;
+    ranges = (struct walk_range *) calloc(wanted, sizeof(*ranges));
+    if (ranges == NULL) {
+        fprintf(stderr, "snmpbulkwalk: out of memory\n");
+        return -1;
+    }
+
+    memmove(ranges[0].name, walk_root, walk_rootlen * sizeof(oid));
+    ranges[0].name_length = walk_rootlen;
+    for (i = 1; i < wanted; i++) {
+        j = cuts[(i * (ncuts + 1)) / wanted - 1];
+        memmove(ranges[i].name, prefix, prefix_length * sizeof(oid));
+        ranges[i].name[prefix_length] = arcs[j];
+        ranges[i].name_length = prefix_length + 1;
+        memmove(ranges[i - 1].end, ranges[i].name,
+                ranges[i].name_length * sizeof(oid));
+        ranges[i - 1].end_length = ranges[i].name_length;
+    }
+    return wanted;
+}
+
+/*
+ * Print everything that is now in order: the buffered results of the
+ * first unfinished range and of every finished range before it.
+ */
+static void
+flush_ranges(void)
+{
+    struct walk_range *r;
+    netsnmp_variable_list *vars;
+
+    while (out_range < nranges) {
+        r = &ranges[out_range];
+        for (vars = r->head; vars; vars = vars->next_variable) {
+            numprinted++;
+            print_variable(vars->name, vars->name_length, vars);
+        }
+        snmp_free_varbind(r->head);
+        r->head = r->tail = NULL;
+        if (r->state != RANGE_DONE)
+            return;
+        out_range++;
+    }
+    if (walk_eom) {
+        printf("End of MIB\n");
+        walk_eom = 0;
+    }
+}
+
+static void
+abort_walk(int exitval)
+{
+    walk_aborted = 1;
+    walk_exitval = exitval;
+}
+
+static int
+range_response(int op, netsnmp_session * ss, int reqid,
+               netsnmp_pdu *response, void *magic)
+{
+    struct walk_range *r = (struct walk_range *) magic;
+    netsnmp_variable_list *list, *vars, *last = NULL;
+    oid             bad[MAX_OID_LEN];
+    size_t          bad_length = 0;
+    int             count;
+
+    if (ranges == NULL)
+        return 1;               /* session closed after the walk */
+    inflight--;
+    r->state = RANGE_IDLE;
+    if (walk_aborted)
+        return 1;
+
+    if (op == NETSNMP_CALLBACK_OP_TIMED_OUT) {
+        fprintf(stderr, "Timeout: No Response from %s\n", ss->peername);
+        walk_status = STAT_TIMEOUT;
+        abort_walk(1);
+        return 1;
+    } else if (op != NETSNMP_CALLBACK_OP_RECEIVED_MESSAGE) {
+        snmp_sess_perror("snmpbulkwalk", ss);
+        walk_status = STAT_ERROR;
+        abort_walk(1);
+        return 1;
+    }
+
+    if (response->errstat != SNMP_ERR_NOERROR) {
+        if (response->errstat == SNMP_ERR_NOSUCHNAME) {
+            r->state = RANGE_DONE;
+            if (r == &ranges[nranges - 1])
+                walk_eom = 1;
+            flush_ranges();
+            return 1;
+        }
+        flush_ranges();
+        fprintf(stderr, "Error in packet.\nReason: %s\n",
+                snmp_errstring(response->errstat));
+        if (response->errindex != 0) {
+            fprintf(stderr, "Failed object: ");
+            for (count = 1, vars = response->variables;
+                 vars && count != response->errindex;
+                 vars = vars->next_variable, count++)
+                /*EMPTY*/;
+            if (vars)
+                fprint_objid(stderr, vars->name, vars->name_length);
+            fprintf(stderr, "\n");
+        }
+        abort_walk(2);
+        return 1;
+    }
+
+    /*
+     * keep the variables up to the end of this range, then append them to
+     * its results
+     */
+    list = snmp_clone_varbind(response->variables);
+    for (vars = list; vars; last = vars, vars = vars->next_variable) {
+        if (!in_subtree(vars->name, vars->name_length) ||
+            (r->end_length &&
+             snmp_oid_compare(vars->name, vars->name_length,
+                              r->end, r->end_length) >= 0)) {
+            r->state = RANGE_DONE;
+            break;
+        }
+        if ((vars->type == SNMP_ENDOFMIBVIEW) ||
+            (vars->type == SNMP_NOSUCHOBJECT) ||
+            (vars->type == SNMP_NOSUCHINSTANCE)) {
+            r->state = RANGE_DONE;
+            last = vars;
+            vars = vars->next_variable;
+            break;
+        }
+        if (!netsnmp_ds_get_boolean(NETSNMP_DS_APPLICATION_ID,
+                                    NETSNMP_DS_WALK_DONT_CHECK_LEXICOGRAPHIC)
+            && snmp_oid_compare(r->name, r->name_length,
+                                vars->name, vars->name_length) >= 0) {
+            memmove(bad, vars->name, vars->name_length * sizeof(oid));
+            bad_length = vars->name_length;
+            last = vars;
+            vars = vars->next_variable;
+            break;
+        }
+        memmove(r->name, vars->name, vars->name_length * sizeof(oid));
+        r->name_length = vars->name_length;
+    }
+    if (last) {
+        last->next_variable = NULL;
+        if (r->tail)
+            r->tail->next_variable = list;
+        else
+            r->head = list;
+        r->tail = last;
+    }
+    if (vars)
+        snmp_free_varbind(vars);
+
+    flush_ranges();
+    if (bad_length) {
+        fflush(stdout);
+        fprintf(stderr, "Error: OID not increasing: ");
+        fprint_objid(stderr, r->name, r->name_length);
+        fprintf(stderr, " >= ");
+        fprint_objid(stderr, bad, bad_length);
+        fprintf(stderr, "\n");
+        abort_walk(1);
+    }
+    return 1;
+}
+
+static int
+range_send(netsnmp_session * ss, struct walk_range *r)
+{
+    netsnmp_pdu    *pdu;
+
+    pdu = snmp_pdu_create(SNMP_MSG_GETBULK);
+    pdu->non_repeaters = non_reps;
+    pdu->max_repetitions = reps;
+    snmp_add_null_var(pdu, r->name, r->name_length);
+    if (snmp_async_send(ss, pdu, range_response, r) == 0) {
+        snmp_sess_perror("snmpbulkwalk", ss);
+        snmp_free_pdu(pdu);
+        walk_status = STAT_ERROR;
+        return -1;
+    }
+    r->state = RANGE_WAITING;
+    inflight++;
+    return 0;
+}
+
+/*
+ * Walk the subtree as up to nranges ranges, keeping at most max_inflight
+ * requests outstanding.  Ranges are started in order so that the output
+ * can be printed as early as possible.
+ */
+static int
+parallel_walk(netsnmp_session * ss, oid * root, size_t rootlen)
+{
+    int             i, count, numfds, block;
+    fd_set          fdset;
+    struct timeval  timeout;
+    NETSNMP_SELECT_TIMEVAL timeout2;
+
+    walk_root = root;
+    walk_rootlen = rootlen;
+    walk_status = STAT_SUCCESS;
+    nranges = split_subtree(ss, nranges);
+    if (nranges < 0)
+        return 1;
+
+    while (!walk_aborted) {
+        for (i = out_range; i < nranges && inflight < max_inflight; i++) {
+            if (ranges[i].state == RANGE_IDLE &&
+                range_send(ss, &ranges[i]) < 0) {
+                abort_walk(1);
+                break;
+            }
+        }
+        if (inflight == 0)
+            break;
+
+        numfds = 0;
+        block = 1;
+        FD_ZERO(&fdset);
+        snmp_select_info(&numfds, &fdset, &timeout, &block);
+        timeout2.tv_sec = timeout.tv_sec;
+        timeout2.tv_usec = timeout.tv_usec;
+        count = select(numfds, &fdset, NULL, NULL, block ? NULL : &timeout2);
+        if (count > 0)
+            snmp_read(&fdset);
+        else if (count == 0)
+            snmp_timeout();
+        else if (errno != EINTR) {
+            fprintf(stderr, "snmpbulkwalk: select: %s\n", strerror(errno));
+            walk_status = STAT_ERROR;
+            abort_walk(1);
+        }
+    }
+
+    for (i = 0; i < nranges; i++)
+        snmp_free_varbind(ranges[i].head);
+    SNMP_FREE(ranges);
+    return walk_exitval;
+}
+
 static
     void
 optProc(int argc, char *const *argv, int opt)
@@ -136,10 +512,31 @@ optProc(int argc, char *const *argv, int opt)
 
             case 'n':
             case 'r':
-                if (*(optarg - 1) == 'r') {
+            case 'P':
+            case 'O':
+                switch (*(optarg - 1)) {
+                case 'r':
                     reps = strtol(optarg, &endptr, 0);
-                } else {
+                    break;
+                case 'n':
                     non_reps = strtol(optarg, &endptr, 0);
+                    break;
+                case 'P':
+                    nranges = strtol(optarg, &endptr, 0);
+                    if (nranges < 1 || nranges > MAX_RANGES) {
+                        fprintf(stderr, "-CP: number of ranges must be "
+                                "between 1 and %d\n", MAX_RANGES);
+                        exit(1);
+                    }
+                    break;
+                default:
+                    max_inflight = strtol(optarg, &endptr, 0);
+                    if (max_inflight < 1) {
+                        fprintf(stderr, "-CO: at least one outstanding "
+                                "request is needed\n");
+                        exit(1);
+                    }
+                    break;
                 }
 
                 if (endptr == optarg) {
@@ -265,6 +662,12 @@ main(int argc, char *argv[])
 
     exitval = 0;
 
+    if (nranges > 1) {
+        exitval = parallel_walk(ss, root, rootlen);
+        status = walk_status;
+        running = 0;
+    }
+
     while (running) {
         /*
          * create PDU for GETBULK request and add object name to request 
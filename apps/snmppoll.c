@@ -0,0 +1,347 @@
+/*
+ * snmppoll.c - poll a list of agents read from a file, using the poller
+ * API (many targets over a few shared sockets).
+ *
+ */
+#include <net-snmp/net-snmp-config.h>
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#else
+#include <strings.h>
+#endif
+#include <sys/types.h>
+#ifdef HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#endif
+#include <stdio.h>
+#include <ctype.h>
+#ifdef TIME_WITH_SYS_TIME
+# include <sys/time.h>
+# include <time.h>
+#else
+# ifdef HAVE_SYS_TIME_H
+#  include <sys/time.h>
+# else
+#  include <time.h>
+# endif
+#endif
+#ifdef HAVE_SYS_SELECT_H
+#include <sys/select.h>
+#endif
+
+#include <net-snmp/net-snmp-includes.h>
+#include <net-snmp/library/snmp_poller.h>
+
+#define NETSNMP_DS_POLL_GETNEXT		1
+#define NETSNMP_DS_POLL_PRINT_STATISTICS	2
+
+#define MAX_OIDS	64
+
+static netsnmp_poller_config poller_config = { 4, 1000, 0, 1, 0, 0, 0 };
+static int      failures;
+
+static void
+usage(void)
+{
+    fprintf(stderr, "USAGE: snmppoll ");
+    snmp_parse_args_usage(stderr);
+    fprintf(stderr, " TARGETFILE [OID...]\n\n");
+    snmp_parse_args_descriptions(stderr);
+    fprintf(stderr,
+            "  -C APPOPTS\t\tSet various application specific behaviours:\n");
+    fprintf(stderr,
+            "\t\t\t  d<MS>:   wait at least <MS> ms between requests to one agent\n");
+    fprintf(stderr,
+            "\t\t\t  i<NUM>:  at most <NUM> outstanding requests (default 1000)\n");
+    fprintf(stderr,
+            "\t\t\t  n:       send GETNEXT instead of GET requests\n");
+    fprintf(stderr,
+            "\t\t\t  p:       print statistics when done\n");
+    fprintf(stderr,
+            "\t\t\t  r<NUM>:  send at most <NUM> requests per second\n");
+    fprintf(stderr,
+            "\t\t\t  s<NUM>:  use <NUM> sockets per address family (default 4)\n");
+    fprintf(stderr,
+            "\t\t\t  t<NUM>:  at most <NUM> outstanding requests per agent (default 1)\n");
+}
+
+static void
+optProc(int argc, char *const *argv, int opt)
+{
+    char           *endptr = NULL;
+    long            val;
+    int             flag;
+
+    switch (opt) {
+    case 'C':
+        while (*optarg) {
+            switch (flag = *optarg++) {
+            case 'n':
+                netsnmp_ds_toggle_boolean(NETSNMP_DS_APPLICATION_ID,
+                                          NETSNMP_DS_POLL_GETNEXT);
+                break;
+
+            case 'p':
+                netsnmp_ds_toggle_boolean(NETSNMP_DS_APPLICATION_ID,
+                                          NETSNMP_DS_POLL_PRINT_STATISTICS);
+                break;
+
+            case 'd':
+            case 'i':
+            case 'r':
+            case 's':
+            case 't':
+                val = strtol(optarg, &endptr, 0);
+                if (endptr == optarg || val < 0) {
+                    usage();
+                    exit(1);
+                }
+                optarg = endptr;
+                switch (flag) {
+                case 'd':
+                    poller_config.target_interval = val;
+                    break;
+                case 'i':
+                    poller_config.max_inflight = val;
+                    break;
+                case 'r':
+                    poller_config.rate = val;
+                    break;
+                case 's':
+                    poller_config.sockets = val;
+                    break;
+                default:
+                    poller_config.target_inflight = val;
+                    break;
+                }
+                if (isspace((unsigned char)(*optarg)))
+                    return;
+                break;
+
+            default:
+                fprintf(stderr, "Unknown flag passed to -C: %c\n",
+                        optarg[-1]);
+                exit(1);
+            }
+        }
+        break;
+    }
+}
+
+static void
+poll_response(int op, netsnmp_poller_target *target, int reqid,
+              netsnmp_pdu *response, void *magic)
+{
+    const char     *name = netsnmp_poller_target_name(target);
+    netsnmp_variable_list *vars;
+    u_char         *buf = NULL;
+    size_t          buf_len = 0, out_len;
+    int             count;
+
+    switch (op) {
+    case NETSNMP_CALLBACK_OP_RECEIVED_MESSAGE:
+        if (response->errstat != SNMP_ERR_NOERROR) {
+            failures++;
+            fprintf(stderr, "%s: Error in packet: %s", name,
+                    snmp_errstring(response->errstat));
+            for (count = 1, vars = response->variables;
+                 vars && count != response->errindex;
+                 vars = vars->next_variable, count++)
+                /*EMPTY*/;
+            if (vars && response->errindex) {
+                fprintf(stderr, ": ");
+                fprint_objid(stderr, vars->name, vars->name_length);
+            }
+            fprintf(stderr, "\n");
+            break;
+        }
+        for (vars = response->variables; vars; vars = vars->next_variable) {
+            out_len = 0;
+            if (sprint_realloc_variable(&buf, &buf_len, &out_len, 1,
+                                        vars->name, vars->name_length,
+                                        vars))
+                printf("%s: %s\n", name, buf);
+            else
+                printf("%s: %s [TRUNCATED]\n", name, buf);
+        }
+        free(buf);
+        break;
+
+    case NETSNMP_CALLBACK_OP_TIMED_OUT:
+        failures++;
+        fprintf(stderr, "%s: Timeout\n", name);
+        break;
+
+    default:
+        failures++;
+        fprintf(stderr, "%s: Request could not be sent\n", name);
+        break;
+    }
+}
+
+int
+main(int argc, char *argv[])
+{
+    netsnmp_session session;
+    netsnmp_poller *poller = NULL;
+    netsnmp_poller_target *target;
+    netsnmp_pdu    *pdu;
+    const netsnmp_poller_stats *stats;
+    FILE           *fp = NULL;
+    char            line[1024], *cp, *agent, *tok, *st;
+    oid             name[MAX_OID_LEN];
+    size_t          name_length;
+    struct {
+        oid             name[MAX_OID_LEN];
+        size_t          name_length;
+    }               oids[MAX_OIDS];
+    int             noids = 0, nargs, i, arg, lineno = 0, ntargets = 0;
+    int             command;
+    int             exitval = 1;
+
+    SOCK_STARTUP;
+
+    netsnmp_ds_register_config(ASN_BOOLEAN, "snmppoll", "printStatistics",
+                               NETSNMP_DS_APPLICATION_ID,
+                               NETSNMP_DS_POLL_PRINT_STATISTICS);
+
+    /*
+     * get the common command line arguments; the "agent" argument is the
+     * name of the target file
+     */
+    switch (arg = snmp_parse_args(argc, argv, &session, "C:", optProc)) {
+    case NETSNMP_PARSE_ARGS_ERROR:
+        goto out;
+    case NETSNMP_PARSE_ARGS_SUCCESS_EXIT:
+        exitval = 0;
+        goto out;
+    case NETSNMP_PARSE_ARGS_ERROR_USAGE:
+        usage();
+        goto out;
+    default:
+        break;
+    }
+
+    if (session.version != SNMP_VERSION_1 &&
+        session.version != SNMP_VERSION_2c) {
+        fprintf(stderr, "snmppoll: only SNMPv1 and SNMPv2c are supported\n");
+        goto out;
+    }
+
+    for (; arg < argc; arg++) {
+        if (noids == MAX_OIDS) {
+            fprintf(stderr, "Too many OIDs specified\n");
+            goto out;
+        }
+        oids[noids].name_length = MAX_OID_LEN;
+        if (!snmp_parse_oid(argv[arg], oids[noids].name,
+                            &oids[noids].name_length)) {
+            snmp_perror(argv[arg]);
+            goto out;
+        }
+        noids++;
+    }
+
+    if (strcmp(session.peername, "-") == 0)
+        fp = stdin;
+    else if ((fp = fopen(session.peername, "r")) == NULL) {
+        perror(session.peername);
+        goto out;
+    }
+
+    poller_config.timeout = session.timeout;
+    poller_config.retries = session.retries;
+    poller = netsnmp_poller_create(&poller_config);
+    if (poller == NULL) {
+        fprintf(stderr, "snmppoll: cannot create poller\n");
+        goto out;
+    }
+    command = netsnmp_ds_get_boolean(NETSNMP_DS_APPLICATION_ID,
+                                     NETSNMP_DS_POLL_GETNEXT) ?
+        SNMP_MSG_GETNEXT : SNMP_MSG_GET;
+
+    exitval = 0;
+
+    /*
+     * each line: AGENT [OID...]; the OIDs from the command line are used
+     * for lines without any
+     */
+    while (fgets(line, sizeof(line), fp)) {
+        lineno++;
+        if ((cp = strchr(line, '#')) != NULL)
+            *cp = '\0';
+        agent = strtok_r(line, " \t\r\n", &st);
+        if (agent == NULL)
+            continue;
+
+        pdu = snmp_pdu_create(command);
+        nargs = 0;
+        while ((tok = strtok_r(NULL, " \t\r\n", &st)) != NULL) {
+            name_length = MAX_OID_LEN;
+            if (!snmp_parse_oid(tok, name, &name_length)) {
+                fprintf(stderr, "%s:%d: ", session.peername, lineno);
+                snmp_perror(tok);
+                continue;
+            }
+            snmp_add_null_var(pdu, name, name_length);
+            nargs++;
+        }
+        for (i = 0; nargs == 0 && i < noids; i++)
+            snmp_add_null_var(pdu, oids[i].name, oids[i].name_length);
+        if (pdu->variables == NULL) {
+            fprintf(stderr, "%s:%d: no OIDs for %s\n", session.peername,
+                    lineno, agent);
+            snmp_free_pdu(pdu);
+            exitval = 1;
+            continue;
+        }
+
+        target = netsnmp_poller_add_target(poller, agent, session.version,
+                                           (const char *) session.community,
+                                           NULL);
+        if (target == NULL) {
+            fprintf(stderr, "%s:%d: cannot add agent %s\n",
+                    session.peername, lineno, agent);
+            snmp_free_pdu(pdu);
+            exitval = 1;
+            continue;
+        }
+        if (netsnmp_poller_send(poller, target, pdu, poll_response,
+                                NULL) == 0) {
+            snmp_perror(agent);
+            snmp_free_pdu(pdu);
+            exitval = 1;
+            continue;
+        }
+        ntargets++;
+    }
+
+    if (netsnmp_poller_run(poller) < 0)
+        exitval = 1;
+    if (failures)
+        exitval = 1;
+
+    if (netsnmp_ds_get_boolean(NETSNMP_DS_APPLICATION_ID,
+                               NETSNMP_DS_POLL_PRINT_STATISTICS)) {
+        stats = netsnmp_poller_get_stats(poller);
+        printf("Agents: %d, requests: %lu, retries: %lu, responses: %lu, "
+               "timeouts: %lu, send failures: %lu, unmatched packets: %lu\n",
+               ntargets, stats->sent, stats->retries, stats->received,
+               stats->timeouts, stats->send_failed, stats->unmatched);
+    }
+
+out:
+    if (fp && fp != stdin)
+        fclose(fp);
+    netsnmp_poller_free(poller);
+    netsnmp_cleanup_session(&session);
+    SOCK_CLEANUP;
+    return exitval;
+}
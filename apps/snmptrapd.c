@@ -109,6 +109,8 @@ SOFTWARE.
 #include "snmptrapd_log.h"
 #include "snmptrapd_auth.h"
 #include "snmptrapd_sql.h"
+#include "snmptrapd_pipeline.h"
+#include "snmptrapd_suppress.h"
 #include "notification-log-mib/notification_log.h"
 #include "tlstm-mib/snmpTlstmCertToTSNTable/snmpTlstmCertToTSNTable.h"
 #include "mibII/vacm_conf.h"
@@ -542,10 +544,13 @@ snmptrapd_main_loop(void)
                 netsnmp_logging_restart();
                 snmp_log(LOG_INFO, "NET-SNMP version %s restarted\n",
                          netsnmp_get_version());
+            netsnmp_trapd_pipeline_stop();
+            netsnmp_trapd_log_handler_stats();
             trapd_update_config();
             if (trap1_fmt_str_remember) {
                 parse_format( NULL, trap1_fmt_str_remember );
             }
+            netsnmp_trapd_pipeline_start();
             reconfig = 0;
         }
         numfds = 0;
@@ -666,9 +671,14 @@ main(int argc, char *argv[])
      * register our configuration handlers now so -H properly displays them 
      */
     snmptrapd_register_configs( );
+    snmptrapd_pipeline_register_configs();
+    snmptrapd_suppress_register_configs();
 #ifdef NETSNMP_USE_MYSQL
     snmptrapd_register_sql_configs( );
 #endif
+#ifdef NETSNMP_USE_SQLITE
+    snmptrapd_register_sqlite_configs();
+#endif
 #ifdef NETSNMP_SECMOD_USM
     init_usm_conf( "snmptrapd" );
 #endif /* NETSNMP_SECMOD_USM */
@@ -1227,6 +1237,12 @@ main(int argc, char *argv[])
         goto sock_cleanup;
     }
 #endif
+#ifdef NETSNMP_USE_SQLITE
+    if (netsnmp_sqlite_init()) {
+        fprintf(stderr, "SQLite initialization failed\n");
+        goto sock_cleanup;
+    }
+#endif
 
 #ifndef WIN32
     /*
@@ -1347,8 +1363,14 @@ main(int argc, char *argv[])
     trapd_status = SNMPTRAPD_RUNNING;
 #endif
 
+    netsnmp_trapd_pipeline_start();
+
     snmptrapd_main_loop();
 
+    netsnmp_trapd_pipeline_stop();
+    netsnmp_trapd_suppress_log_summary();
+    netsnmp_trapd_log_handler_stats();
+
     if (snmp_get_do_logging()) {
         struct tm      *tm;
         time_t          timer;
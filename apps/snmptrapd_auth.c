@@ -9,6 +9,14 @@
  */
 #include <net-snmp/net-snmp-config.h>
 
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#else
+#include <strings.h>
+#endif
 #ifdef HAVE_SYS_TYPES_H
 #include <sys/types.h>
 #endif
@@ -23,6 +31,7 @@
 #include "snmptrapd_handlers.h"
 #include "snmptrapd_auth.h"
 #include "snmptrapd_ds.h"
+#include "snmptrapd_pipeline.h"
 
 #include <net-snmp/agent/agent_module_config.h>
 #include <net-snmp/agent/mib_module_config.h>
@@ -33,6 +42,69 @@
 
 #include <net-snmp/agent/agent_trap.h>
 
+#ifdef NETSNMP_TRAPD_PIPELINE
+#include <pthread.h>
+#endif
+
+/*
+ * The result of the VACM checks for a notification only depends on who
+ * sent it (version, security model and level, community and source
+ * address or user and context) and on its snmpTrapOID, so it is
+ * remembered in a cache of authCacheSize entries, each of which is
+ * simply replaced by the next key that hashes to the same slot.  The
+ * cache is emptied whenever the configuration is read again.
+ */
+#define AUTH_CACHE_DEFAULT_SIZE 1024
+#define AUTH_CACHE_MAX_KEY      512
+
+typedef struct auth_cache_entry_s {
+    unsigned int    hash;
+    u_char         *key;
+    size_t          key_len;
+    int             result;
+    char           *context;    /* context name VACM gave a v2c PDU */
+} auth_cache_entry;
+
+static auth_cache_entry *auth_cache;
+static size_t   auth_cache_slots;
+static int      auth_cache_size = AUTH_CACHE_DEFAULT_SIZE;
+#ifdef NETSNMP_TRAPD_PIPELINE
+static pthread_mutex_t auth_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static void
+auth_cache_flush(void)
+{
+    size_t          i;
+
+    for (i = 0; i < auth_cache_slots; i++) {
+        free(auth_cache[i].key);
+        free(auth_cache[i].context);
+    }
+    SNMP_FREE(auth_cache);
+    auth_cache_slots = 0;
+}
+
+static void
+parse_auth_cache_size(const char *token, char *cptr)
+{
+    int             val = atoi(cptr);
+
+    if (val < 0) {
+        config_perror("value must not be negative");
+        return;
+    }
+    auth_cache_flush();
+    auth_cache_size = val;
+}
+
+static void
+free_auth_cache_size(void)
+{
+    auth_cache_flush();
+    auth_cache_size = AUTH_CACHE_DEFAULT_SIZE;
+}
+
 /**
  * initializes the snmptrapd authorization code registering needed
  * handlers and config parsers.
@@ -58,11 +130,178 @@ init_netsnmp_trapd_auth(void)
     netsnmp_ds_register_config(ASN_BOOLEAN, "snmptrapd", "disableAuthorization",
                                NETSNMP_DS_APPLICATION_ID,
                                NETSNMP_DS_APP_NO_AUTHORIZATION);
+
+    register_config_handler("snmptrapd", "authCacheSize",
+                            parse_auth_cache_size, free_auth_cache_size,
+                            "entries");
 }
 
 /* XXX: store somewhere in the PDU instead */
 static int lastlookup;
 
+/*
+ * Pipeline worker threads each keep their own result.
+ */
+static int *
+auth_result(void)
+{
+    int *slot = netsnmp_trapd_pipeline_auth_slot();
+
+    return slot ? slot : &lastlookup;
+}
+
+static int
+auth_key_add(u_char *key, size_t *len, const void *data, size_t data_len)
+{
+    if (*len + data_len > AUTH_CACHE_MAX_KEY)
+        return 0;
+    memcpy(key + *len, data, data_len);
+    *len += data_len;
+    return 1;
+}
+
+/*
+ * Build the cache key for a notification.  Returns its length, or 0 if it
+ * does not fit (such notifications are simply not cached).
+ */
+static size_t
+auth_cache_key(u_char *key, netsnmp_pdu *pdu, const oid *trapoid,
+               size_t trapoid_len)
+{
+    const void     *addr;
+    size_t          len = 0, addr_len;
+    int             family;
+
+    if (!auth_key_add(key, &len, &pdu->version, sizeof(pdu->version)) ||
+        !auth_key_add(key, &len, &pdu->securityModel,
+                      sizeof(pdu->securityModel)) ||
+        !auth_key_add(key, &len, &pdu->securityLevel,
+                      sizeof(pdu->securityLevel)) ||
+        !auth_key_add(key, &len, &pdu->tDomainLen, sizeof(pdu->tDomainLen)) ||
+        !auth_key_add(key, &len, pdu->tDomain,
+                      pdu->tDomainLen * sizeof(oid)))
+        return 0;
+    if (pdu->version == SNMP_VERSION_1 || pdu->version == SNMP_VERSION_2c) {
+        /* com2sec maps the community and the source to a security name */
+        addr = netsnmp_trapd_source_address(pdu, &addr_len, &family);
+        if (!auth_key_add(key, &len, &family, sizeof(family)) ||
+            !auth_key_add(key, &len, &addr_len, sizeof(addr_len)) ||
+            (addr && !auth_key_add(key, &len, addr, addr_len)) ||
+            !auth_key_add(key, &len, &pdu->community_len,
+                          sizeof(pdu->community_len)) ||
+            (pdu->community &&
+             !auth_key_add(key, &len, pdu->community, pdu->community_len)))
+            return 0;
+    } else {
+        if (!auth_key_add(key, &len, &pdu->securityNameLen,
+                          sizeof(pdu->securityNameLen)) ||
+            (pdu->securityName &&
+             !auth_key_add(key, &len, pdu->securityName,
+                           pdu->securityNameLen)) ||
+            !auth_key_add(key, &len, &pdu->contextNameLen,
+                          sizeof(pdu->contextNameLen)) ||
+            (pdu->contextName &&
+             !auth_key_add(key, &len, pdu->contextName,
+                           pdu->contextNameLen)))
+            return 0;
+    }
+    if (!auth_key_add(key, &len, trapoid, trapoid_len * sizeof(oid)))
+        return 0;
+    return len;
+}
+
+static unsigned int
+auth_cache_hash(const u_char *key, size_t len)
+{
+    unsigned int    hash = 2166136261U;
+
+    while (len--)
+        hash = (hash ^ *key++) * 16777619U;
+    return hash;
+}
+
+/*
+ * Look the key up.  On a hit, returns 1 and the result, and gives a v2c
+ * PDU the context name that VACM gave it the first time.
+ */
+static int
+auth_cache_lookup(netsnmp_pdu *pdu, const u_char *key, size_t len,
+                  unsigned int hash, int *result)
+{
+    auth_cache_entry *entry;
+    char           *context = NULL;
+    int             found = 0;
+
+#ifdef NETSNMP_TRAPD_PIPELINE
+    pthread_mutex_lock(&auth_cache_lock);
+#endif
+    if (auth_cache_slots) {
+        entry = &auth_cache[hash & (auth_cache_slots - 1)];
+        if (entry->key && entry->hash == hash && entry->key_len == len &&
+            memcmp(entry->key, key, len) == 0) {
+            found = 1;
+            *result = entry->result;
+            if (entry->context)
+                context = strdup(entry->context);
+        }
+    }
+#ifdef NETSNMP_TRAPD_PIPELINE
+    pthread_mutex_unlock(&auth_cache_lock);
+#endif
+    if (context) {
+        SNMP_FREE(pdu->contextName);
+        pdu->contextName = context;
+        pdu->contextNameLen = strlen(context);
+    }
+    return found;
+}
+
+static void
+auth_cache_store(netsnmp_pdu *pdu, const u_char *key, size_t len,
+                 unsigned int hash, int result)
+{
+    auth_cache_entry *entry;
+    u_char         *key_copy;
+    char           *context = NULL;
+
+    key_copy = netsnmp_memdup(key, len);
+    if (!key_copy)
+        return;
+    if (pdu->version == SNMP_VERSION_2c && pdu->contextName)
+        context = netsnmp_strdup_and_null((u_char *) pdu->contextName,
+                                          pdu->contextNameLen);
+
+#ifdef NETSNMP_TRAPD_PIPELINE
+    pthread_mutex_lock(&auth_cache_lock);
+#endif
+    if (!auth_cache_slots) {
+        for (auth_cache_slots = 1;
+             auth_cache_slots < (size_t) auth_cache_size;
+             auth_cache_slots <<= 1)
+            ;
+        auth_cache = calloc(auth_cache_slots, sizeof(*auth_cache));
+        if (!auth_cache)
+            auth_cache_slots = 0;
+    }
+    if (auth_cache_slots) {
+        entry = &auth_cache[hash & (auth_cache_slots - 1)];
+        free(entry->key);
+        free(entry->context);
+        entry->hash = hash;
+        entry->key = key_copy;
+        entry->key_len = len;
+        entry->result = result;
+        entry->context = context;
+        key_copy = NULL;
+        context = NULL;
+    }
+#ifdef NETSNMP_TRAPD_PIPELINE
+    pthread_mutex_unlock(&auth_cache_lock);
+#endif
+    free(key_copy);
+    free(context);
+}
+
 /**
  * Authorizes incoming notifications for further processing
  */
@@ -78,6 +317,9 @@ netsnmp_trapd_auth(netsnmp_pdu           *pdu,
     netsnmp_variable_list *var;
 #ifdef USING_MIBII_VACM_CONF_MODULE
     int i;
+    u_char key[AUTH_CACHE_MAX_KEY];
+    size_t key_len = 0;
+    unsigned int hash = 0;
 #endif
 
     /* check to see if authorization was not disabled */
@@ -131,6 +373,18 @@ netsnmp_trapd_auth(netsnmp_pdu           *pdu,
     }
 
 #ifdef USING_MIBII_VACM_CONF_MODULE
+    /* the same sender has sent this notification before */
+    if (auth_cache_size)
+        key_len = auth_cache_key(key, pdu, var->val.objid,
+                                 var->val_len / sizeof(oid));
+    if (key_len) {
+        hash = auth_cache_hash(key, key_len);
+        if (auth_cache_lookup(pdu, key, key_len, hash, &ret)) {
+            DEBUGMSGTL(("snmptrapd:auth", "Cached bitmask auth: %x\n", ret));
+            goto checked;
+        }
+    }
+
     /* check the pdu against each typo of VACM access we may want to
        check up on later.  We cache the results for future lookup on
        each call to netsnmp_trapd_check_auth */
@@ -149,11 +403,14 @@ netsnmp_trapd_auth(netsnmp_pdu           *pdu,
         }
     }
     DEBUGMSGTL(("snmptrapd:auth", "Final bitmask auth: %x\n", ret));
+    if (key_len)
+        auth_cache_store(pdu, key, key_len, hash, ret);
+  checked:
 #endif
 
     if (ret) {
         /* we have policy to at least do "something".  Remember and continue. */
-        lastlookup = ret;
+        *auth_result() = ret;
 #ifndef NETSNMP_DISABLE_SNMPV1
         if (newpdu != pdu)
             snmp_free_pdu(newpdu);
@@ -177,16 +434,19 @@ netsnmp_trapd_auth(netsnmp_pdu           *pdu,
 int
 netsnmp_trapd_check_auth(int authtypes)
 {
+    int lookup;
+
     if (netsnmp_ds_get_boolean(NETSNMP_DS_APPLICATION_ID,
                                NETSNMP_DS_APP_NO_AUTHORIZATION)) {
         DEBUGMSGTL(("snmptrapd:auth", "authorization turned off\n"));
         return 1;
     }
 
+    lookup = *auth_result();
     DEBUGMSGTL(("snmptrapd:auth",
                 "Comparing auth types: result=%d, request=%d, result=%d\n",
-                lastlookup, authtypes,
-                ((authtypes & lastlookup) == authtypes)));
-    return ((authtypes & lastlookup) == authtypes);
+                lookup, authtypes,
+                ((authtypes & lookup) == authtypes)));
+    return ((authtypes & lookup) == authtypes);
 }
 
@@ -42,6 +42,9 @@
 #include "snmptrapd_handlers.h"
 #include "snmptrapd_auth.h"
 #include "snmptrapd_log.h"
+#include "snmptrapd_pipeline.h"
+#include "snmptrapd_persist.h"
+#include "snmptrapd_suppress.h"
 #include "notification-log-mib/notification_log.h"
 
 netsnmp_feature_child_of(add_default_traphandler, snmptrapd);
@@ -56,11 +59,80 @@ char *exec_format2   = NULL;
 int   SyslogTrap = 0;
 int   dropauth = 0;
 
+static int      handler_stats_interval;
+static unsigned int handler_stats_alarm_reg;
+
 const char     *trap1_std_str = "%.4y-%.2m-%.2l %.2h:%.2j:%.2k %B [%b] (via %A [%a]): %N\n\t%W Trap (%q) Uptime: %#T\n%v\n";
 const char     *trap2_std_str = "%.4y-%.2m-%.2l %.2h:%.2j:%.2k %B [%b]:\n%v\n";
 
+#define SYSLOG_V1_STANDARD_FORMAT      "%a: %W Trap (%q) Uptime: %#T%#v\n"
+#define SYSLOG_V1_ENTERPRISE_FORMAT    "%a: %W Trap (%q) Uptime: %#T%#v\n" /* XXX - (%q) become (.N) ??? */
+#define SYSLOG_V23_NOTIFICATION_FORMAT "%B [%b]: Trap %#v\n"	 	   /* XXX - introduces a leading " ," */
+#define PRINT_V23_NOTIFICATION_FORMAT  "%.4y-%.2m-%.2l %.2h:%.2j:%.2k %B [%b]:\n%v\n"
+#define EXECUTE_FORMAT                 "%B\n%b\n%V\n%v\n"
+
+/*
+ * The format strings above, compiled whenever the configuration sets
+ * them.  A slot is only used while its source is still the current
+ * string, so a format string changed some other way is still honoured.
+ */
+typedef struct format_slot_s {
+    const char           *source;
+    netsnmp_trapd_format *format;
+} format_slot;
+
+static format_slot syslog_slot1, syslog_slot2;
+static format_slot print_slot1, print_slot2;
+static format_slot exec_slot1, exec_slot2;
+static format_slot syslog_v1_std_slot, syslog_v1_ent_slot, syslog_v23_slot;
+static format_slot print_v23_slot, exec_std_slot;
+
 void snmptrapd_free_traphandle(void);
 
+static void
+update_format_slot(format_slot *slot, const char *source)
+{
+    if (slot->format && slot->source == source &&
+        !strcmp(netsnmp_trapd_format_source(slot->format), source))
+        return;
+    netsnmp_trapd_format_free(slot->format);
+    slot->format = netsnmp_trapd_format_compile(source);
+    slot->source = source;
+}
+
+static const netsnmp_trapd_format *
+slot_format(const format_slot *slot, const char *source)
+{
+    return (slot->source == source) ? slot->format : NULL;
+}
+
+static void
+compile_formats(void)
+{
+    update_format_slot(&syslog_slot1, syslog_format1);
+    update_format_slot(&syslog_slot2, syslog_format2);
+    update_format_slot(&print_slot1, print_format1);
+    update_format_slot(&print_slot2, print_format2);
+    update_format_slot(&exec_slot1, exec_format1);
+    update_format_slot(&exec_slot2, exec_format2);
+}
+
+/*
+ * Format a trap with the compiled format if there is one, or else the
+ * format string.
+ */
+static int
+format_trap(u_char **buf, size_t *buf_len, size_t *out_len,
+            const netsnmp_trapd_format *compiled, const char *format,
+            netsnmp_pdu *pdu, netsnmp_transport *transport)
+{
+    if (compiled)
+        return realloc_format_compiled_trap(buf, buf_len, out_len, 1,
+                                            compiled, pdu, transport);
+    return realloc_format_trap(buf, buf_len, out_len, 1, format,
+                               pdu, transport);
+}
+
 const char *
 trap_description(int trap)
 {
@@ -96,6 +168,7 @@ snmptrapd_parse_traphandle(const char *token, char *line)
     netsnmp_trapd_handler *traph;
     int             flags = 0;
     char           *format = NULL;
+    int             persist = 0;
 
     memset( buf, 0, sizeof(buf));
     memset(obuf, 0, sizeof(obuf));
@@ -106,6 +179,22 @@ snmptrapd_parse_traphandle(const char *token, char *line)
         format = strdup( buf );
         cptr = copy_nword(cptr, buf, sizeof(buf));
     }
+    if (cptr && !strncmp(buf, "persist", 7) &&
+        (buf[7] == '\0' || buf[7] == '=')) {
+        persist = (buf[7] == '=') ? atoi(buf + 8) : 1;
+        if (persist < 1) {
+            netsnmp_config_error("Bad process count in traphandle persist: %s",
+                                 buf);
+            free(format);
+            return;
+        }
+#ifndef NETSNMP_TRAPD_PERSIST
+        netsnmp_config_error("traphandle persist is not supported");
+        free(format);
+        return;
+#endif
+        cptr = copy_nword(cptr, buf, sizeof(buf));
+    }
     if ( !cptr ) {
         netsnmp_config_error("Missing traphandle command (%s)", buf);
         free(format);
@@ -148,8 +237,13 @@ snmptrapd_parse_traphandle(const char *token, char *line)
         traph->token = strdup(cptr);
         if (format) {
             traph->format = format;
+            traph->compiled_format = netsnmp_trapd_format_compile(format);
             format = NULL;
         }
+        if (persist) {
+            traph->handler_data = netsnmp_trapd_persist_new(cptr, persist);
+            traph->free_handler_data = netsnmp_trapd_persist_free;
+        }
     }
     free(format);
 }
@@ -216,8 +310,10 @@ parse_forward(const char *token, char *line)
         traph->flags = flags;
         traph->authtypes = TRAP_AUTH_NET;
         traph->token = strdup(cptr);
-        if (format)
+        if (format) {
             traph->format = format;
+            traph->compiled_format = netsnmp_trapd_format_compile(format);
+        }
     } else {
         free(format);
     }
@@ -289,6 +385,7 @@ parse_format(const char *token, char *line)
         exec_format1 = strdup(cp);
         exec_format2 = strdup(cp);
     }
+    compile_formats();
 
     *sep = ' ';
 }
@@ -298,6 +395,7 @@ static void
 parse_trap1_fmt(const char *token, char *line)
 {
     print_format1 = strdup(line);
+    compile_formats();
 }
 
 
@@ -307,6 +405,7 @@ free_trap1_fmt(void)
     if (print_format1 && print_format1 != trap1_std_str)
         free(print_format1);
     print_format1 = NULL;
+    compile_formats();
 }
 
 
@@ -314,6 +413,7 @@ static void
 parse_trap2_fmt(const char *token, char *line)
 {
     print_format2 = strdup(line);
+    compile_formats();
 }
 
 
@@ -323,9 +423,44 @@ free_trap2_fmt(void)
     if (print_format2 && print_format2 != trap2_std_str)
         free(print_format2);
     print_format2 = NULL;
+    compile_formats();
 }
 
 
+static void
+handler_stats_alarm(unsigned int clientreg, void *clientarg)
+{
+    netsnmp_trapd_log_handler_stats();
+}
+
+static void
+parse_handler_stats_interval(const char *token, char *line)
+{
+    int             val = atoi(line);
+
+    if (val < 0) {
+        config_perror("value must not be negative");
+        return;
+    }
+    if (handler_stats_alarm_reg)
+        snmp_alarm_unregister(handler_stats_alarm_reg);
+    handler_stats_alarm_reg = 0;
+    handler_stats_interval = val;
+    if (val)
+        handler_stats_alarm_reg = snmp_alarm_register(val, SA_REPEAT,
+                                                      handler_stats_alarm,
+                                                      NULL);
+}
+
+static void
+free_handler_stats_interval(void)
+{
+    if (handler_stats_alarm_reg)
+        snmp_alarm_unregister(handler_stats_alarm_reg);
+    handler_stats_alarm_reg = 0;
+    handler_stats_interval = 0;
+}
+
 void
 snmptrapd_register_configs( void )
 {
@@ -342,6 +477,15 @@ snmptrapd_register_configs( void )
 			    "[print{,1,2}|syslog{,1,2}|execute{,1,2}] format");
     register_config_handler("snmptrapd", "forward",
                             parse_forward, NULL, "OID|\"default\" destination");
+    register_config_handler("snmptrapd", "handlerStatsInterval",
+                            parse_handler_stats_interval,
+                            free_handler_stats_interval, "seconds");
+
+    update_format_slot(&syslog_v1_std_slot, SYSLOG_V1_STANDARD_FORMAT);
+    update_format_slot(&syslog_v1_ent_slot, SYSLOG_V1_ENTERPRISE_FORMAT);
+    update_format_slot(&syslog_v23_slot, SYSLOG_V23_NOTIFICATION_FORMAT);
+    update_format_slot(&print_v23_slot, PRINT_V23_NOTIFICATION_FORMAT);
+    update_format_slot(&exec_std_slot, EXECUTE_FORMAT);
 }
 
 
@@ -371,6 +515,81 @@ static netsnmp_handler_map handlers[] = {
     { NULL, NULL }
 };
 
+/*
+ * The trap specific handlers are also kept in a tree of OIDs, with one
+ * node per sub-identifier, so that finding the handlers for a trap takes
+ * as long as the trap OID and not as long as the list of handlers.  A node
+ * points to the (first) handler registered for exactly its OID.
+ */
+typedef struct trap_route_s {
+    oid             subid;
+    netsnmp_trapd_handler *traph;
+    struct trap_route_s *children;      /* sorted by subid */
+    size_t          nchildren, maxchildren;
+} trap_route;
+
+static trap_route route_root;
+
+static trap_route *
+route_child(trap_route *node, oid subid, int create)
+{
+    size_t          lo = 0, hi = node->nchildren, mid;
+    trap_route     *children;
+
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (node->children[mid].subid == subid)
+            return &node->children[mid];
+        if (node->children[mid].subid < subid)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (!create)
+        return NULL;
+    if (node->nchildren == node->maxchildren) {
+        children = realloc(node->children, (node->maxchildren ?
+                                            node->maxchildren * 2 : 4) *
+                           sizeof(*children));
+        if (children == NULL)
+            return NULL;
+        node->children = children;
+        node->maxchildren = node->maxchildren ? node->maxchildren * 2 : 4;
+    }
+    memmove(&node->children[lo + 1], &node->children[lo],
+            (node->nchildren - lo) * sizeof(*node->children));
+    node->nchildren++;
+    memset(&node->children[lo], 0, sizeof(*node->children));
+    node->children[lo].subid = subid;
+    return &node->children[lo];
+}
+
+static void
+route_add(netsnmp_trapd_handler *traph)
+{
+    trap_route     *node = &route_root;
+    int             i;
+
+    for (i = 0; node && i < traph->trapoid_len; i++)
+        node = route_child(node, traph->trapoid[i], 1);
+    if (node)
+        node->traph = traph;
+    else
+        snmp_log(LOG_ERR, "snmptrapd: could not index trap handler\n");
+}
+
+static void
+route_free(trap_route *node)
+{
+    size_t          i;
+
+    for (i = 0; i < node->nchildren; i++)
+        route_free(&node->children[i]);
+    SNMP_FREE(node->children);
+    node->nchildren = node->maxchildren = 0;
+    node->traph = NULL;
+}
+
 /*
  * Register a new "global" traphandler,
  * to be applied to *all* incoming traps
@@ -494,6 +713,7 @@ netsnmp_add_traphandler(Netsnmp_Trap_Handler* handler,
 	        netsnmp_specific_traphandlers = traph;
             traph2->prevt = traph;
             traph->nextt  = traph2;
+            route_add(traph);
         }
     } else {
         /*
@@ -512,6 +732,7 @@ netsnmp_add_traphandler(Netsnmp_Trap_Handler* handler,
              */
             netsnmp_specific_traphandlers = traph;
         }
+        route_add(traph);
     }
 
     return traph;
@@ -536,6 +757,8 @@ free_non_builtin_handlers(netsnmp_trapd_handler **list_head)
             /* Free */
             if (traph->free_handler_data)
                 traph->free_handler_data(traph->handler_data);
+            netsnmp_trapd_format_free(traph->compiled_format);
+            SNMP_FREE(traph->format);
             SNMP_FREE(traph->token);
             SNMP_FREE(traph);
         } else {
@@ -570,6 +793,8 @@ snmptrapd_free_traphandle(void)
 	    nexth = traph->nexth;
             if (traph->free_handler_data)
                 traph->free_handler_data(traph->handler_data);
+            netsnmp_trapd_format_free(traph->compiled_format);
+            SNMP_FREE(traph->format);
 	    SNMP_FREE(traph->token);
 	    SNMP_FREE(traph->trapoid);
 	    SNMP_FREE(traph);
@@ -578,6 +803,7 @@ snmptrapd_free_traphandle(void)
 	traph = nextt;
     }
     netsnmp_specific_traphandlers = NULL;
+    route_free(&route_root);
 }
 
 void
@@ -603,7 +829,9 @@ snmptrapd_free_all_traphandlers(void)
  */
 netsnmp_trapd_handler *
 netsnmp_get_traphandler( oid *trapOid, int trapOidLen ) {
-    netsnmp_trapd_handler *traph;
+    netsnmp_trapd_handler *traph, *match = NULL;
+    trap_route     *node = &route_root;
+    int             i;
     
     if (!trapOid || !trapOidLen) {
         DEBUGMSGTL(( "snmptrapd:lookup", "get_traphandler no OID!\n"));
@@ -614,46 +842,32 @@ netsnmp_get_traphandler( oid *trapOid, int trapOidLen ) {
     DEBUGMSG(( "snmptrapd:lookup", "\n"));
 
     /*
-     * Look for a matching OID, and return that list...
+     * Walk down the tree along the trap OID.  The handlers registered for
+     * the longest OID that matches win: an OID registered without a
+     * wildcard has to match the trapOID exactly, one registered with a
+     * wildcard should be a prefix of it (and, optionally, *strictly* a
+     * prefix, i.e. not an exact match).
      */
-    for (traph = netsnmp_specific_traphandlers;
-         traph; traph=traph->nextt ) {
-
-        /*
-         * If the trap handler wasn't wildcarded, then the trapOID
-         *   should match the registered OID exactly.
-         */
-        if (!(traph->flags & NETSNMP_TRAPHANDLER_FLAG_MATCH_TREE)) {
-            if (snmp_oid_compare(traph->trapoid, traph->trapoid_len,
-                                 trapOid, trapOidLen) == 0) {
-                DEBUGMSGTL(( "snmptrapd:lookup",
-                             "get_traphandler exact match (%p)\n", traph));
-	        return traph;
-            }
-	} else {
-           /*
-            * If the trap handler *was* wildcarded, then the trapOID
-            *   should have the registered OID as a prefix...
-            */
-            if (snmp_oidsubtree_compare(traph->trapoid,
-                                        traph->trapoid_len,
-                                        trapOid, trapOidLen) == 0) {
-                if (traph->flags & NETSNMP_TRAPHANDLER_FLAG_STRICT_SUBTREE) {
-                    /*
-                     * ... and (optionally) *strictly* as a prefix
-                     *   i.e. not including an exact match.
-                     */
-                    if (snmp_oid_compare(traph->trapoid, traph->trapoid_len,
-                                         trapOid, trapOidLen) != 0) {
-                        DEBUGMSGTL(( "snmptrapd:lookup", "get_traphandler strict subtree match (%p)\n", traph));
-	                return traph;
-                    }
-                } else {
-                    DEBUGMSGTL(( "snmptrapd:lookup", "get_traphandler subtree match (%p)\n", traph));
-	            return traph;
-                }
-            }
-	}
+    for (i = 0; node; i++) {
+        traph = node->traph;
+        if (traph) {
+            if (!(traph->flags & NETSNMP_TRAPHANDLER_FLAG_MATCH_TREE)) {
+                if (i == trapOidLen)
+                    match = traph;
+            } else if (i < trapOidLen ||
+                       !(traph->flags &
+                         NETSNMP_TRAPHANDLER_FLAG_STRICT_SUBTREE))
+                match = traph;
+        }
+        if (i == trapOidLen)
+            break;
+        node = route_child(node, trapOid[i], 0);
+    }
+    if (match) {
+        DEBUGMSGTL(( "snmptrapd:lookup", "get_traphandler %s match (%p)\n",
+                     (match->flags & NETSNMP_TRAPHANDLER_FLAG_MATCH_TREE) ?
+                     "subtree" : "exact", match));
+        return match;
     }
 
     /*
@@ -670,9 +884,61 @@ netsnmp_get_traphandler( oid *trapOid, int trapOidLen ) {
  *
  *-----------------------------*/
 
-#define SYSLOG_V1_STANDARD_FORMAT      "%a: %W Trap (%q) Uptime: %#T%#v\n"
-#define SYSLOG_V1_ENTERPRISE_FORMAT    "%a: %W Trap (%q) Uptime: %#T%#v\n" /* XXX - (%q) become (.N) ??? */
-#define SYSLOG_V23_NOTIFICATION_FORMAT "%B [%b]: Trap %#v\n"	 	   /* XXX - introduces a leading " ," */
+static void
+run_log_job(netsnmp_trapd_job *job)
+{
+    snmp_log(job->priority, "%s%s", job->text,
+             (job->truncated ? " [TRUNCATED]\n" : ""));
+}
+
+/*
+ * Log formatted trap output, or pass a copy of it to the log thread
+ * when running as a pipeline worker.
+ */
+static void
+log_trap_output(int priority, netsnmp_trapd_format_buf *fb, int trunc)
+{
+    netsnmp_trapd_job *job;
+
+    if (netsnmp_trapd_pipeline_running()) {
+        job = netsnmp_trapd_job_new(run_log_job, NULL, NULL);
+        if (job && (job->text = netsnmp_memdup(fb->buf, fb->out_len + 1))) {
+            job->priority = priority;
+            job->truncated = trunc;
+            netsnmp_trapd_pipeline_output(NETSNMPTRAPD_STAGE_LOG, job);
+        } else
+            netsnmp_trapd_job_free(job);
+        return;
+    }
+    snmp_log(priority, "%s%s", fb->buf, (trunc?" [TRUNCATED]\n":""));
+}
+
+/*
+ * Queue a copy of the trap for a pipeline stage, along with copies of the
+ * handler token and format.
+ */
+static int
+queue_trap_job(int stage, Netsnmp_Trapd_Job *run, netsnmp_pdu *pdu,
+               netsnmp_transport *transport, netsnmp_trapd_handler *handler)
+{
+    netsnmp_trapd_job *job;
+
+    job = netsnmp_trapd_job_new(run, snmp_clone_pdu(pdu), transport);
+    if (job == NULL || job->pdu == NULL ||
+        (handler && handler->token &&
+         (job->token = strdup(handler->token)) == NULL) ||
+        (handler && handler->format &&
+         (job->format = strdup(handler->format)) == NULL)) {
+        netsnmp_trapd_job_free(job);
+        return NETSNMPTRAPD_HANDLER_FAIL;
+    }
+    if (handler) {
+        job->handler_data = handler->handler_data;
+        job->compiled_format = handler->compiled_format;
+    }
+    netsnmp_trapd_pipeline_output(stage, job);
+    return NETSNMPTRAPD_HANDLER_OK;
+}
 
 /*
  *  Trap handler for logging via syslog
@@ -681,8 +947,7 @@ int   syslog_handler(  netsnmp_pdu           *pdu,
                        netsnmp_transport     *transport,
                        netsnmp_trapd_handler *handler)
 {
-    u_char         *rbuf = NULL;
-    size_t          r_len = 64, o_len = 0;
+    netsnmp_trapd_format_buf *fb;
     int             trunc = 0;
 
     DEBUGMSGTL(( "snmptrapd", "syslog_handler\n"));
@@ -690,7 +955,7 @@ int   syslog_handler(  netsnmp_pdu           *pdu,
     if (SyslogTrap)
         return NETSNMPTRAPD_HANDLER_OK;
 
-    if ((rbuf = calloc(r_len, 1)) == NULL) {
+    if ((fb = netsnmp_trapd_format_buffer()) == NULL) {
         snmp_log(LOG_ERR, "couldn't display trap -- malloc failed\n");
         return NETSNMPTRAPD_HANDLER_FAIL;	/* Failed but keep going */
     }
@@ -701,10 +966,10 @@ int   syslog_handler(  netsnmp_pdu           *pdu,
     if (handler && handler->format) {
         DEBUGMSGTL(( "snmptrapd", "format = '%s'\n", handler->format));
         if (*handler->format) {
-            trunc = !realloc_format_trap(&rbuf, &r_len, &o_len, 1,
-                                     handler->format, pdu, transport);
+            trunc = !format_trap(&fb->buf, &fb->buf_len, &fb->out_len,
+                                 handler->compiled_format, handler->format,
+                                 pdu, transport);
         } else {
-            free(rbuf);
             return NETSNMPTRAPD_HANDLER_OK;    /* A 0-length format string means don't log */
         }
 
@@ -721,41 +986,43 @@ int   syslog_handler(  netsnmp_pdu           *pdu,
 	if ( pdu->command == SNMP_MSG_TRAP ) {
             if (syslog_format1) {
                 DEBUGMSGTL(( "snmptrapd", "syslog_format v1 = '%s'\n", syslog_format1));
-                trunc = !realloc_format_trap(&rbuf, &r_len, &o_len, 1,
-                                             syslog_format1, pdu, transport);
+                trunc = !format_trap(&fb->buf, &fb->buf_len, &fb->out_len,
+                                     slot_format(&syslog_slot1, syslog_format1),
+                                     syslog_format1, pdu, transport);
 
 	    } else if (pdu->trap_type == SNMP_TRAP_ENTERPRISESPECIFIC) {
                 DEBUGMSGTL(( "snmptrapd", "v1 enterprise format\n"));
-                trunc = !realloc_format_trap(&rbuf, &r_len, &o_len, 1,
-                                             SYSLOG_V1_ENTERPRISE_FORMAT,
-                                             pdu, transport);
+                trunc = !format_trap(&fb->buf, &fb->buf_len, &fb->out_len,
+                                     syslog_v1_ent_slot.format,
+                                     SYSLOG_V1_ENTERPRISE_FORMAT,
+                                     pdu, transport);
 	    } else {
                 DEBUGMSGTL(( "snmptrapd", "v1 standard trap format\n"));
-                trunc = !realloc_format_trap(&rbuf, &r_len, &o_len, 1,
-                                             SYSLOG_V1_STANDARD_FORMAT,
-                                             pdu, transport);
+                trunc = !format_trap(&fb->buf, &fb->buf_len, &fb->out_len,
+                                     syslog_v1_std_slot.format,
+                                     SYSLOG_V1_STANDARD_FORMAT,
+                                     pdu, transport);
 	    }
 	} else {	/* SNMPv2/3 notifications */
             if (syslog_format2) {
                 DEBUGMSGTL(( "snmptrapd", "syslog_format v1 = '%s'\n", syslog_format2));
-                trunc = !realloc_format_trap(&rbuf, &r_len, &o_len, 1,
-                                             syslog_format2, pdu, transport);
+                trunc = !format_trap(&fb->buf, &fb->buf_len, &fb->out_len,
+                                     slot_format(&syslog_slot2, syslog_format2),
+                                     syslog_format2, pdu, transport);
 	    } else {
                 DEBUGMSGTL(( "snmptrapd", "v2/3 format\n"));
-                trunc = !realloc_format_trap(&rbuf, &r_len, &o_len, 1,
-                                             SYSLOG_V23_NOTIFICATION_FORMAT,
-                                             pdu, transport);
+                trunc = !format_trap(&fb->buf, &fb->buf_len, &fb->out_len,
+                                     syslog_v23_slot.format,
+                                     SYSLOG_V23_NOTIFICATION_FORMAT,
+                                     pdu, transport);
 	    }
         }
     }
-    snmp_log(LOG_WARNING, "%s%s", rbuf, (trunc?" [TRUNCATED]\n":""));
-    free(rbuf);
+    log_trap_output(LOG_WARNING, fb, trunc);
     return NETSNMPTRAPD_HANDLER_OK;
 }
 
 
-#define PRINT_V23_NOTIFICATION_FORMAT "%.4y-%.2m-%.2l %.2h:%.2j:%.2k %B [%b]:\n%v\n"
-
 /*
  *  Trap handler for logging to a file
  */
@@ -763,8 +1030,7 @@ int   print_handler(   netsnmp_pdu           *pdu,
                        netsnmp_transport     *transport,
                        netsnmp_trapd_handler *handler)
 {
-    u_char         *rbuf = NULL;
-    size_t          r_len = 64, o_len = 0;
+    netsnmp_trapd_format_buf *fb;
     int             trunc = 0;
 
     DEBUGMSGTL(( "snmptrapd", "print_handler\n"));
@@ -776,7 +1042,7 @@ int   print_handler(   netsnmp_pdu           *pdu,
     if (pdu->trap_type == SNMP_TRAP_AUTHFAIL && dropauth)
         return NETSNMPTRAPD_HANDLER_OK;
 
-    if ((rbuf = calloc(r_len, 1)) == NULL) {
+    if ((fb = netsnmp_trapd_format_buffer()) == NULL) {
         snmp_log(LOG_ERR, "couldn't display trap -- malloc failed\n");
         return NETSNMPTRAPD_HANDLER_FAIL;	/* Failed but keep going */
     }
@@ -787,10 +1053,10 @@ int   print_handler(   netsnmp_pdu           *pdu,
     if (handler && handler->format) {
         DEBUGMSGTL(( "snmptrapd", "format = '%s'\n", handler->format));
         if (*handler->format) {
-            trunc = !realloc_format_trap(&rbuf, &r_len, &o_len, 1,
-                                     handler->format, pdu, transport);
+            trunc = !format_trap(&fb->buf, &fb->buf_len, &fb->out_len,
+                                 handler->compiled_format, handler->format,
+                                 pdu, transport);
         } else {
-            free(rbuf);
             return NETSNMPTRAPD_HANDLER_OK;    /* A 0-length format string means don't log */
         }
 
@@ -807,33 +1073,163 @@ int   print_handler(   netsnmp_pdu           *pdu,
 	if ( pdu->command == SNMP_MSG_TRAP ) {
             if (print_format1) {
                 DEBUGMSGTL(( "snmptrapd", "print_format v1 = '%s'\n", print_format1));
-                trunc = !realloc_format_trap(&rbuf, &r_len, &o_len, 1,
-                                             print_format1, pdu, transport);
+                trunc = !format_trap(&fb->buf, &fb->buf_len, &fb->out_len,
+                                     slot_format(&print_slot1, print_format1),
+                                     print_format1, pdu, transport);
 	    } else {
                 DEBUGMSGTL(( "snmptrapd", "v1 format\n"));
-                trunc = !realloc_format_plain_trap(&rbuf, &r_len, &o_len, 1,
+                trunc = !realloc_format_plain_trap(&fb->buf, &fb->buf_len,
+                                                   &fb->out_len, 1,
                                                    pdu, transport);
 	    }
 	} else {
             if (print_format2) {
                 DEBUGMSGTL(( "snmptrapd", "print_format v2 = '%s'\n", print_format2));
-                trunc = !realloc_format_trap(&rbuf, &r_len, &o_len, 1,
-                                             print_format2, pdu, transport);
+                trunc = !format_trap(&fb->buf, &fb->buf_len, &fb->out_len,
+                                     slot_format(&print_slot2, print_format2),
+                                     print_format2, pdu, transport);
 	    } else {
                 DEBUGMSGTL(( "snmptrapd", "v2/3 format\n"));
-                trunc = !realloc_format_trap(&rbuf, &r_len, &o_len, 1,
-                                             PRINT_V23_NOTIFICATION_FORMAT,
-                                             pdu, transport);
+                trunc = !format_trap(&fb->buf, &fb->buf_len, &fb->out_len,
+                                     print_v23_slot.format,
+                                     PRINT_V23_NOTIFICATION_FORMAT,
+                                     pdu, transport);
 	    }
         }
     }
-    snmp_log(LOG_INFO, "%s%s", rbuf, (trunc?" [TRUNCATED]\n":""));
-    free(rbuf);
+    log_trap_output(LOG_INFO, fb, trunc);
     return NETSNMPTRAPD_HANDLER_OK;
 }
 
 
-#define EXECUTE_FORMAT	"%B\n%b\n%V\n%v\n"
+#ifdef USING_UTILITIES_EXECUTE_MODULE
+/*
+ *  Format the trap the way it is passed to traphandle commands
+ */
+static u_char *
+format_command_input(netsnmp_pdu       *pdu,
+                     netsnmp_transport *transport,
+                     const char        *format,
+                     const netsnmp_trapd_format *compiled,
+                     size_t            *len)
+{
+    u_char         *rbuf = NULL;
+    size_t          r_len = 64, o_len = 0;
+    int             oldquick;
+    netsnmp_pdu    *v2_pdu = NULL;
+
+    if ((rbuf = calloc(r_len, 1)) == NULL) {
+        snmp_log(LOG_ERR, "couldn't display trap -- malloc failed\n");
+        return NULL;
+    }
+
+    if (pdu->command == SNMP_MSG_TRAP)
+        v2_pdu = convert_v1pdu_to_v2(pdu);
+    else
+        v2_pdu = pdu;
+
+    /*
+     * Changes the output options for everyone, so keep other threads
+     * from formatting meanwhile.
+     */
+    netsnmp_trapd_pipeline_format_lock(1);
+    oldquick = netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID, 
+                                      NETSNMP_DS_LIB_QUICK_PRINT);
+    netsnmp_ds_set_boolean(NETSNMP_DS_LIBRARY_ID, 
+                           NETSNMP_DS_LIB_QUICK_PRINT, 1);
+
+    /*
+     *  If there's a format string registered for this trap, then use it.
+     *  Otherwise use the standard execution format setting.
+     */
+    if (format && *format) {
+        DEBUGMSGTL(( "snmptrapd", "format = '%s'\n", format));
+        format_trap(&rbuf, &r_len, &o_len, compiled, format,
+                    v2_pdu, transport);
+    } else {
+        if ( pdu->command == SNMP_MSG_TRAP && exec_format1 ) {
+            DEBUGMSGTL(( "snmptrapd", "exec v1 = '%s'\n", exec_format1));
+            format_trap(&rbuf, &r_len, &o_len,
+                        slot_format(&exec_slot1, exec_format1),
+                        exec_format1, pdu, transport);
+        } else if ( pdu->command != SNMP_MSG_TRAP && exec_format2 ) {
+            DEBUGMSGTL(( "snmptrapd", "exec v2/3 = '%s'\n", exec_format2));
+            format_trap(&rbuf, &r_len, &o_len,
+                        slot_format(&exec_slot2, exec_format2),
+                        exec_format2, pdu, transport);
+        } else {
+            DEBUGMSGTL(( "snmptrapd", "execute format\n"));
+            format_trap(&rbuf, &r_len, &o_len, exec_std_slot.format,
+                        EXECUTE_FORMAT, v2_pdu, transport);
+        }
+    }
+    netsnmp_ds_set_boolean(NETSNMP_DS_LIBRARY_ID, 
+                           NETSNMP_DS_LIB_QUICK_PRINT, oldquick);
+    netsnmp_trapd_pipeline_format_unlock(1);
+
+    if (pdu->command == SNMP_MSG_TRAP)
+        snmp_free_pdu(v2_pdu);
+    if (len)
+        *len = o_len;
+    return rbuf;
+}
+
+/*
+ *  Format the trap and pass this string to an external command
+ */
+static void
+run_trap_command(netsnmp_pdu           *pdu,
+                 netsnmp_transport     *transport,
+                 const char            *command,
+                 const char            *format,
+                 const netsnmp_trapd_format *compiled)
+{
+    u_char         *rbuf;
+
+    rbuf = format_command_input(pdu, transport, format, compiled, NULL);
+    if (!rbuf)
+        return;
+
+    /*
+     *  and pass this formatted string to the command specified
+     */
+    run_shell_command(command, (char*)rbuf, NULL, NULL);   /* Not interested in output */
+    free(rbuf);
+}
+
+static void
+run_command_job(netsnmp_trapd_job *job)
+{
+    run_trap_command(job->pdu, job->transport, job->token, job->format,
+                     job->compiled_format);
+}
+
+/*
+ *  Format the trap and stream it to a persistent handler
+ */
+static void
+send_persist_trap(netsnmp_pdu           *pdu,
+                  netsnmp_transport     *transport,
+                  netsnmp_trapd_persist *persist,
+                  const char            *format,
+                  const netsnmp_trapd_format *compiled)
+{
+    u_char         *rbuf;
+    size_t          len;
+
+    rbuf = format_command_input(pdu, transport, format, compiled, &len);
+    if (rbuf)
+        netsnmp_trapd_persist_send(persist, rbuf, len);
+}
+
+static void
+run_persist_job(netsnmp_trapd_job *job)
+{
+    send_persist_trap(job->pdu, job->transport,
+                      (netsnmp_trapd_persist *) job->handler_data,
+                      job->format, job->compiled_format);
+}
+#endif /* USING_UTILITIES_EXECUTE_MODULE */
 
 /*
  *  Trap handler for invoking a suitable script
@@ -847,67 +1243,25 @@ int   command_handler( netsnmp_pdu           *pdu,
                      "support for run_shell_command not available\n"));
     return NETSNMPTRAPD_HANDLER_FAIL;
 #else
-    u_char         *rbuf = NULL;
-    size_t          r_len = 64, o_len = 0;
-    int             oldquick;
-
     netsnmp_assert(handler);
 
     DEBUGMSGTL(( "snmptrapd", "command_handler\n"));
     DEBUGMSGTL(( "snmptrapd", "token = '%s'\n", handler->token));
-    if (handler->token && *handler->token) {
-	netsnmp_pdu    *v2_pdu = NULL;
-	if (pdu->command == SNMP_MSG_TRAP)
-	    v2_pdu = convert_v1pdu_to_v2(pdu);
-	else
-	    v2_pdu = pdu;
-        oldquick = netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID, 
-                                          NETSNMP_DS_LIB_QUICK_PRINT);
-        netsnmp_ds_set_boolean(NETSNMP_DS_LIBRARY_ID, 
-                               NETSNMP_DS_LIB_QUICK_PRINT, 1);
-
+    if (handler->handler_data) {
         /*
-	 * Format the trap and pass this string to the external command
-	 */
-        if ((rbuf = calloc(r_len, 1)) == NULL) {
-            snmp_log(LOG_ERR, "couldn't display trap -- malloc failed\n");
-            return NETSNMPTRAPD_HANDLER_FAIL;	/* Failed but keep going */
-        }
-
-        /*
-         *  If there's a format string registered for this trap, then use it.
-         *  Otherwise use the standard execution format setting.
+         * persistent handlers are only ever driven from the main thread
          */
-        if (handler->format && *handler->format) {
-            DEBUGMSGTL(( "snmptrapd", "format = '%s'\n", handler->format));
-            realloc_format_trap(&rbuf, &r_len, &o_len, 1,
-                                             handler->format,
-                                             v2_pdu, transport);
-        } else {
-	    if ( pdu->command == SNMP_MSG_TRAP && exec_format1 ) {
-                DEBUGMSGTL(( "snmptrapd", "exec v1 = '%s'\n", exec_format1));
-                realloc_format_trap(&rbuf, &r_len, &o_len, 1,
-                                             exec_format1, pdu, transport);
-	    } else if ( pdu->command != SNMP_MSG_TRAP && exec_format2 ) {
-                DEBUGMSGTL(( "snmptrapd", "exec v2/3 = '%s'\n", exec_format2));
-                realloc_format_trap(&rbuf, &r_len, &o_len, 1,
-                                             exec_format2, pdu, transport);
-	    } else {
-                DEBUGMSGTL(( "snmptrapd", "execute format\n"));
-                realloc_format_trap(&rbuf, &r_len, &o_len, 1, EXECUTE_FORMAT,
-                                             v2_pdu, transport);
-            }
-	}
-
-        /*
-         *  and pass this formatted string to the command specified
-         */
-        run_shell_command(handler->token, (char*)rbuf, NULL, NULL);   /* Not interested in output */
-        netsnmp_ds_set_boolean(NETSNMP_DS_LIBRARY_ID, 
-                               NETSNMP_DS_LIB_QUICK_PRINT, oldquick);
-        if (pdu->command == SNMP_MSG_TRAP)
-            snmp_free_pdu(v2_pdu);
-        free(rbuf);
+        if (netsnmp_trapd_pipeline_running())
+            return queue_trap_job(NETSNMPTRAPD_STAGE_MAIN, run_persist_job,
+                                  pdu, transport, handler);
+        send_persist_trap(pdu, transport, handler->handler_data,
+                          handler->format, handler->compiled_format);
+    } else if (handler->token && *handler->token) {
+        if (netsnmp_trapd_pipeline_running())
+            return queue_trap_job(NETSNMPTRAPD_STAGE_EXEC, run_command_job,
+                                  pdu, transport, handler);
+        run_trap_command(pdu, transport, handler->token, handler->format,
+                         handler->compiled_format);
     }
     return NETSNMPTRAPD_HANDLER_OK;
 #endif /* !def USING_UTILITIES_EXECUTE_MODULE */
@@ -919,10 +1273,21 @@ int   command_handler( netsnmp_pdu           *pdu,
 /*
  *  Trap handler for forwarding to the AgentX master agent
  */
+static void
+run_axforward_job(netsnmp_trapd_job *job)
+{
+    netsnmp_trapd_pipeline_format_lock(0);
+    send_v2trap( job->pdu->variables );
+    netsnmp_trapd_pipeline_format_unlock(0);
+}
+
 int axforward_handler( netsnmp_pdu           *pdu,
                        netsnmp_transport     *transport,
                        netsnmp_trapd_handler *handler)
 {
+    if (netsnmp_trapd_pipeline_running())
+        return queue_trap_job(NETSNMPTRAPD_STAGE_MAIN, run_axforward_job,
+                              pdu, transport, NULL);
     send_v2trap( pdu->variables );
     return NETSNMPTRAPD_HANDLER_OK;
 }
@@ -1043,26 +1408,21 @@ static int add_forwarder_info(netsnmp_pdu *pdu, netsnmp_pdu *pdu2)
 }
 
 /*
- *  Trap handler for forwarding to another destination
+ *  Forward a trap to another destination
  */
-int   forward_handler( netsnmp_pdu           *pdu,
-                       netsnmp_transport     *transport,
-                       netsnmp_trapd_handler *handler)
+static int
+forward_trap(netsnmp_pdu *pdu, const char *destination)
 {
     netsnmp_session session, *ss;
     netsnmp_pdu *pdu2;
-    char buf[BUFSIZ], *cp;
-
-    DEBUGMSGTL(( "snmptrapd", "forward_handler (%s)\n", handler->token));
+    char buf[BUFSIZ];
 
     snmp_sess_init( &session );
-    if (strchr( handler->token, ':') == NULL) {
-        snprintf( buf, BUFSIZ, "%s:%d", handler->token, SNMP_TRAP_PORT);
-        cp = buf;
-    } else {
-        cp = handler->token;
-    }
-    session.peername = cp;
+    if (strchr( destination, ':') == NULL)
+        snprintf( buf, BUFSIZ, "%s:%d", destination, SNMP_TRAP_PORT);
+    else
+        snprintf( buf, BUFSIZ, "%s", destination);
+    session.peername = buf;
     session.version  = pdu->version;
     ss = snmp_open( &session );
     if (!ss)
@@ -1099,16 +1459,48 @@ int   forward_handler( netsnmp_pdu           *pdu,
     return NETSNMPTRAPD_HANDLER_OK;
 }
 
+static void
+run_forward_job(netsnmp_trapd_job *job)
+{
+    forward_trap(job->pdu, job->token);
+}
+
+/*
+ *  Trap handler for forwarding to another destination
+ */
+int   forward_handler( netsnmp_pdu           *pdu,
+                       netsnmp_transport     *transport,
+                       netsnmp_trapd_handler *handler)
+{
+    DEBUGMSGTL(( "snmptrapd", "forward_handler (%s)\n", handler->token));
+
+    if (netsnmp_trapd_pipeline_running())
+        return queue_trap_job(NETSNMPTRAPD_STAGE_FORWARD, run_forward_job,
+                              pdu, transport, handler);
+    return forward_trap(pdu, handler->token);
+}
+
 #if defined(USING_NOTIFICATION_LOG_MIB_NOTIFICATION_LOG_MODULE) && defined(USING_AGENTX_SUBAGENT_MODULE) && !defined(NETSNMP_SNMPTRAPD_DISABLE_AGENTX)
 /*
  *  "Notification" handler for implementing NOTIFICATION-MIB
  *  		(presumably)
  */
+static void
+run_notification_job(netsnmp_trapd_job *job)
+{
+    netsnmp_trapd_pipeline_format_lock(0);
+    log_notification(job->pdu, job->transport);
+    netsnmp_trapd_pipeline_format_unlock(0);
+}
+
 int   notification_handler(netsnmp_pdu           *pdu,
                            netsnmp_transport     *transport,
                            netsnmp_trapd_handler *handler)
 {
     DEBUGMSGTL(( "snmptrapd", "notification_handler\n"));
+    if (netsnmp_trapd_pipeline_running())
+        return queue_trap_job(NETSNMPTRAPD_STAGE_MAIN, run_notification_job,
+                              pdu, transport, NULL);
     log_notification(pdu, transport);
     return NETSNMPTRAPD_HANDLER_OK;
 }
@@ -1120,7 +1512,187 @@ int   notification_handler(netsnmp_pdu           *pdu,
  *
  *-----------------------------*/
 
+/*
+ * Run the lists of handlers for a trap.  Returns
+ * NETSNMPTRAPD_HANDLER_FINISH if a handler stopped all further processing.
+ */
+int
+netsnmp_trapd_run_handlers(netsnmp_pdu *pdu, netsnmp_transport *transport,
+                           oid *trapOid, int trapOidLen)
+{
+    netsnmp_trapd_handler *traph;
+    int ret, idx;
+
+    for( idx = 0; handlers[idx].descr; ++idx ) {
+        DEBUGMSGTL(("snmptrapd", "Running %s handlers\n",
+                    handlers[idx].descr));
+        if (NULL == handlers[idx].handler) /* specific */
+            traph = netsnmp_get_traphandler(trapOid, trapOidLen);
+        else
+            traph = *handlers[idx].handler;
+
+        for( ; traph; traph = traph->nexth) {
+            if (!netsnmp_trapd_check_auth(traph->authtypes))
+                continue; /* we continue on and skip this one */
 
+#ifdef NETSNMP_TRAPD_PIPELINE
+            __atomic_fetch_add(&traph->hits, 1, __ATOMIC_RELAXED);
+#else
+            traph->hits++;
+#endif
+            ret = (*(traph->handler))(pdu, transport, traph);
+            if(NETSNMPTRAPD_HANDLER_FINISH == ret)
+                return NETSNMPTRAPD_HANDLER_FINISH;
+            if (ret == NETSNMPTRAPD_HANDLER_BREAK)
+                break; /* move on to next type */
+        } /* traph */
+    } /* handlers */
+    return NETSNMPTRAPD_HANDLER_OK;
+}
+
+/*
+ * The built-in handlers below can be called from a pipeline worker thread;
+ * anything else (embedded perl, mysql, handlers added by extensions) has
+ * to run in the main thread.
+ */
+static int
+handler_is_threadsafe(netsnmp_trapd_handler *traph)
+{
+    return traph->handler == netsnmp_trapd_auth ||
+        traph->handler == print_handler ||
+        traph->handler == syslog_handler ||
+        traph->handler == command_handler ||
+        traph->handler == forward_handler ||
+#if defined(USING_NOTIFICATION_LOG_MIB_NOTIFICATION_LOG_MODULE) && defined(USING_AGENTX_SUBAGENT_MODULE) && !defined(NETSNMP_SNMPTRAPD_DISABLE_AGENTX)
+        traph->handler == notification_handler ||
+#endif
+#ifdef NETSNMP_USE_SQLITE
+        traph->handler == sqlite_handler ||
+#endif
+        traph->handler == axforward_handler;
+}
+
+/*
+ * Returns 1 if every handler that may be run for this trap is thread-safe.
+ */
+int
+netsnmp_trapd_handlers_threadsafe(oid *trapOid, int trapOidLen)
+{
+    netsnmp_trapd_handler *traph;
+    int idx;
+
+    for (idx = 0; handlers[idx].descr; ++idx) {
+        if (NULL == handlers[idx].handler)
+            traph = netsnmp_get_traphandler(trapOid, trapOidLen);
+        else
+            traph = *handlers[idx].handler;
+        for (; traph; traph = traph->nexth)
+            if (!handler_is_threadsafe(traph))
+                return 0;
+    }
+    return 1;
+}
+
+static const char *
+handler_name(netsnmp_trapd_handler *traph)
+{
+    if (traph->handler == command_handler)
+        return "traphandle";
+    if (traph->handler == forward_handler ||
+        traph->handler == axforward_handler)
+        return "forward";
+    if (traph->handler == print_handler)
+        return "print";
+    if (traph->handler == syslog_handler)
+        return "syslog";
+    if (traph->handler == netsnmp_trapd_auth)
+        return "authorization";
+#if defined(USING_NOTIFICATION_LOG_MIB_NOTIFICATION_LOG_MODULE) && defined(USING_AGENTX_SUBAGENT_MODULE) && !defined(NETSNMP_SNMPTRAPD_DISABLE_AGENTX)
+    if (traph->handler == notification_handler)
+        return "notification log";
+#endif
+    return "handler";
+}
+
+static void
+log_handler_list(const char *descr, netsnmp_trapd_handler *traph)
+{
+    char            oidbuf[SPRINT_MAX_LEN];
+
+    for (; traph; traph = traph->nexth) {
+        oidbuf[0] = '\0';
+        if (traph->trapoid)
+            snprint_objid(oidbuf, sizeof(oidbuf), traph->trapoid,
+                          traph->trapoid_len);
+        snmp_log(LOG_INFO, "%s %s%s%s%s%s%s: %lu hits\n", descr,
+                 handler_name(traph), oidbuf[0] ? " " : "", oidbuf,
+                 !(traph->flags & NETSNMP_TRAPHANDLER_FLAG_MATCH_TREE) ? "" :
+                 (traph->flags & NETSNMP_TRAPHANDLER_FLAG_STRICT_SUBTREE) ?
+                 ".*" : "*",
+                 traph->token ? " " : "", traph->token ? traph->token : "",
+#ifdef NETSNMP_TRAPD_PIPELINE
+                 __atomic_load_n(&traph->hits, __ATOMIC_RELAXED)
+#else
+                 traph->hits
+#endif
+            );
+    }
+}
+
+/*
+ * Log how often each handler has been run since the configuration was
+ * read, if handlerStatsInterval is set.
+ */
+void
+netsnmp_trapd_log_handler_stats(void)
+{
+    netsnmp_trapd_handler *traph;
+    int idx;
+
+    if (!handler_stats_interval)
+        return;
+    for (idx = 0; handlers[idx].descr; ++idx) {
+        if (handlers[idx].handler) {
+            log_handler_list(handlers[idx].descr, *handlers[idx].handler);
+            continue;
+        }
+        for (traph = netsnmp_specific_traphandlers; traph;
+             traph = traph->nextt)
+            log_handler_list(handlers[idx].descr, traph);
+        log_handler_list("default", netsnmp_default_traphandlers);
+    }
+}
+
+/*
+ * The source address of a notification, without the port where there is
+ * one, for grouping notifications by source.  *family is AF_INET or
+ * AF_INET6 for IP addresses; for other transports it is 0 and the whole
+ * transport address is returned.
+ */
+const void *
+netsnmp_trapd_source_address(netsnmp_pdu *pdu, size_t *len, int *family)
+{
+    netsnmp_indexed_addr_pair *addr_pair;
+
+    *family = 0;
+    *len = pdu->transport_data ? pdu->transport_data_length : 0;
+    if (*len == sizeof(netsnmp_indexed_addr_pair)) {
+        addr_pair = (netsnmp_indexed_addr_pair *) pdu->transport_data;
+        if (addr_pair->remote_addr.sa.sa_family == AF_INET) {
+            *family = AF_INET;
+            *len = sizeof(addr_pair->remote_addr.sin.sin_addr);
+            return &addr_pair->remote_addr.sin.sin_addr;
+        }
+#ifdef NETSNMP_ENABLE_IPV6
+        if (addr_pair->remote_addr.sa.sa_family == AF_INET6) {
+            *family = AF_INET6;
+            *len = sizeof(addr_pair->remote_addr.sin6.sin6_addr);
+            return &addr_pair->remote_addr.sin6.sin6_addr;
+        }
+#endif
+    }
+    return pdu->transport_data;
+}
 
 int
 snmp_input(int op, netsnmp_session *session,
@@ -1131,9 +1703,7 @@ snmp_input(int op, netsnmp_session *session,
     oid trapOid[MAX_OID_LEN+2] = {0};
     int trapOidLen;
     netsnmp_variable_list *vars;
-    netsnmp_trapd_handler *traph;
     netsnmp_transport *transport = (netsnmp_transport *) magic;
-    int ret, idx;
 
     switch (op) {
     case NETSNMP_CALLBACK_OP_RECEIVED_MESSAGE:
@@ -1241,26 +1811,25 @@ t        *     d) any other global handlers
          *  OK - Enough waffling, let's get to work.....
 	 */
 
-        for( idx = 0; handlers[idx].descr; ++idx ) {
-            DEBUGMSGTL(("snmptrapd", "Running %s handlers\n",
-                        handlers[idx].descr));
-            if (NULL == handlers[idx].handler) /* specific */
-                traph = netsnmp_get_traphandler(trapOid, trapOidLen);
-            else
-                traph = *handlers[idx].handler;
-
-            for( ; traph; traph = traph->nexth) {
-                if (!netsnmp_trapd_check_auth(traph->authtypes))
-                    continue; /* we continue on and skip this one */
-
-                ret = (*(traph->handler))(pdu, transport, traph);
-                if(NETSNMPTRAPD_HANDLER_FINISH == ret)
-                    return 1;
-                if (ret == NETSNMPTRAPD_HANDLER_BREAK)
-                    break; /* move on to next type */
-            } /* traph */
-        } /* handlers */
-
+        if (netsnmp_trapd_suppressed(pdu, transport, trapOid, trapOidLen)) {
+            /*
+             * Dropped as a duplicate or over the rate limit.  An INFORM
+             * is still acknowledged, so that the sender does not add to
+             * the storm by retrying it.
+             */
+        } else if (netsnmp_trapd_pipeline_running()) {
+            /*
+             * Hand it to a worker.  A dropped INFORM is not acknowledged,
+             * so that the sender tries again; a queued one is acknowledged
+             * now, before its handlers have had a chance to reject it.
+             */
+            if (netsnmp_trapd_pipeline_submit(pdu, transport, trapOid,
+                                              trapOidLen) != 0)
+                return 1;
+        } else if (netsnmp_trapd_run_handlers(pdu, transport, trapOid,
+                                              trapOidLen) ==
+                   NETSNMPTRAPD_HANDLER_FINISH)
+            return 1;
 
 	if (pdu->command == SNMP_MSG_INFORM) {
 	    netsnmp_pdu *reply = snmp_clone_pdu(pdu);
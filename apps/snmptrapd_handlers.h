@@ -23,6 +23,8 @@ struct netsnmp_trapd_handler_s {
      Netsnmp_Trap_Handler *handler;
      void *handler_data;
      void (*free_handler_data)(void *);
+     struct netsnmp_trapd_format_s *compiled_format; /* format, compiled */
+     u_long hits;		/* Number of times it was run */
 
      netsnmp_trapd_handler *nexth;	/* Next handler for this trap */
              /* Doubly-linked list of traps with registered handlers */
@@ -38,6 +40,7 @@ Netsnmp_Trap_Handler   forward_handler;
 Netsnmp_Trap_Handler   axforward_handler;
 Netsnmp_Trap_Handler   notification_handler;
 Netsnmp_Trap_Handler   mysql_handler;
+Netsnmp_Trap_Handler   sqlite_handler;
 
 void free_trap1_fmt(void);
 void free_trap2_fmt(void);
@@ -67,6 +70,12 @@ void snmptrapd_free_all_traphandlers(void);
 const char *trap_description(int trap);
 int snmp_input(int op, netsnmp_session *session,
            int reqid, netsnmp_pdu *pdu, void *magic);
+int netsnmp_trapd_run_handlers(netsnmp_pdu *pdu, netsnmp_transport *transport,
+                               oid *trapOid, int trapOidLen);
+int netsnmp_trapd_handlers_threadsafe(oid *trapOid, int trapOidLen);
+void netsnmp_trapd_log_handler_stats(void);
+const void *netsnmp_trapd_source_address(netsnmp_pdu *pdu, size_t *len,
+                                         int *family);
 
 void parse_format(const char *token, char *line);
 
@@ -87,6 +87,10 @@ SOFTWARE.
 #include <net-snmp/net-snmp-includes.h>
 #include "snmptrapd_handlers.h"
 #include "snmptrapd_log.h"
+#include "snmptrapd_pipeline.h"
+#ifdef NETSNMP_TRAPD_PIPELINE
+#include <pthread.h>
+#endif
 
 
 #ifndef BSD4_3
@@ -111,7 +115,57 @@ typedef struct {
     int             leading_zeroes;     /* if true, display with leading zeroes */
 } options_type;
 
-char            separator[32];
+/*
+ * A format string is compiled into a list of these operations, which
+ * is then run for every trap that is formatted.
+ */
+#define FMT_OP_TEXT     0       /* copy literal text */
+#define FMT_OP_CMD      1       /* run a format command */
+#define FMT_OP_JSON     2       /* the whole trap as a JSON object */
+
+#define SEPARATOR_LEN   32
+
+typedef struct {
+    int             type;
+    options_type    options;    /* FMT_OP_CMD */
+    size_t          text_offset;        /* FMT_OP_TEXT, into the text buffer */
+    size_t          text_len;
+    char            separator[SEPARATOR_LEN];   /* set by %V, used by %v */
+} format_op;
+
+struct netsnmp_trapd_format_s {
+    char           *source;     /* the format string */
+    format_op      *ops;
+    size_t          nops;
+    size_t          max_ops;
+    u_char         *text;       /* literal text of all FMT_OP_TEXT ops */
+    size_t          text_len;
+    size_t          text_size;
+};
+
+/*
+ * The format string that selects JSON-lines output
+ */
+#define JSON_FORMAT     "json"
+
+/*
+ * Values that several format commands may need, worked out at most
+ * once per trap.
+ */
+typedef struct {
+    time_t          now;
+    struct tm       local_tm;
+    struct tm       utc_tm;
+    int             have_now;
+    int             local_state;        /* 0 not yet, 1 valid, -1 failed */
+    int             utc_state;
+} format_ctx;
+
+/*
+ * Output buffers that are kept for reuse are trimmed back when a trap
+ * has made them larger than this.
+ */
+#define FORMAT_BUFFER_KEEP  (64 * 1024)
 
 /*
  * These symbols define the characters that the parser recognizes.
@@ -329,60 +383,53 @@ init_options(options_type * options)
 
 
 static int
-realloc_output_temp_bfr(u_char ** buf, size_t * buf_len, size_t * out_len,
-                        int allow_realloc,
-                        u_char ** temp_buf, options_type * options)
+realloc_output_field(u_char ** buf, size_t * buf_len, size_t * out_len,
+                     int allow_realloc,
+                     const char *field, options_type * options)
 
      /*
       * Function:
-      *    Append the contents of the temporary buffer to the specified
-      * buffer using the correct justification, leading zeroes, width,
-      * precision, and other characteristics specified in the options
-      * structure.
+      *    Append a string to the specified buffer using the correct
+      * justification, leading zeroes, width, precision, and other
+      * characteristics specified in the options structure.
       *
       *    buf, buf_len, out_len, allow_realloc - standard relocatable
       *                                           buffer parameters
-      *    temp_buf - pointer to string to append onto output buffer.  THIS
-      *               STRING IS free()d BY THIS FUNCTION.
+      *    field    - string to append onto output buffer
       *    options  - what options to use when appending string
       */
 {
-    size_t          temp_len;   /* length of temporary buffer */
-    size_t          temp_to_write;      /* # of chars to write from temp bfr */
+    size_t          field_len;  /* length of the field */
+    size_t          field_to_write;     /* # of chars to write from field */
     size_t          char_to_write;      /* # of other chars to write */
     size_t          zeroes_to_write;    /* fill to precision with zeroes for numbers */
 
-    if (temp_buf == NULL || *temp_buf == NULL) {
-        return 1;
-    }
-
     /*
-     * Figure out how many characters are in the temporary buffer now,
+     * Figure out how many characters are in the field,
      * and how many of them we'll write.
      */
-    temp_len = strlen((char *) *temp_buf);
-    temp_to_write = temp_len;
+    field_len = strlen(field);
+    field_to_write = field_len;
 
     if (options->precision != UNDEF_PRECISION &&
-        temp_to_write > (size_t)options->precision) {
-        temp_to_write = options->precision;
+        field_to_write > (size_t)options->precision) {
+        field_to_write = options->precision;
     }
 
     /*
      * Handle leading characters.  
      */
-    if ((!options->left_justify) && (temp_to_write < options->width)) {
-        zeroes_to_write = options->precision - temp_to_write;
+    if ((!options->left_justify) && (field_to_write < options->width)) {
+        zeroes_to_write = options->precision - field_to_write;
         if (!is_numeric_cmd(options->cmd)) {
             zeroes_to_write = 0;
         }
 
-        for (char_to_write = options->width - temp_to_write;
+        for (char_to_write = options->width - field_to_write;
              char_to_write > 0; char_to_write--) {
             if ((*out_len + 1) >= *buf_len) {
                 if (!(allow_realloc && snmp_realloc(buf, buf_len))) {
                     *(*buf + *out_len) = '\0';
-                    free(*temp_buf);
                     return 0;
                 }
             }
@@ -397,24 +444,26 @@ realloc_output_temp_bfr(u_char ** buf, size_t * buf_len, size_t * out_len,
     }
 
     /*
-     * Truncate the temporary buffer and append its contents.  
+     * Append the (possibly truncated) field.  
      */
-    *(*temp_buf + temp_to_write) = '\0';
-    if (!snmp_strcat(buf, buf_len, out_len, allow_realloc, *temp_buf)) {
-        free(*temp_buf);
-        return 0;
+    while ((*out_len + field_to_write + 1) >= *buf_len) {
+        if (!(allow_realloc && snmp_realloc(buf, buf_len))) {
+            *(*buf + *out_len) = '\0';
+            return 0;
+        }
     }
+    memcpy(*buf + *out_len, field, field_to_write);
+    *out_len += field_to_write;
 
     /*
      * Handle trailing characters.  
      */
-    if ((options->left_justify) && (temp_to_write < options->width)) {
-        for (char_to_write = options->width - temp_to_write;
+    if ((options->left_justify) && (field_to_write < options->width)) {
+        for (char_to_write = options->width - field_to_write;
              char_to_write > 0; char_to_write--) {
             if ((*out_len + 1) >= *buf_len) {
                 if (!(allow_realloc && snmp_realloc(buf, buf_len))) {
                     *(*buf + *out_len) = '\0';
-                    free(*temp_buf);
                     return 0;
                 }
             }
@@ -428,16 +477,104 @@ realloc_output_temp_bfr(u_char ** buf, size_t * buf_len, size_t * out_len,
      */
 
     *(*buf + *out_len) = '\0';
+    return 1;
+}
+
+
+static int
+realloc_output_temp_bfr(u_char ** buf, size_t * buf_len, size_t * out_len,
+                        int allow_realloc,
+                        u_char ** temp_buf, options_type * options)
+
+     /*
+      * Function:
+      *    Append the contents of the temporary buffer to the specified
+      * buffer as realloc_output_field() does, and free it.
+      *
+      *    buf, buf_len, out_len, allow_realloc - standard relocatable
+      *                                           buffer parameters
+      *    temp_buf - pointer to string to append onto output buffer.  THIS
+      *               STRING IS free()d BY THIS FUNCTION.
+      *    options  - what options to use when appending string
+      */
+{
+    int             rc;
+
+    if (temp_buf == NULL || *temp_buf == NULL) {
+        return 1;
+    }
+
+    rc = realloc_output_field(buf, buf_len, out_len, allow_realloc,
+                              (char *) *temp_buf, options);
     free(*temp_buf);
     *temp_buf = NULL;
-    return 1;
+    return rc;
+}
+
+
+static time_t
+format_ctx_now(format_ctx *ctx)
+
+     /*
+      * Function:
+      *    Return the current time, the same for all fields of a trap.
+      */
+{
+    if (!ctx->have_now) {
+        time(&ctx->now);
+        ctx->have_now = 1;
+    }
+    return ctx->now;
+}
+
+
+static struct tm *
+parse_time(const time_t *time_val, int utc, struct tm *result)
+
+     /*
+      * Function:
+      *    Thread-safe localtime() or gmtime().
+      */
+{
+#ifdef HAVE_LOCALTIME_R
+    return utc ? gmtime_r(time_val, result) : localtime_r(time_val, result);
+#else
+    struct tm      *parsed = utc ? gmtime(time_val) : localtime(time_val);
+
+    if (!parsed)
+        return NULL;
+    *result = *parsed;
+    return result;
+#endif
+}
+
+
+static struct tm *
+format_ctx_tm(format_ctx *ctx, int utc)
+
+     /*
+      * Function:
+      *    Return the broken down current time (local or UTC), parsing it
+      * only once per trap.
+      */
+{
+    int            *state = utc ? &ctx->utc_state : &ctx->local_state;
+    struct tm      *tm = utc ? &ctx->utc_tm : &ctx->local_tm;
+    time_t          now;
+
+    if (*state == 0) {
+        now = format_ctx_now(ctx);
+        *state = parse_time(&now, utc, tm) ? 1 : -1;
+    }
+    return *state > 0 ? tm : NULL;
 }
 
 
 static int
 realloc_handle_time_fmt(u_char ** buf, size_t * buf_len, size_t * out_len,
                         int allow_realloc,
-                        options_type * options, netsnmp_pdu *pdu)
+                        options_type * options, netsnmp_pdu *pdu,
+                        format_ctx *ctx)
 
      /*
       * Function:
@@ -450,18 +587,16 @@ realloc_handle_time_fmt(u_char ** buf, size_t * buf_len, size_t * out_len,
       *                                           buffer parameters
       *    options - options governing how to write the field
       *    pdu     - information about this trap
+      *    ctx     - values shared by the fields of this trap
       */
 {
     time_t          time_val;   /* the time value to output */
     unsigned long   time_ul;    /* u_long time/timeticks */
     struct tm      *parsed_time;        /* parsed version of current time */
-    char           *safe_bfr = NULL;
+    struct tm       tm_buf;
+    char            safe_bfr[48];
     char            fmt_cmd = options->cmd;     /* the format command to use */
 
-    if ((safe_bfr = calloc(30, 1)) == NULL) {
-        return 0;
-    }
-
     memset(&time_val, 0, sizeof(time_val));
 
     /*
@@ -473,7 +608,7 @@ realloc_handle_time_fmt(u_char ** buf, size_t * buf_len, size_t * out_len,
         /*
          * Note: a time_t is a signed long.  
          */
-        time(&time_val);
+        time_val = format_ctx_now(ctx);
         time_ul = (unsigned long) time_val;
     }
 
@@ -516,10 +651,10 @@ realloc_handle_time_fmt(u_char ** buf, size_t * buf_len, size_t * out_len,
          * Handle other time fields.  
          */
 
-        if (options->alt_format) {
-            parsed_time = gmtime(&time_val);
+        if (!is_up_time_cmd(fmt_cmd)) {
+            parsed_time = format_ctx_tm(ctx, options->alt_format);
         } else {
-            parsed_time = localtime(&time_val);
+            parsed_time = parse_time(&time_val, options->alt_format, &tm_buf);
         }
 
         if (!parsed_time) {
@@ -589,8 +724,8 @@ realloc_handle_time_fmt(u_char ** buf, size_t * buf_len, size_t * out_len,
     /*
      * Output with correct justification, leading zeroes, etc.  
      */
-    return realloc_output_temp_bfr(buf, buf_len, out_len, allow_realloc,
-                                   (u_char **) & safe_bfr, options);
+    return realloc_output_field(buf, buf_len, out_len, allow_realloc,
+                                safe_bfr, options);
 }
 
 static
@@ -822,7 +957,8 @@ realloc_handle_ent_fmt(u_char ** buf, size_t * buf_len, size_t * out_len,
 static int
 realloc_handle_trap_fmt(u_char ** buf, size_t * buf_len, size_t * out_len,
                         int allow_realloc,
-                        options_type * options, netsnmp_pdu *pdu)
+                        options_type * options, const char *sep,
+                        netsnmp_pdu *pdu)
 
      /*
       * Function:
@@ -834,6 +970,7 @@ realloc_handle_trap_fmt(u_char ** buf, size_t * buf_len, size_t * out_len,
       *    buf, buf_len, out_len, allow_realloc - standard relocatable
       *                                           buffer parameters
       *    options - options governing how to write the field
+      *    sep     - variable separator set with %V, if any
       *    pdu     - information about this trap 
       */
 {
@@ -841,10 +978,32 @@ realloc_handle_trap_fmt(u_char ** buf, size_t * buf_len, size_t * out_len,
     char            fmt_cmd = options->cmd;     /* what we're outputting */
     u_char         *temp_buf = NULL;
     size_t          tbuf_len = 64, tout_len = 0;
-    const char           *sep = separator;
     const char           *default_sep = "\t";
     const char           *default_alt_sep = ", ";
 
+    if (fmt_cmd == CHR_TRAP_VARS && !sep[0])
+        sep = (options->alt_format ? default_alt_sep : default_sep);
+
+    if (fmt_cmd == CHR_TRAP_VARS && options->width == 0 &&
+        options->precision == UNDEF_PRECISION) {
+        /*
+         * Nothing to pad or truncate, so write the variables straight
+         * into the output buffer.
+         */
+        for (vars = pdu->variables; vars != NULL;
+             vars = vars->next_variable) {
+            if (options->alt_format || vars != pdu->variables) {
+                if (!snmp_cstrcat(buf, buf_len, out_len, allow_realloc, sep))
+                    return 0;
+            }
+            if (!sprint_realloc_variable(buf, buf_len, out_len,
+                                         allow_realloc, vars->name,
+                                         vars->name_length, vars))
+                return 0;
+        }
+        return 1;
+    }
+
     if ((temp_buf = calloc(tbuf_len, 1)) == NULL) {
         return 0;
     }
@@ -932,8 +1091,6 @@ realloc_handle_trap_fmt(u_char ** buf, size_t * buf_len, size_t * out_len,
         /*
          * Write the trap's variables.  
          */
-        if (!sep || !*sep)
-            sep = (options->alt_format ? default_alt_sep : default_sep);
         for (vars = pdu->variables; vars != NULL;
              vars = vars->next_variable) {
             /*
@@ -1182,8 +1339,9 @@ realloc_handle_wrap_fmt(u_char ** buf, size_t * buf_len, size_t * out_len,
 static int
 realloc_dispatch_format_cmd(u_char ** buf, size_t * buf_len,
                             size_t * out_len, int allow_realloc,
-                            options_type * options, netsnmp_pdu *pdu,
-                            netsnmp_transport *transport)
+                            options_type * options, const char *sep,
+                            netsnmp_pdu *pdu, netsnmp_transport *transport,
+                            format_ctx *ctx)
 
      /*
       * Function:
@@ -1193,8 +1351,10 @@ realloc_dispatch_format_cmd(u_char ** buf, size_t * buf_len,
       *    buf, buf_len, out_len, allow_realloc - standard relocatable
       *                                           buffer parameters
       *    options   - options governing how to write the field
+      *    sep       - variable separator set with %V, if any
       *    pdu       - information about this trap
       *    transport - the transport descriptor
+      *    ctx       - values shared by the fields of this trap
       */
 {
     char            fmt_cmd = options->cmd;     /* for speed */
@@ -1205,13 +1365,13 @@ realloc_dispatch_format_cmd(u_char ** buf, size_t * buf_len,
 
     if (is_cur_time_cmd(fmt_cmd) || is_up_time_cmd(fmt_cmd)) {
         return realloc_handle_time_fmt(buf, buf_len, out_len,
-                                       allow_realloc, options, pdu);
+                                       allow_realloc, options, pdu, ctx);
     } else if (is_agent_cmd(fmt_cmd) || is_pdu_ip_cmd(fmt_cmd)) {
         return realloc_handle_ip_fmt(buf, buf_len, out_len, allow_realloc,
                                      options, pdu, transport);
     } else if (is_trap_cmd(fmt_cmd)) {
         return realloc_handle_trap_fmt(buf, buf_len, out_len,
-                                       allow_realloc, options, pdu);
+                                       allow_realloc, options, sep, pdu);
     } else if (is_auth_cmd(fmt_cmd)) {
         return realloc_handle_auth_fmt(buf, buf_len, out_len,
                                        allow_realloc, options, pdu);
@@ -1288,6 +1448,525 @@ realloc_handle_backslash(u_char ** buf, size_t * buf_len, size_t * out_len,
 }
 
 
+static int
+realloc_json_string(u_char ** buf, size_t * buf_len, size_t * out_len,
+                    int allow_realloc, const u_char * str, size_t len)
+
+     /*
+      * Function:
+      *     Append a string as a quoted JSON string.  Control characters
+      * are escaped, other bytes are copied as they are.
+      */
+{
+    static const char hex[] = "0123456789abcdef";
+    u_char         *cp;
+    size_t          i;
+
+    /*
+     * at worst every character becomes \u00XX 
+     */
+    while ((*out_len + 6 * len + 3) >= *buf_len) {
+        if (!(allow_realloc && snmp_realloc(buf, buf_len))) {
+            return 0;
+        }
+    }
+
+    cp = *buf + *out_len;
+    *cp++ = '"';
+    for (i = 0; i < len; i++) {
+        switch (str[i]) {
+        case '"':
+        case '\\':
+            *cp++ = '\\';
+            *cp++ = str[i];
+            break;
+        case '\n':
+            *cp++ = '\\';
+            *cp++ = 'n';
+            break;
+        case '\r':
+            *cp++ = '\\';
+            *cp++ = 'r';
+            break;
+        case '\t':
+            *cp++ = '\\';
+            *cp++ = 't';
+            break;
+        default:
+            if (str[i] < 0x20 || str[i] == 0x7f) {
+                memcpy(cp, "\\u00", 4);
+                cp[4] = hex[str[i] >> 4];
+                cp[5] = hex[str[i] & 0xf];
+                cp += 6;
+            } else {
+                *cp++ = str[i];
+            }
+        }
+    }
+    *cp++ = '"';
+    *cp = '\0';
+    *out_len = cp - *buf;
+    return 1;
+}
+
+
+static int
+realloc_json_hex(u_char ** buf, size_t * buf_len, size_t * out_len,
+                 int allow_realloc, const u_char * data, size_t len)
+
+     /*
+      * Function:
+      *     Append binary data as a JSON string of hex digits.
+      */
+{
+    static const char hex[] = "0123456789abcdef";
+    u_char         *cp;
+    size_t          i;
+
+    while ((*out_len + 2 * len + 3) >= *buf_len) {
+        if (!(allow_realloc && snmp_realloc(buf, buf_len))) {
+            return 0;
+        }
+    }
+
+    cp = *buf + *out_len;
+    *cp++ = '"';
+    for (i = 0; i < len; i++) {
+        *cp++ = hex[data[i] >> 4];
+        *cp++ = hex[data[i] & 0xf];
+    }
+    *cp++ = '"';
+    *cp = '\0';
+    *out_len = cp - *buf;
+    return 1;
+}
+
+
+static int
+json_is_text(const u_char * str, size_t len)
+
+     /*
+      * Function:
+      *     Returns true if an octet string can be shown as text: valid
+      * UTF-8 without control characters other than white space.
+      */
+{
+    size_t          i = 0, follow;
+
+    while (i < len) {
+        if (str[i] < 0x80) {
+            if ((str[i] < 0x20 && str[i] != '\t' && str[i] != '\n' &&
+                 str[i] != '\r') || str[i] == 0x7f)
+                return FALSE;
+            i++;
+            continue;
+        }
+        if ((str[i] & 0xe0) == 0xc0 && str[i] >= 0xc2)
+            follow = 1;
+        else if ((str[i] & 0xf0) == 0xe0)
+            follow = 2;
+        else if ((str[i] & 0xf8) == 0xf0 && str[i] <= 0xf4)
+            follow = 3;
+        else
+            return FALSE;
+        if (i + follow >= len)
+            return FALSE;
+        for (i++; follow > 0; follow--, i++) {
+            if ((str[i] & 0xc0) != 0x80)
+                return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+
+static int
+realloc_json_key(u_char ** buf, size_t * buf_len, size_t * out_len,
+                 int allow_realloc, const char *key)
+
+     /*
+      * Function:
+      *     Start an object member, with a separating comma unless it is
+      * the first one.
+      */
+{
+    if (*out_len && (*buf)[*out_len - 1] != '{' &&
+        !snmp_cstrcat(buf, buf_len, out_len, allow_realloc, ",")) {
+        return 0;
+    }
+    return snmp_cstrcat(buf, buf_len, out_len, allow_realloc, "\"") &&
+        snmp_cstrcat(buf, buf_len, out_len, allow_realloc, key) &&
+        snmp_cstrcat(buf, buf_len, out_len, allow_realloc, "\":");
+}
+
+
+static int
+realloc_json_objid(u_char ** buf, size_t * buf_len, size_t * out_len,
+                   int allow_realloc, u_char ** tmp, size_t * tmp_len,
+                   const oid * objid, size_t objid_len)
+
+     /*
+      * Function:
+      *     Append an OID, printed according to the output options, as a
+      * JSON string.  tmp is scratch space reused for the whole trap.
+      * Numeric OIDs are written directly, since they never need the MIB
+      * tree (nor any escaping).
+      */
+{
+    size_t          tmp_out = 0;
+
+    if (netsnmp_ds_get_int(NETSNMP_DS_LIBRARY_ID,
+                           NETSNMP_DS_LIB_OID_OUTPUT_FORMAT) ==
+        NETSNMP_OID_OUTPUT_NUMERIC) {
+        char            sub[24];
+        size_t          i;
+
+        if (!snmp_cstrcat(buf, buf_len, out_len, allow_realloc, "\"")) {
+            return 0;
+        }
+        for (i = 0; i < objid_len; i++) {
+            snprintf(sub, sizeof(sub), ".%" NETSNMP_PRIo "u", objid[i]);
+            if (!snmp_cstrcat(buf, buf_len, out_len, allow_realloc, sub)) {
+                return 0;
+            }
+        }
+        return snmp_cstrcat(buf, buf_len, out_len, allow_realloc, "\"");
+    }
+
+    if (!sprint_realloc_objid(tmp, tmp_len, &tmp_out, 1, objid, objid_len)) {
+        return 0;
+    }
+    return realloc_json_string(buf, buf_len, out_len, allow_realloc,
+                               *tmp, tmp_out);
+}
+
+
+static int
+realloc_json_varbind(u_char ** buf, size_t * buf_len, size_t * out_len,
+                     int allow_realloc, u_char ** tmp, size_t * tmp_len,
+                     netsnmp_variable_list * var)
+
+     /*
+      * Function:
+      *     Append a variable binding as a JSON object with its OID, its
+      * type and its value.  Numbers are JSON numbers, octet strings are
+      * strings unless they are binary, in which case they are shown as
+      * hex digits (and marked as such), like any other opaque data.
+      */
+{
+    char            safe_bfr[64];
+    const char     *type;
+    int             hex = FALSE, rc;
+
+    switch (var->type) {
+    case ASN_INTEGER:
+        type = "integer";
+        snprintf(safe_bfr, sizeof(safe_bfr), "%ld", *var->val.integer);
+        break;
+    case ASN_COUNTER:
+        type = "counter";
+        goto unsigned32;
+    case ASN_GAUGE:
+        type = "gauge";
+        goto unsigned32;
+    case ASN_TIMETICKS:
+        type = "timeticks";
+        goto unsigned32;
+    case ASN_UINTEGER:
+        type = "unsigned";
+      unsigned32:
+        snprintf(safe_bfr, sizeof(safe_bfr), "%lu",
+                 *var->val.integer & 0xffffffffUL);
+        break;
+    case ASN_COUNTER64:
+        type = "counter64";
+        printU64(safe_bfr, var->val.counter64);
+        break;
+    case ASN_OCTET_STR:
+        type = "octet";
+        hex = !json_is_text(var->val.string, var->val_len);
+        break;
+    case ASN_OBJECT_ID:
+        type = "oid";
+        break;
+    case ASN_IPADDRESS:
+        type = "ipaddress";
+        if (var->val_len == 4) {
+            snprintf(safe_bfr, sizeof(safe_bfr), "\"%u.%u.%u.%u\"",
+                     var->val.string[0], var->val.string[1],
+                     var->val.string[2], var->val.string[3]);
+        } else {
+            hex = TRUE;
+        }
+        break;
+    case ASN_NULL:
+        type = "null";
+        strcpy(safe_bfr, "null");
+        break;
+    case SNMP_NOSUCHOBJECT:
+        type = "noSuchObject";
+        strcpy(safe_bfr, "null");
+        break;
+    case SNMP_NOSUCHINSTANCE:
+        type = "noSuchInstance";
+        strcpy(safe_bfr, "null");
+        break;
+    case SNMP_ENDOFMIBVIEW:
+        type = "endOfMibView";
+        strcpy(safe_bfr, "null");
+        break;
+    case ASN_OPAQUE:
+        type = "opaque";
+        hex = TRUE;
+        break;
+    case ASN_BIT_STR:
+        type = "bits";
+        hex = TRUE;
+        break;
+    default:
+        type = "unknown";
+        hex = TRUE;
+    }
+
+    if (!snmp_cstrcat(buf, buf_len, out_len, allow_realloc, "{") ||
+        !realloc_json_key(buf, buf_len, out_len, allow_realloc, "oid") ||
+        !realloc_json_objid(buf, buf_len, out_len, allow_realloc,
+                            tmp, tmp_len, var->name, var->name_length) ||
+        !realloc_json_key(buf, buf_len, out_len, allow_realloc, "type") ||
+        !realloc_json_string(buf, buf_len, out_len, allow_realloc,
+                             (const u_char *) type, strlen(type)) ||
+        !realloc_json_key(buf, buf_len, out_len, allow_realloc, "value")) {
+        return 0;
+    }
+
+    if (hex) {
+        rc = realloc_json_hex(buf, buf_len, out_len, allow_realloc,
+                              var->val.string, var->val_len) &&
+            realloc_json_key(buf, buf_len, out_len, allow_realloc,
+                             "encoding") &&
+            snmp_cstrcat(buf, buf_len, out_len, allow_realloc, "\"hex\"");
+    } else if (var->type == ASN_OCTET_STR) {
+        rc = realloc_json_string(buf, buf_len, out_len, allow_realloc,
+                                 var->val.string, var->val_len);
+    } else if (var->type == ASN_OBJECT_ID) {
+        rc = realloc_json_objid(buf, buf_len, out_len, allow_realloc,
+                                tmp, tmp_len, var->val.objid,
+                                var->val_len / sizeof(oid));
+    } else {
+        rc = snmp_cstrcat(buf, buf_len, out_len, allow_realloc, safe_bfr);
+    }
+    return rc && snmp_cstrcat(buf, buf_len, out_len, allow_realloc, "}");
+}
+
+
+static int
+realloc_json_ip(u_char ** buf, size_t * buf_len, size_t * out_len,
+                int allow_realloc, u_char ** tmp, size_t * tmp_len,
+                char fmt_cmd, netsnmp_pdu *pdu, netsnmp_transport *transport)
+
+     /*
+      * Function:
+      *     Append the sender's address or name (as for %b or %B) as a
+      * JSON string.  tmp is scratch space reused for the whole trap.
+      */
+{
+    options_type    options;
+    size_t          tmp_out = 0;
+
+    init_options(&options);
+    options.cmd = fmt_cmd;
+    if (!realloc_handle_ip_fmt(tmp, tmp_len, &tmp_out, 1, &options, pdu,
+                               transport)) {
+        return 0;
+    }
+    return realloc_json_string(buf, buf_len, out_len, allow_realloc,
+                               *tmp, tmp_out);
+}
+
+
+static int
+realloc_format_json_trap(u_char ** buf, size_t * buf_len, size_t * out_len,
+                         int allow_realloc, netsnmp_pdu *pdu,
+                         netsnmp_transport *transport, format_ctx *ctx)
+
+     /*
+      * Function:
+      *     Format the trap as a single line JSON object, for log shippers
+      * that read one record per line:
+      *
+      *  {"time":"2024-01-01T12:00:00Z","host":"...","address":"...",
+      *   "pdu":"TRAP2","version":"2c","community":"public",
+      *   "trapOID":"...","varbinds":[{"oid":"...","type":"...",
+      *   "value":...},...]}
+      *
+      * v1 traps also have agent, enterprise, generic, specific and
+      * uptime members, and their trapOID is the RFC 3584 translation.
+      * v3 notifications have user and context instead of community.
+      * The time is always UTC.  OIDs are printed following the output
+      * options.
+      *
+      * Input Parameters:
+      *    buf, buf_len, out_len, allow_realloc - standard relocatable
+      *                                           buffer parameters
+      *    pdu       - the pdu information
+      *    transport - the transport descriptor
+      *    ctx       - values shared by the fields of this trap
+      */
+{
+    static const oid snmpTraps[] = { 1, 3, 6, 1, 6, 3, 1, 1, 5, 0 };
+    oid             trap_oid[MAX_OID_LEN + 2];
+    size_t          trap_oid_len = 0;
+    u_char         *tmp = NULL;
+    size_t          tmp_len = 0;
+    netsnmp_variable_list *vars;
+    struct tm      *tm;
+    char            safe_bfr[64];
+    const char     *pdu_type, *version;
+    int             rc = 0;
+
+#define JSON_KEY(key) \
+    realloc_json_key(buf, buf_len, out_len, allow_realloc, key)
+#define JSON_STRING(str, len) \
+    realloc_json_string(buf, buf_len, out_len, allow_realloc, \
+                        (const u_char *) (str), len)
+#define JSON_RAW(str) \
+    snmp_cstrcat(buf, buf_len, out_len, allow_realloc, str)
+
+    tmp_len = 256;
+    if ((tmp = malloc(tmp_len)) == NULL || !JSON_RAW("{")) {
+        free(tmp);
+        return 0;
+    }
+
+    tm = format_ctx_tm(ctx, 1);
+    if (tm) {
+        strftime(safe_bfr, sizeof(safe_bfr), "%Y-%m-%dT%H:%M:%SZ", tm);
+        if (!JSON_KEY("time") || !JSON_STRING(safe_bfr, strlen(safe_bfr)))
+            goto done;
+    }
+
+    if (!JSON_KEY("host") ||
+        !realloc_json_ip(buf, buf_len, out_len, allow_realloc, &tmp,
+                         &tmp_len, CHR_PDU_NAME, pdu, transport) ||
+        !JSON_KEY("address") ||
+        !realloc_json_ip(buf, buf_len, out_len, allow_realloc, &tmp,
+                         &tmp_len, CHR_PDU_IP, pdu, transport))
+        goto done;
+
+    switch (pdu->command) {
+    case SNMP_MSG_TRAP:
+        pdu_type = "TRAP";
+        break;
+    case SNMP_MSG_TRAP2:
+        pdu_type = "TRAP2";
+        break;
+    case SNMP_MSG_INFORM:
+        pdu_type = "INFORM";
+        break;
+    default:
+        pdu_type = NULL;
+    }
+    if (pdu_type && (!JSON_KEY("pdu") ||
+                     !JSON_STRING(pdu_type, strlen(pdu_type))))
+        goto done;
+
+    switch (pdu->version) {
+    case SNMP_VERSION_1:
+        version = "1";
+        break;
+    case SNMP_VERSION_2c:
+        version = "2c";
+        break;
+    case SNMP_VERSION_3:
+        version = "3";
+        break;
+    default:
+        version = NULL;
+    }
+    if (version && (!JSON_KEY("version") ||
+                    !JSON_STRING(version, strlen(version))))
+        goto done;
+
+    if (pdu->version == SNMP_VERSION_3) {
+        if (!JSON_KEY("user") ||
+            !JSON_STRING(pdu->securityName, pdu->securityNameLen) ||
+            !JSON_KEY("context") ||
+            !JSON_STRING(pdu->contextName, pdu->contextNameLen))
+            goto done;
+    } else {
+        if (!JSON_KEY("community") ||
+            !JSON_STRING(pdu->community, pdu->community_len))
+            goto done;
+    }
+
+    if (pdu->command == SNMP_MSG_TRAP) {
+        u_char         *agent = (u_char *) pdu->agent_addr;
+
+        snprintf(safe_bfr, sizeof(safe_bfr), "%u.%u.%u.%u",
+                 agent[0], agent[1], agent[2], agent[3]);
+        if (!JSON_KEY("agent") || !JSON_STRING(safe_bfr, strlen(safe_bfr)) ||
+            !JSON_KEY("enterprise") ||
+            !realloc_json_objid(buf, buf_len, out_len, allow_realloc,
+                                &tmp, &tmp_len, pdu->enterprise,
+                                pdu->enterprise_length))
+            goto done;
+        snprintf(safe_bfr, sizeof(safe_bfr), "%ld", pdu->trap_type);
+        if (!JSON_KEY("generic") || !JSON_RAW(safe_bfr))
+            goto done;
+        snprintf(safe_bfr, sizeof(safe_bfr), "%ld", pdu->specific_type);
+        if (!JSON_KEY("specific") || !JSON_RAW(safe_bfr))
+            goto done;
+        snprintf(safe_bfr, sizeof(safe_bfr), "%lu", (u_long) pdu->time);
+        if (!JSON_KEY("uptime") || !JSON_RAW(safe_bfr))
+            goto done;
+
+        if (pdu->trap_type != SNMP_TRAP_ENTERPRISESPECIFIC) {
+            trap_oid_len = OID_LENGTH(snmpTraps);
+            memcpy(trap_oid, snmpTraps, sizeof(snmpTraps));
+            trap_oid[trap_oid_len - 1] = pdu->trap_type + 1;
+        } else if (pdu->enterprise_length > 0 &&
+                   pdu->enterprise_length <= MAX_OID_LEN) {
+            trap_oid_len = pdu->enterprise_length;
+            memcpy(trap_oid, pdu->enterprise, trap_oid_len * sizeof(oid));
+            if (trap_oid[trap_oid_len - 1] != 0)
+                trap_oid[trap_oid_len++] = 0;
+            trap_oid[trap_oid_len++] = pdu->specific_type;
+        }
+    } else if (pdu->variables && pdu->variables->next_variable &&
+               pdu->variables->next_variable->type == ASN_OBJECT_ID) {
+        vars = pdu->variables->next_variable;
+        trap_oid_len = vars->val_len / sizeof(oid);
+        if (trap_oid_len > MAX_OID_LEN)
+            trap_oid_len = MAX_OID_LEN;
+        memcpy(trap_oid, vars->val.objid, trap_oid_len * sizeof(oid));
+    }
+    if (trap_oid_len &&
+        (!JSON_KEY("trapOID") ||
+         !realloc_json_objid(buf, buf_len, out_len, allow_realloc,
+                             &tmp, &tmp_len, trap_oid, trap_oid_len)))
+        goto done;
+
+    if (!JSON_KEY("varbinds") || !JSON_RAW("["))
+        goto done;
+    for (vars = pdu->variables; vars != NULL; vars = vars->next_variable) {
+        if (vars != pdu->variables && !JSON_RAW(","))
+            goto done;
+        if (!realloc_json_varbind(buf, buf_len, out_len, allow_realloc,
+                                  &tmp, &tmp_len, vars))
+            goto done;
+    }
+    rc = JSON_RAW("]}");
+
+#undef JSON_KEY
+#undef JSON_STRING
+#undef JSON_RAW
+
+  done:
+    free(tmp);
+    return rc;
+}
+
+
 int
 realloc_format_plain_trap(u_char ** buf, size_t * buf_len,
                           size_t * out_len, int allow_realloc,
@@ -1507,41 +2186,143 @@ realloc_format_plain_trap(u_char ** buf, size_t * buf_len,
 }
 
 
-int
-realloc_format_trap(u_char ** buf, size_t * buf_len, size_t * out_len,
-                    int allow_realloc, const char *format_str,
-                    netsnmp_pdu *pdu, netsnmp_transport *transport)
+static int
+format_add_op(netsnmp_trapd_format *fmt, int type)
 
      /*
       * Function:
-      *    Format the trap information for display in a log. Place the results
-      *    in the specified buffer (truncating to the length of the buffer).
-      *    Returns the number of characters it put in the buffer.
+      *    Add an operation to a compiled format.  Returns 1 on success
+      * or 0 if out of memory.
+      */
+{
+    format_op      *ops;
+    size_t          max_ops;
+
+    if (fmt->nops == fmt->max_ops) {
+        max_ops = fmt->max_ops ? 2 * fmt->max_ops : 8;
+        ops = realloc(fmt->ops, max_ops * sizeof(format_op));
+        if (ops == NULL) {
+            return 0;
+        }
+        fmt->ops = ops;
+        fmt->max_ops = max_ops;
+    }
+    memset(&fmt->ops[fmt->nops], 0, sizeof(format_op));
+    fmt->ops[fmt->nops].type = type;
+    fmt->nops++;
+    return 1;
+}
+
+
+static int
+format_add_text(netsnmp_trapd_format *fmt, const char *text, size_t len)
+
+     /*
+      * Function:
+      *    Add literal text to a compiled format, extending the previous
+      * operation if that was literal text as well.  Returns 1 on success
+      * or 0 if out of memory.
+      */
+{
+    format_op      *op;
+
+    while (fmt->text_len + len >= fmt->text_size) {
+        if (!snmp_realloc(&fmt->text, &fmt->text_size)) {
+            return 0;
+        }
+    }
+    memcpy(fmt->text + fmt->text_len, text, len);
+
+    op = fmt->nops ? &fmt->ops[fmt->nops - 1] : NULL;
+    if (op == NULL || op->type != FMT_OP_TEXT) {
+        if (!format_add_op(fmt, FMT_OP_TEXT)) {
+            return 0;
+        }
+        op = &fmt->ops[fmt->nops - 1];
+        op->text_offset = fmt->text_len;
+    }
+    op->text_len += len;
+    fmt->text_len += len;
+    return 1;
+}
+
+
+static int
+format_add_cmd(netsnmp_trapd_format *fmt, options_type * options,
+               const char *separator)
+
+     /*
+      * Function:
+      *    Add a format command to a compiled format.  Returns 1 on
+      * success or 0 if out of memory.
+      */
+{
+    format_op      *op;
+
+    if (!format_add_op(fmt, FMT_OP_CMD)) {
+        return 0;
+    }
+    op = &fmt->ops[fmt->nops - 1];
+    op->options = *options;
+    strlcpy(op->separator, separator, sizeof(op->separator));
+    return 1;
+}
+
+
+netsnmp_trapd_format *
+netsnmp_trapd_format_compile(const char *format_str)
+
+     /*
+      * Function:
+      *    Compile a format string into the list of operations that
+      * realloc_format_compiled_trap() runs for every trap, so that the
+      * string is parsed once rather than for every trap.  The format
+      * string "json" selects JSON-lines output.  Returns NULL if out of
+      * memory.
       *
       * Input Parameters:
-      *    buf, buf_len, out_len, allow_realloc - standard relocatable
-      *                                           buffer parameters
       *    format_str - specifies how to format the trap info
-      *    pdu        - the pdu information
-      *    transport  - the transport descriptor
       */
 {
-    unsigned long   fmt_idx = 0;        /* index into the format string */
+    netsnmp_trapd_format *fmt;
     options_type    options;    /* formatting options */
     parse_state_type state = PARSE_NORMAL;      /* state of the parser */
+    const char     *cp;         /* position in the format string */
     char            next_chr;   /* for speed */
     int             reset_options = TRUE;       /* reset opts on next NORMAL state */
+    char            separator[SEPARATOR_LEN];   /* current %V separator */
+    u_char          esc_bfr[4], *esc = esc_bfr; /* backslash sequences */
+    size_t          esc_len, esc_out;
+    int             ok = 1;
 
-    if (buf == NULL) {
-        return 0;
+    if (format_str == NULL) {
+        return NULL;
+    }
+    fmt = SNMP_MALLOC_TYPEDEF(netsnmp_trapd_format);
+    if (fmt == NULL) {
+        return NULL;
+    }
+    if ((fmt->source = strdup(format_str)) == NULL) {
+        free(fmt);
+        return NULL;
+    }
+
+    if (strcmp(format_str, JSON_FORMAT) == 0) {
+        if (!format_add_op(fmt, FMT_OP_JSON) ||
+            !format_add_text(fmt, "\n", 1)) {
+            netsnmp_trapd_format_free(fmt);
+            return NULL;
+        }
+        return fmt;
     }
 
     memset(separator, 0, sizeof(separator));
+    init_options(&options);
     /*
      * Go until we reach the end of the format string:  
      */
-    for (fmt_idx = 0; format_str[fmt_idx] != '\0'; fmt_idx++) {
-        next_chr = format_str[fmt_idx];
+    for (cp = format_str; ok && *cp != '\0'; cp++) {
+        next_chr = *cp;
         switch (state) {
         case PARSE_NORMAL:
             /*
@@ -1556,13 +2337,7 @@ realloc_format_trap(u_char ** buf, size_t * buf_len, size_t * out_len,
             } else if (next_chr == CHR_FMT_DELIM) {
                 state = PARSE_IN_FORMAT;
             } else {
-                if ((*out_len + 1) >= *buf_len) {
-                    if (!(allow_realloc && snmp_realloc(buf, buf_len))) {
-                        return 0;
-                    }
-                }
-                *(*buf + *out_len) = next_chr;
-                (*out_len)++;
+                ok = format_add_text(fmt, &next_chr, 1);
             }
             break;
 
@@ -1571,11 +2346,11 @@ realloc_format_trap(u_char ** buf, size_t * buf_len, size_t * out_len,
              * Parse the separator character
              * XXX - Possibly need to handle quoted strings ??
              */
-	    {   char *sep = separator;
+	    {   u_char *sep = (u_char *) separator;
 		size_t i, j;
-		i = sizeof(separator);
+		i = sizeof(separator) - 1;
 		j = 0;
-		memset(separator, 0, i);
+		memset(separator, 0, sizeof(separator));
 		while (j < i && next_chr && next_chr != CHR_FMT_DELIM) {
 		    if (next_chr == '\\') {
 			/*
@@ -1583,15 +2358,22 @@ realloc_format_trap(u_char ** buf, size_t * buf_len, size_t * out_len,
 			 * Print to "separator" string rather than the output buffer
 			 *    (a bit of a hack, but it should work!)
 			 */
-			next_chr = format_str[++fmt_idx];
-			if (!realloc_handle_backslash
-			    ((u_char **)&sep, &i, &j, 0, next_chr)) {
-			    return 0;
+			next_chr = *++cp;
+			if (!next_chr ||
+			    !realloc_handle_backslash(&sep, &i, &j, 0, next_chr)) {
+			    break;
 			}
 		    } else {
 			separator[j++] = next_chr;
 		    }
-		    next_chr = format_str[++fmt_idx];
+		    next_chr = *++cp;
+		}
+		separator[j] = '\0';
+		if (!next_chr) {
+		    /*
+		     * ran off the end of the format string
+		     */
+		    cp--;
 		}
 	    }
             state = PARSE_IN_FORMAT;
@@ -1601,9 +2383,11 @@ realloc_format_trap(u_char ** buf, size_t * buf_len, size_t * out_len,
             /*
              * Found a backslash.  
              */
-            if (!realloc_handle_backslash
-                (buf, buf_len, out_len, allow_realloc, next_chr)) {
-                return 0;
+            esc_len = sizeof(esc_bfr);
+            esc_out = 0;
+            if (realloc_handle_backslash(&esc, &esc_len, &esc_out, 0,
+                                         next_chr)) {
+                ok = format_add_text(fmt, (char *) esc_bfr, esc_out);
             }
             state = PARSE_NORMAL;
             break;
@@ -1629,20 +2413,10 @@ realloc_format_trap(u_char ** buf, size_t * buf_len, size_t * out_len,
                 state = PARSE_GET_WIDTH;
             } else if (is_fmt_cmd(next_chr)) {
                 options.cmd = next_chr;
-                if (!realloc_dispatch_format_cmd
-                    (buf, buf_len, out_len, allow_realloc, &options, pdu,
-                     transport)) {
-                    return 0;
-                }
+                ok = format_add_cmd(fmt, &options, separator);
                 state = PARSE_NORMAL;
             } else {
-                if ((*out_len + 1) >= *buf_len) {
-                    if (!(allow_realloc && snmp_realloc(buf, buf_len))) {
-                        return 0;
-                    }
-                }
-                *(*buf + *out_len) = next_chr;
-                (*out_len)++;
+                ok = format_add_text(fmt, &next_chr, 1);
                 state = PARSE_NORMAL;
             }
             break;
@@ -1660,20 +2434,10 @@ realloc_format_trap(u_char ** buf, size_t * buf_len, size_t * out_len,
                 state = PARSE_GET_PRECISION;
             } else if (is_fmt_cmd(next_chr)) {
                 options.cmd = next_chr;
-                if (!realloc_dispatch_format_cmd
-                    (buf, buf_len, out_len, allow_realloc, &options, pdu,
-                     transport)) {
-                    return 0;
-                }
+                ok = format_add_cmd(fmt, &options, separator);
                 state = PARSE_NORMAL;
             } else {
-                if ((*out_len + 1) >= *buf_len) {
-                    if (!(allow_realloc && snmp_realloc(buf, buf_len))) {
-                        return 0;
-                    }
-                }
-                *(*buf + *out_len) = next_chr;
-                (*out_len)++;
+                ok = format_add_text(fmt, &next_chr, 1);
                 state = PARSE_NORMAL;
             }
             break;
@@ -1698,20 +2462,10 @@ realloc_format_trap(u_char ** buf, size_t * buf_len, size_t * out_len,
                     (options.width < (size_t)options.precision)) {
                     options.width = (size_t)options.precision;
                 }
-                if (!realloc_dispatch_format_cmd
-                    (buf, buf_len, out_len, allow_realloc, &options, pdu,
-                     transport)) {
-                    return 0;
-                }
+                ok = format_add_cmd(fmt, &options, separator);
                 state = PARSE_NORMAL;
             } else {
-                if ((*out_len + 1) >= *buf_len) {
-                    if (!(allow_realloc && snmp_realloc(buf, buf_len))) {
-                        return 0;
-                    }
-                }
-                *(*buf + *out_len) = next_chr;
-                (*out_len)++;
+                ok = format_add_text(fmt, &next_chr, 1);
                 state = PARSE_NORMAL;
             }
             break;
@@ -1721,17 +2475,228 @@ realloc_format_trap(u_char ** buf, size_t * buf_len, size_t * out_len,
              * Unknown state.  
              */
             reset_options = TRUE;
-            if ((*out_len + 1) >= *buf_len) {
+            ok = format_add_text(fmt, &next_chr, 1);
+            state = PARSE_NORMAL;
+        }
+    }
+
+    if (!ok) {
+        netsnmp_trapd_format_free(fmt);
+        return NULL;
+    }
+    DEBUGMSGTL(("snmptrapd:format", "compiled '%s' into %d operations\n",
+                format_str, (int) fmt->nops));
+    return fmt;
+}
+
+
+void
+netsnmp_trapd_format_free(netsnmp_trapd_format *fmt)
+
+     /*
+      * Function:
+      *    Free a compiled format.
+      */
+{
+    if (fmt == NULL) {
+        return;
+    }
+    free(fmt->source);
+    free(fmt->ops);
+    free(fmt->text);
+    free(fmt);
+}
+
+
+const char *
+netsnmp_trapd_format_source(const netsnmp_trapd_format *fmt)
+
+     /*
+      * Function:
+      *    Return the format string a compiled format was built from.
+      */
+{
+    return fmt ? fmt->source : NULL;
+}
+
+
+int
+realloc_format_compiled_trap(u_char ** buf, size_t * buf_len,
+                             size_t * out_len, int allow_realloc,
+                             const netsnmp_trapd_format *fmt,
+                             netsnmp_pdu *pdu, netsnmp_transport *transport)
+
+     /*
+      * Function:
+      *    Format the trap information as realloc_format_trap() does,
+      *    using a format compiled by netsnmp_trapd_format_compile().
+      *    Returns 1 if the output was completed successfully or 0 if it
+      *    is truncated.
+      *
+      * Input Parameters:
+      *    buf, buf_len, out_len, allow_realloc - standard relocatable
+      *                                           buffer parameters
+      *    fmt        - the compiled format
+      *    pdu        - the pdu information
+      *    transport  - the transport descriptor
+      */
+{
+    format_ctx      ctx;
+    const format_op *op;
+    options_type    options;
+    size_t          i;
+
+    if (buf == NULL || fmt == NULL) {
+        return 0;
+    }
+    if (*buf == NULL || *out_len >= *buf_len) {
+        if (!(allow_realloc && snmp_realloc(buf, buf_len))) {
+            return 0;
+        }
+    }
+
+    memset(&ctx, 0, sizeof(ctx));
+    for (i = 0, op = fmt->ops; i < fmt->nops; i++, op++) {
+        switch (op->type) {
+        case FMT_OP_TEXT:
+            while ((*out_len + op->text_len + 1) >= *buf_len) {
                 if (!(allow_realloc && snmp_realloc(buf, buf_len))) {
+                    *(*buf + *out_len) = '\0';
                     return 0;
                 }
             }
-            *(*buf + *out_len) = next_chr;
-            (*out_len)++;
-            state = PARSE_NORMAL;
+            memcpy(*buf + *out_len, fmt->text + op->text_offset,
+                   op->text_len);
+            *out_len += op->text_len;
+            break;
+
+        case FMT_OP_CMD:
+            options = op->options;
+            if (!realloc_dispatch_format_cmd(buf, buf_len, out_len,
+                                             allow_realloc, &options,
+                                             op->separator, pdu, transport,
+                                             &ctx)) {
+                return 0;
+            }
+            break;
+
+        case FMT_OP_JSON:
+            if (!realloc_format_json_trap(buf, buf_len, out_len,
+                                          allow_realloc, pdu, transport,
+                                          &ctx)) {
+                return 0;
+            }
+            break;
         }
     }
 
     *(*buf + *out_len) = '\0';
     return 1;
 }
+
+
+int
+realloc_format_trap(u_char ** buf, size_t * buf_len, size_t * out_len,
+                    int allow_realloc, const char *format_str,
+                    netsnmp_pdu *pdu, netsnmp_transport *transport)
+
+     /*
+      * Function:
+      *    Format the trap information for display in a log. Place the results
+      *    in the specified buffer (truncating to the length of the buffer).
+      *    Returns 1 if the output was completed successfully or 0 if it
+      *    is truncated.  Formats that are used more than once should be
+      *    compiled with netsnmp_trapd_format_compile() instead.
+      *
+      * Input Parameters:
+      *    buf, buf_len, out_len, allow_realloc - standard relocatable
+      *                                           buffer parameters
+      *    format_str - specifies how to format the trap info
+      *    pdu        - the pdu information
+      *    transport  - the transport descriptor
+      */
+{
+    netsnmp_trapd_format *fmt;
+    int             rc;
+
+    if (buf == NULL) {
+        return 0;
+    }
+
+    fmt = netsnmp_trapd_format_compile(format_str);
+    if (fmt == NULL) {
+        return 0;
+    }
+    rc = realloc_format_compiled_trap(buf, buf_len, out_len, allow_realloc,
+                                      fmt, pdu, transport);
+    netsnmp_trapd_format_free(fmt);
+    return rc;
+}
+
+
+#ifdef NETSNMP_TRAPD_PIPELINE
+static pthread_key_t format_buffer_key;
+static pthread_once_t format_buffer_once = PTHREAD_ONCE_INIT;
+
+static void
+format_buffer_free(void *data)
+{
+    netsnmp_trapd_format_buf *fb = (netsnmp_trapd_format_buf *) data;
+
+    free(fb->buf);
+    free(fb);
+}
+
+static void
+format_buffer_key_init(void)
+{
+    pthread_key_create(&format_buffer_key, format_buffer_free);
+}
+#else
+static netsnmp_trapd_format_buf format_buffer;
+#endif
+
+netsnmp_trapd_format_buf *
+netsnmp_trapd_format_buffer(void)
+
+     /*
+      * Function:
+      *    Return an empty output buffer that belongs to the calling
+      * thread, so that formatting a trap does not need to allocate
+      * memory.  The buffer is only valid until the next call from the
+      * same thread.  Returns NULL if out of memory.
+      */
+{
+    netsnmp_trapd_format_buf *fb;
+
+#ifdef NETSNMP_TRAPD_PIPELINE
+    pthread_once(&format_buffer_once, format_buffer_key_init);
+    fb = (netsnmp_trapd_format_buf *) pthread_getspecific(format_buffer_key);
+    if (fb == NULL) {
+        fb = SNMP_MALLOC_TYPEDEF(netsnmp_trapd_format_buf);
+        if (fb == NULL) {
+            return NULL;
+        }
+        pthread_setspecific(format_buffer_key, fb);
+    }
+#else
+    fb = &format_buffer;
+#endif
+
+    /*
+     * don't hang on to the memory used by one huge trap
+     */
+    if (fb->buf_len > FORMAT_BUFFER_KEEP) {
+        SNMP_FREE(fb->buf);
+        fb->buf_len = 0;
+    }
+    if (fb->buf == NULL) {
+        fb->buf_len = 0;
+        if (!snmp_realloc(&fb->buf, &fb->buf_len)) {
+            return NULL;
+        }
+    }
+    fb->buf[0] = '\0';
+    fb->out_len = 0;
+    return fb;
+}
@@ -3,6 +3,20 @@
 
 #include "snmptrapd_ds.h"
 
+/*
+ * A format string compiled for repeated use
+ */
+typedef struct netsnmp_trapd_format_s netsnmp_trapd_format;
+
+/*
+ * A per-thread output buffer, see netsnmp_trapd_format_buffer()
+ */
+typedef struct netsnmp_trapd_format_buf_s {
+    u_char         *buf;
+    size_t          buf_len;
+    size_t          out_len;
+} netsnmp_trapd_format_buf;
+
 int             realloc_format_trap(u_char ** buf, size_t * buf_len,
                                     size_t * out_len, int allow_realloc,
                                     const char *format_str,
@@ -15,4 +29,19 @@ int             realloc_format_plain_trap(u_char ** buf, size_t * buf_len,
                                           netsnmp_pdu *pdu,
                                           struct netsnmp_transport_s
                                           *transport);
+
+netsnmp_trapd_format *netsnmp_trapd_format_compile(const char *format_str);
+void            netsnmp_trapd_format_free(netsnmp_trapd_format *fmt);
+const char     *netsnmp_trapd_format_source(const netsnmp_trapd_format
+                                            *fmt);
+int             realloc_format_compiled_trap(u_char ** buf,
+                                             size_t * buf_len,
+                                             size_t * out_len,
+                                             int allow_realloc,
+                                             const netsnmp_trapd_format
+                                             *fmt, netsnmp_pdu *pdu,
+                                             struct netsnmp_transport_s
+                                             *transport);
+netsnmp_trapd_format_buf *netsnmp_trapd_format_buffer(void);
+
 #endif                          /* _SNMPTRAPD_LOG_H */
@@ -0,0 +1,565 @@
+/*
+ * snmptrapd_persist.c - stream traps to long-running traphandle processes
+ *
+ * A "traphandle persist" entry starts its program (or a pool of copies of
+ * it) once and keeps it running.  After checking that the process is alive
+ * (snmptrapd writes "PING", the process replies "PONG"), each trap is sent
+ * as a line "TRAP <length>" followed by exactly <length> bytes of formatted
+ * trap, and the process answers every trap with a line "OK" once it has
+ * dealt with it.  Any other line the process writes is logged.
+ *
+ * At most PERSIST_WINDOW traps are outstanding per process; anything beyond
+ * that waits in a bounded backlog, and traps are dropped (and counted) only
+ * when the backlog is full.  A process that exits, breaks the protocol or
+ * does not answer the PING within PERSIST_START_TIMEOUT seconds is
+ * restarted, at most once per second, and the traps it had not
+ * acknowledged are sent again (once).  A process that is stopped is reaped
+ * from an alarm, and killed if it has not exited after PERSIST_REAP_TRIES
+ * checks.
+ */
+#include <net-snmp/net-snmp-config.h>
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#include <stdio.h>
+#ifdef HAVE_STRING_H
+#include <string.h>
+#else
+#include <strings.h>
+#endif
+#include <errno.h>
+#include <signal.h>
+#include <sys/types.h>
+#ifdef HAVE_SYS_WAIT_H
+#include <sys/wait.h>
+#endif
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#include <net-snmp/net-snmp-includes.h>
+#include <net-snmp/agent/net-snmp-agent-includes.h>
+#include "snmptrapd_persist.h"
+
+#ifdef NETSNMP_TRAPD_PERSIST
+
+#include "util_funcs.h"
+
+#define PERSIST_WINDOW     32   /* unacknowledged traps per process */
+#define PERSIST_BACKLOG  1024   /* traps waiting for a process */
+#define PERSIST_MAXLINE   256
+#define PERSIST_START_TIMEOUT 5 /* seconds to answer the PING */
+#define PERSIST_REAP_TRIES 10   /* checks, PERSIST_REAP_INTERVAL ms apart, */
+#define PERSIST_REAP_INTERVAL 10 /* before killing a stopped process */
+
+typedef struct persist_frame_s {
+    struct persist_frame_s *next;
+    u_char         *data;
+    size_t          len;
+    int             resent;
+} persist_frame;
+
+#define PERSIST_DOWN     0
+#define PERSIST_STARTING 1      /* waiting for PONG */
+#define PERSIST_READY    2
+
+typedef struct persist_proc_s {
+    netsnmp_trapd_persist *persist;
+    int             state;
+    netsnmp_pid_t   pid;
+    int             fdIn;       /* replies from the process */
+    int             fdOut;      /* traps to the process */
+    long            last_start;
+    unsigned int    start_alarm; /* PONG deadline */
+    char           *wbuf;       /* pending output */
+    size_t          wlen, woff, wsize;
+    int             writing;    /* fdOut registered for writing */
+    char            line[PERSIST_MAXLINE];
+    size_t          linelen;
+    persist_frame  *unacked, *unacked_tail;
+    int             nunacked;
+} persist_proc;
+
+struct netsnmp_trapd_persist_s {
+    char           *command;
+    int             nprocs;
+    persist_proc   *procs;
+    persist_frame  *backlog, *backlog_tail;
+    int             nbacklog;
+    u_long          dropped;
+    unsigned int    retry_alarm;
+};
+
+typedef struct persist_child_s {
+    netsnmp_pid_t   pid;
+    int             tries;
+} persist_child;
+
+static void     persist_dispatch(netsnmp_trapd_persist *p);
+
+static long
+persist_now(void)
+{
+    struct timeval  now;
+
+    netsnmp_get_monotonic_clock(&now);
+    return now.tv_sec;
+}
+
+static void
+persist_drop(netsnmp_trapd_persist *p, persist_frame *frame)
+{
+    if (p->dropped++ % 1000 == 0)
+        snmp_log(LOG_WARNING,
+                 "traphandle persist %s: dropped %lu trap(s)\n",
+                 p->command, p->dropped);
+    free(frame->data);
+    free(frame);
+}
+
+static void
+persist_free_frames(persist_frame *frame)
+{
+    persist_frame  *next;
+
+    for (; frame; frame = next) {
+        next = frame->next;
+        free(frame->data);
+        free(frame);
+    }
+}
+
+/*
+ * Wait for a stopped process to exit without blocking: closing its input
+ * normally makes it exit; if it has not after a while, kill it.
+ */
+static void
+persist_reap_check(unsigned int clientreg, void *clientarg)
+{
+    persist_child  *child = (persist_child *) clientarg;
+
+    if (waitpid(child->pid, NULL, WNOHANG) == 0) {
+        if (++child->tries == PERSIST_REAP_TRIES) {
+            DEBUGMSGTL(("snmptrapd:persist", "killing pid %d\n",
+                        (int) child->pid));
+            kill(child->pid, SIGKILL);
+        }
+        return;
+    }
+    snmp_alarm_unregister(clientreg);
+    free(child);
+}
+
+static void
+persist_reap(netsnmp_pid_t pid)
+{
+    struct timeval  interval;
+    persist_child  *child;
+
+    if (waitpid(pid, NULL, WNOHANG) != 0)
+        return;
+    child = SNMP_MALLOC_TYPEDEF(persist_child);
+    if (child)
+        child->pid = pid;
+    interval.tv_sec = 0;
+    interval.tv_usec = PERSIST_REAP_INTERVAL * 1000;
+    if (!child || snmp_alarm_register_hr(interval, SA_REPEAT,
+                                         persist_reap_check, child) == 0) {
+        free(child);
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+    }
+}
+
+static void
+persist_stop_proc(persist_proc *proc)
+{
+    if (proc->state == PERSIST_DOWN)
+        return;
+    if (proc->start_alarm)
+        snmp_alarm_unregister(proc->start_alarm);
+    proc->start_alarm = 0;
+    unregister_readfd(proc->fdIn);
+    if (proc->writing)
+        unregister_writefd(proc->fdOut);
+    close(proc->fdIn);
+    close(proc->fdOut);
+    proc->writing = 0;
+    proc->wlen = proc->woff = 0;
+    proc->linelen = 0;
+    proc->state = PERSIST_DOWN;
+    persist_reap(proc->pid);
+}
+
+/*
+ * The process is gone or misbehaving: stop it and put the traps it has not
+ * acknowledged back in front of the backlog.
+ */
+static void
+persist_died(persist_proc *proc, const char *why)
+{
+    netsnmp_trapd_persist *p = proc->persist;
+    persist_frame  *frame, *next, *head = NULL, *tail = NULL;
+
+    snmp_log(LOG_WARNING, "traphandle persist %s: %s\n", p->command, why);
+    persist_stop_proc(proc);
+
+    for (frame = proc->unacked; frame; frame = next) {
+        next = frame->next;
+        frame->next = NULL;
+        if (frame->resent++) {
+            persist_drop(p, frame);
+            continue;
+        }
+        if (tail)
+            tail->next = frame;
+        else
+            head = frame;
+        tail = frame;
+        p->nbacklog++;
+    }
+    proc->unacked = proc->unacked_tail = NULL;
+    proc->nunacked = 0;
+    if (head) {
+        tail->next = p->backlog;
+        if (!p->backlog)
+            p->backlog_tail = tail;
+        p->backlog = head;
+    }
+}
+
+static int
+persist_append(persist_proc *proc, const void *data, size_t len)
+{
+    char           *newbuf;
+    size_t          newsize;
+
+    if (proc->wlen + len > proc->wsize) {
+        newsize = proc->wsize ? proc->wsize : 1024;
+        while (newsize < proc->wlen + len)
+            newsize *= 2;
+        newbuf = realloc(proc->wbuf, newsize);
+        if (!newbuf)
+            return -1;
+        proc->wbuf = newbuf;
+        proc->wsize = newsize;
+    }
+    memcpy(proc->wbuf + proc->wlen, data, len);
+    proc->wlen += len;
+    return 0;
+}
+
+static void     persist_writable(int fd, void *data);
+
+/*
+ * Write as much pending output as the pipe takes; wait for it to become
+ * writable again if it fills up.
+ */
+static void
+persist_flush(persist_proc *proc)
+{
+    ssize_t         n;
+
+    while (proc->woff < proc->wlen) {
+        n = write(proc->fdOut, proc->wbuf + proc->woff,
+                  proc->wlen - proc->woff);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN) {
+                if (!proc->writing &&
+                    register_writefd(proc->fdOut, persist_writable,
+                                     proc) == FD_REGISTERED_OK)
+                    proc->writing = 1;
+                return;
+            }
+            persist_died(proc, "write to handler failed");
+            return;
+        }
+        proc->woff += n;
+    }
+    proc->wlen = proc->woff = 0;
+    if (proc->writing) {
+        unregister_writefd(proc->fdOut);
+        proc->writing = 0;
+    }
+}
+
+static void
+persist_writable(int fd, void *data)
+{
+    persist_proc   *proc = (persist_proc *) data;
+
+    persist_flush(proc);
+    persist_dispatch(proc->persist);
+}
+
+static void
+persist_line(persist_proc *proc)
+{
+    persist_frame  *frame;
+
+    if (proc->state == PERSIST_STARTING) {
+        if (strcmp(proc->line, "PONG") == 0) {
+            DEBUGMSGTL(("snmptrapd:persist", "%s ready (pid %d)\n",
+                        proc->persist->command, (int) proc->pid));
+            proc->state = PERSIST_READY;
+            if (proc->start_alarm)
+                snmp_alarm_unregister(proc->start_alarm);
+            proc->start_alarm = 0;
+        } else
+            snmp_log(LOG_WARNING, "traphandle persist %s: %s\n",
+                     proc->persist->command, proc->line);
+        return;
+    }
+    if (strcmp(proc->line, "OK") != 0 || !proc->unacked) {
+        snmp_log(LOG_WARNING, "traphandle persist %s: %s\n",
+                 proc->persist->command, proc->line);
+        return;
+    }
+    frame = proc->unacked;
+    proc->unacked = frame->next;
+    if (!proc->unacked)
+        proc->unacked_tail = NULL;
+    proc->nunacked--;
+    free(frame->data);
+    free(frame);
+}
+
+static void
+persist_readable(int fd, void *data)
+{
+    persist_proc   *proc = (persist_proc *) data;
+    char            buf[1024];
+    ssize_t         n, i;
+
+    n = read(fd, buf, sizeof(buf));
+    if (n < 0 && (errno == EINTR || errno == EAGAIN))
+        return;
+    if (n <= 0) {
+        persist_died(proc, "handler exited");
+        persist_dispatch(proc->persist);
+        return;
+    }
+    for (i = 0; i < n && proc->state != PERSIST_DOWN; i++) {
+        if (buf[i] == '\n') {
+            proc->line[proc->linelen] = '\0';
+            persist_line(proc);
+            proc->linelen = 0;
+        } else if (buf[i] != '\r' && proc->linelen < sizeof(proc->line) - 1)
+            proc->line[proc->linelen++] = buf[i];
+    }
+    persist_dispatch(proc->persist);
+}
+
+static void
+persist_start_timeout(unsigned int clientreg, void *clientarg)
+{
+    persist_proc   *proc = (persist_proc *) clientarg;
+
+    proc->start_alarm = 0;
+    if (proc->state != PERSIST_STARTING)
+        return;
+    persist_died(proc, "handler did not answer PING");
+    persist_dispatch(proc->persist);
+}
+
+static int
+persist_start(persist_proc *proc)
+{
+    netsnmp_trapd_persist *p = proc->persist;
+
+    proc->last_start = persist_now();
+    if (!get_exec_pipes(p->command, &proc->fdIn, &proc->fdOut, &proc->pid)) {
+        snmp_log(LOG_ERR, "traphandle persist: couldn't start %s\n",
+                 p->command);
+        return -1;
+    }
+    DEBUGMSGTL(("snmptrapd:persist", "started %s (pid %d)\n", p->command,
+                (int) proc->pid));
+    fcntl(proc->fdIn, F_SETFL, fcntl(proc->fdIn, F_GETFL) | O_NONBLOCK);
+    fcntl(proc->fdOut, F_SETFL, fcntl(proc->fdOut, F_GETFL) | O_NONBLOCK);
+    register_readfd(proc->fdIn, persist_readable, proc);
+    proc->state = PERSIST_STARTING;
+    proc->start_alarm = snmp_alarm_register(PERSIST_START_TIMEOUT, 0,
+                                            persist_start_timeout, proc);
+    persist_append(proc, "PING\n", 5);
+    persist_flush(proc);
+    return 0;
+}
+
+static void
+persist_retry(unsigned int clientreg, void *clientarg)
+{
+    netsnmp_trapd_persist *p = (netsnmp_trapd_persist *) clientarg;
+
+    p->retry_alarm = 0;
+    persist_dispatch(p);
+}
+
+/*
+ * Hand waiting traps to the ready process with the fewest outstanding,
+ * (re)starting processes as needed.
+ */
+static void
+persist_dispatch(netsnmp_trapd_persist *p)
+{
+    persist_proc   *proc, *best;
+    persist_frame  *frame;
+    char            header[32];
+    long            now;
+    int             i, alive;
+
+    while (p->backlog) {
+        now = persist_now();
+        best = NULL;
+        alive = 0;
+        for (i = 0; i < p->nprocs; i++) {
+            proc = &p->procs[i];
+            if (proc->state == PERSIST_DOWN && now != proc->last_start)
+                persist_start(proc);
+            if (proc->state != PERSIST_DOWN)
+                alive++;
+            if (proc->state == PERSIST_READY &&
+                proc->nunacked < PERSIST_WINDOW &&
+                (!best || proc->nunacked < best->nunacked))
+                best = proc;
+        }
+        if (!best) {
+            if (!alive && !p->retry_alarm)
+                p->retry_alarm = snmp_alarm_register(1, 0, persist_retry, p);
+            return;
+        }
+
+        frame = p->backlog;
+        p->backlog = frame->next;
+        if (!p->backlog)
+            p->backlog_tail = NULL;
+        p->nbacklog--;
+        frame->next = NULL;
+
+        snprintf(header, sizeof(header), "TRAP %lu\n", (u_long) frame->len);
+        if (persist_append(best, header, strlen(header)) < 0 ||
+            persist_append(best, frame->data, frame->len) < 0) {
+            persist_drop(p, frame);
+            continue;
+        }
+        if (best->unacked_tail)
+            best->unacked_tail->next = frame;
+        else
+            best->unacked = frame;
+        best->unacked_tail = frame;
+        best->nunacked++;
+        persist_flush(best);
+    }
+}
+
+netsnmp_trapd_persist *
+netsnmp_trapd_persist_new(const char *command, int nprocs)
+{
+    netsnmp_trapd_persist *p;
+    int             i;
+
+    if (nprocs < 1)
+        nprocs = 1;
+    p = SNMP_MALLOC_TYPEDEF(netsnmp_trapd_persist);
+    if (!p)
+        return NULL;
+    p->command = strdup(command);
+    p->procs = calloc(nprocs, sizeof(persist_proc));
+    if (!p->command || !p->procs) {
+        free(p->command);
+        free(p->procs);
+        free(p);
+        return NULL;
+    }
+    p->nprocs = nprocs;
+    for (i = 0; i < nprocs; i++) {
+        p->procs[i].persist = p;
+        p->procs[i].last_start = -1;
+    }
+    return p;
+}
+
+void
+netsnmp_trapd_persist_free(void *data)
+{
+    netsnmp_trapd_persist *p = (netsnmp_trapd_persist *) data;
+    int             i;
+
+    if (!p)
+        return;
+    for (i = 0; i < p->nprocs; i++) {
+        persist_stop_proc(&p->procs[i]);
+        p->dropped += p->procs[i].nunacked;
+        persist_free_frames(p->procs[i].unacked);
+        free(p->procs[i].wbuf);
+    }
+    p->dropped += p->nbacklog;
+    persist_free_frames(p->backlog);
+    if (p->retry_alarm)
+        snmp_alarm_unregister(p->retry_alarm);
+    if (p->dropped)
+        snmp_log(LOG_WARNING, "traphandle persist %s: %lu trap(s) dropped\n",
+                 p->command, p->dropped);
+    free(p->procs);
+    free(p->command);
+    free(p);
+}
+
+/*
+ * Queue a formatted trap for the handler processes.  Takes over text.
+ */
+int
+netsnmp_trapd_persist_send(netsnmp_trapd_persist *p, u_char *text,
+                           size_t len)
+{
+    persist_frame  *frame;
+
+    frame = SNMP_MALLOC_TYPEDEF(persist_frame);
+    if (!frame) {
+        free(text);
+        return -1;
+    }
+    frame->data = text;
+    frame->len = len;
+    if (p->nbacklog >= PERSIST_BACKLOG) {
+        persist_drop(p, frame);
+        return -1;
+    }
+    if (p->backlog_tail)
+        p->backlog_tail->next = frame;
+    else
+        p->backlog = frame;
+    p->backlog_tail = frame;
+    p->nbacklog++;
+    persist_dispatch(p);
+    return 0;
+}
+
+#else                           /* !NETSNMP_TRAPD_PERSIST */
+
+netsnmp_trapd_persist *
+netsnmp_trapd_persist_new(const char *command, int nprocs)
+{
+    return NULL;
+}
+
+void
+netsnmp_trapd_persist_free(void *data)
+{
+}
+
+int
+netsnmp_trapd_persist_send(netsnmp_trapd_persist *p, u_char *text,
+                           size_t len)
+{
+    free(text);
+    return -1;
+}
+
+#endif                          /* !NETSNMP_TRAPD_PERSIST */
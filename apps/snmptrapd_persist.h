@@ -0,0 +1,21 @@
+#ifndef SNMPTRAPD_PERSIST_H
+#define SNMPTRAPD_PERSIST_H
+
+/*
+ * "traphandle persist" support: formatted traps are streamed to one or
+ * more long-running handler processes instead of starting the handler
+ * once per trap.  All of this runs in the main thread.
+ */
+#if defined(USING_UTIL_FUNCS_MODULE) && !defined(WIN32)
+#define NETSNMP_TRAPD_PERSIST 1
+#endif
+
+typedef struct netsnmp_trapd_persist_s netsnmp_trapd_persist;
+
+netsnmp_trapd_persist *netsnmp_trapd_persist_new(const char *command,
+                                                 int nprocs);
+void            netsnmp_trapd_persist_free(void *persist);
+int             netsnmp_trapd_persist_send(netsnmp_trapd_persist *persist,
+                                           u_char *text, size_t len);
+
+#endif                          /* SNMPTRAPD_PERSIST_H */
@@ -0,0 +1,779 @@
+/*
+ * snmptrapd_pipeline.c - process notifications in several threads
+ *
+ * The main thread receives and decodes notifications, as before, and then
+ * queues them for one of pipelineWorkers worker threads.  The worker is
+ * chosen from the source address so that notifications from one source are
+ * always handled in order.  Workers run the handler lists; the built-in
+ * output handlers only format their output there and queue it for one
+ * thread per output type (logging, traphandle commands and forwarding).
+ * Handlers that are not known to be thread-safe are run in the main thread.
+ *
+ * All queues are bounded; a notification that does not fit is dropped and
+ * counted.  The exception is the hand-over to the main thread: a worker
+ * waits for room there instead, so that the backlog builds up in its own
+ * queue and new notifications are dropped on arrival, where an INFORM is
+ * left unacknowledged and will be sent again.
+ */
+#include <net-snmp/net-snmp-config.h>
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#else
+#include <strings.h>
+#endif
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+#include <sys/types.h>
+
+#include <net-snmp/net-snmp-includes.h>
+#include <net-snmp/library/fd_event_manager.h>
+#include "snmptrapd_handlers.h"
+#include "snmptrapd_pipeline.h"
+
+#ifdef NETSNMP_TRAPD_PIPELINE
+#include <pthread.h>
+#endif
+
+#define PIPELINE_DEFAULT_QUEUE_SIZE 8192
+
+static int      pipeline_workers;
+static int      pipeline_queue_size = PIPELINE_DEFAULT_QUEUE_SIZE;
+static int      pipeline_stats_interval;
+
+static void
+parse_pipeline_config(const char *token, char *cptr)
+{
+    int             val = atoi(cptr);
+
+    if (val < 0) {
+        config_perror("value must not be negative");
+        return;
+    }
+    if (strcmp(token, "pipelineWorkers") == 0) {
+#ifndef NETSNMP_TRAPD_PIPELINE
+        if (val > 0)
+            config_pwarn("snmptrapd was built without thread support; "
+                         "pipelineWorkers is ignored");
+#endif
+        pipeline_workers = val;
+    } else if (strcmp(token, "pipelineQueueSize") == 0)
+        pipeline_queue_size = val;
+    else
+        pipeline_stats_interval = val;
+}
+
+static void
+free_pipeline_config(void)
+{
+    pipeline_workers = 0;
+    pipeline_queue_size = PIPELINE_DEFAULT_QUEUE_SIZE;
+    pipeline_stats_interval = 0;
+}
+
+void
+snmptrapd_pipeline_register_configs(void)
+{
+    register_config_handler("snmptrapd", "pipelineWorkers",
+                            parse_pipeline_config, free_pipeline_config,
+                            "number-of-worker-threads");
+    register_config_handler("snmptrapd", "pipelineQueueSize",
+                            parse_pipeline_config, NULL, "entries");
+    register_config_handler("snmptrapd", "pipelineStatsInterval",
+                            parse_pipeline_config, NULL, "seconds");
+}
+
+/*
+ * Allocate a job.  It takes over pdu, which is freed with the job (or right
+ * away if the allocation fails).
+ */
+netsnmp_trapd_job *
+netsnmp_trapd_job_new(Netsnmp_Trapd_Job *run, netsnmp_pdu *pdu,
+                      netsnmp_transport *transport)
+{
+    netsnmp_trapd_job *job = SNMP_MALLOC_TYPEDEF(netsnmp_trapd_job);
+
+    if (job == NULL) {
+        if (pdu)
+            snmp_free_pdu(pdu);
+        return NULL;
+    }
+    job->run = run;
+    job->pdu = pdu;
+    job->transport = transport;
+    return job;
+}
+
+void
+netsnmp_trapd_job_free(netsnmp_trapd_job *job)
+{
+    if (job == NULL)
+        return;
+    if (job->pdu)
+        snmp_free_pdu(job->pdu);
+    free(job->trapOid);
+    free(job->token);
+    free(job->format);
+    free(job->text);
+    free(job);
+}
+
+#ifdef NETSNMP_TRAPD_PIPELINE
+
+/*
+ * Bounded multi-producer queue of jobs (after Dmitry Vyukov's MPMC queue).
+ * Each cell carries a sequence number telling whether it may be written
+ * (seq == position) or read (seq == position + 1) next, so producers and
+ * the consumer only touch the head resp. tail index and the cell itself.
+ */
+struct trapd_cell {
+    size_t             seq;
+    netsnmp_trapd_job *job;
+};
+
+typedef struct trapd_queue_s {
+    struct trapd_cell *cells;
+    size_t          mask;
+    size_t          head;
+    size_t          tail;
+    u_long          queued;
+    u_long          dropped;
+    u_long          max_depth;
+    /*
+     * for sleeping while the queue is empty
+     */
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    int             sleepers;
+} trapd_queue;
+
+typedef struct trapd_thread_s {
+    trapd_queue     queue;
+    pthread_t       thread;
+    int             started;
+    int             worker;
+    int             auth;       /* result of netsnmp_trapd_auth() */
+} trapd_thread;
+
+static const char *stage_names[NETSNMPTRAPD_STAGES] =
+    { "log", "exec", "forward", "main" };
+
+static trapd_thread *workers;
+static int      nworkers;
+static trapd_thread stages[NETSNMPTRAPD_STAGES];
+static int      running, stopping;
+static long     pending;        /* jobs queued or being processed */
+static int      main_pipe[2] = { -1, -1 };
+static int      main_signaled;
+static unsigned int stats_alarm;
+
+static pthread_key_t thread_key;
+static int      thread_key_created;
+static pthread_mutex_t handoff_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t handoff_cond = PTHREAD_COND_INITIALIZER;
+static pthread_mutex_t format_gate = PTHREAD_MUTEX_INITIALIZER;
+static pthread_rwlock_t format_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+static int
+queue_init(trapd_queue *q, size_t size)
+{
+    size_t          i;
+
+    memset(q, 0, sizeof(*q));
+    q->cells = calloc(size, sizeof(*q->cells));
+    if (q->cells == NULL)
+        return -1;
+    for (i = 0; i < size; i++)
+        q->cells[i].seq = i;
+    q->mask = size - 1;
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->cond, NULL);
+    return 0;
+}
+
+static void
+queue_cleanup(trapd_queue *q)
+{
+    if (q->cells == NULL)
+        return;
+    free(q->cells);
+    q->cells = NULL;
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->cond);
+}
+
+static int
+queue_push(trapd_queue *q, netsnmp_trapd_job *job)
+{
+    struct trapd_cell *cell;
+    size_t          pos, depth;
+    long            diff;
+
+    pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+    for (;;) {
+        cell = &q->cells[pos & q->mask];
+        diff = (long) (__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) - pos);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&q->head, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED))
+                break;
+        } else if (diff < 0)
+            return -1;
+        else
+            pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+    }
+    cell->job = job;
+    __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+
+    __atomic_add_fetch(&q->queued, 1, __ATOMIC_RELAXED);
+    depth = pos + 1 - __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+    if (depth > __atomic_load_n(&q->max_depth, __ATOMIC_RELAXED))
+        __atomic_store_n(&q->max_depth, depth, __ATOMIC_RELAXED);
+
+    /*
+     * pairs with the consumer announcing itself in queue_wait() before
+     * looking at the queue a last time
+     */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&q->sleepers, __ATOMIC_RELAXED)) {
+        pthread_mutex_lock(&q->lock);
+        pthread_cond_signal(&q->cond);
+        pthread_mutex_unlock(&q->lock);
+    }
+    return 0;
+}
+
+static netsnmp_trapd_job *
+queue_pop(trapd_queue *q)
+{
+    struct trapd_cell *cell;
+    netsnmp_trapd_job *job;
+    size_t          pos;
+    long            diff;
+
+    pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+    for (;;) {
+        cell = &q->cells[pos & q->mask];
+        diff = (long) (__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) -
+                       (pos + 1));
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&q->tail, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED))
+                break;
+        } else if (diff < 0)
+            return NULL;
+        else
+            pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+    }
+    job = cell->job;
+    __atomic_store_n(&cell->seq, pos + q->mask + 1, __ATOMIC_RELEASE);
+    return job;
+}
+
+/*
+ * Wait for the next job; returns NULL once the pipeline is stopping and
+ * the queue is empty.
+ */
+static netsnmp_trapd_job *
+queue_wait(trapd_queue *q)
+{
+    netsnmp_trapd_job *job;
+
+    if ((job = queue_pop(q)) != NULL)
+        return job;
+    pthread_mutex_lock(&q->lock);
+    __atomic_add_fetch(&q->sleepers, 1, __ATOMIC_SEQ_CST);
+    while ((job = queue_pop(q)) == NULL &&
+           !__atomic_load_n(&stopping, __ATOMIC_SEQ_CST))
+        pthread_cond_wait(&q->cond, &q->lock);
+    __atomic_sub_fetch(&q->sleepers, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&q->lock);
+    return job;
+}
+
+static int
+enqueue(trapd_queue *q, netsnmp_trapd_job *job)
+{
+    __atomic_add_fetch(&pending, 1, __ATOMIC_SEQ_CST);
+    if (queue_push(q, job) != 0) {
+        __atomic_sub_fetch(&pending, 1, __ATOMIC_SEQ_CST);
+        __atomic_add_fetch(&q->dropped, 1, __ATOMIC_RELAXED);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Let the main thread know there is work on its queue.
+ */
+static void
+signal_main(void)
+{
+    if (__atomic_exchange_n(&main_signaled, 1, __ATOMIC_SEQ_CST) == 0) {
+        if (write(main_pipe[1], "", 1) < 0)
+            DEBUGMSGTL(("snmptrapd:pipeline", "wakeup failed\n"));
+    }
+}
+
+/*
+ * Run the handler lists for a notification.
+ */
+static void
+run_trap_job(netsnmp_trapd_job *job)
+{
+    netsnmp_trapd_pipeline_format_lock(0);
+    netsnmp_trapd_run_handlers(job->pdu, job->transport, job->trapOid,
+                               job->trapOidLen);
+    netsnmp_trapd_pipeline_format_unlock(0);
+}
+
+static void
+run_main_jobs(void)
+{
+    netsnmp_trapd_job *job;
+
+    while ((job = queue_pop(&stages[NETSNMPTRAPD_STAGE_MAIN].queue))) {
+        if (job->run == run_trap_job) {
+            /*
+             * handed over by a worker, which waits for it and frees it
+             */
+            run_trap_job(job);
+            pthread_mutex_lock(&handoff_lock);
+            job->done = 1;
+            pthread_cond_broadcast(&handoff_cond);
+            pthread_mutex_unlock(&handoff_lock);
+            continue;
+        }
+        job->run(job);
+        netsnmp_trapd_job_free(job);
+        __atomic_sub_fetch(&pending, 1, __ATOMIC_SEQ_CST);
+    }
+}
+
+static void
+main_stage_read(int fd, void *data)
+{
+    char            buf[64];
+
+    while (read(fd, buf, sizeof(buf)) > 0)
+        ;
+    __atomic_store_n(&main_signaled, 0, __ATOMIC_SEQ_CST);
+    run_main_jobs();
+}
+
+static void
+worker_process(netsnmp_trapd_job *job)
+{
+    if (netsnmp_trapd_handlers_threadsafe(job->trapOid, job->trapOidLen)) {
+        run_trap_job(job);
+        return;
+    }
+
+    /*
+     * Some handler for this notification must run in the main thread.
+     * Wait for it, so that later notifications from this source cannot
+     * overtake it.  If the main queue is full, wait for the main thread
+     * to make room rather than lose the notification.
+     */
+    job->done = 0;
+    while (queue_push(&stages[NETSNMPTRAPD_STAGE_MAIN].queue, job) != 0) {
+        signal_main();
+        usleep(1000);
+    }
+    signal_main();
+    pthread_mutex_lock(&handoff_lock);
+    while (!job->done)
+        pthread_cond_wait(&handoff_cond, &handoff_lock);
+    pthread_mutex_unlock(&handoff_lock);
+}
+
+static void    *
+stage_thread(void *arg)
+{
+    trapd_thread   *t = (trapd_thread *) arg;
+    netsnmp_trapd_job *job;
+
+    pthread_setspecific(thread_key, t);
+    while ((job = queue_wait(&t->queue)) != NULL) {
+        if (t->worker)
+            worker_process(job);
+        else
+            job->run(job);
+        netsnmp_trapd_job_free(job);
+        __atomic_sub_fetch(&pending, 1, __ATOMIC_SEQ_CST);
+    }
+    return NULL;
+}
+
+/*
+ * Hash the source address, without the port.
+ */
+static unsigned int
+source_hash(netsnmp_pdu *pdu)
+{
+    const u_char   *cp;
+    size_t          len;
+    int             family;
+    unsigned int    hash = 2166136261U;
+
+    cp = netsnmp_trapd_source_address(pdu, &len, &family);
+    while (cp && len--)
+        hash = (hash ^ *cp++) * 16777619U;
+    return hash;
+}
+
+static void
+pipeline_stats_alarm(unsigned int clientreg, void *clientarg)
+{
+    netsnmp_trapd_pipeline_log_stats();
+}
+
+int
+netsnmp_trapd_pipeline_running(void)
+{
+    return running;
+}
+
+int
+netsnmp_trapd_pipeline_start(void)
+{
+    size_t          size;
+    int             i, stage;
+
+    if (running || pipeline_workers <= 0)
+        return 0;
+
+    for (size = 16; size < (size_t) pipeline_queue_size; size <<= 1)
+        ;
+    if (!thread_key_created) {
+        if (pthread_key_create(&thread_key, NULL) != 0) {
+            snmp_log(LOG_ERR, "pipeline: cannot create thread key\n");
+            return -1;
+        }
+        thread_key_created = 1;
+    }
+    if (pipe(main_pipe) != 0) {
+        snmp_log_perror("pipeline: pipe");
+        return -1;
+    }
+    fcntl(main_pipe[0], F_SETFL, fcntl(main_pipe[0], F_GETFL) | O_NONBLOCK);
+    fcntl(main_pipe[1], F_SETFL, fcntl(main_pipe[1], F_GETFL) | O_NONBLOCK);
+    register_readfd(main_pipe[0], main_stage_read, NULL);
+
+    nworkers = pipeline_workers;
+    workers = calloc(nworkers, sizeof(*workers));
+    if (workers == NULL)
+        goto fail;
+    for (i = 0; i < nworkers; i++) {
+        if (queue_init(&workers[i].queue, size) != 0)
+            goto fail;
+        workers[i].worker = 1;
+    }
+    for (stage = 0; stage < NETSNMPTRAPD_STAGES; stage++)
+        if (queue_init(&stages[stage].queue, size) != 0)
+            goto fail;
+
+    running = 1;
+    stopping = 0;
+    for (i = 0; i < nworkers; i++) {
+        if (pthread_create(&workers[i].thread, NULL, stage_thread,
+                           &workers[i]) != 0)
+            goto fail;
+        workers[i].started = 1;
+    }
+    for (stage = 0; stage < NETSNMPTRAPD_STAGES; stage++) {
+        if (stage == NETSNMPTRAPD_STAGE_MAIN)
+            continue;
+        if (pthread_create(&stages[stage].thread, NULL, stage_thread,
+                           &stages[stage]) != 0)
+            goto fail;
+        stages[stage].started = 1;
+    }
+
+    if (pipeline_stats_interval > 0)
+        stats_alarm = snmp_alarm_register(pipeline_stats_interval, SA_REPEAT,
+                                          pipeline_stats_alarm, NULL);
+    snmp_log(LOG_INFO, "Processing notifications with %d worker threads\n",
+             nworkers);
+    return 0;
+
+  fail:
+    snmp_log(LOG_ERR, "pipeline: cannot start worker threads\n");
+    running = 1;
+    netsnmp_trapd_pipeline_stop();
+    return -1;
+}
+
+/*
+ * Wait for all queued notifications to be processed, then stop the threads.
+ */
+void
+netsnmp_trapd_pipeline_stop(void)
+{
+    trapd_thread   *t;
+    int             i;
+
+    if (!running)
+        return;
+
+    while (__atomic_load_n(&pending, __ATOMIC_SEQ_CST) > 0) {
+        run_main_jobs();
+        usleep(1000);
+    }
+
+    __atomic_store_n(&stopping, 1, __ATOMIC_SEQ_CST);
+    for (i = 0; i < nworkers + NETSNMPTRAPD_STAGES; i++) {
+        t = i < nworkers ? &workers[i] : &stages[i - nworkers];
+        if (!t->started)
+            continue;
+        pthread_mutex_lock(&t->queue.lock);
+        pthread_cond_broadcast(&t->queue.cond);
+        pthread_mutex_unlock(&t->queue.lock);
+        pthread_join(t->thread, NULL);
+        t->started = 0;
+    }
+
+    if (stats_alarm) {
+        snmp_alarm_unregister(stats_alarm);
+        stats_alarm = 0;
+    }
+    netsnmp_trapd_pipeline_log_stats();
+
+    for (i = 0; workers && i < nworkers; i++)
+        queue_cleanup(&workers[i].queue);
+    for (i = 0; i < NETSNMPTRAPD_STAGES; i++)
+        queue_cleanup(&stages[i].queue);
+    SNMP_FREE(workers);
+    nworkers = 0;
+    if (main_pipe[0] >= 0) {
+        unregister_readfd(main_pipe[0]);
+        close(main_pipe[0]);
+        close(main_pipe[1]);
+        main_pipe[0] = main_pipe[1] = -1;
+    }
+    main_signaled = 0;
+    running = 0;
+}
+
+/*
+ * Queue a notification for a worker.  Returns 0 if it was queued and -1 if
+ * it was dropped.
+ */
+int
+netsnmp_trapd_pipeline_submit(netsnmp_pdu *pdu, netsnmp_transport *transport,
+                              oid *trapOid, int trapOidLen)
+{
+    netsnmp_trapd_job *job;
+    trapd_queue    *q;
+
+    if (!running)
+        return -1;
+    q = &workers[source_hash(pdu) % nworkers].queue;
+    job = netsnmp_trapd_job_new(run_trap_job, snmp_clone_pdu(pdu), transport);
+    if (job == NULL || job->pdu == NULL)
+        goto drop;
+    job->trapOid = netsnmp_memdup(trapOid, trapOidLen * sizeof(oid));
+    job->trapOidLen = trapOidLen;
+    if (job->trapOid == NULL)
+        goto drop;
+    if (enqueue(q, job) == 0)
+        return 0;
+    DEBUGMSGTL(("snmptrapd:pipeline", "worker queue full, dropped\n"));
+    netsnmp_trapd_job_free(job);
+    return -1;
+
+  drop:
+    __atomic_add_fetch(&q->dropped, 1, __ATOMIC_RELAXED);
+    netsnmp_trapd_job_free(job);
+    return -1;
+}
+
+/*
+ * Queue a job for an output stage; the job is freed once it has run, or
+ * right away if the queue is full.
+ */
+int
+netsnmp_trapd_pipeline_output(int stage, netsnmp_trapd_job *job)
+{
+    if (job == NULL)
+        return -1;
+    if (!running || stage < 0 || stage >= NETSNMPTRAPD_STAGES) {
+        netsnmp_trapd_job_free(job);
+        return -1;
+    }
+    if (enqueue(&stages[stage].queue, job) != 0) {
+        DEBUGMSGTL(("snmptrapd:pipeline", "%s queue full, dropped\n",
+                    stage_names[stage]));
+        netsnmp_trapd_job_free(job);
+        return -1;
+    }
+    if (stage == NETSNMPTRAPD_STAGE_MAIN)
+        signal_main();
+    return 0;
+}
+
+static void
+queue_stats(netsnmp_trapd_stage_stats *stats, trapd_queue *q)
+{
+    size_t          head, tail;
+    u_long          max_depth;
+
+    head = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+    tail = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+    max_depth = __atomic_load_n(&q->max_depth, __ATOMIC_RELAXED);
+    stats->queued += __atomic_load_n(&q->queued, __ATOMIC_RELAXED);
+    stats->dropped += __atomic_load_n(&q->dropped, __ATOMIC_RELAXED);
+    stats->depth += head - tail;
+    if (max_depth > stats->max_depth)
+        stats->max_depth = max_depth;
+}
+
+/*
+ * Fill in the counters of the worker queues (added up) and of each output
+ * queue.  Returns the number of entries filled in.
+ */
+int
+netsnmp_trapd_pipeline_stats(netsnmp_trapd_stage_stats *stats, int max)
+{
+    int             i, n = 0;
+
+    if (!running || max < 1)
+        return 0;
+    memset(stats, 0, max * sizeof(*stats));
+    stats[n].name = "workers";
+    for (i = 0; i < nworkers; i++)
+        queue_stats(&stats[n], &workers[i].queue);
+    for (n++, i = 0; i < NETSNMPTRAPD_STAGES && n < max; i++, n++) {
+        stats[n].name = stage_names[i];
+        queue_stats(&stats[n], &stages[i].queue);
+    }
+    return n;
+}
+
+void
+netsnmp_trapd_pipeline_log_stats(void)
+{
+    netsnmp_trapd_stage_stats stats[NETSNMPTRAPD_STAGES + 1];
+    int             i, n;
+
+    n = netsnmp_trapd_pipeline_stats(stats, NETSNMPTRAPD_STAGES + 1);
+    for (i = 0; i < n; i++)
+        snmp_log(LOG_INFO, "pipeline %s: %lu queued, %lu dropped, "
+                 "depth %lu (max %lu)\n", stats[i].name, stats[i].queued,
+                 stats[i].dropped, stats[i].depth, stats[i].max_depth);
+}
+
+/*
+ * Where netsnmp_trapd_auth() leaves its result for the notification being
+ * handled by the calling thread; NULL in the main thread.
+ */
+int            *
+netsnmp_trapd_pipeline_auth_slot(void)
+{
+    trapd_thread   *t;
+
+    if (!running)
+        return NULL;
+    t = (trapd_thread *) pthread_getspecific(thread_key);
+    return t ? &t->auth : NULL;
+}
+
+/*
+ * Formatting output is shared between threads, except while the exec
+ * stage changes the output options for a command; waiting writers keep
+ * new readers out (through format_gate) so they do not starve.
+ */
+void
+netsnmp_trapd_pipeline_format_lock(int exclusive)
+{
+    if (!running)
+        return;
+    pthread_mutex_lock(&format_gate);
+    if (exclusive) {
+        pthread_rwlock_wrlock(&format_lock);
+        return;
+    }
+    pthread_mutex_unlock(&format_gate);
+    pthread_rwlock_rdlock(&format_lock);
+}
+
+void
+netsnmp_trapd_pipeline_format_unlock(int exclusive)
+{
+    if (!running)
+        return;
+    pthread_rwlock_unlock(&format_lock);
+    if (exclusive)
+        pthread_mutex_unlock(&format_gate);
+}
+
+#else                           /* NETSNMP_TRAPD_PIPELINE */
+
+int
+netsnmp_trapd_pipeline_running(void)
+{
+    return 0;
+}
+
+int
+netsnmp_trapd_pipeline_start(void)
+{
+    return 0;
+}
+
+void
+netsnmp_trapd_pipeline_stop(void)
+{
+}
+
+int
+netsnmp_trapd_pipeline_submit(netsnmp_pdu *pdu, netsnmp_transport *transport,
+                              oid *trapOid, int trapOidLen)
+{
+    return -1;
+}
+
+int
+netsnmp_trapd_pipeline_output(int stage, netsnmp_trapd_job *job)
+{
+    netsnmp_trapd_job_free(job);
+    return -1;
+}
+
+int
+netsnmp_trapd_pipeline_stats(netsnmp_trapd_stage_stats *stats, int max)
+{
+    return 0;
+}
+
+void
+netsnmp_trapd_pipeline_log_stats(void)
+{
+}
+
+int            *
+netsnmp_trapd_pipeline_auth_slot(void)
+{
+    return NULL;
+}
+
+void
+netsnmp_trapd_pipeline_format_lock(int exclusive)
+{
+}
+
+void
+netsnmp_trapd_pipeline_format_unlock(int exclusive)
+{
+}
+
+#endif                          /* NETSNMP_TRAPD_PIPELINE */
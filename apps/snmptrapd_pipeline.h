@@ -0,0 +1,70 @@
+#ifndef SNMPTRAPD_PIPELINE_H
+#define SNMPTRAPD_PIPELINE_H
+
+/*
+ * Multi-threaded trap processing.  The main thread receives and decodes
+ * notifications and hands them to a pool of workers (always the same worker
+ * for a given source, so that traps from one source stay in order).  The
+ * workers run the handler lists and pass what the output handlers produce
+ * on to one thread per output type.  Needs a thread-safe library.
+ */
+#if defined(NETSNMP_REENTRANT) && defined(HAVE_PTHREAD_H) && \
+    defined(__ATOMIC_ACQUIRE)
+#define NETSNMP_TRAPD_PIPELINE 1
+#endif
+
+#define NETSNMPTRAPD_STAGE_LOG     0    /* print and syslog output */
+#define NETSNMPTRAPD_STAGE_EXEC    1    /* traphandle commands */
+#define NETSNMPTRAPD_STAGE_FORWARD 2    /* forwarding to other hosts */
+#define NETSNMPTRAPD_STAGE_MAIN    3    /* run in the main thread */
+#define NETSNMPTRAPD_STAGES        4
+
+typedef struct netsnmp_trapd_job_s netsnmp_trapd_job;
+typedef void (Netsnmp_Trapd_Job)(netsnmp_trapd_job *job);
+
+struct netsnmp_trapd_job_s {
+    Netsnmp_Trapd_Job *run;
+    netsnmp_pdu       *pdu;         /* private copy, freed with the job */
+    netsnmp_transport *transport;
+    oid               *trapOid;
+    int                trapOidLen;
+    char              *token;       /* copy of the handler token */
+    char              *format;      /* copy of the handler format */
+    u_char            *text;        /* output formatted by a worker */
+    void              *handler_data;  /* the handler's, not freed */
+    struct netsnmp_trapd_format_s *compiled_format; /* not freed either */
+    int                priority;
+    int                truncated;
+    volatile int       done;
+};
+
+typedef struct netsnmp_trapd_stage_stats_s {
+    const char     *name;
+    u_long          queued;
+    u_long          dropped;
+    u_long          depth;
+    u_long          max_depth;
+} netsnmp_trapd_stage_stats;
+
+void            snmptrapd_pipeline_register_configs(void);
+int             netsnmp_trapd_pipeline_start(void);
+void            netsnmp_trapd_pipeline_stop(void);
+int             netsnmp_trapd_pipeline_running(void);
+int             netsnmp_trapd_pipeline_submit(netsnmp_pdu *pdu,
+                                              netsnmp_transport *transport,
+                                              oid *trapOid, int trapOidLen);
+int             netsnmp_trapd_pipeline_output(int stage,
+                                              netsnmp_trapd_job *job);
+int             netsnmp_trapd_pipeline_stats(netsnmp_trapd_stage_stats *stats,
+                                             int max);
+void            netsnmp_trapd_pipeline_log_stats(void);
+int            *netsnmp_trapd_pipeline_auth_slot(void);
+void            netsnmp_trapd_pipeline_format_lock(int exclusive);
+void            netsnmp_trapd_pipeline_format_unlock(int exclusive);
+
+netsnmp_trapd_job *netsnmp_trapd_job_new(Netsnmp_Trapd_Job *run,
+                                         netsnmp_pdu *pdu,
+                                         netsnmp_transport *transport);
+void            netsnmp_trapd_job_free(netsnmp_trapd_job *job);
+
+#endif                          /* SNMPTRAPD_PIPELINE_H */
@@ -1,2 +1,4 @@
 void snmptrapd_register_sql_configs(void);
 int netsnmp_mysql_init(void);
+void snmptrapd_register_sqlite_configs(void);
+int netsnmp_sqlite_init(void);
@@ -0,0 +1,933 @@
+/*
+ * File       : snmptrapd_sqlite
+ *
+ * Use is subject to license terms specified in the COPYING file
+ * distributed with the Net-SNMP package.
+ *
+ * This file implements a handler for snmptrapd which stores incoming
+ * traps in a local SQLite database, using the same tables as the MySQL
+ * handler.  Traps are queued and written in batches, one transaction and
+ * a few multi-row INSERT statements per batch.  Where threads are
+ * available the batches are written by a thread of their own, so that
+ * disk writes never hold up the receiving of traps; otherwise they are
+ * written from the main loop.
+ */
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-features.h>
+
+#ifdef NETSNMP_USE_SQLITE
+
+#include <sqlite3.h>
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#include <stdio.h>
+#ifdef HAVE_STRING_H
+#include <string.h>
+#else
+#include <strings.h>
+#endif
+#include <sys/types.h>
+#ifdef HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#endif
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#define NETSNMP_SQLITE_THREAD 1
+#define QUEUE_LOCK()   pthread_mutex_lock(&_sqlite.lock)
+#define QUEUE_UNLOCK() pthread_mutex_unlock(&_sqlite.lock)
+#else
+#define QUEUE_LOCK()
+#define QUEUE_UNLOCK()
+#endif
+
+#include <net-snmp/net-snmp-includes.h>
+#include <net-snmp/agent/net-snmp-agent-includes.h>
+#include "snmptrapd_handlers.h"
+#include "snmptrapd_auth.h"
+#include "snmptrapd_log.h"
+#include "snmptrapd_sql.h"
+
+/*
+ * multi-row INSERTs are limited by the number of parameters per statement
+ * (999 in older SQLite versions)
+ */
+#define TRAP_COLS      16
+#define TRAPS_PER_STMT 32
+#define VB_COLS        4
+#define VBS_PER_STMT   128
+
+/** a queued varbind, already formatted */
+typedef struct sqlite_vb_buf_t {
+    char           *oid;
+    char           *value;
+    int             type;
+} sqlite_vb_buf;
+
+/** a queued trap, already formatted */
+typedef struct sqlite_buf_t {
+    struct sqlite_buf_t *next;
+    char            date_time[32];
+    char           *host;
+    char           *user;
+    char           *oid;
+    char           *transport;
+    int             type, version, security_model;
+    long            reqid;
+    /* SNMPv3 only */
+    int             v3;
+    long            msgid;
+    int             security_level;
+    char           *context;
+    char           *context_engine;
+    char           *security_name;
+    char           *security_engine;
+    int             nvarbinds;
+    sqlite_vb_buf  *varbinds;
+} sqlite_buf;
+
+/*
+ * define a structure to hold all the file globals
+ */
+typedef struct netsnmp_sqlite_globals_t {
+    char           *db_file;        /* database file (def=none, disabled) */
+    int             batch_size;     /* write when this many are queued */
+    int             interval;       /* ... or after this many seconds */
+    int             queue_max;      /* drop traps when the queue is full */
+    sqlite3        *db;             /* used by the writer only */
+    sqlite3_stmt   *trap_stmt[TRAPS_PER_STMT + 1]; /* INSERTs by number */
+    sqlite3_stmt   *vb_stmt[VBS_PER_STMT + 1];     /* of rows, prepared */
+                                                   /* when first used */
+    sqlite_buf     *head, *tail;    /* traps waiting to be written */
+    int             queued;
+    u_long          written;        /* counters, for the log */
+    u_long          dropped;
+    u_long          failed, failed_reported;
+    char            error[256];     /* last error of the writer */
+    u_int           alarm_id;
+#ifdef NETSNMP_SQLITE_THREAD
+    pthread_t       thread;
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    int             ready;          /* lock and cond initialized */
+    time_t          oldest;         /* when head was queued */
+    int             running;
+    int             stopping;
+#endif
+} netsnmp_sqlite_globals;
+
+static netsnmp_sqlite_globals _sqlite = {
+    NULL,                  /* db_file */
+    512,                   /* batch_size */
+    1,                     /* interval */
+    65536,                 /* queue_max */
+};
+
+static const char _sqlite_trap_head[] = "INSERT INTO notifications "
+    "(trap_id, date_time, host, auth, type, version, request_id, "
+    "snmpTrapOID, transport, security_model, v3msgid, "
+    "v3security_level, v3context_name, v3context_engine, "
+    "v3security_name, v3security_engine) VALUES";
+static const char _sqlite_vb_head[] = "INSERT INTO varbinds "
+    "(trap_id, oid, type, value) VALUES";
+
+static const char *_sqlite_schema =
+    "CREATE TABLE IF NOT EXISTS notifications ("
+    " trap_id INTEGER PRIMARY KEY, date_time TEXT NOT NULL,"
+    " host TEXT NOT NULL, auth TEXT NOT NULL, type TEXT NOT NULL,"
+    " version TEXT NOT NULL, request_id INTEGER NOT NULL,"
+    " snmpTrapOID TEXT NOT NULL, transport TEXT NOT NULL,"
+    " security_model TEXT NOT NULL, v3msgid INTEGER,"
+    " v3security_level TEXT, v3context_name TEXT, v3context_engine TEXT,"
+    " v3security_name TEXT, v3security_engine TEXT);"
+    "CREATE TABLE IF NOT EXISTS varbinds ("
+    " trap_id INTEGER NOT NULL, oid TEXT NOT NULL, type TEXT NOT NULL,"
+    " value TEXT NOT NULL);"
+    "CREATE INDEX IF NOT EXISTS varbinds_trap_id ON varbinds (trap_id);";
+
+/*
+ * names for the enumerated columns, as in the MySQL schema (1 based)
+ */
+static const char *_pdu_types[] = {
+    "get", "getnext", "response", "set", "trap", "getbulk", "inform",
+    "trap2", "report"
+};
+static const char *_versions[] = { "v1", "v2c", "unsupported(v2u)", "v3" };
+static const char *_security_models[] = { "snmpV1", "snmpV2c", "USM" };
+static const char *_security_levels[] = {
+    "noAuthNoPriv", "authNoPriv", "authPriv"
+};
+static const char *_vb_types[] = {
+    "boolean", "integer", "bit", "octet", "null", "oid", "ipaddress",
+    "counter", "unsigned", "timeticks", "opaque", "unused1", "counter64",
+    "unused2"
+};
+
+#define ENUM_NAME(names, i, buf) \
+    (((i) >= 1 && (i) <= (int) (sizeof(names) / sizeof(names[0]))) ? \
+     names[(i) - 1] : (snprintf(buf, sizeof(buf), "%d", (i)), buf))
+
+static void     _sqlite_flush(u_int dontcare, void *meeither);
+
+/*
+ * parse the sqliteDatabase configuration token
+ */
+static void
+_parse_db_file(const char *token, char *cptr)
+{
+    char           *old = _sqlite.db_file;
+
+    /*
+     * on reconfiguration, the writer thread may be copying the name to
+     * reconnect
+     */
+#ifdef NETSNMP_SQLITE_THREAD
+    if (_sqlite.ready)
+        pthread_mutex_lock(&_sqlite.lock);
+#endif
+    _sqlite.db_file = strdup(cptr);
+#ifdef NETSNMP_SQLITE_THREAD
+    if (_sqlite.ready)
+        pthread_mutex_unlock(&_sqlite.lock);
+#endif
+    free(old);
+}
+
+/*
+ * parse the sqliteBatchSize configuration token
+ */
+static void
+_parse_batch_size(const char *token, char *cptr)
+{
+    _sqlite.batch_size = atoi(cptr);
+    if (_sqlite.batch_size < 1) {
+        config_perror("sqliteBatchSize must be at least 1");
+        _sqlite.batch_size = 1;
+    }
+}
+
+/*
+ * parse the sqliteFlushInterval configuration token
+ */
+static void
+_parse_interval(const char *token, char *cptr)
+{
+    _sqlite.interval = atoi(cptr);
+    if (_sqlite.interval < 1) {
+        config_perror("sqliteFlushInterval must be at least 1 second");
+        _sqlite.interval = 1;
+    }
+}
+
+/*
+ * parse the sqliteMaxQueue configuration token
+ */
+static void
+_parse_queue_max(const char *token, char *cptr)
+{
+    _sqlite.queue_max = atoi(cptr);
+}
+
+/*
+ * register SQLite related configuration tokens
+ */
+void
+snmptrapd_register_sqlite_configs(void)
+{
+    register_config_handler("snmptrapd", "sqliteDatabase",
+                            _parse_db_file, NULL, "file");
+    register_config_handler("snmptrapd", "sqliteBatchSize",
+                            _parse_batch_size, NULL, "integer");
+    register_config_handler("snmptrapd", "sqliteFlushInterval",
+                            _parse_interval, NULL, "seconds");
+    register_config_handler("snmptrapd", "sqliteMaxQueue",
+                            _parse_queue_max, NULL, "integer");
+}
+
+static void
+_sqlite_buf_free(sqlite_buf *sqlb)
+{
+    int             i;
+
+    for (i = 0; i < sqlb->nvarbinds; i++) {
+        free(sqlb->varbinds[i].oid);
+        free(sqlb->varbinds[i].value);
+    }
+    free(sqlb->varbinds);
+    free(sqlb->host);
+    free(sqlb->user);
+    free(sqlb->oid);
+    free(sqlb->transport);
+    free(sqlb->context);
+    free(sqlb->context_engine);
+    free(sqlb->security_name);
+    free(sqlb->security_engine);
+    free(sqlb);
+}
+
+/*
+ * count traps that could not be written, remembering why (if what is
+ * given); this is logged from the main thread
+ */
+static void
+_sqlite_failed(const char *what, int count)
+{
+    QUEUE_LOCK();
+    if (what)
+        snprintf(_sqlite.error, sizeof(_sqlite.error), "%s: %s", what,
+                 sqlite3_errmsg(_sqlite.db));
+    _sqlite.failed += count;
+    QUEUE_UNLOCK();
+}
+
+static void
+_sqlite_report(void)
+{
+    char            error[sizeof(_sqlite.error)];
+    u_long          failed;
+
+    QUEUE_LOCK();
+    failed = _sqlite.failed - _sqlite.failed_reported;
+    _sqlite.failed_reported = _sqlite.failed;
+    memcpy(error, _sqlite.error, sizeof(error));
+    QUEUE_UNLOCK();
+    if (failed)
+        snmp_log(LOG_ERR, "sqlite: %lu trap(s) not written (%s)\n",
+                 failed, error);
+}
+
+/*
+ * open the database, create the tables and switch to WAL mode
+ */
+static sqlite3 *
+_sqlite_open(const char *db_file, char *errbuf, size_t errlen)
+{
+    sqlite3        *db = NULL;
+    char           *errmsg = NULL;
+
+    if (sqlite3_open_v2(db_file, &db,
+                        SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE,
+                        NULL) != SQLITE_OK) {
+        snprintf(errbuf, errlen, "cannot open %s: %s", db_file,
+                 db ? sqlite3_errmsg(db) : "out of memory");
+        sqlite3_close(db);
+        return NULL;
+    }
+    sqlite3_busy_timeout(db, 5000);
+    if (sqlite3_exec(db, "PRAGMA journal_mode=WAL;"
+                     "PRAGMA synchronous=NORMAL;", NULL, NULL,
+                     &errmsg) != SQLITE_OK ||
+        sqlite3_exec(db, _sqlite_schema, NULL, NULL, &errmsg) != SQLITE_OK) {
+        snprintf(errbuf, errlen, "cannot set up %s: %s", db_file,
+                 errmsg ? errmsg : "unknown error");
+        sqlite3_free(errmsg);
+        sqlite3_close(db);
+        return NULL;
+    }
+    return db;
+}
+
+/*
+ * the INSERT of rows rows of cols values each, from the statements
+ * already prepared for that many rows (stmts), or prepared now
+ */
+static sqlite3_stmt *
+_sqlite_prepare(sqlite3_stmt **stmts, const char *head, int cols, int rows)
+{
+    sqlite3_stmt   *stmt = NULL;
+    char           *sql, *cp;
+    int             r, c;
+
+    if (stmts[rows])
+        return stmts[rows];
+    sql = malloc(strlen(head) + rows * (cols * 2 + 4));
+    if (!sql)
+        return NULL;
+    cp = sql + sprintf(sql, "%s", head);
+    for (r = 0; r < rows; r++) {
+        *cp++ = r ? ',' : ' ';
+        *cp++ = '(';
+        for (c = 0; c < cols; c++) {
+            if (c)
+                *cp++ = ',';
+            *cp++ = '?';
+        }
+        *cp++ = ')';
+    }
+    *cp = '\0';
+    if (sqlite3_prepare_v2(_sqlite.db, sql, -1, &stmt, NULL) != SQLITE_OK)
+        stmt = NULL;
+    free(sql);
+    stmts[rows] = stmt;
+    return stmt;
+}
+
+static void
+_sqlite_disconnect(void)
+{
+    int             i;
+
+    for (i = 0; i <= TRAPS_PER_STMT; i++) {
+        sqlite3_finalize(_sqlite.trap_stmt[i]);
+        _sqlite.trap_stmt[i] = NULL;
+    }
+    for (i = 0; i <= VBS_PER_STMT; i++) {
+        sqlite3_finalize(_sqlite.vb_stmt[i]);
+        _sqlite.vb_stmt[i] = NULL;
+    }
+    sqlite3_close(_sqlite.db);
+    _sqlite.db = NULL;
+}
+
+static int
+_sqlite_connect(void)
+{
+    char            error[sizeof(_sqlite.error)];
+    char           *db_file;
+
+    if (_sqlite.db)
+        return 0;
+    /*
+     * the main thread may replace the name when it is reconfigured
+     */
+    QUEUE_LOCK();
+    db_file = _sqlite.db_file ? strdup(_sqlite.db_file) : NULL;
+    QUEUE_UNLOCK();
+    if (db_file)
+        _sqlite.db = _sqlite_open(db_file, error, sizeof(error));
+    else
+        strlcpy(error, "out of memory", sizeof(error));
+    free(db_file);
+    if (!_sqlite.db) {
+        QUEUE_LOCK();
+        memcpy(_sqlite.error, error, sizeof(error));
+        QUEUE_UNLOCK();
+        return -1;
+    }
+    return 0;
+}
+
+static void
+_bind_text(sqlite3_stmt *stmt, int col, const char *text)
+{
+    if (text)
+        sqlite3_bind_text(stmt, col, text, -1, SQLITE_STATIC);
+    else
+        sqlite3_bind_null(stmt, col);
+}
+
+/*
+ * bind one trap as the row'th row of an INSERT; the enumerated values
+ * are converted into buf, which must stay valid until the step
+ */
+static void
+_sqlite_bind_trap(sqlite3_stmt *stmt, int row, sqlite_buf *sqlb,
+                  sqlite3_int64 trap_id, char buf[][16])
+{
+    int             col = row * TRAP_COLS + 1;
+
+    sqlite3_bind_int64(stmt, col++, trap_id);
+    _bind_text(stmt, col++, sqlb->date_time);
+    _bind_text(stmt, col++, sqlb->host ? sqlb->host : "");
+    _bind_text(stmt, col++, sqlb->user ? sqlb->user : "");
+    _bind_text(stmt, col++, ENUM_NAME(_pdu_types, sqlb->type, buf[0]));
+    _bind_text(stmt, col++, ENUM_NAME(_versions, sqlb->version, buf[1]));
+    sqlite3_bind_int64(stmt, col++, sqlb->reqid);
+    _bind_text(stmt, col++, sqlb->oid ? sqlb->oid : "");
+    _bind_text(stmt, col++, sqlb->transport ? sqlb->transport : "");
+    _bind_text(stmt, col++, ENUM_NAME(_security_models, sqlb->security_model,
+                                      buf[2]));
+    if (sqlb->v3) {
+        sqlite3_bind_int64(stmt, col++, sqlb->msgid);
+        _bind_text(stmt, col++, ENUM_NAME(_security_levels,
+                                          sqlb->security_level, buf[3]));
+        _bind_text(stmt, col++, sqlb->context);
+        _bind_text(stmt, col++, sqlb->context_engine);
+        _bind_text(stmt, col++, sqlb->security_name);
+        _bind_text(stmt, col++, sqlb->security_engine);
+    } else {
+        for (; col <= (row + 1) * TRAP_COLS; col++)
+            sqlite3_bind_null(stmt, col);
+    }
+}
+
+static int
+_sqlite_step(sqlite3_stmt *stmt)
+{
+    int             rc = sqlite3_step(stmt);
+
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    return rc == SQLITE_DONE ? 0 : -1;
+}
+
+/*
+ * insert the traps of a batch (count of them, starting at first_id)
+ */
+static int
+_sqlite_insert_traps(sqlite_buf *batch, int count, sqlite3_int64 first_id)
+{
+    char            buf[TRAPS_PER_STMT][4][16];
+    sqlite3_stmt   *stmt;
+    sqlite_buf     *sqlb = batch;
+    sqlite3_int64   id = first_id;
+    int             rows, row;
+
+    while (count > 0) {
+        rows = count >= TRAPS_PER_STMT ? TRAPS_PER_STMT : count;
+        stmt = _sqlite_prepare(_sqlite.trap_stmt, _sqlite_trap_head,
+                               TRAP_COLS, rows);
+        if (!stmt)
+            return -1;
+        for (row = 0; row < rows; row++, sqlb = sqlb->next)
+            _sqlite_bind_trap(stmt, row, sqlb, id++, buf[row]);
+        if (_sqlite_step(stmt) < 0)
+            return -1;
+        count -= rows;
+    }
+    return 0;
+}
+
+/*
+ * insert the varbinds of all traps of a batch
+ */
+static int
+_sqlite_insert_varbinds(sqlite_buf *batch, int total, sqlite3_int64 first_id)
+{
+    char            buf[VBS_PER_STMT][16];
+    sqlite3_stmt   *stmt;
+    sqlite_buf     *sqlb = batch;
+    sqlite_vb_buf  *vb;
+    sqlite3_int64   id = first_id;
+    int             i = 0, rows, row, col;
+
+    while (total > 0) {
+        rows = total >= VBS_PER_STMT ? VBS_PER_STMT : total;
+        stmt = _sqlite_prepare(_sqlite.vb_stmt, _sqlite_vb_head, VB_COLS,
+                               rows);
+        if (!stmt)
+            return -1;
+        for (row = 0; row < rows; row++) {
+            while (i >= sqlb->nvarbinds) {
+                sqlb = sqlb->next;
+                id++;
+                i = 0;
+            }
+            vb = &sqlb->varbinds[i++];
+            col = row * VB_COLS + 1;
+            sqlite3_bind_int64(stmt, col++, id);
+            _bind_text(stmt, col++, vb->oid ? vb->oid : "");
+            _bind_text(stmt, col++, ENUM_NAME(_vb_types, vb->type, buf[row]));
+            _bind_text(stmt, col++, vb->value ? vb->value : "");
+        }
+        if (_sqlite_step(stmt) < 0)
+            return -1;
+        total -= rows;
+    }
+    return 0;
+}
+
+/*
+ * write a batch of traps in one transaction, and free it
+ */
+static void
+_sqlite_write(sqlite_buf *batch)
+{
+    sqlite3_stmt   *stmt;
+    sqlite3_int64   first_id = 1;
+    sqlite_buf     *sqlb, *next;
+    int             count = 0, nvarbinds = 0;
+
+    for (sqlb = batch; sqlb; sqlb = sqlb->next) {
+        count++;
+        nvarbinds += sqlb->nvarbinds;
+    }
+    if (!count)
+        return;
+
+    if (_sqlite_connect() < 0) {
+        _sqlite_failed(NULL, count);
+        goto free;
+    }
+
+    /*
+     * The trap ids are assigned here, so that traps and varbinds can be
+     * inserted many rows at a time; the write lock taken by BEGIN
+     * IMMEDIATE keeps other writers from using the same ids.
+     */
+    if (sqlite3_exec(_sqlite.db, "BEGIN IMMEDIATE", NULL, NULL,
+                     NULL) != SQLITE_OK) {
+        _sqlite_failed("cannot begin transaction", count);
+        _sqlite_disconnect();
+        goto free;
+    }
+    if (sqlite3_prepare_v2(_sqlite.db,
+                           "SELECT max(trap_id) FROM notifications", -1,
+                           &stmt, NULL) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW)
+            first_id = sqlite3_column_int64(stmt, 0) + 1;
+        sqlite3_finalize(stmt);
+    }
+
+    if (_sqlite_insert_traps(batch, count, first_id) < 0 ||
+        _sqlite_insert_varbinds(batch, nvarbinds, first_id) < 0 ||
+        sqlite3_exec(_sqlite.db, "COMMIT", NULL, NULL, NULL) != SQLITE_OK) {
+        _sqlite_failed("cannot insert traps", count);
+        sqlite3_exec(_sqlite.db, "ROLLBACK", NULL, NULL, NULL);
+        goto free;
+    }
+    _sqlite.written += count;
+    DEBUGMSGTL(("sqlite", "wrote %d traps, %d varbinds\n", count,
+                nvarbinds));
+
+  free:
+    for (sqlb = batch; sqlb; sqlb = next) {
+        next = sqlb->next;
+        _sqlite_buf_free(sqlb);
+    }
+}
+
+#ifdef NETSNMP_SQLITE_THREAD
+/*
+ * the writer thread: take the queue whenever a batch is full or its
+ * oldest trap has waited for the flush interval, and write it
+ */
+static void    *
+_sqlite_writer(void *arg)
+{
+    struct timespec deadline;
+    sqlite_buf     *batch;
+
+    pthread_mutex_lock(&_sqlite.lock);
+    for (;;) {
+        while (!_sqlite.stopping && _sqlite.queued < _sqlite.batch_size) {
+            if (!_sqlite.head) {
+                pthread_cond_wait(&_sqlite.cond, &_sqlite.lock);
+                continue;
+            }
+            deadline.tv_sec = _sqlite.oldest + _sqlite.interval;
+            deadline.tv_nsec = 0;
+            if (pthread_cond_timedwait(&_sqlite.cond, &_sqlite.lock,
+                                       &deadline) != 0)
+                break;
+        }
+        batch = _sqlite.head;
+        _sqlite.head = _sqlite.tail = NULL;
+        _sqlite.queued = 0;
+        if (!batch && _sqlite.stopping)
+            break;
+        pthread_mutex_unlock(&_sqlite.lock);
+        _sqlite_write(batch);
+        pthread_mutex_lock(&_sqlite.lock);
+    }
+    pthread_mutex_unlock(&_sqlite.lock);
+    _sqlite_disconnect();
+    return NULL;
+}
+#endif                          /* NETSNMP_SQLITE_THREAD */
+
+/*
+ * queue a trap for writing.  Traps are dropped when the queue is full.
+ */
+static void
+_sqlite_enqueue(sqlite_buf *sqlb)
+{
+    int             full;
+
+#ifdef NETSNMP_SQLITE_THREAD
+    pthread_mutex_lock(&_sqlite.lock);
+    /*
+     * started on first use rather than at startup, which comes before
+     * snmptrapd forks into the background
+     */
+    if (!_sqlite.running && !_sqlite.stopping) {
+        if (pthread_create(&_sqlite.thread, NULL, _sqlite_writer, NULL) == 0)
+            _sqlite.running = 1;
+    }
+#endif
+    full = _sqlite.queued >= _sqlite.queue_max;
+    if (!full) {
+        if (_sqlite.tail)
+            _sqlite.tail->next = sqlb;
+        else {
+            _sqlite.head = sqlb;
+#ifdef NETSNMP_SQLITE_THREAD
+            _sqlite.oldest = time(NULL);
+#endif
+        }
+        _sqlite.tail = sqlb;
+        _sqlite.queued++;
+    } else
+        _sqlite.dropped++;
+#ifdef NETSNMP_SQLITE_THREAD
+    if (_sqlite.queued >= _sqlite.batch_size || _sqlite.queued == 1)
+        pthread_cond_signal(&_sqlite.cond);
+    pthread_mutex_unlock(&_sqlite.lock);
+#else
+    if (_sqlite.queued >= _sqlite.batch_size)
+        _sqlite_flush(0, NULL);
+#endif
+    if (full)
+        _sqlite_buf_free(sqlb);
+}
+
+/*
+ * periodic alarm: without a writer thread, write what is queued; in
+ * any case log what went wrong since last time
+ */
+static void
+_sqlite_flush(u_int dontcare, void *meeither)
+{
+#ifndef NETSNMP_SQLITE_THREAD
+    sqlite_buf     *batch = _sqlite.head;
+
+    _sqlite.head = _sqlite.tail = NULL;
+    _sqlite.queued = 0;
+    _sqlite_write(batch);
+#endif
+    _sqlite_report();
+}
+
+static char    *
+_sqlite_oid(const oid *name, size_t len)
+{
+    char           *buf, *cp;
+    size_t          i;
+
+    buf = malloc(len * 11 + 1);
+    if (!buf)
+        return NULL;
+    cp = buf;
+    *cp = '\0';
+    for (i = 0; i < len; i++)
+        cp += sprintf(cp, ".%" NETSNMP_PRIo "u", name[i]);
+    return buf;
+}
+
+/*
+ * copy what is to be stored from an incoming trap
+ */
+static sqlite_buf *
+_sqlite_buf_get(netsnmp_pdu *pdu, netsnmp_transport *transport)
+{
+    static const oid trapoids[] = { 1, 3, 6, 1, 6, 3, 1, 1, 5, 0 };
+    oid             trap_oid[MAX_OID_LEN];
+    size_t          trap_oid_len, buf_len, out_len;
+    netsnmp_variable_list *var;
+    sqlite_buf     *sqlb;
+    sqlite_vb_buf  *vb;
+    time_t          now;
+    struct tm      *tm;
+#ifdef HAVE_LOCALTIME_R
+    struct tm       tm_buf;
+#endif
+
+    sqlb = SNMP_MALLOC_TYPEDEF(sqlite_buf);
+    if (!sqlb)
+        return NULL;
+
+    /** time */
+    (void) time(&now);
+#ifdef HAVE_LOCALTIME_R
+    tm = localtime_r(&now, &tm_buf);
+#else
+    tm = localtime(&now);
+#endif
+    if (tm)
+        strftime(sqlb->date_time, sizeof(sqlb->date_time),
+                 "%Y-%m-%d %H:%M:%S", tm);
+
+    /** host name and community string/user name */
+    buf_len = out_len = 0;
+    realloc_format_trap((u_char **) &sqlb->host, &buf_len, &out_len, 1, "%B",
+                        pdu, transport);
+    buf_len = out_len = 0;
+    realloc_format_trap((u_char **) &sqlb->user, &buf_len, &out_len, 1, "%u",
+                        pdu, transport);
+    if (transport)
+        sqlb->transport = transport->f_fmtaddr(transport, pdu->transport_data,
+                                               pdu->transport_data_length);
+
+    /** snmpTrapOID, converting v1 traps as for the MySQL handler */
+    trap_oid_len = 0;
+    if (pdu->command == SNMP_MSG_TRAP) {
+        if (pdu->trap_type == SNMP_TRAP_ENTERPRISESPECIFIC &&
+            pdu->enterprise_length + 2 <= MAX_OID_LEN) {
+            trap_oid_len = pdu->enterprise_length;
+            memcpy(trap_oid, pdu->enterprise, trap_oid_len * sizeof(oid));
+            if (trap_oid_len && trap_oid[trap_oid_len - 1] != 0)
+                trap_oid[trap_oid_len++] = 0;
+            trap_oid[trap_oid_len++] = pdu->specific_type;
+        } else if (pdu->trap_type != SNMP_TRAP_ENTERPRISESPECIFIC) {
+            trap_oid_len = OID_LENGTH(trapoids);
+            memcpy(trap_oid, trapoids, sizeof(trapoids));
+            trap_oid[trap_oid_len - 1] = pdu->trap_type + 1;
+        }
+    } else if (pdu->variables && pdu->variables->next_variable &&
+               pdu->variables->next_variable->type == ASN_OBJECT_ID) {
+        trap_oid_len = pdu->variables->next_variable->val_len / sizeof(oid);
+        if (trap_oid_len > MAX_OID_LEN)
+            trap_oid_len = MAX_OID_LEN;
+        memcpy(trap_oid, pdu->variables->next_variable->val.objid,
+               trap_oid_len * sizeof(oid));
+    }
+    sqlb->oid = _sqlite_oid(trap_oid, trap_oid_len);
+
+    /** types are stored 1 based, as the MySQL enums */
+    sqlb->reqid = pdu->reqid;
+    sqlb->version = pdu->version + 1;
+    sqlb->type = pdu->command - 159;
+    sqlb->security_model = pdu->securityModel;
+
+    if (pdu->version == SNMP_VERSION_3) {
+        sqlb->v3 = 1;
+        sqlb->msgid = pdu->msgid;
+        sqlb->security_level = pdu->securityLevel;
+        if (pdu->contextName)
+            sqlb->context = netsnmp_strdup_and_null((u_char *) pdu->contextName,
+                                                    pdu->contextNameLen);
+        if (pdu->contextEngineID)
+            binary_to_hex(pdu->contextEngineID, pdu->contextEngineIDLen,
+                          &sqlb->context_engine);
+        if (pdu->securityName)
+            sqlb->security_name =
+                netsnmp_strdup_and_null((u_char *) pdu->securityName,
+                                        pdu->securityNameLen);
+        if (pdu->securityEngineID)
+            binary_to_hex(pdu->securityEngineID, pdu->securityEngineIDLen,
+                          &sqlb->security_engine);
+    }
+
+    /** varbinds */
+    for (var = pdu->variables; var; var = var->next_variable)
+        sqlb->nvarbinds++;
+    sqlb->varbinds = calloc(sqlb->nvarbinds ? sqlb->nvarbinds : 1,
+                            sizeof(sqlite_vb_buf));
+    if (!sqlb->varbinds) {
+        sqlb->nvarbinds = 0;
+        _sqlite_buf_free(sqlb);
+        return NULL;
+    }
+    for (vb = sqlb->varbinds, var = pdu->variables; var;
+         vb++, var = var->next_variable) {
+        vb->oid = _sqlite_oid(var->name, var->name_length);
+        if (var->type > ASN_OBJECT_ID)
+            /** convert application types to the enum */
+            vb->type = ASN_OBJECT_ID + 1 + (var->type & ~ASN_APPLICATION);
+        else
+            vb->type = var->type;
+        buf_len = out_len = 0;
+        sprint_realloc_by_type((u_char **) &vb->value, &buf_len, &out_len, 1,
+                               var, NULL, NULL, NULL);
+    }
+    return sqlb;
+}
+
+/*
+ * SQLite trap handler.  Only reads the output settings, so it may run in
+ * any pipeline worker.
+ */
+int
+sqlite_handler(netsnmp_pdu           *pdu,
+               netsnmp_transport     *transport,
+               netsnmp_trapd_handler *handler)
+{
+    sqlite_buf     *sqlb;
+
+    DEBUGMSGTL(("sqlite:handler", "called\n"));
+
+    sqlb = _sqlite_buf_get(pdu, transport);
+    if (NULL == sqlb) {
+        snmp_log(LOG_ERR, "Could not allocate trap sqlite buffer\n");
+        return NETSNMPTRAPD_HANDLER_FAIL;
+    }
+    _sqlite_enqueue(sqlb);
+    return NETSNMPTRAPD_HANDLER_OK;
+}
+
+/*
+ * cleanup function, called at exit: write what is still queued
+ */
+static void
+netsnmp_sqlite_cleanup(void)
+{
+    DEBUGMSGTL(("sqlite:cleanup", "called\n"));
+
+    if (_sqlite.alarm_id)
+        snmp_alarm_unregister(_sqlite.alarm_id);
+    _sqlite.alarm_id = 0;
+
+#ifdef NETSNMP_SQLITE_THREAD
+    pthread_mutex_lock(&_sqlite.lock);
+    _sqlite.stopping = 1;
+    pthread_cond_signal(&_sqlite.cond);
+    pthread_mutex_unlock(&_sqlite.lock);
+    if (_sqlite.running)
+        pthread_join(_sqlite.thread, NULL);
+    _sqlite.running = 0;
+#endif
+    _sqlite_flush(0, NULL);
+    _sqlite_disconnect();
+    if (_sqlite.dropped)
+        snmp_log(LOG_WARNING, "sqlite: %lu trap(s) dropped, queue full\n",
+                 _sqlite.dropped);
+    DEBUGMSGTL(("sqlite:cleanup", "%lu traps written\n", _sqlite.written));
+}
+
+/** one-time initialization for SQLite */
+int
+netsnmp_sqlite_init(void)
+{
+    netsnmp_trapd_handler *traph;
+    char            errbuf[256];
+    sqlite3        *db;
+
+    DEBUGMSGTL(("sqlite:init", "called\n"));
+
+    if (!_sqlite.db_file) {
+        DEBUGMSGTL(("sqlite:init",
+                    "sqlite not enabled (no sqliteDatabase)\n"));
+        return 0;
+    }
+
+    /*
+     * check that the database can be used now, but leave the connection
+     * to the writer
+     */
+    db = _sqlite_open(_sqlite.db_file, errbuf, sizeof(errbuf));
+    if (!db) {
+        snmp_log(LOG_ERR, "sqlite: %s\n", errbuf);
+        return -1;
+    }
+    sqlite3_close(db);
+
+#ifdef NETSNMP_SQLITE_THREAD
+    pthread_mutex_init(&_sqlite.lock, NULL);
+    pthread_cond_init(&_sqlite.cond, NULL);
+    _sqlite.ready = 1;
+#endif
+
+    _sqlite.alarm_id = snmp_alarm_register(_sqlite.interval, SA_REPEAT,
+                                           _sqlite_flush, NULL);
+
+    /** add handler; it stays in place across reconfiguration */
+    traph = netsnmp_add_global_traphandler(NETSNMPTRAPD_PRE_HANDLER,
+                                           sqlite_handler);
+    if (NULL == traph) {
+        snmp_log(LOG_ERR, "Could not allocate sqlite trap handler\n");
+        return -1;
+    }
+    traph->authtypes = TRAP_AUTH_LOG;
+    traph->flags |= NETSNMP_TRAPHANDLER_FLAG_BUILTIN;
+
+    atexit(netsnmp_sqlite_cleanup);
+    return 0;
+}
+
+#else
+int unused_sqlite;	/* Suppress "empty translation unit" warning */
+#endif /* NETSNMP_USE_SQLITE */
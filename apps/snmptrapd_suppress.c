@@ -0,0 +1,516 @@
+/*
+ * snmptrapd_suppress.c - trap storm suppression
+ *
+ * Before any handler runs, each notification is checked against two
+ * tables.  The first is keyed by the source address, the notification OID
+ * and the values of the varbinds selected with suppressDuplicates; a
+ * notification whose key was let through less than the window ago is a
+ * duplicate and is dropped.  The second is keyed by the source address
+ * alone and holds a token bucket per source; a notification that finds
+ * its bucket empty is dropped as well.
+ *
+ * Both tables are hash tables of a bounded size whose least recently used
+ * entry is reused when they are full, so that checking a notification
+ * costs the same however many sources there are.  What was dropped is
+ * counted per entry and logged every suppressSummaryInterval seconds.
+ */
+#include <net-snmp/net-snmp-config.h>
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#else
+#include <strings.h>
+#endif
+#include <sys/types.h>
+#ifdef HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#endif
+#ifdef HAVE_ARPA_INET_H
+#include <arpa/inet.h>
+#endif
+
+#include <net-snmp/net-snmp-includes.h>
+#include "snmptrapd_handlers.h"
+#include "snmptrapd_suppress.h"
+#include "inet_ntop.h"
+
+#define SUPPRESS_DEFAULT_TABLE_SIZE       4096
+#define SUPPRESS_DEFAULT_SUMMARY_INTERVAL 60
+#define SUPPRESS_MAX_OIDS                 16
+
+typedef struct suppress_entry_s {
+    struct suppress_entry_s *hnext;     /* hash chain */
+    struct suppress_entry_s *prev, *next;       /* LRU list, newest first */
+    unsigned int    hash;
+    u_char         *key;
+    size_t          key_len;
+    char           *source;     /* printable source address */
+    oid            *trapOid;    /* duplicates table only */
+    size_t          trapOidLen;
+    struct timeval  last;       /* let through / bucket refilled */
+    double          tokens;     /* rate table only */
+    u_long          suppressed; /* since the last summary */
+} suppress_entry;
+
+typedef struct suppress_table_s {
+    suppress_entry **buckets;
+    size_t          nbuckets;   /* a power of two */
+    size_t          count;
+    suppress_entry *newest, *oldest;
+    u_long          lost;       /* counts of entries that were reused */
+} suppress_table;
+
+static suppress_table dup_table;
+static suppress_table rate_table;
+
+static int      dup_window;     /* seconds; 0 disables */
+static oid     *dup_oids[SUPPRESS_MAX_OIDS];
+static size_t   dup_oid_lens[SUPPRESS_MAX_OIDS];
+static int      dup_noids;
+static double   rate_limit;     /* per second; 0 disables */
+static double   rate_burst;
+static int      table_size = SUPPRESS_DEFAULT_TABLE_SIZE;
+static int      summary_interval = SUPPRESS_DEFAULT_SUMMARY_INTERVAL;
+static unsigned int summary_alarm;
+
+static u_char  *keybuf;
+static size_t   keybuf_len;
+
+static void
+table_clear(suppress_table *t)
+{
+    suppress_entry *e, *next;
+
+    for (e = t->newest; e; e = next) {
+        next = e->next;
+        free(e->key);
+        free(e->source);
+        free(e->trapOid);
+        free(e);
+    }
+    free(t->buckets);
+    t->buckets = NULL;
+    t->nbuckets = 0;
+    t->count = 0;
+    t->newest = t->oldest = NULL;
+    t->lost = 0;
+}
+
+static void
+parse_suppress_duplicates(const char *token, char *cptr)
+{
+    char            buf[SPRINT_MAX_LEN];
+    oid             name[MAX_OID_LEN];
+    size_t          name_len;
+
+    cptr = copy_nword(cptr, buf, sizeof(buf));
+    dup_window = atoi(buf);
+    if (dup_window < 0) {
+        config_perror("the window must not be negative");
+        dup_window = 0;
+        return;
+    }
+    for (; dup_noids; dup_noids--)
+        SNMP_FREE(dup_oids[dup_noids - 1]);
+    while (cptr) {
+        cptr = copy_nword(cptr, buf, sizeof(buf));
+        name_len = OID_LENGTH(name);
+        if (!snmp_parse_oid(buf, name, &name_len)) {
+            netsnmp_config_error("unknown object %s", buf);
+            continue;
+        }
+        if (dup_noids == SUPPRESS_MAX_OIDS) {
+            netsnmp_config_error("at most %d objects can be used",
+                                 SUPPRESS_MAX_OIDS);
+            break;
+        }
+        dup_oids[dup_noids] = snmp_duplicate_objid(name, name_len);
+        if (dup_oids[dup_noids])
+            dup_oid_lens[dup_noids++] = name_len;
+    }
+}
+
+static void
+parse_suppress_rate(const char *token, char *cptr)
+{
+    char            buf[SPRINT_MAX_LEN];
+
+    cptr = copy_nword(cptr, buf, sizeof(buf));
+    rate_limit = atof(buf);
+    rate_burst = cptr ? atof(cptr) : rate_limit;
+    if (rate_limit < 0 || rate_burst < 0) {
+        config_perror("the rate must not be negative");
+        rate_limit = 0;
+        return;
+    }
+    if (rate_burst < 1)
+        rate_burst = 1;
+}
+
+static void
+parse_suppress_config(const char *token, char *cptr)
+{
+    int             val = atoi(cptr);
+
+    if (val < 0) {
+        config_perror("value must not be negative");
+        return;
+    }
+    if (strcmp(token, "suppressTableSize") == 0) {
+        if (val < 1) {
+            config_perror("the table needs at least one entry");
+            return;
+        }
+        table_size = val;
+    } else
+        summary_interval = val;
+}
+
+static void
+free_suppress_config(void)
+{
+    netsnmp_trapd_suppress_log_summary();
+    if (summary_alarm) {
+        snmp_alarm_unregister(summary_alarm);
+        summary_alarm = 0;
+    }
+    table_clear(&dup_table);
+    table_clear(&rate_table);
+    dup_window = 0;
+    for (; dup_noids; dup_noids--)
+        SNMP_FREE(dup_oids[dup_noids - 1]);
+    rate_limit = rate_burst = 0;
+    table_size = SUPPRESS_DEFAULT_TABLE_SIZE;
+    summary_interval = SUPPRESS_DEFAULT_SUMMARY_INTERVAL;
+    SNMP_FREE(keybuf);
+    keybuf_len = 0;
+}
+
+void
+snmptrapd_suppress_register_configs(void)
+{
+    register_config_handler("snmptrapd", "suppressDuplicates",
+                            parse_suppress_duplicates, free_suppress_config,
+                            "seconds [OID ...]");
+    register_config_handler("snmptrapd", "suppressRate",
+                            parse_suppress_rate, NULL,
+                            "notifications-per-second [burst]");
+    register_config_handler("snmptrapd", "suppressTableSize",
+                            parse_suppress_config, NULL, "entries");
+    register_config_handler("snmptrapd", "suppressSummaryInterval",
+                            parse_suppress_config, NULL, "seconds");
+}
+
+/*
+ * Append to the key being built in keybuf.
+ */
+static int
+key_add(size_t *len, const void *data, size_t data_len)
+{
+    while (*len + data_len > keybuf_len)
+        if (!snmp_realloc(&keybuf, &keybuf_len))
+            return 0;
+    memcpy(keybuf + *len, data, data_len);
+    *len += data_len;
+    return 1;
+}
+
+/*
+ * Add the source address, without the port, to the key.
+ */
+static int
+key_add_source(size_t *len, netsnmp_pdu *pdu)
+{
+    const void     *addr;
+    size_t          addr_len;
+    int             family;
+    u_char          f;
+
+    addr = netsnmp_trapd_source_address(pdu, &addr_len, &family);
+    f = (u_char) family;
+    return key_add(len, &f, 1) &&
+        (addr == NULL || key_add(len, addr, addr_len));
+}
+
+/*
+ * The source address, as found at the start of a key.
+ */
+static char    *
+source_string(const u_char *key, netsnmp_pdu *pdu,
+              netsnmp_transport *transport)
+{
+    char            buf[64];
+
+    if (key[0] == AF_INET)
+        return strdup(inet_ntop(AF_INET, key + 1, buf, sizeof(buf)) ?
+                      buf : "?");
+#ifdef NETSNMP_ENABLE_IPV6
+    if (key[0] == AF_INET6)
+        return strdup(inet_ntop(AF_INET6, key + 1, buf, sizeof(buf)) ?
+                      buf : "?");
+#endif
+    if (transport && transport->f_fmtaddr)
+        return transport->f_fmtaddr(transport, pdu->transport_data,
+                                    pdu->transport_data_length);
+    return strdup("<UNKNOWN>");
+}
+
+static unsigned int
+key_hash(size_t len)
+{
+    unsigned int    hash = 2166136261U;
+    const u_char   *cp = keybuf;
+
+    while (len--)
+        hash = (hash ^ *cp++) * 16777619U;
+    return hash;
+}
+
+static void
+lru_unlink(suppress_table *t, suppress_entry *e)
+{
+    if (e->prev)
+        e->prev->next = e->next;
+    else
+        t->newest = e->next;
+    if (e->next)
+        e->next->prev = e->prev;
+    else
+        t->oldest = e->prev;
+}
+
+static void
+lru_push(suppress_table *t, suppress_entry *e)
+{
+    e->prev = NULL;
+    e->next = t->newest;
+    if (t->newest)
+        t->newest->prev = e;
+    else
+        t->oldest = e;
+    t->newest = e;
+}
+
+/*
+ * Find the entry for the key in keybuf, or set up a new one (reusing the
+ * least recently used entry if the table is full).  *created tells which.
+ */
+static suppress_entry *
+table_lookup(suppress_table *t, size_t key_len, netsnmp_pdu *pdu,
+             netsnmp_transport *transport, int *created)
+{
+    unsigned int    hash = key_hash(key_len);
+    suppress_entry *e, **ep;
+    u_char         *key;
+
+    *created = 0;
+    if (t->buckets == NULL) {
+        for (t->nbuckets = 1; t->nbuckets < (size_t) table_size;
+             t->nbuckets <<= 1)
+            ;
+        t->buckets = calloc(t->nbuckets, sizeof(*t->buckets));
+        if (t->buckets == NULL) {
+            t->nbuckets = 0;
+            return NULL;
+        }
+    }
+
+    for (e = t->buckets[hash & (t->nbuckets - 1)]; e; e = e->hnext)
+        if (e->hash == hash && e->key_len == key_len &&
+            memcmp(e->key, keybuf, key_len) == 0) {
+            if (e != t->newest) {
+                lru_unlink(t, e);
+                lru_push(t, e);
+            }
+            return e;
+        }
+
+    key = netsnmp_memdup(keybuf, key_len);
+    if (key == NULL)
+        return NULL;
+    if (t->count < (size_t) table_size) {
+        e = SNMP_MALLOC_TYPEDEF(suppress_entry);
+        if (e == NULL) {
+            free(key);
+            return NULL;
+        }
+        t->count++;
+    } else {
+        e = t->oldest;
+        for (ep = &t->buckets[e->hash & (t->nbuckets - 1)]; *ep != e;
+             ep = &(*ep)->hnext)
+            ;
+        *ep = e->hnext;
+        lru_unlink(t, e);
+        t->lost += e->suppressed;
+        free(e->key);
+        free(e->source);
+        free(e->trapOid);
+        memset(e, 0, sizeof(*e));
+    }
+    e->hash = hash;
+    e->key = key;
+    e->key_len = key_len;
+    e->source = source_string(key, pdu, transport);
+    e->hnext = t->buckets[hash & (t->nbuckets - 1)];
+    t->buckets[hash & (t->nbuckets - 1)] = e;
+    lru_push(t, e);
+    *created = 1;
+    return e;
+}
+
+static void
+suppress_summary_alarm(unsigned int clientreg, void *clientarg)
+{
+    netsnmp_trapd_suppress_log_summary();
+}
+
+/*
+ * Count a dropped notification, starting the summary timer if needed.
+ * Without summaries nothing is counted.
+ */
+static void
+count_suppressed(suppress_entry *e)
+{
+    if (!summary_interval)
+        return;
+    e->suppressed++;
+    if (!summary_alarm)
+        summary_alarm = snmp_alarm_register(summary_interval, SA_REPEAT,
+                                            suppress_summary_alarm, NULL);
+}
+
+static int
+is_duplicate(netsnmp_pdu *pdu, netsnmp_transport *transport,
+             oid *trapOid, int trapOidLen, const struct timeval *now)
+{
+    netsnmp_variable_list *vars;
+    suppress_entry *e;
+    size_t          len = 0;
+    int             i, created;
+
+    if (!key_add_source(&len, pdu) ||
+        !key_add(&len, trapOid, trapOidLen * sizeof(oid)))
+        return 0;
+    for (vars = pdu->variables; vars; vars = vars->next_variable) {
+        for (i = 0; i < dup_noids; i++)
+            if (netsnmp_oid_is_subtree(dup_oids[i], dup_oid_lens[i],
+                                       vars->name, vars->name_length) == 0)
+                break;
+        if (i == dup_noids)
+            continue;
+        if (!key_add(&len, &vars->name_length, sizeof(vars->name_length)) ||
+            !key_add(&len, vars->name, vars->name_length * sizeof(oid)) ||
+            !key_add(&len, &vars->type, sizeof(vars->type)) ||
+            !key_add(&len, &vars->val_len, sizeof(vars->val_len)) ||
+            (vars->val.string &&
+             !key_add(&len, vars->val.string, vars->val_len)))
+            return 0;
+    }
+
+    e = table_lookup(&dup_table, len, pdu, transport, &created);
+    if (e == NULL)
+        return 0;
+    if (created) {
+        e->trapOid = snmp_duplicate_objid(trapOid, trapOidLen);
+        e->trapOidLen = e->trapOid ? trapOidLen : 0;
+    } else if (now->tv_sec - e->last.tv_sec < dup_window) {
+        count_suppressed(e);
+        return 1;
+    }
+    e->last = *now;
+    return 0;
+}
+
+static int
+is_rate_limited(netsnmp_pdu *pdu, netsnmp_transport *transport,
+                const struct timeval *now)
+{
+    suppress_entry *e;
+    size_t          len = 0;
+    int             created;
+
+    if (!key_add_source(&len, pdu))
+        return 0;
+    e = table_lookup(&rate_table, len, pdu, transport, &created);
+    if (e == NULL)
+        return 0;
+    if (created)
+        e->tokens = rate_burst;
+    else {
+        e->tokens += rate_limit * ((now->tv_sec - e->last.tv_sec) +
+                                   (now->tv_usec - e->last.tv_usec) / 1e6);
+        if (e->tokens > rate_burst)
+            e->tokens = rate_burst;
+    }
+    e->last = *now;
+    if (e->tokens < 1) {
+        count_suppressed(e);
+        return 1;
+    }
+    e->tokens -= 1;
+    return 0;
+}
+
+/*
+ * Returns 1 if the notification is to be dropped: it duplicates one that
+ * was let through less than suppressDuplicates seconds ago, or its source
+ * has exceeded its suppressRate.  Duplicates are not charged to the rate.
+ */
+int
+netsnmp_trapd_suppressed(netsnmp_pdu *pdu, netsnmp_transport *transport,
+                         oid *trapOid, int trapOidLen)
+{
+    struct timeval  now;
+
+    if (!dup_window && !rate_limit)
+        return 0;
+    netsnmp_get_monotonic_clock(&now);
+    if (dup_window &&
+        is_duplicate(pdu, transport, trapOid, trapOidLen, &now)) {
+        DEBUGMSGTL(("snmptrapd:suppress", "duplicate dropped\n"));
+        return 1;
+    }
+    if (rate_limit && is_rate_limited(pdu, transport, &now)) {
+        DEBUGMSGTL(("snmptrapd:suppress", "rate limit exceeded\n"));
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * Log how many notifications were dropped since the last summary, per
+ * notification and source, and reset the counts.
+ */
+void
+netsnmp_trapd_suppress_log_summary(void)
+{
+    char            trap[SPRINT_MAX_LEN];
+    suppress_entry *e;
+
+    for (e = dup_table.newest; e; e = e->next) {
+        if (!e->suppressed)
+            continue;
+        snprint_objid(trap, sizeof(trap), e->trapOid, e->trapOidLen);
+        snmp_log(LOG_NOTICE, "suppressed %lu duplicate%s of %s from %s\n",
+                 e->suppressed, e->suppressed == 1 ? "" : "s", trap,
+                 e->source);
+        e->suppressed = 0;
+    }
+    for (e = rate_table.newest; e; e = e->next) {
+        if (!e->suppressed)
+            continue;
+        snmp_log(LOG_NOTICE, "suppressed %lu notification%s from %s "
+                 "(rate limit)\n", e->suppressed,
+                 e->suppressed == 1 ? "" : "s", e->source);
+        e->suppressed = 0;
+    }
+    if (dup_table.lost + rate_table.lost)
+        snmp_log(LOG_NOTICE, "suppressed %lu more notifications from "
+                 "sources no longer tracked\n",
+                 dup_table.lost + rate_table.lost);
+    dup_table.lost = rate_table.lost = 0;
+}
@@ -0,0 +1,15 @@
+#ifndef SNMPTRAPD_SUPPRESS_H
+#define SNMPTRAPD_SUPPRESS_H
+
+/*
+ * Trap storm suppression: duplicate notifications within a time window
+ * and notifications beyond a per-source rate are dropped before any
+ * handler runs, and counted in periodic summaries.  Main thread only.
+ */
+void            snmptrapd_suppress_register_configs(void);
+int             netsnmp_trapd_suppressed(netsnmp_pdu *pdu,
+                                         netsnmp_transport *transport,
+                                         oid *trapOid, int trapOidLen);
+void            netsnmp_trapd_suppress_log_summary(void);
+
+#endif                          /* SNMPTRAPD_SUPPRESS_H */
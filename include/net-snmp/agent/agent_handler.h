@@ -32,6 +32,12 @@ struct netsnmp_handler_registration_s;
 #define MIB_HANDLER_AUTO_NEXT                   0x00000001
 #define MIB_HANDLER_AUTO_NEXT_OVERRIDE_ONCE     0x00000002
 #define MIB_HANDLER_INSTANCE                    0x00000004
+/*
+ * handler can process GETBULK repetitions of a table as a batch of
+ * independent MODE_GET cell requests (see the table_container helper).
+ * Such handlers must not delegate requests.
+ */
+#define MIB_HANDLER_BULK_CELLS                  0x00000008
 
 #define MIB_HANDLER_CUSTOM4                     0x10000000
 #define MIB_HANDLER_CUSTOM3                     0x20000000
@@ -270,6 +276,8 @@ typedef int (Netsnmp_Node_Handler) (netsnmp_mib_handler *handler,
 
 #define REQUEST_IS_DELEGATED     1
 #define REQUEST_IS_NOT_DELEGATED 0
+/* delegated, and completed with netsnmp_request_completed() */
+#define REQUEST_IS_DELEGATED_NOTIFY 2
     void           
         netsnmp_handler_mark_requests_as_delegated(netsnmp_request_info *,
                                                    int);
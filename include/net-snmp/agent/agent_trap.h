@@ -52,6 +52,9 @@ void            snmpd_parse_config_trapcommunity(const char *, char *);
 void            snmpd_free_trapcommunity(void);
 void            send_trap_to_sess(netsnmp_session * sess,
                                   netsnmp_pdu *template_pdu);
+int             handle_inform_response(int op, netsnmp_session *session,
+                                       int reqid, netsnmp_pdu *pdu,
+                                       void *magic);
 
 int             create_trap_session(char *, u_short, char *, int, int);
 int             create_trap_session_with_src(const char *, const char *,
@@ -42,6 +42,7 @@
 #define NETSNMP_DS_AGENT_DISKIO_NO_RAM  20      /* 1 = don't report /dev/ram*  entries in diskIOTable */
 #define NETSNMP_DS_AGENT_DISKIO_NO_MD   21      /* 1 = don't report /dev/md*   entries in diskIOTable */
 #define NETSNMP_DS_AGENT_DISKIO_NO_NBD  22      /* 1 = don't report /dev/nbd*  entries in diskIOTable */
+#define NETSNMP_DS_AGENT_INTERNAL_DIRECT 23     /* 1 = answer internal queries in-process */
 
 /* WARNING: The trap receiver also uses DS flags and must not conflict with these!
  * If you define additional boolean entries, check in "apps/snmptrapd_ds.h" first */
@@ -79,4 +80,5 @@
 #define NETSNMP_DS_AGENT_AVG_BULKVARBINDSIZE 15 /* avg varbind size estimate */
 #define NETSNMP_DS_AGENT_PDU_STATS_MAX       16 /* size of top N array*/
 #define NETSNMP_DS_AGENT_PDU_STATS_THRESHOLD 17 /* minimum threshold time */
+#define NETSNMP_DS_AGENT_AGENTX_WINDOW  18     /* AgentX requests in progress */
 #endif
@@ -39,6 +39,11 @@ extern          "C" {
 
 #define SNMP_AGENT_FLAGS_NONE                   0x0
 #define SNMP_AGENT_FLAGS_CANCEL_IN_PROGRESS     0x1
+#define SNMP_AGENT_FLAGS_DIRECT                 0x2 /* internal query */
+#define SNMP_AGENT_FLAGS_DIRECT_DONE            0x4
+#define SNMP_AGENT_FLAGS_DELEGATED              0x8 /* on the delegated list */
+#define SNMP_AGENT_FLAGS_POLL_DELEGATED         0x10 /* checked on each pass */
+#define SNMP_AGENT_FLAGS_COMPLETED              0x20 /* queued for resumption */
 
     struct timeval;
 
@@ -216,6 +221,13 @@ extern          "C" {
         netsnmp_cachemap *cache_store;
         int             vbcount;
         int             flags;
+
+        /*
+         * delegated list neighbours, and the next session queued
+         * for resumption by netsnmp_request_completed()
+         */
+        struct netsnmp_agent_session_s *delegated_prev;
+        struct netsnmp_agent_session_s *completed_next;
     } netsnmp_agent_session;
 
     /*
@@ -242,9 +254,14 @@ extern          "C" {
     int             agent_check_and_process(int block);
     void            netsnmp_check_delegated_requests(void);
     void            netsnmp_check_outstanding_agent_requests(void);
+    int             netsnmp_agent_direct_query(netsnmp_session *,
+                                               netsnmp_variable_list *,
+                                               int, int *);
 
     int             netsnmp_request_set_error(netsnmp_request_info *request,
                                               int error_value);
+    void            netsnmp_request_delegate(netsnmp_request_info *request);
+    void            netsnmp_request_completed(netsnmp_request_info *request);
     int             netsnmp_check_requests_error(netsnmp_request_info *reqs);
     int             netsnmp_check_all_requests_error(netsnmp_agent_session *asp,
                                                      int look_for_specific);
@@ -469,6 +469,51 @@ extern "C" {
     netsnmp_container *SUBCONTAINER_FIND(netsnmp_container *x,
                                          const char* name);
 
+    /*
+     * merge a freshly loaded snapshot into a live container, keeping
+     * unchanged items in place. Both containers must be sorted.
+     */
+    typedef struct netsnmp_container_merge_ops_s {
+        /*
+         * item exists in both containers. update the live item from the
+         * fresh one; return non-zero if anything changed.
+         */
+        int    (*update)(void *live_item, void *fresh_item, void *ctx);
+
+        /*
+         * item only exists in the fresh container. return the item to
+         * insert into the live container (e.g. a row context wrapping
+         * the fresh item), or NULL to skip it.
+         */
+        void * (*add)(void *fresh_item, void *ctx);
+
+        /*
+         * item no longer exists; it has been removed from the live
+         * container and should be released.
+         */
+        void   (*remove)(void *live_item, void *ctx);
+
+        /*
+         * fresh item which was matched to a live item, and is no longer
+         * needed.
+         */
+        void   (*release)(void *fresh_item, void *ctx);
+    } netsnmp_container_merge_ops;
+
+    typedef struct netsnmp_container_merge_stats_s {
+        size_t  unchanged;
+        size_t  changed;
+        size_t  added;
+        size_t  deleted;
+    } netsnmp_container_merge_stats;
+
+    NETSNMP_IMPORT
+    int netsnmp_container_merge(netsnmp_container *live,
+                                netsnmp_container *fresh,
+                                const netsnmp_container_merge_ops *ops,
+                                void *ctx,
+                                netsnmp_container_merge_stats *stats);
+
     /*
      * INTERNAL utility routines for container implementations
      */
@@ -72,6 +72,19 @@ int             snmp_res_unlock(int groupID, int resourceID);
 NETSNMP_IMPORT
 int             snmp_res_destroy_mutex(int groupID, int resourceID);
 
+/*
+ * Mutexes that are not part of a lock group, e.g. one per session.  They
+ * are recursive, like the group locks.
+ */
+NETSNMP_IMPORT
+int             netsnmp_mutex_init(mutex_type *mutex);
+NETSNMP_IMPORT
+int             netsnmp_mutex_lock(mutex_type *mutex);
+NETSNMP_IMPORT
+int             netsnmp_mutex_unlock(mutex_type *mutex);
+NETSNMP_IMPORT
+int             netsnmp_mutex_destroy(mutex_type *mutex);
+
 #else /*  NETSNMP_REENTRANT  */
 
 #ifndef WIN32
@@ -79,10 +92,27 @@ int             snmp_res_destroy_mutex(int groupID, int resourceID);
 #define snmp_res_lock(x,y) do {} while (0)
 #define snmp_res_unlock(x,y) do {} while (0)
 #define snmp_res_destroy_mutex(x,y) do {} while (0)
+#define netsnmp_mutex_init(m) do {} while (0)
+#define netsnmp_mutex_lock(m) do {} while (0)
+#define netsnmp_mutex_unlock(m) do {} while (0)
+#define netsnmp_mutex_destroy(m) do {} while (0)
 #endif /*  WIN32  */
 
 #endif /*  NETSNMP_REENTRANT  */
 
+/*
+ * NETSNMP_ATOMIC_INC_LONG(p) atomically increments the long *p and returns
+ * the new value.  It is only defined when that can be done without a lock;
+ * callers fall back to a lock group otherwise.
+ */
+#if !defined(NETSNMP_REENTRANT) && !defined(WIN32)
+#define NETSNMP_ATOMIC_INC_LONG(p) (++*(p))
+#elif defined(__ATOMIC_RELAXED)
+#define NETSNMP_ATOMIC_INC_LONG(p) __atomic_add_fetch((p), 1, __ATOMIC_RELAXED)
+#elif defined(WIN32)
+#define NETSNMP_ATOMIC_INC_LONG(p) InterlockedIncrement((volatile LONG *)(p))
+#endif
+
 #ifdef __cplusplus
 }
 #endif
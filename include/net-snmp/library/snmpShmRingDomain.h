@@ -0,0 +1,58 @@
+#ifndef _SNMPSHMRINGDOMAIN_H
+#define _SNMPSHMRINGDOMAIN_H
+
+#ifdef NETSNMP_TRANSPORT_SHMRING_DOMAIN
+
+#if !defined(linux) && !defined(__linux__)
+    config_error(ShmRing transport requires Linux memfd and eventfd support);
+#endif
+
+#ifdef HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif
+#ifdef HAVE_SYS_UN_H
+#include <sys/un.h>
+#endif
+
+#include <net-snmp/library/snmp_transport.h>
+
+config_require(Unix);
+
+#ifdef __cplusplus
+extern          "C" {
+#endif
+
+/*
+ * Shared memory ring transport for local stream connections (typically
+ * AgentX).  A client connects to a Unix domain socket as usual and offers
+ * the server a pair of shared memory rings; if the server accepts, all
+ * further messages are exchanged through the rings, otherwise both ends
+ * keep using the socket.
+ */
+
+#define TRANSPORT_DOMAIN_SHMRING	1,3,6,1,4,1,8072,3,3,11
+NETSNMP_IMPORT const oid netsnmp_ShmRingDomain[];
+
+/*
+ * Size of each ring (one per direction).  Must be a power of two.
+ */
+#ifndef NETSNMP_SHMRING_SIZE
+#define NETSNMP_SHMRING_SIZE	(256 * 1024)
+#endif
+
+netsnmp_transport *netsnmp_shmring_transport(const struct sockaddr_un *addr,
+                                             int local);
+
+/*
+ * "Constructor" for transport domain object.
+ */
+
+void            netsnmp_shmring_ctor(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif                          /* NETSNMP_TRANSPORT_SHMRING_DOMAIN */
+
+#endif/*_SNMPSHMRINGDOMAIN_H*/
@@ -39,7 +39,10 @@ extern          "C" {
         struct timeval  t_nextM;
         void           *clientarg;
         SNMPAlarmCallback *thecallback;
+        /** Next alarm in the same clientreg hash bucket. */
         struct snmp_alarm *next;
+        /** Position in the alarm heap; -1 if not scheduled. */
+        int             heap_index;
     };
 
     /*
@@ -147,6 +147,7 @@ SOFTWARE.
 
 #define SNMP_DETAIL_SIZE        512
 
+#define SNMP_FLAGS_DIRECT_QUERY    0x4000     /* answer internal queries in-process */
 #define SNMP_FLAGS_TIME_CREATED    0x2000
 #define SNMP_FLAGS_SESSION_USER    0x1000
 #define SNMP_FLAGS_UDP_BROADCAST   0x800
@@ -379,6 +380,11 @@ SOFTWARE.
 
     NETSNMP_IMPORT
     u_char         *snmp_pdu_build(const netsnmp_pdu *, u_char *, size_t *);
+    NETSNMP_IMPORT
+    int             snmp_pdu_encode_varbinds(netsnmp_pdu *pdu);
+    NETSNMP_IMPORT
+    void            snmp_pdu_share_varbind_encoding(netsnmp_pdu *to,
+                                                    const netsnmp_pdu *from);
 #ifdef NETSNMP_USE_REVERSE_ASNENCODING
     NETSNMP_IMPORT
     u_char         *snmp_pdu_rbuild(const netsnmp_pdu *, u_char *, size_t *);
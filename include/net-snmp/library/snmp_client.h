@@ -88,9 +88,19 @@ extern          "C" {
     int             snmp_clone_mem(void **, const void *, unsigned);
 
 
+/*
+ * In-process handler for internal queries on SNMP_FLAGS_DIRECT_QUERY
+ * sessions: returns 1 with the error status in the last argument if it
+ * answered the query, or 0 to let it take the normal path.
+ */
+typedef int (netsnmp_query_direct)(netsnmp_session *,
+                                   netsnmp_variable_list *, int, int *);
+
 NETSNMP_IMPORT
 void              netsnmp_query_set_default_session(netsnmp_session *);
 NETSNMP_IMPORT
+void              netsnmp_query_set_direct_handler(netsnmp_query_direct *);
+NETSNMP_IMPORT
 void              netsnmp_query_shutdown(void);
 NETSNMP_IMPORT
 netsnmp_session * netsnmp_query_get_default_session_unchecked( void );
@@ -0,0 +1,124 @@
+#ifndef NET_SNMP_POLLER_H
+#define NET_SNMP_POLLER_H
+
+/**
+ * @file snmp_poller.h
+ *
+ * Poll a large number of SNMPv1/SNMPv2c agents from a single process.
+ *
+ * Unlike the session API, which needs one netsnmp_session (and hence one
+ * socket) per agent, a poller sends the requests for all of its targets
+ * through a small set of shared UDP sockets.  Responses are matched to
+ * their request through a hash table keyed on the request ID,
+ * retransmissions and timeouts are scheduled on a timer wheel, and the
+ * rate at which requests are sent can be limited both globally and per
+ * target.
+ */
+
+#ifdef HAVE_SYS_SELECT_H
+#include <sys/select.h>
+#endif
+
+#ifdef __cplusplus
+extern          "C" {
+#endif
+
+    typedef struct netsnmp_poller_s netsnmp_poller;
+    /** A target (agent); lives as long as the poller it was added to. */
+    typedef struct netsnmp_poller_target_s netsnmp_poller_target;
+
+    /**
+     * Called once for every request passed to netsnmp_poller_send().
+     *
+     * @param op       NETSNMP_CALLBACK_OP_RECEIVED_MESSAGE with the
+     *                 response in @p response, or
+     *                 NETSNMP_CALLBACK_OP_TIMED_OUT,
+     *                 NETSNMP_CALLBACK_OP_SEND_FAILED or (when the poller
+     *                 is freed with requests pending)
+     *                 NETSNMP_CALLBACK_OP_DISCONNECT with @p response NULL.
+     * @param target   Target the request was sent to.
+     * @param reqid    Request ID returned by netsnmp_poller_send().
+     * @param response Response PDU.  Owned by the poller.
+     * @param magic    Argument passed to netsnmp_poller_send().
+     */
+    typedef void    (netsnmp_poller_callback) (int op,
+                                               netsnmp_poller_target *target,
+                                               int reqid,
+                                               netsnmp_pdu *response,
+                                               void *magic);
+
+    /**
+     * Poller settings.  Zero means "no limit" for the limits and "use the
+     * default" for the other fields, except for retries, where zero means
+     * "do not retry" and a negative value selects the default.
+     */
+    typedef struct netsnmp_poller_config_s {
+        int             sockets;         /**< UDP sockets per address family */
+        int             max_inflight;    /**< outstanding requests in total */
+        int             rate;            /**< requests sent per second */
+        int             target_inflight; /**< outstanding requests per target
+                                          *   (default 1) */
+        int             target_interval; /**< minimum time between two
+                                          *   requests to one target (ms) */
+        long            timeout;         /**< default request timeout (us) */
+        int             retries;         /**< default number of retries
+                                          *   (< 0: library default) */
+    } netsnmp_poller_config;
+
+    typedef struct netsnmp_poller_stats_s {
+        u_long          sent;            /**< requests sent (first time) */
+        u_long          retries;         /**< retransmissions */
+        u_long          received;        /**< responses matched */
+        u_long          timeouts;        /**< requests that timed out */
+        u_long          send_failed;     /**< requests that could not be sent */
+        u_long          unmatched;       /**< packets that matched no request */
+    } netsnmp_poller_stats;
+
+    NETSNMP_IMPORT
+    netsnmp_poller *netsnmp_poller_create(const netsnmp_poller_config *config);
+    NETSNMP_IMPORT
+    void            netsnmp_poller_free(netsnmp_poller *poller);
+
+    NETSNMP_IMPORT
+    netsnmp_poller_target *netsnmp_poller_add_target(netsnmp_poller *poller,
+                                                     const char *peername,
+                                                     long version,
+                                                     const char *community,
+                                                     void *magic);
+    NETSNMP_IMPORT
+    const char     *netsnmp_poller_target_name(netsnmp_poller_target *target);
+    NETSNMP_IMPORT
+    void           *netsnmp_poller_target_magic(netsnmp_poller_target *target);
+    NETSNMP_IMPORT
+    void            netsnmp_poller_target_set_timeout(netsnmp_poller_target
+                                                      *target, long timeout,
+                                                      int retries);
+
+    NETSNMP_IMPORT
+    int             netsnmp_poller_send(netsnmp_poller *poller,
+                                        netsnmp_poller_target *target,
+                                        netsnmp_pdu *pdu,
+                                        netsnmp_poller_callback *callback,
+                                        void *magic);
+
+    NETSNMP_IMPORT
+    void            netsnmp_poller_select_info(netsnmp_poller *poller,
+                                               int *numfds, fd_set *fdset,
+                                               struct timeval *timeout,
+                                               int *block);
+    NETSNMP_IMPORT
+    void            netsnmp_poller_read(netsnmp_poller *poller,
+                                        fd_set *fdset);
+    NETSNMP_IMPORT
+    void            netsnmp_poller_timeout(netsnmp_poller *poller);
+    NETSNMP_IMPORT
+    int             netsnmp_poller_pending(netsnmp_poller *poller);
+    NETSNMP_IMPORT
+    int             netsnmp_poller_run(netsnmp_poller *poller);
+    NETSNMP_IMPORT
+    const netsnmp_poller_stats *netsnmp_poller_get_stats(netsnmp_poller *poller);
+
+#ifdef __cplusplus
+}
+#endif
+#endif                          /* NET_SNMP_POLLER_H */
@@ -333,6 +333,9 @@ extern          "C" {
 #ifdef NETSNMP_TRANSPORT_UNIX_DOMAIN
 #include <net-snmp/library/snmpUnixDomain.h>
 #endif
+#ifdef NETSNMP_TRANSPORT_SHMRING_DOMAIN
+#include <net-snmp/library/snmpShmRingDomain.h>
+#endif
 #ifdef NETSNMP_TRANSPORT_UDP_DOMAIN
 #include <net-snmp/library/snmpUDPDomain.h>
 #endif
@@ -244,6 +244,12 @@ typedef struct snmp_pdu {
     int             range_subid;
     
     void           *securityStateRef;
+
+    /**
+     * Encoded variable-bindings, shared by copies of a notification
+     * sent to several destinations; see snmp_pdu_encode_varbinds()
+     */
+    struct netsnmp_varbind_encoding_s *varbind_encoding;
 } netsnmp_pdu;
 
 
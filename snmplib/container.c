@@ -35,6 +35,7 @@ netsnmp_feature_child_of(container_compare, container_all);
 netsnmp_feature_child_of(container_dup, container_all);
 netsnmp_feature_child_of(container_free_all, container_all);
 netsnmp_feature_child_of(subcontainer_find, container_all);
+netsnmp_feature_child_of(container_merge, container_all);
 
 netsnmp_feature_child_of(container_ncompare_cstring, container_compare);
 netsnmp_feature_child_of(container_compare_mem, container_compare);
@@ -549,6 +550,209 @@ netsnmp_container *SUBCONTAINER_FIND(netsnmp_container *x,
 #endif /* NETSNMP_FEATURE_REMOVE_SUBCONTAINER_FIND */
 
 
+#ifndef NETSNMP_FEATURE_REMOVE_CONTAINER_MERGE
+/*
+ * grow a merge work list, if needed, so that it can hold one more item.
+ */
+static int
+_merge_list_add(void ***list, size_t *count, size_t *max, void *item)
+{
+    if (*count == *max) {
+        size_t new_max = *max ? *max * 2 : 16;
+        void **tmp = realloc(*list, new_max * sizeof(void *));
+        if (NULL == tmp)
+            return -1;
+        *list = tmp;
+        *max = new_max;
+    }
+    (*list)[(*count)++] = item;
+    return 0;
+}
+
+/**
+ * Merge a freshly loaded snapshot into a live container.
+ *
+ * Both containers must be sorted with compatible compare functions (the
+ * compare function of the live container is used to match items). Items
+ * present in both containers are kept in the live container, and the
+ * update callback is given a chance to copy changed fields from the
+ * fresh item. Items only present in the fresh container are inserted
+ * into the live container (all indexes), and items only present in the
+ * live container are removed from it.
+ *
+ * When this function returns, the fresh container is empty: each of its
+ * items has either been moved to the live container or released. The
+ * caller is still responsible for freeing the fresh container itself.
+ *
+ * @param live   container currently in use (e.g. by a table handler)
+ * @param fresh  container holding the newly loaded data
+ * @param ops    callbacks; NULL (or any NULL member) selects the defaults:
+ *               update - items are considered unchanged
+ *               add    - the fresh item itself is inserted
+ *               remove - live->free_item is called
+ *               release- fresh->free_item is called
+ * @param ctx    context passed to each callback
+ * @param stats  optional, filled with the number of items in each state
+ *
+ * @retval  0 success
+ * @retval -1 error (bad parameters, unsorted or iterator-less container,
+ *            or memory allocation failure). Neither container is modified.
+ */
+int
+netsnmp_container_merge(netsnmp_container *live, netsnmp_container *fresh,
+                        const netsnmp_container_merge_ops *ops, void *ctx,
+                        netsnmp_container_merge_stats *stats)
+{
+    netsnmp_container_merge_stats tmp_stats;
+    netsnmp_iterator *it_live, *it_fresh;
+    void           **deleted = NULL, **added = NULL, **matched = NULL;
+    size_t           deleted_count = 0, deleted_max = 0;
+    size_t           added_count = 0, added_max = 0;
+    size_t           matched_count = 0, matched_max = 0;
+    void            *lhs, *rhs;
+    size_t           i;
+    int              rc = 0, cmp;
+
+    if ((NULL == live) || (NULL == fresh) || (NULL == live->compare)) {
+        snmp_log(LOG_ERR, "netsnmp_container_merge called with bad params\n");
+        return -1;
+    }
+
+    /** always work on the primary containers */
+    while (live->prev)
+        live = live->prev;
+    while (fresh->prev)
+        fresh = fresh->prev;
+
+    if ((live->flags | fresh->flags) & CONTAINER_KEY_UNSORTED) {
+        snmp_log(LOG_ERR, "can't merge unsorted container '%s'\n",
+                 live->container_name ? live->container_name : "");
+        return -1;
+    }
+    if ((NULL == live->get_iterator) || (NULL == fresh->get_iterator)) {
+        snmp_log(LOG_ERR, "can't merge container '%s' without iterator\n",
+                 live->container_name ? live->container_name : "");
+        return -1;
+    }
+
+    if (NULL == stats)
+        stats = &tmp_stats;
+    memset(stats, 0x0, sizeof(*stats));
+
+    it_live = CONTAINER_ITERATOR(live);
+    it_fresh = CONTAINER_ITERATOR(fresh);
+    if ((NULL == it_live) || (NULL == it_fresh)) {
+        if (it_live)
+            ITERATOR_RELEASE(it_live);
+        if (it_fresh)
+            ITERATOR_RELEASE(it_fresh);
+        return -1;
+    }
+
+    /*
+     * walk both (sorted) containers in parallel, sorting items into
+     * deleted, added and matched lists. Nothing is modified until the
+     * walk is complete, so the iterators stay valid.
+     */
+    lhs = ITERATOR_FIRST(it_live);
+    rhs = ITERATOR_FIRST(it_fresh);
+    while ((0 == rc) && (lhs || rhs)) {
+        if (NULL == rhs)
+            cmp = -1;
+        else if (NULL == lhs)
+            cmp = 1;
+        else
+            cmp = live->compare(lhs, rhs);
+
+        if (cmp < 0) {
+            rc = _merge_list_add(&deleted, &deleted_count, &deleted_max, lhs);
+            lhs = ITERATOR_NEXT(it_live);
+        } else if (cmp > 0) {
+            rc = _merge_list_add(&added, &added_count, &added_max, rhs);
+            rhs = ITERATOR_NEXT(it_fresh);
+        } else {
+            rc = _merge_list_add(&matched, &matched_count, &matched_max, lhs);
+            if (0 == rc)
+                rc = _merge_list_add(&matched, &matched_count, &matched_max,
+                                     rhs);
+            lhs = ITERATOR_NEXT(it_live);
+            rhs = ITERATOR_NEXT(it_fresh);
+        }
+    }
+    ITERATOR_RELEASE(it_live);
+    ITERATOR_RELEASE(it_fresh);
+
+    if (rc) {
+        snmp_log(LOG_ERR, "malloc failed while merging container '%s'\n",
+                 live->container_name ? live->container_name : "");
+        goto out;
+    }
+
+    /*
+     * everything sorted out. empty the fresh container (without freeing
+     * any items), then apply the changes to the live container.
+     */
+    CONTAINER_CLEAR(fresh, NULL, NULL);
+
+    for (i = 0; i < matched_count; i += 2) {
+        if (ops && ops->update && ops->update(matched[i], matched[i + 1], ctx))
+            ++stats->changed;
+        else
+            ++stats->unchanged;
+        if (ops && ops->release)
+            ops->release(matched[i + 1], ctx);
+        else if (fresh->free_item)
+            fresh->free_item(matched[i + 1], NULL);
+    }
+
+    for (i = 0; i < deleted_count; ++i) {
+        CONTAINER_REMOVE(live, deleted[i]);
+        if (ops && ops->remove)
+            ops->remove(deleted[i], ctx);
+        else if (live->free_item)
+            live->free_item(deleted[i], NULL);
+        ++stats->deleted;
+    }
+
+    for (i = 0; i < added_count; ++i) {
+        void *item = added[i];
+
+        if (ops && ops->add)
+            item = ops->add(added[i], ctx);
+        if (NULL == item)
+            continue;
+        if (CONTAINER_INSERT(live, item) < 0) {
+            snmp_log(LOG_ERR, "insert failed while merging container '%s'\n",
+                     live->container_name ? live->container_name : "");
+            if (item != added[i]) {
+                if (ops->remove)
+                    ops->remove(item, ctx);
+                else if (live->free_item)
+                    live->free_item(item, NULL);
+            } else if (fresh->free_item)
+                fresh->free_item(item, NULL);
+            continue;
+        }
+        ++stats->added;
+    }
+
+    DEBUGMSGTL(("container:merge",
+                "'%s': %" NETSNMP_PRIz "d unchanged, %" NETSNMP_PRIz
+                "d changed, %" NETSNMP_PRIz "d added, %" NETSNMP_PRIz
+                "d deleted\n",
+                live->container_name ? live->container_name : "",
+                stats->unchanged, stats->changed, stats->added,
+                stats->deleted));
+
+  out:
+    free(deleted);
+    free(added);
+    free(matched);
+
+    return rc;
+}
+#endif /* NETSNMP_FEATURE_REMOVE_CONTAINER_MERGE */
+
 /*------------------------------------------------------------------
  */
 void
@@ -39,8 +39,8 @@ _mt_res(int groupID, int resourceID)
     return (&s_res[groupID][resourceID]);
 }
 
-static int
-snmp_res_init_mutex(mutex_type *mutex)
+int
+netsnmp_mutex_init(mutex_type *mutex)
 {
     int rc = 0;
 #ifdef HAVE_PTHREAD_H
@@ -68,7 +68,7 @@ snmp_res_init(void)
 	    if (!mutex) {
 		continue;
 	    }
-	    rc = snmp_res_init_mutex(mutex);
+	    rc = netsnmp_mutex_init(mutex);
 	}
     }
 
@@ -76,13 +76,9 @@ snmp_res_init(void)
 }
 
 int
-snmp_res_destroy_mutex(int groupID, int resourceID)
+netsnmp_mutex_destroy(mutex_type *mutex)
 {
     int rc = 0;
-    mutex_type *mutex = _mt_res(groupID, resourceID);
-    if (!mutex) {
-	return EFAULT;
-    }
 
 #ifdef HAVE_PTHREAD_H
     rc = pthread_mutex_destroy(mutex);
@@ -94,14 +90,9 @@ snmp_res_destroy_mutex(int groupID, int resourceID)
 }
 
 int
-snmp_res_lock(int groupID, int resourceID)
+netsnmp_mutex_lock(mutex_type *mutex)
 {
     int rc = 0;
-    mutex_type *mutex = _mt_res(groupID, resourceID);
-    
-    if (!mutex) {
-	return EFAULT;
-    }
 
 #ifdef HAVE_PTHREAD_H
     rc = pthread_mutex_lock(mutex);
@@ -113,14 +104,9 @@ snmp_res_lock(int groupID, int resourceID)
 }
 
 int
-snmp_res_unlock(int groupID, int resourceID)
+netsnmp_mutex_unlock(mutex_type *mutex)
 {
     int rc = 0;
-    mutex_type *mutex = _mt_res(groupID, resourceID);
-
-    if (!mutex) {
-	return EFAULT;
-    }
 
 #ifdef HAVE_PTHREAD_H
     rc = pthread_mutex_unlock(mutex);
@@ -131,6 +117,41 @@ snmp_res_unlock(int groupID, int resourceID)
     return rc;
 }
 
+int
+snmp_res_destroy_mutex(int groupID, int resourceID)
+{
+    mutex_type *mutex = _mt_res(groupID, resourceID);
+    if (!mutex) {
+	return EFAULT;
+    }
+
+    return netsnmp_mutex_destroy(mutex);
+}
+
+int
+snmp_res_lock(int groupID, int resourceID)
+{
+    mutex_type *mutex = _mt_res(groupID, resourceID);
+    
+    if (!mutex) {
+	return EFAULT;
+    }
+
+    return netsnmp_mutex_lock(mutex);
+}
+
+int
+snmp_res_unlock(int groupID, int resourceID)
+{
+    mutex_type *mutex = _mt_res(groupID, resourceID);
+
+    if (!mutex) {
+	return EFAULT;
+    }
+
+    return netsnmp_mutex_unlock(mutex);
+}
+
 #else  /*  NETSNMP_REENTRANT  */
 #ifdef WIN32
 
@@ -161,6 +182,30 @@ snmp_res_destroy_mutex(int groupID, int resourceID)
 {
     return 0;
 }
+
+int
+netsnmp_mutex_init(mutex_type *mutex)
+{
+    return 0;
+}
+
+int
+netsnmp_mutex_lock(mutex_type *mutex)
+{
+    return 0;
+}
+
+int
+netsnmp_mutex_unlock(mutex_type *mutex)
+{
+    return 0;
+}
+
+int
+netsnmp_mutex_destroy(mutex_type *mutex)
+{
+    return 0;
+}
 #endif /*  WIN32  */
 #endif /*  NETSNMP_REENTRANT  */
 
@@ -53,10 +53,154 @@
 #include <net-snmp/library/callback.h>
 #include <net-snmp/library/snmp_alarm.h>
 
-static struct snmp_alarm *thealarms = NULL;
+/*
+ * Alarms that are waiting to fire are kept in a binary min-heap ordered on
+ * t_nextM (ties are broken on clientreg, i.e. registration order), and all
+ * registered alarms in a hash table on clientreg.  Neither finding the next
+ * alarm nor looking one up has to walk the whole set.  An alarm whose
+ * callback is running (SA_FIRED) is not in the heap.
+ */
+static struct snmp_alarm **sa_heap = NULL;
+static int      sa_heap_len = 0;
+static int      sa_heap_size = 0;
+static struct snmp_alarm **sa_hash = NULL;
+static unsigned int sa_hash_size = 0;
+static unsigned int sa_count = 0;
+
 static int      start_alarms = 0;
 static unsigned int regnum = 1;
 
+#define SA_MIN_SIZE 64
+
+static int
+sa_before(const struct snmp_alarm *a, const struct snmp_alarm *b)
+{
+    if (a->t_nextM.tv_sec != b->t_nextM.tv_sec)
+        return a->t_nextM.tv_sec < b->t_nextM.tv_sec;
+    if (a->t_nextM.tv_usec != b->t_nextM.tv_usec)
+        return a->t_nextM.tv_usec < b->t_nextM.tv_usec;
+    return a->clientreg < b->clientreg;
+}
+
+static void
+sa_heap_sift_up(int i)
+{
+    struct snmp_alarm *a = sa_heap[i];
+    int             parent;
+
+    while (i > 0) {
+        parent = (i - 1) / 2;
+        if (!sa_before(a, sa_heap[parent]))
+            break;
+        sa_heap[i] = sa_heap[parent];
+        sa_heap[i]->heap_index = i;
+        i = parent;
+    }
+    sa_heap[i] = a;
+    a->heap_index = i;
+}
+
+static void
+sa_heap_sift_down(int i)
+{
+    struct snmp_alarm *a = sa_heap[i];
+    int             child;
+
+    while ((child = 2 * i + 1) < sa_heap_len) {
+        if (child + 1 < sa_heap_len &&
+            sa_before(sa_heap[child + 1], sa_heap[child]))
+            child++;
+        if (!sa_before(sa_heap[child], a))
+            break;
+        sa_heap[i] = sa_heap[child];
+        sa_heap[i]->heap_index = i;
+        i = child;
+    }
+    sa_heap[i] = a;
+    a->heap_index = i;
+}
+
+static void
+sa_heap_remove(struct snmp_alarm *a)
+{
+    struct snmp_alarm *last;
+    int             i = a->heap_index;
+
+    if (i < 0)
+        return;
+    a->heap_index = -1;
+    last = sa_heap[--sa_heap_len];
+    if (last == a)
+        return;
+    sa_heap[i] = last;
+    last->heap_index = i;
+    sa_heap_sift_up(i);
+    sa_heap_sift_down(last->heap_index);
+}
+
+/*
+ * (Re)position an alarm in the heap after its t_nextM changed.  The heap
+ * has room for every registered alarm (see snmp_alarm_register_hr()), so
+ * this cannot fail.
+ */
+static void
+sa_schedule(struct snmp_alarm *a)
+{
+    if (a->heap_index < 0) {
+        netsnmp_assert(sa_heap_len < sa_heap_size);
+        a->heap_index = sa_heap_len;
+        sa_heap[sa_heap_len++] = a;
+    }
+    sa_heap_sift_up(a->heap_index);
+    sa_heap_sift_down(a->heap_index);
+}
+
+static int
+sa_hash_add(struct snmp_alarm *a)
+{
+    struct snmp_alarm **newhash, *sa_ptr, *sa_next;
+    unsigned int    newsize, i;
+
+    if (sa_count >= sa_hash_size) {
+        newsize = sa_hash_size ? sa_hash_size * 2 : SA_MIN_SIZE;
+        newhash = calloc(newsize, sizeof(*newhash));
+        if (newhash == NULL)
+            return -1;
+        for (i = 0; i < sa_hash_size; i++) {
+            for (sa_ptr = sa_hash[i]; sa_ptr != NULL; sa_ptr = sa_next) {
+                sa_next = sa_ptr->next;
+                sa_ptr->next = newhash[sa_ptr->clientreg & (newsize - 1)];
+                newhash[sa_ptr->clientreg & (newsize - 1)] = sa_ptr;
+            }
+        }
+        free(sa_hash);
+        sa_hash = newhash;
+        sa_hash_size = newsize;
+    }
+    a->next = sa_hash[a->clientreg & (sa_hash_size - 1)];
+    sa_hash[a->clientreg & (sa_hash_size - 1)] = a;
+    sa_count++;
+    return 0;
+}
+
+static struct snmp_alarm *
+sa_hash_remove(unsigned int clientreg)
+{
+    struct snmp_alarm *sa_ptr, **prevNext;
+
+    if (sa_hash == NULL)
+        return NULL;
+    for (prevNext = &sa_hash[clientreg & (sa_hash_size - 1)];
+         (sa_ptr = *prevNext) != NULL; prevNext = &sa_ptr->next) {
+        if (sa_ptr->clientreg == clientreg) {
+            *prevNext = sa_ptr->next;
+            sa_count--;
+            return sa_ptr;
+        }
+    }
+    return NULL;
+}
+
 int
 init_alarm_post_config(int majorid, int minorid, void *serverarg,
                        void *clientarg)
@@ -95,14 +239,19 @@ sa_update_entry(struct snmp_alarm *a)
                 DEBUGMSGTL(("snmp_alarm",
                             "update_entry: illegal interval specified\n"));
                 snmp_alarm_unregister(a->clientreg);
+                return;
             }
         } else {
             /*
              * Single time call, remove it.  
              */
             snmp_alarm_unregister(a->clientreg);
+            return;
         }
     }
+
+    if (!(a->flags & SA_FIRED))
+        sa_schedule(a);
 }
 
 /**
@@ -121,16 +270,10 @@ sa_update_entry(struct snmp_alarm *a)
 void
 snmp_alarm_unregister(unsigned int clientreg)
 {
-    struct snmp_alarm *sa_ptr, **prevNext = &thealarms;
-
-    for (sa_ptr = thealarms;
-         sa_ptr != NULL && sa_ptr->clientreg != clientreg;
-         sa_ptr = sa_ptr->next) {
-        prevNext = &(sa_ptr->next);
-    }
+    struct snmp_alarm *sa_ptr = sa_hash_remove(clientreg);
 
     if (sa_ptr != NULL) {
-        *prevNext = sa_ptr->next;
+        sa_heap_remove(sa_ptr);
         DEBUGMSGTL(("snmp_alarm", "unregistered alarm %d\n", 
 		    sa_ptr->clientreg));
         /*
@@ -155,26 +298,29 @@ void
 snmp_alarm_unregister_all(void)
 {
   struct snmp_alarm *sa_ptr, *sa_tmp;
+  unsigned int i;
 
-  for (sa_ptr = thealarms; sa_ptr != NULL; sa_ptr = sa_tmp) {
-    sa_tmp = sa_ptr->next;
-    free(sa_ptr);
+  for (i = 0; i < sa_hash_size; i++) {
+    for (sa_ptr = sa_hash[i]; sa_ptr != NULL; sa_ptr = sa_tmp) {
+      sa_tmp = sa_ptr->next;
+      free(sa_ptr);
+    }
   }
   DEBUGMSGTL(("snmp_alarm", "ALL alarms unregistered\n"));
-  thealarms = NULL;
+  free(sa_hash);
+  sa_hash = NULL;
+  sa_hash_size = 0;
+  sa_count = 0;
+  free(sa_heap);
+  sa_heap = NULL;
+  sa_heap_size = 0;
+  sa_heap_len = 0;
 }  
 
 struct snmp_alarm *
 sa_find_next(void)
 {
-    struct snmp_alarm *a, *lowest = NULL;
-
-    for (a = thealarms; a != NULL; a = a->next)
-        if (!(a->flags & SA_FIRED)
-            && (lowest == NULL || timercmp(&a->t_nextM, &lowest->t_nextM, <)))
-            lowest = a;
-
-    return lowest;
+    return sa_heap_len ? sa_heap[0] : NULL;
 }
 
 NETSNMP_IMPORT struct snmp_alarm *sa_find_specific(unsigned int clientreg);
@@ -182,7 +328,11 @@ struct snmp_alarm *
 sa_find_specific(unsigned int clientreg)
 {
     struct snmp_alarm *sa_ptr;
-    for (sa_ptr = thealarms; sa_ptr != NULL; sa_ptr = sa_ptr->next) {
+
+    if (sa_hash == NULL)
+        return NULL;
+    for (sa_ptr = sa_hash[clientreg & (sa_hash_size - 1)]; sa_ptr != NULL;
+         sa_ptr = sa_ptr->next) {
         if (sa_ptr->clientreg == clientreg) {
             return sa_ptr;
         }
@@ -198,8 +348,8 @@ run_alarms(void)
     struct timeval  t_now;
 
     /*
-     * Loop through everything we have repeatedly looking for the next thing to
-     * call until all events are finally in the future again.  
+     * Keep calling the first alarm in the heap until all events are finally
+     * in the future again.
      */
 
     while ((a = sa_find_next()) != NULL) {
@@ -209,6 +359,7 @@ run_alarms(void)
             return;
 
         clientreg = a->clientreg;
+        sa_heap_remove(a);
         a->flags |= SA_FIRED;
         DEBUGMSGTL(("snmp_alarm", "run alarm %d\n", clientreg));
         (*(a->thecallback)) (clientreg, a->clientarg);
@@ -417,34 +568,51 @@ unsigned int
 snmp_alarm_register_hr(struct timeval t, unsigned int flags,
                        SNMPAlarmCallback * cb, void *cd)
 {
-    struct snmp_alarm **s = NULL;
+    struct snmp_alarm *s, **newheap;
+    unsigned int    clientreg;
+    int             newsize;
 
-    for (s = &(thealarms); *s != NULL; s = &((*s)->next));
+    /*
+     * Make sure the heap can hold every registered alarm, so that
+     * rescheduling one never needs to allocate.
+     */
+    if (sa_count >= (unsigned int) sa_heap_size) {
+        newsize = sa_heap_size ? sa_heap_size * 2 : SA_MIN_SIZE;
+        newheap = realloc(sa_heap, newsize * sizeof(*newheap));
+        if (newheap == NULL)
+            return 0;
+        sa_heap = newheap;
+        sa_heap_size = newsize;
+    }
 
-    *s = SNMP_MALLOC_STRUCT(snmp_alarm);
-    if (*s == NULL) {
+    s = SNMP_MALLOC_STRUCT(snmp_alarm);
+    if (s == NULL) {
         return 0;
     }
 
-    (*s)->t = t;
-    (*s)->flags = flags;
-    (*s)->clientarg = cd;
-    (*s)->thecallback = cb;
-    (*s)->clientreg = regnum++;
-    (*s)->next = NULL;
-
-    sa_update_entry(*s);
+    s->t = t;
+    s->flags = flags;
+    s->clientarg = cd;
+    s->thecallback = cb;
+    s->clientreg = clientreg = regnum++;
+    s->heap_index = -1;
+    if (sa_hash_add(s) < 0) {
+        free(s);
+        return 0;
+    }
 
     DEBUGMSGTL(("snmp_alarm",
                 "registered alarm %d, t = %ld.%03ld, flags=0x%02x\n",
-                (*s)->clientreg, (long) (*s)->t.tv_sec, (long)((*s)->t.tv_usec / 1000),
-                (*s)->flags));
+                s->clientreg, (long) s->t.tv_sec, (long)(s->t.tv_usec / 1000),
+                s->flags));
+
+    sa_update_entry(s);
 
     if (start_alarms) {
         set_an_alarm();
     }
 
-    return (*s)->clientreg;
+    return clientreg;
 }
 
 /**
@@ -471,6 +639,8 @@ snmp_alarm_reset(unsigned int clientreg)
         a->t_nextM.tv_sec = 0;
         a->t_nextM.tv_usec = 0;
         NETSNMP_TIMERADD(&t_now, &a->t, &a->t_nextM);
+        if (!(a->flags & SA_FIRED))
+            sa_schedule(a);
         return 0;
     }
     DEBUGMSGTL(("snmp_alarm_reset", "alarm %d not found\n",
@@ -188,10 +188,12 @@ static const oid default_enterprise[] = { 1, 3, 6, 1, 4, 1, 3, 1, 1 };
 #define DEFAULT_TIME	    0
 
 /*
- * A list of all the outstanding requests for a particular session.
+ * An outstanding request of a particular session.
  */
 typedef struct request_list {
-    struct request_list *next_request;
+    struct request_list *next_reqid;   /* next in request id hash chain */
+    struct request_list *next_msgid;   /* next in message id hash chain */
+    int             timeout_index;  /* position in the session timeout heap */
     long            request_id;     /* request id */
     long            message_id;     /* message id */
     netsnmp_callback callback;      /* user callback per request (NULL if unused) */
@@ -210,8 +212,21 @@ typedef struct request_list {
  * Internal information about the state of the snmp session.
  */
 struct snmp_internal_session {
-    netsnmp_request_list *requests;     /* Info about outstanding requests */
-    netsnmp_request_list *requestsEnd;  /* ptr to end of list */
+    /*
+     * Outstanding requests are hashed both on request id (to match
+     * SNMPv1/v2c and AgentX responses) and on message id (SNMPv3), and
+     * kept in a min-heap ordered on expiry time that drives retransmissions
+     * and timeouts.
+     */
+    netsnmp_request_list **requests_by_reqid;
+    netsnmp_request_list **requests_by_msgid;
+    unsigned int    request_hash_size;  /* buckets in each hash table */
+    netsnmp_request_list **timeouts;    /* heap of requests on expireM */
+    int             timeouts_size;      /* allocated heap entries */
+    int             nrequests;          /* number of outstanding requests */
+#if defined(NETSNMP_REENTRANT) || defined(WIN32)
+    mutex_type      lock;               /* protects the request tables */
+#endif
     int             (*hook_pre) (netsnmp_session *, netsnmp_transport *,
                                  void *, int);
     int             (*hook_parse) (netsnmp_session *, netsnmp_pdu *,
@@ -236,9 +251,19 @@ struct snmp_internal_session {
     size_t        opacket_len;  /* length of data */
 };
 
-static void
-remove_request(struct snmp_internal_session *isp,
-               netsnmp_request_list *orp, netsnmp_request_list *rp);
+static int      add_request(struct snmp_internal_session *isp,
+                            netsnmp_request_list *rp);
+static void     remove_request(struct snmp_internal_session *isp,
+                               netsnmp_request_list *rp);
+static netsnmp_request_list *
+                request_first_expiry(struct snmp_internal_session *isp,
+                                     const struct timeval *before);
+static void     request_set_message_id(struct snmp_internal_session *isp,
+                                       netsnmp_request_list *rp,
+                                       long message_id);
+static void     request_set_expiry(struct snmp_internal_session *isp,
+                                   netsnmp_request_list *rp,
+                                   const struct timeval *expire);
 
 /*
  * information about received packet
@@ -250,6 +275,15 @@ typedef struct snmp_rcv_packet_s {
     int       olength;
 } snmp_rcv_packet;
 
+/*
+ * encoded variable-bindings sequence, shared by reference between PDUs
+ */
+struct netsnmp_varbind_encoding_s {
+    u_char   *data;
+    size_t    len;
+    int       refcount;
+};
+
 static const char *api_errors[-SNMPERR_MAX + 1] = {
     "No error",                 /* SNMPERR_SUCCESS */
     "Generic error",            /* SNMPERR_GENERR */
@@ -368,7 +402,6 @@ static int      snmpv3_build(u_char ** pkt, size_t * pkt_len,
                              netsnmp_pdu *pdu);
 static int      snmp_parse_version(u_char *, size_t);
 static int      snmp_resend_request(struct session_list *slp,
-                                    netsnmp_request_list *orp,
                                     netsnmp_request_list *rp,
                                     int incr_retries);
 static void     register_default_handlers(void);
@@ -439,88 +472,62 @@ snmp_pdu_type(int type)
 #define DEBUGPRINTPDUTYPE(token, type) \
     DEBUGDUMPSECTION(token, snmp_pdu_type(type))
 
-long
-snmp_get_next_reqid(void)
+/*
+ * Return the next value of the ID counter *id, masked to 15 or 31 bits and
+ * never zero.  Without a lock-free increment the lock resource resourceID
+ * protects the counter.
+ */
+static long
+_snmp_get_next_id(long *id, int resourceID)
 {
-    long            retVal;
-    snmp_res_lock(MT_LIBRARY_ID, MT_LIB_REQUESTID);
-    retVal = 1 + Reqid;         /*MTCRITICAL_RESOURCE */
-    if (!retVal)
-        retVal = 2;
-    Reqid = retVal;
+    long            retVal, mask;
+
     if (netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_16BIT_IDS))
-        retVal &= 0x7fff;	/* mask to 15 bits */
+        mask = 0x7fff;          /* mask to 15 bits */
     else
-        retVal &= 0x7fffffff;	/* mask to 31 bits */
+        mask = 0x7fffffff;      /* mask to 31 bits */
 
+#ifdef NETSNMP_ATOMIC_INC_LONG
+    do {
+        retVal = NETSNMP_ATOMIC_INC_LONG(id) & mask;
+    } while (!retVal);
+#else
+    snmp_res_lock(MT_LIBRARY_ID, resourceID);
+    retVal = 1 + *id;           /*MTCRITICAL_RESOURCE */
+    if (!retVal)
+        retVal = 2;
+    *id = retVal;
+    retVal &= mask;
     if (!retVal) {
-        Reqid = retVal = 2;
+        *id = retVal = 2;
     }
-    snmp_res_unlock(MT_LIBRARY_ID, MT_LIB_REQUESTID);
+    snmp_res_unlock(MT_LIBRARY_ID, resourceID);
+#endif
     return retVal;
 }
 
 long
-snmp_get_next_msgid(void)
+snmp_get_next_reqid(void)
 {
-    long            retVal;
-    snmp_res_lock(MT_LIBRARY_ID, MT_LIB_MESSAGEID);
-    retVal = 1 + Msgid;         /*MTCRITICAL_RESOURCE */
-    if (!retVal)
-        retVal = 2;
-    Msgid = retVal;
-    if (netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_16BIT_IDS))
-        retVal &= 0x7fff;	/* mask to 15 bits */
-    else
-        retVal &= 0x7fffffff;	/* mask to 31 bits */
+    return _snmp_get_next_id(&Reqid, MT_LIB_REQUESTID);
+}
 
-    if (!retVal) {
-        Msgid = retVal = 2;
-    }
-    snmp_res_unlock(MT_LIBRARY_ID, MT_LIB_MESSAGEID);
-    return retVal;
+long
+snmp_get_next_msgid(void)
+{
+    return _snmp_get_next_id(&Msgid, MT_LIB_MESSAGEID);
 }
 
 long
 snmp_get_next_sessid(void)
 {
-    long            retVal;
-    snmp_res_lock(MT_LIBRARY_ID, MT_LIB_SESSIONID);
-    retVal = 1 + Sessid;        /*MTCRITICAL_RESOURCE */
-    if (!retVal)
-        retVal = 2;
-    Sessid = retVal;
-    if (netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_16BIT_IDS))
-        retVal &= 0x7fff;	/* mask to 15 bits */
-    else
-        retVal &= 0x7fffffff;	/* mask to 31 bits */
-
-    if (!retVal) {
-        Sessid = retVal = 2;
-    }
-    snmp_res_unlock(MT_LIBRARY_ID, MT_LIB_SESSIONID);
-    return retVal;
+    return _snmp_get_next_id(&Sessid, MT_LIB_SESSIONID);
 }
 
 long
 snmp_get_next_transid(void)
 {
-    long            retVal;
-    snmp_res_lock(MT_LIBRARY_ID, MT_LIB_TRANSID);
-    retVal = 1 + Transid;       /*MTCRITICAL_RESOURCE */
-    if (!retVal)
-        retVal = 2;
-    Transid = retVal;
-    if (netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_16BIT_IDS))
-        retVal &= 0x7fff;	/* mask to 15 bits */
-    else
-        retVal &= 0x7fffffff;	/* mask to 31 bits */
-
-    if (!retVal) {
-        Transid = retVal = 2;
-    }
-    snmp_res_unlock(MT_LIBRARY_ID, MT_LIB_TRANSID);
-    return retVal;
+    return _snmp_get_next_id(&Transid, MT_LIB_TRANSID);
 }
 
 void
@@ -1142,6 +1149,7 @@ _sess_copy(netsnmp_session * in_session)
         in_session->s_snmp_errno = SNMPERR_MALLOC;
         return (NULL);
     }
+    netsnmp_mutex_init(&isp->lock);
 
     slp->internal = isp;
     slp->session = netsnmp_memdup(in_session, sizeof(netsnmp_session));
@@ -2120,25 +2128,26 @@ snmp_sess_close(struct session_list *slp)
     slp->internal = NULL;
 
     if (isp) {
-        netsnmp_request_list *rp, *orp;
+        netsnmp_request_list *rp;
 
         SNMP_FREE(isp->packet);
 
         /*
-         * Free each element in the input request list.  
+         * Free each outstanding request, the first to expire first.
          */
-        rp = isp->requests;
-        while (rp) {
-            orp = rp;
-            rp = rp->next_request;
-            if (orp->callback) {
-                orp->callback(NETSNMP_CALLBACK_OP_TIMED_OUT,
-                              slp->session, orp->pdu->reqid,
-                              orp->pdu, orp->cb_data);
+        while ((rp = request_first_expiry(isp, NULL)) != NULL) {
+            if (rp->callback) {
+                rp->callback(NETSNMP_CALLBACK_OP_TIMED_OUT,
+                             slp->session, rp->pdu->reqid,
+                             rp->pdu, rp->cb_data);
             }
-            remove_request(isp, NULL, orp);
-            free(orp);
+            remove_request(isp, rp);
+            free(rp);
         }
+        SNMP_FREE(isp->requests_by_reqid);
+        SNMP_FREE(isp->requests_by_msgid);
+        SNMP_FREE(isp->timeouts);
+        netsnmp_mutex_destroy(&isp->lock);
 
         free(isp);
     }
@@ -3380,15 +3389,101 @@ snmp_build(u_char ** pkt, size_t * pkt_len, size_t * offset,
     return rc;
 }
 
+/*
+ * Build the variable-bindings sequence of a PDU at cp.
+ * On error, returns NULL (likely an encoding problem).
+ */
+static u_char  *
+snmp_pdu_build_varbinds(const netsnmp_pdu *pdu, u_char * cp,
+                        size_t * out_length)
+{
+    u_char         *h2, *h2e, *save_ptr;
+    netsnmp_variable_list *vp, *save_vp = NULL;
+    size_t          length, save_length;
+
+    length = *out_length;
+    /*
+     * Save current location and build SEQUENCE tag and length placeholder
+     * for variable-bindings sequence
+     * (actual length will be inserted later) 
+     */
+    h2 = cp;
+    cp = asn_build_sequence(cp, out_length,
+                            (u_char) (ASN_SEQUENCE | ASN_CONSTRUCTOR), 0);
+    if (cp == NULL)
+        return NULL;
+    h2e = cp;
+
+    /*
+     * Store variable-bindings 
+     */
+    DEBUGDUMPSECTION("send", "VarBindList");
+    for (vp = pdu->variables; vp; vp = vp->next_variable) {
+        /*
+         * if estimated getbulk response size exceeded packet max size,
+         * processing was stopped before bulk cache was filled and type
+         * was set to ASN_PRIV_STOP, indicating that the rest of the varbinds
+         * in the cache are empty and we can stop encoding them.
+         */
+        if (ASN_PRIV_STOP == vp->type)
+            break;
+
+        /*
+         * save current ptr and length so that if we exceed the packet length
+         * encoding this varbind and this is a bulk response, we can drop
+         * the failed varbind (and any that follow it) and continue encoding
+         * the (shorter) bulk response.
+         */
+        save_ptr = cp;
+        save_length = *out_length;
+
+        DEBUGDUMPSECTION("send", "VarBind");
+        cp = snmp_build_var_op(cp, vp->name, &vp->name_length, vp->type,
+                               vp->val_len, vp->val.string, out_length);
+        DEBUGINDENTLESS();
+        if (cp == NULL) {
+            if (save_vp && (pdu->flags & UCD_MSG_FLAG_BULK_TOOBIG)) {
+                DEBUGDUMPSECTION("send",
+                                 "VarBind would exceed packet size; dropped");
+                cp = save_ptr;
+                *out_length = save_length;
+                break;
+            } else
+                return NULL;
+        }
+        save_vp = vp;
+    }
+    DEBUGINDENTLESS();
+
+    /** did we run out of room? (should only happen for bulk responses) */
+    if (vp && save_vp) {
+        save_vp->next_variable = NULL; /* truncate variable list */
+        /** count remaining varbinds in list, then free them */
+        save_vp = vp;
+        for(save_length = 0; save_vp; save_vp = save_vp->next_variable)
+            ++save_length;
+        DEBUGMSGTL(("send", "trimmed %" NETSNMP_PRIz "d variables\n", save_length));
+        snmp_free_varbind(vp);
+    }
+
+    /*
+     * insert actual length of variable-bindings sequence 
+     */
+    asn_build_sequence(h2, &length,
+                       (u_char) (ASN_SEQUENCE | ASN_CONSTRUCTOR),
+                       cp - h2e);
+
+    return cp;
+}
+
 /*
  * on error, returns NULL (likely an encoding problem). 
  */
 u_char         *
 snmp_pdu_build(const netsnmp_pdu *pdu, u_char * cp, size_t * out_length)
 {
-    u_char         *h1, *h1e, *h2, *h2e, *save_ptr;
-    netsnmp_variable_list *vp, *save_vp = NULL;
-    size_t          length, save_length;
+    u_char         *h1, *h1e;
+    size_t          length;
 
     length = *out_length;
     /*
@@ -3512,76 +3607,22 @@ snmp_pdu_build(const netsnmp_pdu *pdu, u_char * cp, size_t * out_length)
     }
 
     /*
-     * Save current location and build SEQUENCE tag and length placeholder
-     * for variable-bindings sequence
-     * (actual length will be inserted later) 
+     * Store variable-bindings, or copy their shared encoding
      */
-    h2 = cp;
-    cp = asn_build_sequence(cp, out_length,
-                            (u_char) (ASN_SEQUENCE | ASN_CONSTRUCTOR), 0);
-    if (cp == NULL)
-        return NULL;
-    h2e = cp;
+    if (pdu->varbind_encoding) {
+        const struct netsnmp_varbind_encoding_s *enc = pdu->varbind_encoding;
 
-    /*
-     * Store variable-bindings 
-     */
-    DEBUGDUMPSECTION("send", "VarBindList");
-    for (vp = pdu->variables; vp; vp = vp->next_variable) {
-        /*
-         * if estimated getbulk response size exceeded packet max size,
-         * processing was stopped before bulk cache was filled and type
-         * was set to ASN_PRIV_STOP, indicating that the rest of the varbinds
-         * in the cache are empty and we can stop encoding them.
-         */
-        if (ASN_PRIV_STOP == vp->type)
-            break;
-
-        /*
-         * save current ptr and length so that if we exceed the packet length
-         * encoding this varbind and this is a bulk response, we can drop
-         * the failed varbind (and any that follow it) and continue encoding
-         * the (shorter) bulk response.
-         */
-        save_ptr = cp;
-        save_length = *out_length;
-
-        DEBUGDUMPSECTION("send", "VarBind");
-        cp = snmp_build_var_op(cp, vp->name, &vp->name_length, vp->type,
-                               vp->val_len, vp->val.string, out_length);
-        DEBUGINDENTLESS();
-        if (cp == NULL) {
-            if (save_vp && (pdu->flags & UCD_MSG_FLAG_BULK_TOOBIG)) {
-                DEBUGDUMPSECTION("send",
-                                 "VarBind would exceed packet size; dropped");
-                cp = save_ptr;
-                *out_length = save_length;
-                break;
-            } else
-                return NULL;
-        }
-        save_vp = vp;
-    }
-    DEBUGINDENTLESS();
-
-    /** did we run out of room? (should only happen for bulk responses) */
-    if (vp && save_vp) {
-        save_vp->next_variable = NULL; /* truncate variable list */
-        /** count remaining varbinds in list, then free them */
-        save_vp = vp;
-        for(save_length = 0; save_vp; save_vp = save_vp->next_variable)
-            ++save_length;
-        DEBUGMSGTL(("send", "trimmed %" NETSNMP_PRIz "d variables\n", save_length));
-        snmp_free_varbind(vp);
+        if (*out_length < enc->len)
+            return NULL;
+        memcpy(cp, enc->data, enc->len);
+        cp += enc->len;
+        *out_length -= enc->len;
+    } else {
+        cp = snmp_pdu_build_varbinds(pdu, cp, out_length);
+        if (cp == NULL)
+            return NULL;
     }
 
-    /*
-     * insert actual length of variable-bindings sequence 
-     */
-    asn_build_sequence(h2, &length,
-                       (u_char) (ASN_SEQUENCE | ASN_CONSTRUCTOR),
-                       cp - h2e);
-
     /*
      * insert actual length of PDU sequence 
      */
@@ -3592,11 +3633,12 @@ snmp_pdu_build(const netsnmp_pdu *pdu, u_char * cp, size_t * out_length)
 
 #ifdef NETSNMP_USE_REVERSE_ASNENCODING
 /*
- * On error, returns 0 (likely an encoding problem).  
+ * Build the variable-bindings sequence of a PDU in reverse.
+ * On error, returns 0 (likely an encoding problem).
  */
-int
-snmp_pdu_realloc_rbuild(u_char ** pkt, size_t * pkt_len, size_t * offset,
-                        const netsnmp_pdu *pdu)
+static int
+snmp_pdu_realloc_rbuild_varbinds(u_char ** pkt, size_t * pkt_len,
+                                 size_t * offset, const netsnmp_pdu *pdu)
 {
 #ifndef VPCACHE_SIZE
 #define VPCACHE_SIZE 50
@@ -3605,8 +3647,6 @@ snmp_pdu_realloc_rbuild(u_char ** pkt, size_t * pkt_len, size_t * offset,
     netsnmp_variable_list *vp, *tmpvp;
     size_t          start_offset = *offset;
     int             i, wrapped = 0, notdone, final, rc = 0;
-
-    DEBUGMSGTL(("snmp_pdu_realloc_rbuild", "starting\n"));
     for (vp = pdu->variables, i = VPCACHE_SIZE - 1; vp;
          vp = vp->next_variable, i--) {
         /*
@@ -3685,10 +3725,34 @@ snmp_pdu_realloc_rbuild(u_char ** pkt, size_t * pkt_len, size_t * offset,
      * variable-bindings sequence (actual length will be inserted later).  
      */
 
-    rc = asn_realloc_rbuild_sequence(pkt, pkt_len, offset, 1,
-                                     (u_char) (ASN_SEQUENCE |
-                                               ASN_CONSTRUCTOR),
-                                     *offset - start_offset);
+    return asn_realloc_rbuild_sequence(pkt, pkt_len, offset, 1,
+                                       (u_char) (ASN_SEQUENCE |
+                                                 ASN_CONSTRUCTOR),
+                                       *offset - start_offset);
+}
+
+/*
+ * On error, returns 0 (likely an encoding problem).  
+ */
+int
+snmp_pdu_realloc_rbuild(u_char ** pkt, size_t * pkt_len, size_t * offset,
+                        const netsnmp_pdu *pdu)
+{
+    size_t          start_offset = *offset;
+    int             rc = 0;
+
+    DEBUGMSGTL(("snmp_pdu_realloc_rbuild", "starting\n"));
+    if (pdu->varbind_encoding) {
+        const struct netsnmp_varbind_encoding_s *enc = pdu->varbind_encoding;
+
+        while ((*pkt_len - *offset) < enc->len) {
+            if (!asn_realloc(pkt, pkt_len))
+                return 0;
+        }
+        *offset += enc->len;
+        memcpy(*pkt + *pkt_len - *offset, enc->data, enc->len);
+    } else if (!snmp_pdu_realloc_rbuild_varbinds(pkt, pkt_len, offset, pdu))
+        return 0;
 
     /*
      * Store fields in the PDU preceding the variable-bindings sequence.
@@ -3818,6 +3882,105 @@ snmp_pdu_realloc_rbuild(u_char ** pkt, size_t * pkt_len, size_t * offset,
 }
 #endif                          /* NETSNMP_USE_REVERSE_ASNENCODING */
 
+static void
+_release_varbind_encoding(netsnmp_pdu *pdu)
+{
+    struct netsnmp_varbind_encoding_s *enc = pdu->varbind_encoding;
+
+    pdu->varbind_encoding = NULL;
+    if (enc && --enc->refcount == 0) {
+        free(enc->data);
+        free(enc);
+    }
+}
+
+/**
+ * Encode the variable-bindings of a PDU once, so that building it, or
+ * any copy given the encoding by snmp_pdu_share_varbind_encoding(),
+ * copies the encoded sequence instead of encoding every varbind again.
+ * This is meant for a notification sent to many destinations; the
+ * variables must not change afterwards.  The reference count is not
+ * locked, so PDUs sharing an encoding must belong to one thread.
+ *
+ * @param pdu [in]  PDU whose variables to encode.
+ *
+ * @returns 0 upon success; -1 upon failure.
+ */
+int
+snmp_pdu_encode_varbinds(netsnmp_pdu *pdu)
+{
+    struct netsnmp_varbind_encoding_s *enc;
+    u_char         *buf = NULL, *cp;
+    size_t          buf_len = 512, len = 0;
+
+    if (!pdu || (pdu->flags & UCD_MSG_FLAG_BULK_TOOBIG))
+        return -1;
+    if (pdu->varbind_encoding)
+        return 0;
+
+#ifdef NETSNMP_USE_REVERSE_ASNENCODING
+    if (netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID,
+                               NETSNMP_DS_LIB_REVERSE_ENCODE)) {
+        buf = malloc(buf_len);
+        if (!buf ||
+            !snmp_pdu_realloc_rbuild_varbinds(&buf, &buf_len, &len, pdu)) {
+            free(buf);
+            return -1;
+        }
+        memmove(buf, buf + buf_len - len, len);
+    } else
+#endif                          /* NETSNMP_USE_REVERSE_ASNENCODING */
+    {
+        for (;;) {
+            size_t          left = buf_len;
+
+            buf = malloc(buf_len);
+            if (!buf)
+                return -1;
+            cp = snmp_pdu_build_varbinds(pdu, buf, &left);
+            if (cp) {
+                len = cp - buf;
+                break;
+            }
+            free(buf);
+            if (buf_len >= 0x10000)
+                return -1;
+            buf_len *= 4;
+        }
+    }
+
+    enc = SNMP_MALLOC_TYPEDEF(struct netsnmp_varbind_encoding_s);
+    if (!enc) {
+        free(buf);
+        return -1;
+    }
+    enc->data = buf;
+    enc->len = len;
+    enc->refcount = 1;
+    pdu->varbind_encoding = enc;
+    DEBUGMSGTL(("snmp_pdu_encode_varbinds", "%" NETSNMP_PRIz "d bytes\n",
+                len));
+    return 0;
+}
+
+/**
+ * Let a PDU use the encoded variable-bindings of another one, which it
+ * must be a copy of.
+ *
+ * @param to   [in]  PDU to build with the encoding.
+ * @param from [in]  PDU encoded by snmp_pdu_encode_varbinds().
+ */
+void
+snmp_pdu_share_varbind_encoding(netsnmp_pdu *to, const netsnmp_pdu *from)
+{
+    if (!to || !from || to->varbind_encoding == from->varbind_encoding)
+        return;
+    _release_varbind_encoding(to);
+    to->varbind_encoding = from->varbind_encoding;
+    if (to->varbind_encoding)
+        ++to->varbind_encoding->refcount;
+}
+
 /*
  * Parses the packet received to determine version, either directly
  * from packets version field or inferred from ASN.1 construct.
@@ -5565,20 +5728,13 @@ _sess_async_send(struct session_list *slp,
         tv.tv_usec %= 1000000L;
         rp->expireM = tv;
 
-        /*
-         * XX lock should be per session ! 
-         */
-        snmp_res_lock(MT_LIBRARY_ID, MT_LIB_SESSION);
-        if (isp->requestsEnd) {
-            rp->next_request = isp->requestsEnd->next_request;
-            isp->requestsEnd->next_request = rp;
-            isp->requestsEnd = rp;
-        } else {
-            rp->next_request = isp->requests;
-            isp->requests = rp;
-            isp->requestsEnd = rp;
+        if (add_request(isp, rp) < 0) {
+            if (rp->cb_data_refcounted)
+                ((netsnmp_refcnt_void *) cb_data)->refcnt--;
+            free(rp);
+            session->s_snmp_errno = SNMPERR_MALLOC;
+            return 0;
         }
-        snmp_res_unlock(MT_LIBRARY_ID, MT_LIB_SESSION);
     } else {
         /*
          * No response expected...  
@@ -5697,6 +5853,7 @@ snmp_free_pdu(netsnmp_pdu *pdu)
     if (sptr && sptr->pdu_free)
         (*sptr->pdu_free)(pdu);
 
+    _release_varbind_encoding(pdu);
     snmp_free_varbind(pdu->variables);
     free(pdu->enterprise);
     free(pdu->community);
@@ -5868,17 +6025,206 @@ _sess_process_packet_parse_pdu(struct session_list *slp, netsnmp_session * sp,
   return pdu;
 }
 
-/* Remove request @rp from session @isp. @orp is the request before @rp. */
+#define REQUEST_HASH_MIN_SIZE   16
+#define REQUEST_HASH(isp, id)   ((u_long)(id) & ((isp)->request_hash_size - 1))
+
+static int
+request_expires_before(const netsnmp_request_list *a,
+                       const netsnmp_request_list *b)
+{
+    return timercmp(&a->expireM, &b->expireM, <);
+}
+
+/* Move the request at position @i of the timeout heap to its place. */
 static void
-remove_request(struct snmp_internal_session *isp,
-               netsnmp_request_list *orp, netsnmp_request_list *rp)
+request_timeout_sift(struct snmp_internal_session *isp, int i)
 {
-    if (orp)
-        orp->next_request = rp->next_request;
-    else
-        isp->requests = rp->next_request;
-    if (isp->requestsEnd == rp)
-        isp->requestsEnd = orp;
+    netsnmp_request_list *rp = isp->timeouts[i];
+    int             parent, child;
+
+    while (i > 0) {
+        parent = (i - 1) / 2;
+        if (!request_expires_before(rp, isp->timeouts[parent]))
+            break;
+        isp->timeouts[i] = isp->timeouts[parent];
+        isp->timeouts[i]->timeout_index = i;
+        i = parent;
+    }
+    while ((child = 2 * i + 1) < isp->nrequests) {
+        if (child + 1 < isp->nrequests &&
+            request_expires_before(isp->timeouts[child + 1],
+                                   isp->timeouts[child]))
+            child++;
+        if (!request_expires_before(isp->timeouts[child], rp))
+            break;
+        isp->timeouts[i] = isp->timeouts[child];
+        isp->timeouts[i]->timeout_index = i;
+        i = child;
+    }
+    isp->timeouts[i] = rp;
+    rp->timeout_index = i;
+}
+
+/* Resize both request hash tables of session @isp to @size buckets. */
+static int
+request_hash_resize(struct snmp_internal_session *isp, unsigned int size)
+{
+    netsnmp_request_list **by_reqid, **by_msgid, *rp, *next;
+    unsigned int    i, old_size = isp->request_hash_size;
+
+    by_reqid = calloc(size, sizeof(*by_reqid));
+    by_msgid = calloc(size, sizeof(*by_msgid));
+    if (by_reqid == NULL || by_msgid == NULL) {
+        free(by_reqid);
+        free(by_msgid);
+        return -1;
+    }
+
+    isp->request_hash_size = size;
+    for (i = 0; i < old_size; i++) {
+        for (rp = isp->requests_by_reqid[i]; rp; rp = next) {
+            next = rp->next_reqid;
+            rp->next_reqid = by_reqid[REQUEST_HASH(isp, rp->request_id)];
+            by_reqid[REQUEST_HASH(isp, rp->request_id)] = rp;
+        }
+        for (rp = isp->requests_by_msgid[i]; rp; rp = next) {
+            next = rp->next_msgid;
+            rp->next_msgid = by_msgid[REQUEST_HASH(isp, rp->message_id)];
+            by_msgid[REQUEST_HASH(isp, rp->message_id)] = rp;
+        }
+    }
+    free(isp->requests_by_reqid);
+    free(isp->requests_by_msgid);
+    isp->requests_by_reqid = by_reqid;
+    isp->requests_by_msgid = by_msgid;
+    return 0;
+}
+
+/*
+ * Add request @rp to the outstanding requests of session @isp.
+ *
+ * The request tables are protected by the session lock, so that sessions
+ * used from different threads never contend with each other.
+ */
+static int
+add_request(struct snmp_internal_session *isp, netsnmp_request_list *rp)
+{
+    netsnmp_request_list **timeouts;
+    netsnmp_request_list **bucket;
+    int             size;
+
+    netsnmp_mutex_lock(&isp->lock);
+    if (isp->nrequests == isp->timeouts_size) {
+        size = isp->timeouts_size ? 2 * isp->timeouts_size :
+            REQUEST_HASH_MIN_SIZE;
+        timeouts = realloc(isp->timeouts, size * sizeof(*timeouts));
+        if (timeouts == NULL) {
+            netsnmp_mutex_unlock(&isp->lock);
+            return -1;
+        }
+        isp->timeouts = timeouts;
+        isp->timeouts_size = size;
+    }
+    if (isp->nrequests >= (int) isp->request_hash_size &&
+        request_hash_resize(isp, isp->request_hash_size ?
+                            2 * isp->request_hash_size :
+                            REQUEST_HASH_MIN_SIZE) < 0 &&
+        isp->request_hash_size == 0) {
+        netsnmp_mutex_unlock(&isp->lock);
+        return -1;
+    }
+
+    /*
+     * Requests are added to the end of their hash chains so that, as
+     * before, the oldest of several requests with the same id is matched
+     * first.
+     */
+    for (bucket = &isp->requests_by_reqid[REQUEST_HASH(isp, rp->request_id)];
+         *bucket; bucket = &(*bucket)->next_reqid)
+        ;
+    rp->next_reqid = NULL;
+    *bucket = rp;
+    for (bucket = &isp->requests_by_msgid[REQUEST_HASH(isp, rp->message_id)];
+         *bucket; bucket = &(*bucket)->next_msgid)
+        ;
+    rp->next_msgid = NULL;
+    *bucket = rp;
+
+    rp->timeout_index = isp->nrequests;
+    isp->timeouts[isp->nrequests++] = rp;
+    request_timeout_sift(isp, rp->timeout_index);
+    netsnmp_mutex_unlock(&isp->lock);
+    return 0;
+}
+
+static void
+request_unlink_msgid(struct snmp_internal_session *isp,
+                     netsnmp_request_list *rp)
+{
+    netsnmp_request_list **bucket;
+
+    for (bucket = &isp->requests_by_msgid[REQUEST_HASH(isp, rp->message_id)];
+         *bucket; bucket = &(*bucket)->next_msgid) {
+        if (*bucket == rp) {
+            *bucket = rp->next_msgid;
+            break;
+        }
+    }
+}
+
+/* Change the message id of request @rp (e.g. when it is resent). */
+static void
+request_set_message_id(struct snmp_internal_session *isp,
+                       netsnmp_request_list *rp, long message_id)
+{
+    netsnmp_request_list **bucket;
+
+    netsnmp_mutex_lock(&isp->lock);
+    request_unlink_msgid(isp, rp);
+    rp->message_id = message_id;
+    for (bucket = &isp->requests_by_msgid[REQUEST_HASH(isp, message_id)];
+         *bucket; bucket = &(*bucket)->next_msgid)
+        ;
+    rp->next_msgid = NULL;
+    *bucket = rp;
+    netsnmp_mutex_unlock(&isp->lock);
+}
+
+/* Change the expiry time of request @rp. */
+static void
+request_set_expiry(struct snmp_internal_session *isp,
+                   netsnmp_request_list *rp, const struct timeval *expire)
+{
+    netsnmp_mutex_lock(&isp->lock);
+    rp->expireM = *expire;
+    request_timeout_sift(isp, rp->timeout_index);
+    netsnmp_mutex_unlock(&isp->lock);
+}
+
+/* Remove request @rp from session @isp. */
+static void
+remove_request(struct snmp_internal_session *isp, netsnmp_request_list *rp)
+{
+    netsnmp_request_list **bucket, *last;
+
+    netsnmp_mutex_lock(&isp->lock);
+    for (bucket = &isp->requests_by_reqid[REQUEST_HASH(isp, rp->request_id)];
+         *bucket; bucket = &(*bucket)->next_reqid) {
+        if (*bucket == rp) {
+            *bucket = rp->next_reqid;
+            break;
+        }
+    }
+    request_unlink_msgid(isp, rp);
+
+    last = isp->timeouts[--isp->nrequests];
+    if (last != rp) {
+        isp->timeouts[rp->timeout_index] = last;
+        last->timeout_index = rp->timeout_index;
+        request_timeout_sift(isp, last->timeout_index);
+    }
+    netsnmp_mutex_unlock(&isp->lock);
+
     if (rp->cb_data_refcounted) {
         netsnmp_refcnt_void *aux = (netsnmp_refcnt_void*) rp->cb_data;
         if (aux) {
@@ -5891,6 +6237,73 @@ remove_request(struct snmp_internal_session *isp,
     snmp_free_pdu(rp->pdu);
 }
 
+/*
+ * Find the outstanding request of session @isp that response @pdu answers,
+ * looking after request @rp if it is not NULL.  The request is only looked
+ * up under the session lock, as another thread may be adding requests, but
+ * it stays valid after that, since requests are only freed by the thread
+ * reading the session.
+ */
+static netsnmp_request_list *
+request_match(struct snmp_internal_session *isp, netsnmp_pdu *pdu,
+              netsnmp_request_list *rp)
+{
+    int             v3 = pdu->version == SNMP_VERSION_3;
+
+    netsnmp_mutex_lock(&isp->lock);
+    if (rp)
+        rp = v3 ? rp->next_msgid : rp->next_reqid;
+    else if (isp->request_hash_size == 0)
+        rp = NULL;
+    else if (v3)
+        rp = isp->requests_by_msgid[REQUEST_HASH(isp, pdu->msgid)];
+    else
+        rp = isp->requests_by_reqid[REQUEST_HASH(isp, pdu->reqid)];
+
+    for (; rp; rp = v3 ? rp->next_msgid : rp->next_reqid) {
+        if (v3) {
+            /*
+             * msgId must match for v3 messages.
+             */
+            if (rp->message_id != pdu->msgid) {
+                DEBUGMSGTL(("sess_process_packet",
+                            "unmatched msg id: %ld != %ld\n",
+                            rp->message_id, pdu->msgid));
+                continue;
+            }
+            /*
+             * Check that message fields match original, if not, no
+             * further processing.
+             */
+            if (!snmpv3_verify_msg(rp, pdu))
+                rp = NULL;
+            break;
+        }
+        if (rp->request_id == pdu->reqid)
+            break;
+    }
+    netsnmp_mutex_unlock(&isp->lock);
+    return rp;
+}
+
+/*
+ * The request of session @isp to expire first, if it expires before
+ * @before, or at all if @before is NULL.
+ */
+static netsnmp_request_list *
+request_first_expiry(struct snmp_internal_session *isp,
+                     const struct timeval *before)
+{
+    netsnmp_request_list *rp = NULL;
+
+    netsnmp_mutex_lock(&isp->lock);
+    if (isp->nrequests > 0 &&
+        (!before || timercmp(&isp->timeouts[0]->expireM, before, <)))
+        rp = isp->timeouts[0];
+    netsnmp_mutex_unlock(&isp->lock);
+    return rp;
+}
+
 /*
  * This function processes a PDU and calls the relevant callbacks.
  */
@@ -5899,7 +6312,7 @@ _sess_process_packet_handle_pdu(struct session_list *slp, netsnmp_session * sp,
                                 struct snmp_internal_session *isp,
                                 netsnmp_transport *transport, netsnmp_pdu *pdu)
 {
-  netsnmp_request_list *rp, *orp = NULL;
+  netsnmp_request_list *rp;
   int             handled = 0;
 
   if (pdu->flags & UCD_MSG_FLAG_RESPONSE_PDU) {
@@ -5908,33 +6321,11 @@ _sess_process_packet_handle_pdu(struct session_list *slp, netsnmp_session * sp,
      */
     free_securityStateRef(pdu);
 
-    for (rp = isp->requests; rp; orp = rp, rp = rp->next_request) {
+    for (rp = request_match(isp, pdu, NULL); rp;
+         rp = request_match(isp, pdu, rp)) {
       snmp_callback   callback;
       void           *magic;
 
-      if (pdu->version == SNMP_VERSION_3) {
-	/*
-	 * msgId must match for v3 messages.  
-	 */
-	if (rp->message_id != pdu->msgid) {
-            DEBUGMSGTL(("sess_process_packet", "unmatched msg id: %ld != %ld\n",
-                        rp->message_id, pdu->msgid));
-	    continue;
-	}
-
-	/*
-	 * Check that message fields match original, if not, no further
-	 * processing.  
-	 */
-	if (!snmpv3_verify_msg(rp, pdu)) {
-	  break;
-	}
-      } else {
-	if (rp->request_id != pdu->reqid) {
-	  continue;
-	}
-      }
-
       if (rp->callback) {
 	callback = rp->callback;
 	magic = rp->cb_data;
@@ -5944,11 +6335,6 @@ _sess_process_packet_handle_pdu(struct session_list *slp, netsnmp_session * sp,
       }
       handled = 1;
 
-      /*
-       * MTR snmp_res_lock(MT_LIBRARY_ID, MT_LIB_SESSION);  ?* XX lock
-       * should be per session ! 
-       */
-
       if (pdu->command == SNMP_MSG_REPORT) {
         if (sp->s_snmp_errno == SNMPERR_NOT_IN_TIME_WINDOW ||
             snmpv3_get_report_type(pdu) == SNMPERR_NOT_IN_TIME_WINDOW) {
@@ -5958,7 +6344,7 @@ _sess_process_packet_handle_pdu(struct session_list *slp, netsnmp_session * sp,
            * * inifinite resend                      
            */
           if (rp->retries <= sp->retries) {
-            snmp_resend_request(slp, orp, rp, TRUE);
+            snmp_resend_request(slp, rp, TRUE);
             break;
           } else {
             /* We're done with retries, so no longer waiting for a response */
@@ -6017,28 +6403,19 @@ _sess_process_packet_handle_pdu(struct session_list *slp, netsnmp_session * sp,
 	/*
 	 * Successful, so delete request.  
 	 */
-	remove_request(isp, orp, rp);
+	remove_request(isp, rp);
 	free(rp);
 	/*
 	 * There shouldn't be any more requests with the same reqid.  
 	 */
 	break;
       }
-      /*
-       * MTR snmp_res_unlock(MT_LIBRARY_ID, MT_LIB_SESSION);  ?* XX lock should be per session ! 
-       */
     }
   } else {
     if (sp->callback) {
-      /*
-       * MTR snmp_res_lock(MT_LIBRARY_ID, MT_LIB_SESSION); 
-       */
       handled = 1;
       sp->callback(NETSNMP_CALLBACK_OP_RECEIVED_MESSAGE,
 		   sp, pdu->reqid, pdu, sp->callback_magic);
-      /*
-       * MTR snmp_res_unlock(MT_LIBRARY_ID, MT_LIB_SESSION); 
-       */
     }
   }
 
@@ -6826,12 +7203,15 @@ snmp_sess_select_info2_flags(struct session_list *sessp, int *numfds,
         }
 
         NETSNMP_LARGE_FD_SET(slp->transport->sock, fdset);
-        if (slp->internal != NULL && slp->internal->requests) {
-            /*
-             * Found another session with outstanding requests.  
-             */
-            requests++;
-            for (rp = slp->internal->requests; rp; rp = rp->next_request) {
+        if (slp->internal != NULL) {
+            netsnmp_mutex_lock(&slp->internal->lock);
+            if (slp->internal->nrequests > 0) {
+                /*
+                 * Found another session with outstanding requests; the
+                 * first of its requests to expire is at the top of its heap.
+                 */
+                requests++;
+                rp = slp->internal->timeouts[0];
                 if (!timerisset(&earliest)
                     || (timerisset(&rp->expireM)
                         && timercmp(&rp->expireM, &earliest, <))) {
@@ -6840,6 +7220,7 @@ snmp_sess_select_info2_flags(struct session_list *sessp, int *numfds,
                                (int)earliest.tv_sec, (int)earliest.tv_usec));
                 }
             }
+            netsnmp_mutex_unlock(&slp->internal->lock);
         }
 
         active++;
@@ -6923,8 +7304,8 @@ snmp_timeout(void)
 }
 
 static int
-snmp_resend_request(struct session_list *slp, netsnmp_request_list *orp,
-                    netsnmp_request_list *rp, int incr_retries)
+snmp_resend_request(struct session_list *slp, netsnmp_request_list *rp,
+                    int incr_retries)
 {
     struct snmp_internal_session *isp;
     netsnmp_session *sp;
@@ -6939,13 +7320,13 @@ snmp_resend_request(struct session_list *slp, netsnmp_request_list *orp,
     transport = slp->transport;
     if (!sp || !isp || !transport) {
         DEBUGMSGTL(("sess_read", "resend fail: closing...\n"));
-        return 0;
+        return -1;
     }
 
     if ((pktbuf = (u_char *)malloc(2048)) == NULL) {
         DEBUGMSGTL(("sess_resend",
                     "couldn't malloc initial packet buffer\n"));
-        return 0;
+        return -1;
     } else {
         pktbuf_len = 2048;
     }
@@ -6957,7 +7338,8 @@ snmp_resend_request(struct session_list *slp, netsnmp_request_list *orp,
     /*
      * Always increment msgId for resent messages.  
      */
-    rp->pdu->msgid = rp->message_id = snmp_get_next_msgid();
+    rp->pdu->msgid = snmp_get_next_msgid();
+    request_set_message_id(isp, rp, rp->pdu->msgid);
 
     result = netsnmp_build_packet(isp, sp, rp->pdu, &pktbuf, &pktbuf_len,
                                   &packet, &length);
@@ -6994,7 +7376,7 @@ snmp_resend_request(struct session_list *slp, netsnmp_request_list *orp,
         if (rp->callback) {
             rp->callback(NETSNMP_CALLBACK_OP_SEND_FAILED, sp,
                          rp->pdu->reqid, rp->pdu, rp->cb_data);
-            remove_request(isp, orp, rp);
+            remove_request(isp, rp);
             free(rp);
 	}
         return -1;
@@ -7005,7 +7387,7 @@ snmp_resend_request(struct session_list *slp, netsnmp_request_list *orp,
         tv.tv_usec += rp->timeout;
         tv.tv_sec += tv.tv_usec / 1000000L;
         tv.tv_usec %= 1000000L;
-        rp->expireM = tv;
+        request_set_expiry(isp, rp, &tv);
         if (rp->callback)
             rp->callback(NETSNMP_CALLBACK_OP_RESEND, sp,
                          rp->pdu->reqid, rp->pdu, rp->cb_data);
@@ -7020,7 +7402,7 @@ snmp_sess_timeout(struct session_list *slp)
 {
     netsnmp_session *sp;
     struct snmp_internal_session *isp;
-    netsnmp_request_list *rp, *orp = NULL, *freeme = NULL;
+    netsnmp_request_list *rp;
     struct timeval  now;
     snmp_callback   callback;
     void           *magic;
@@ -7036,60 +7418,44 @@ snmp_sess_timeout(struct session_list *slp)
     netsnmp_get_monotonic_clock(&now);
 
     /*
-     * For each request outstanding, check to see if it has expired.
+     * Handle the expired requests, the first to expire first.  Resent
+     * requests expire after now, so each request is handled once.
      */
-    for (rp = isp->requests; rp; rp = rp->next_request) {
-        if (freeme != NULL) {
+    while ((rp = request_first_expiry(isp, &now)) != NULL) {
+        if ((sptr = find_sec_mod(rp->pdu->securityModel)) != NULL &&
+            sptr->pdu_timeout != NULL) {
             /*
-             * frees rp's after the for loop goes on to the next_request 
+             * call security model if it needs to know about this 
              */
-            free(freeme);
-            freeme = NULL;
+            (*sptr->pdu_timeout) (rp->pdu);
         }
 
-        if ((timercmp(&rp->expireM, &now, <))) {
-            if ((sptr = find_sec_mod(rp->pdu->securityModel)) != NULL &&
-                sptr->pdu_timeout != NULL) {
-                /*
-                 * call security model if it needs to know about this 
-                 */
-                (*sptr->pdu_timeout) (rp->pdu);
+        /*
+         * this timer has expired 
+         */
+        if (rp->retries >= sp->retries) {
+            if (rp->callback) {
+                callback = rp->callback;
+                magic = rp->cb_data;
+            } else {
+                callback = sp->callback;
+                magic = sp->callback_magic;
             }
 
             /*
-             * this timer has expired 
+             * No more chances, delete this entry 
              */
-            if (rp->retries >= sp->retries) {
-                if (rp->callback) {
-                    callback = rp->callback;
-                    magic = rp->cb_data;
-                } else {
-                    callback = sp->callback;
-                    magic = sp->callback_magic;
-                }
-
-                /*
-                 * No more chances, delete this entry 
-                 */
-                if (callback) {
-                    callback(NETSNMP_CALLBACK_OP_TIMED_OUT, sp,
-                             rp->pdu->reqid, rp->pdu, magic);
-                }
-                remove_request(isp, orp, rp);
-                freeme = rp;
-                continue;       /* don't update orp below */
-            } else {
-                if (snmp_resend_request(slp, orp, rp, TRUE)) {
-                    break;
-                }
+            if (callback) {
+                callback(NETSNMP_CALLBACK_OP_TIMED_OUT, sp,
+                         rp->pdu->reqid, rp->pdu, magic);
+            }
+            remove_request(isp, rp);
+            free(rp);
+        } else {
+            if (snmp_resend_request(slp, rp, TRUE)) {
+                break;
             }
         }
-        orp = rp;
-    }
-
-    if (freeme != NULL) {
-        free(freeme);
-        freeme = NULL;
     }
 }
 
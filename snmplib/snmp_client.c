@@ -382,6 +382,7 @@ _clone_pdu_header(netsnmp_pdu *pdu)
     newpdu->contextName = NULL;
     newpdu->transport_data = NULL;
     newpdu->securityStateRef = NULL;
+    newpdu->varbind_encoding = NULL;
 
     /*
      * copy buffers individually. If any copy fails, all are freed. 
@@ -1240,6 +1241,7 @@ snmp_errstring(int errstat)
 #include <net-snmp/library/snmp_debug.h>
 
 static netsnmp_session *_def_query_session = NULL;
+static netsnmp_query_direct *_direct_query = NULL;
 
 #ifndef NETSNMP_FEATURE_REMOVE_QUERY_SET_DEFAULT_SESSION
 void
@@ -1249,6 +1251,16 @@ netsnmp_query_set_default_session( netsnmp_session *sess) {
 }
 #endif /* NETSNMP_FEATURE_REMOVE_QUERY_SET_DEFAULT_SESSION */
 
+/*
+ * Install the routine answering queries on SNMP_FLAGS_DIRECT_QUERY
+ * sessions without going through the session transport.
+ */
+void
+netsnmp_query_set_direct_handler( netsnmp_query_direct *fn) {
+    DEBUGMSGTL(("iquery", "set direct handler %p\n", fn));
+    _direct_query = fn;
+}
+
 void
 netsnmp_query_shutdown(void) {
     if (_def_query_session) {
@@ -1309,6 +1321,14 @@ static int _query(netsnmp_variable_list *list,
         return SNMP_ERR_GENERR;
     }
 
+    if ( !session )
+        session = _def_query_session;
+    if ( session && (session->flags & SNMP_FLAGS_DIRECT_QUERY) &&
+         _direct_query && (*_direct_query)( session, list, request, &ret )) {
+        DEBUGMSGTL(("iquery", "direct query returned %d\n", ret));
+        return ret;
+    }
+
     pdu = snmp_pdu_create( request );
     if (NULL == pdu) {
         snmp_log(LOG_ERR, "could not allocate pdu\n");
@@ -1329,9 +1349,7 @@ static int _query(netsnmp_variable_list *list,
 retry:
 #endif
     if ( session )
-        ret = snmp_synch_response(            session, pdu, &response );
-    else if (_def_query_session)
-        ret = snmp_synch_response( _def_query_session, pdu, &response );
+        ret = snmp_synch_response( session, pdu, &response );
     else {
         /* No session specified */
         snmp_free_pdu(pdu);
@@ -0,0 +1,1033 @@
+/*
+ * snmp_poller.c: poll many SNMPv1/SNMPv2c agents over shared sockets.
+ *
+ * The session API binds one transport (and socket) to every agent, and
+ * snmp_read()/snmp_timeout() walk the list of all sessions and of all
+ * their outstanding requests.  That works for tens of agents but not for
+ * a collector polling hundreds of thousands of them.  A poller instead
+ *
+ *  - sends the requests for all targets through a few shared unconnected
+ *    UDP sockets (per address family),
+ *  - matches responses to requests through a hash table keyed on the
+ *    request ID (the source address and version must match as well),
+ *  - schedules retransmissions, timeouts and deferred sends on a timer
+ *    wheel, so that neither depends on the number of requests pending,
+ *  - limits the number of outstanding requests and the send rate, both in
+ *    total and per target.
+ *
+ * Requests are encoded once, when they are submitted; retransmissions
+ * resend the same packet.  Only the community based versions are
+ * supported: SNMPv3 needs per-target engine ID discovery and security
+ * state, which is what netsnmp_session is for.
+ */
+#include <net-snmp/net-snmp-config.h>
+
+#include <stdio.h>
+#include <errno.h>
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#else
+#include <strings.h>
+#endif
+#include <sys/types.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif
+#ifdef HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#endif
+#ifdef HAVE_SYS_SELECT_H
+#include <sys/select.h>
+#endif
+
+#include <net-snmp/types.h>
+#include <net-snmp/output_api.h>
+#include <net-snmp/pdu_api.h>
+#include <net-snmp/session_api.h>
+#include <net-snmp/library/snmp_api.h>
+#include <net-snmp/library/snmp.h>
+#include <net-snmp/library/snmp_impl.h>
+#include <net-snmp/library/asn1.h>
+#include <net-snmp/library/tools.h>
+#include <net-snmp/library/default_store.h>
+#include <net-snmp/library/snmpSocketBaseDomain.h>
+#include <net-snmp/library/snmpIPv4BaseDomain.h>
+#ifdef NETSNMP_TRANSPORT_UDPIPV6_DOMAIN
+#include <net-snmp/library/snmpIPv6BaseDomain.h>
+#endif
+#include <net-snmp/library/snmp_poller.h>
+
+#define POLLER_MAX_SOCKETS	64
+#define POLLER_RCVBUF		(4 * 1024 * 1024)
+#define POLLER_READ_BATCH	256     /* packets per socket per read call */
+
+/*
+ * Timer wheel: POLLER_WHEEL_SLOTS slots of POLLER_TICK ms each.  Timers
+ * further away than one revolution simply stay in their slot until the
+ * wheel has come round often enough.
+ */
+#define POLLER_TICK		10
+#define POLLER_WHEEL_SLOTS	1024
+#define POLLER_WHEEL_MASK	(POLLER_WHEEL_SLOTS - 1)
+
+#define TIMER_IDLE		0
+#define TIMER_REQUEST		1
+#define TIMER_TARGET		2
+
+#define TARGET_READY		0x01    /* on the ready list */
+
+#define AF_IDX_INET		0
+#define AF_IDX_INET6		1
+
+typedef struct poller_timer_s {
+    struct poller_timer_s *prev, *next;
+    u_long          expire;     /* tick */
+    int             kind;
+} poller_timer;
+
+/*
+ * The timer must be the first member of both structures below, so that
+ * a timer can be converted back to its request or target.
+ */
+typedef struct netsnmp_poller_req_s {
+    poller_timer    timer;
+    struct netsnmp_poller_req_s *hash_next;
+    struct netsnmp_poller_req_s *queue_next;
+    netsnmp_poller_target *target;
+    long            reqid;
+    u_char         *packet;
+    size_t          packet_len;
+    int             tries_left;
+    netsnmp_poller_callback *callback;
+    void           *magic;
+} netsnmp_poller_req;
+
+struct netsnmp_poller_target_s {
+    poller_timer    timer;
+    netsnmp_poller_target *next;        /* all targets */
+    netsnmp_poller_target *next_ready;
+    char           *peername;
+    void           *magic;
+    long            version;
+    u_char         *community;
+    size_t          community_len;
+    long            timeout;    /* us */
+    int             retries;
+    union {
+        struct sockaddr     sa;
+        struct sockaddr_in  sin;
+#ifdef NETSNMP_TRANSPORT_UDPIPV6_DOMAIN
+        struct sockaddr_in6 sin6;
+#endif
+    }               addr;
+    socklen_t       addr_len;
+    int             af_idx;
+    int             flags;
+    int             inflight;
+    u_long          next_send;  /* ms */
+    netsnmp_poller_req *queue_head, *queue_tail;
+};
+
+struct netsnmp_poller_s {
+    netsnmp_poller_config config;
+    int             socks[2][POLLER_MAX_SOCKETS];
+    int             nsocks[2];
+    int             next_sock[2];
+
+    netsnmp_poller_req **hash;
+    size_t          hash_size;  /* power of two */
+    size_t          hash_count;
+
+    poller_timer   *wheel[POLLER_WHEEL_SLOTS];
+    u_long          wheel_tick;
+    int             ntimers;
+
+    netsnmp_poller_target *targets;
+    netsnmp_poller_target *ready_head, *ready_tail;
+    int             inflight;
+    int             queued;
+
+    long            credit;     /* rate limit, 1000 per request */
+    long            credit_max;
+    u_long          credit_time;
+
+    struct timeval  epoch;
+    u_char         *txbuf, *rxbuf;
+    size_t          txbuf_len, rxbuf_len;
+    netsnmp_session build_sess, parse_sess;
+    netsnmp_poller_stats stats;
+};
+
+static u_long
+_poller_now(netsnmp_poller *p)
+{
+    struct timeval  now, diff;
+
+    netsnmp_get_monotonic_clock(&now);
+    NETSNMP_TIMERSUB(&now, &p->epoch, &diff);
+    return diff.tv_sec * 1000 + diff.tv_usec / 1000;
+}
+
+/*
+ * timer wheel
+ */
+
+static void
+_timer_del(netsnmp_poller *p, poller_timer *t)
+{
+    if (t->kind == TIMER_IDLE)
+        return;
+    if (t->prev)
+        t->prev->next = t->next;
+    else
+        p->wheel[t->expire & POLLER_WHEEL_MASK] = t->next;
+    if (t->next)
+        t->next->prev = t->prev;
+    t->prev = t->next = NULL;
+    t->kind = TIMER_IDLE;
+    p->ntimers--;
+}
+
+static void
+_timer_add(netsnmp_poller *p, poller_timer *t, int kind, u_long now,
+           u_long delay)
+{
+    poller_timer  **slot;
+
+    _timer_del(p, t);
+    t->expire = (now + delay + POLLER_TICK - 1) / POLLER_TICK;
+    if (t->expire <= p->wheel_tick)
+        t->expire = p->wheel_tick + 1;
+    t->kind = kind;
+    slot = &p->wheel[t->expire & POLLER_WHEEL_MASK];
+    t->prev = NULL;
+    t->next = *slot;
+    if (*slot)
+        (*slot)->prev = t;
+    *slot = t;
+    p->ntimers++;
+}
+
+/*
+ * Milliseconds until the first non-empty slot, or -1 if there are no
+ * timers at all.
+ */
+static long
+_timer_next(netsnmp_poller *p, u_long now)
+{
+    u_long          tick;
+    long            delay;
+
+    if (p->ntimers == 0)
+        return -1;
+    for (tick = p->wheel_tick + 1;
+         tick <= p->wheel_tick + POLLER_WHEEL_SLOTS; tick++)
+        if (p->wheel[tick & POLLER_WHEEL_MASK])
+            break;
+    delay = (long) (tick * POLLER_TICK) - (long) now;
+    return delay > 0 ? delay : 0;
+}
+
+/*
+ * hash table of outstanding requests
+ */
+
+static size_t
+_hash_slot(netsnmp_poller *p, long reqid)
+{
+    return ((u_long) reqid * 2654435761UL) & (p->hash_size - 1);
+}
+
+static void
+_hash_grow(netsnmp_poller *p)
+{
+    netsnmp_poller_req **old = p->hash, *req, *next;
+    size_t          old_size = p->hash_size, i;
+
+    p->hash = (netsnmp_poller_req **) calloc(old_size * 2,
+                                             sizeof(*p->hash));
+    if (p->hash == NULL) {
+        p->hash = old;          /* just get longer chains */
+        return;
+    }
+    p->hash_size = old_size * 2;
+    for (i = 0; i < old_size; i++) {
+        for (req = old[i]; req; req = next) {
+            size_t          slot = _hash_slot(p, req->reqid);
+
+            next = req->hash_next;
+            req->hash_next = p->hash[slot];
+            p->hash[slot] = req;
+        }
+    }
+    free(old);
+}
+
+static void
+_hash_add(netsnmp_poller *p, netsnmp_poller_req *req)
+{
+    size_t          slot;
+
+    if (p->hash_count >= p->hash_size * 2)
+        _hash_grow(p);
+    slot = _hash_slot(p, req->reqid);
+    req->hash_next = p->hash[slot];
+    p->hash[slot] = req;
+    p->hash_count++;
+}
+
+static netsnmp_poller_req *
+_hash_find(netsnmp_poller *p, long reqid)
+{
+    netsnmp_poller_req *req;
+
+    for (req = p->hash[_hash_slot(p, reqid)]; req; req = req->hash_next)
+        if (req->reqid == reqid)
+            return req;
+    return NULL;
+}
+
+static void
+_hash_remove(netsnmp_poller *p, netsnmp_poller_req *req)
+{
+    netsnmp_poller_req **prev;
+
+    for (prev = &p->hash[_hash_slot(p, req->reqid)]; *prev;
+         prev = &(*prev)->hash_next) {
+        if (*prev == req) {
+            *prev = req->hash_next;
+            p->hash_count--;
+            return;
+        }
+    }
+}
+
+/*
+ * scheduling
+ */
+
+static int
+_target_can_send(netsnmp_poller *p, netsnmp_poller_target *t)
+{
+    return t->queue_head != NULL &&
+        t->inflight < p->config.target_inflight;
+}
+
+/*
+ * Put a target that has something to send on the ready list, or on the
+ * timer wheel if it has to wait for its send interval first.
+ */
+static void
+_target_schedule(netsnmp_poller *p, netsnmp_poller_target *t, u_long now)
+{
+    if ((t->flags & TARGET_READY) || t->timer.kind != TIMER_IDLE ||
+        !_target_can_send(p, t))
+        return;
+    if (t->next_send > now) {
+        _timer_add(p, &t->timer, TIMER_TARGET, now, t->next_send - now);
+        return;
+    }
+    t->flags |= TARGET_READY;
+    t->next_ready = NULL;
+    if (p->ready_tail)
+        p->ready_tail->next_ready = t;
+    else
+        p->ready_head = t;
+    p->ready_tail = t;
+}
+
+static void
+_req_free(netsnmp_poller_req *req)
+{
+    free(req->packet);
+    free(req);
+}
+
+static void
+_req_complete(netsnmp_poller *p, netsnmp_poller_req *req, int op,
+              netsnmp_pdu *response, u_long now)
+{
+    netsnmp_poller_target *t = req->target;
+
+    _hash_remove(p, req);
+    _timer_del(p, &req->timer);
+    t->inflight--;
+    p->inflight--;
+    if (req->callback)
+        req->callback(op, t, (int) req->reqid, response, req->magic);
+    _req_free(req);
+    _target_schedule(p, t, now);
+}
+
+static int
+_req_transmit(netsnmp_poller *p, netsnmp_poller_req *req)
+{
+    netsnmp_poller_target *t = req->target;
+    int             idx = t->af_idx, sock;
+    ssize_t         rc;
+
+    sock = p->socks[idx][p->next_sock[idx]];
+    if (++p->next_sock[idx] >= p->nsocks[idx])
+        p->next_sock[idx] = 0;
+
+    do {
+        rc = sendto(sock, (const void *) req->packet, req->packet_len, 0,
+                    &t->addr.sa, t->addr_len);
+    } while (rc < 0 && errno == EINTR);
+    if (rc < 0 && errno != EAGAIN && errno != EWOULDBLOCK &&
+        errno != ENOBUFS) {
+        DEBUGMSGTL(("snmp_poller", "sendto %s failed: %s\n",
+                    t->peername, strerror(errno)));
+        return -1;
+    }
+    /*
+     * a full socket buffer is treated like a lost packet: the request will
+     * be retransmitted when its timer expires
+     */
+    return 0;
+}
+
+static void
+_refill_credit(netsnmp_poller *p, u_long now)
+{
+    u_long          elapsed = now - p->credit_time;
+
+    if (!p->config.rate)
+        return;
+    if (elapsed > 1000)
+        elapsed = 1000;
+    p->credit += (long) elapsed * p->config.rate;
+    if (p->credit > p->credit_max)
+        p->credit = p->credit_max;
+    p->credit_time = now;
+}
+
+/*
+ * Send queued requests of ready targets for as long as the limits allow.
+ */
+static void
+_dispatch(netsnmp_poller *p, u_long now)
+{
+    netsnmp_poller_target *t;
+    netsnmp_poller_req *req;
+
+    _refill_credit(p, now);
+    while ((t = p->ready_head) != NULL) {
+        if (p->config.max_inflight && p->inflight >= p->config.max_inflight)
+            break;
+        if (p->config.rate && p->credit < 1000)
+            break;
+
+        p->ready_head = t->next_ready;
+        if (p->ready_head == NULL)
+            p->ready_tail = NULL;
+        t->flags &= ~TARGET_READY;
+        if (!_target_can_send(p, t))
+            continue;
+
+        req = t->queue_head;
+        t->queue_head = req->queue_next;
+        if (t->queue_head == NULL)
+            t->queue_tail = NULL;
+        req->queue_next = NULL;
+        p->queued--;
+
+        _hash_add(p, req);
+        t->inflight++;
+        p->inflight++;
+        if (p->config.rate)
+            p->credit -= 1000;
+        if (p->config.target_interval)
+            t->next_send = now + p->config.target_interval;
+
+        if (_req_transmit(p, req) < 0) {
+            p->stats.send_failed++;
+            _req_complete(p, req, NETSNMP_CALLBACK_OP_SEND_FAILED, NULL,
+                          now);
+            continue;
+        }
+        p->stats.sent++;
+        _timer_add(p, &req->timer, TIMER_REQUEST, now,
+                   t->timeout / 1000);
+        _target_schedule(p, t, now);
+    }
+}
+
+static void
+_timer_fire(netsnmp_poller *p, poller_timer *tm, u_long now)
+{
+    netsnmp_poller_req *req;
+    netsnmp_poller_target *t;
+
+    if (tm->kind == TIMER_TARGET) {
+        t = (netsnmp_poller_target *) tm;
+        _timer_del(p, tm);
+        _target_schedule(p, t, now);
+        return;
+    }
+
+    req = (netsnmp_poller_req *) tm;
+    if (req->tries_left > 0) {
+        req->tries_left--;
+        p->stats.retries++;
+        DEBUGMSGTL(("snmp_poller", "resending request %ld to %s\n",
+                    req->reqid, req->target->peername));
+        if (_req_transmit(p, req) == 0) {
+            _timer_add(p, tm, TIMER_REQUEST, now,
+                       req->target->timeout / 1000);
+            return;
+        }
+        p->stats.send_failed++;
+        _req_complete(p, req, NETSNMP_CALLBACK_OP_SEND_FAILED, NULL, now);
+        return;
+    }
+    p->stats.timeouts++;
+    _req_complete(p, req, NETSNMP_CALLBACK_OP_TIMED_OUT, NULL, now);
+}
+
+static void
+_wheel_run(netsnmp_poller *p, u_long now)
+{
+    u_long          now_tick = now / POLLER_TICK;
+    poller_timer   *tm, *next;
+    int             i;
+
+    if (now_tick - p->wheel_tick >= POLLER_WHEEL_SLOTS) {
+        /*
+         * more than one revolution behind: visit every slot once
+         */
+        p->wheel_tick = now_tick;
+        for (i = 0; i < POLLER_WHEEL_SLOTS; i++) {
+            for (tm = p->wheel[i]; tm; tm = next) {
+                next = tm->next;
+                if (tm->expire <= now_tick)
+                    _timer_fire(p, tm, now);
+            }
+        }
+        return;
+    }
+    while (p->wheel_tick < now_tick) {
+        p->wheel_tick++;
+        for (tm = p->wheel[p->wheel_tick & POLLER_WHEEL_MASK]; tm;
+             tm = next) {
+            next = tm->next;
+            if (tm->expire <= p->wheel_tick)
+                _timer_fire(p, tm, now);
+        }
+    }
+}
+
+/*
+ * public interface
+ */
+
+netsnmp_poller *
+netsnmp_poller_create(const netsnmp_poller_config *config)
+{
+    netsnmp_poller *p;
+
+    p = SNMP_MALLOC_TYPEDEF(netsnmp_poller);
+    if (p == NULL)
+        return NULL;
+    if (config)
+        p->config = *config;
+    if (p->config.sockets <= 0)
+        p->config.sockets = 1;
+    else if (p->config.sockets > POLLER_MAX_SOCKETS)
+        p->config.sockets = POLLER_MAX_SOCKETS;
+    if (p->config.target_inflight <= 0)
+        p->config.target_inflight = 1;
+    if (p->config.timeout <= 0) {
+        int             timeout = netsnmp_ds_get_int(NETSNMP_DS_LIBRARY_ID,
+                                                     NETSNMP_DS_LIB_TIMEOUT);
+        p->config.timeout = timeout > 0 ? timeout * 1000000L : 1000000L;
+    }
+    if (p->config.retries < 0) {
+        int             retries = netsnmp_ds_get_int(NETSNMP_DS_LIBRARY_ID,
+                                                     NETSNMP_DS_LIB_RETRIES);
+        p->config.retries = retries >= 0 ? retries : 5;
+    }
+
+    p->hash_size = 1024;
+    p->hash = (netsnmp_poller_req **) calloc(p->hash_size,
+                                             sizeof(*p->hash));
+    p->rxbuf_len = 65536;
+    p->rxbuf = (u_char *) malloc(p->rxbuf_len);
+    p->txbuf_len = SNMP_MAX_MSG_SIZE;
+    p->txbuf = (u_char *) malloc(p->txbuf_len);
+    if (p->hash == NULL || p->rxbuf == NULL || p->txbuf == NULL) {
+        netsnmp_poller_free(p);
+        return NULL;
+    }
+
+    netsnmp_get_monotonic_clock(&p->epoch);
+    p->wheel_tick = 0;
+    if (p->config.rate) {
+        /*
+         * allow bursts of up to 50ms worth of requests
+         */
+        p->credit_max = 1000L * (p->config.rate / 20 + 1);
+        p->credit = p->credit_max;
+    }
+    snmp_sess_init(&p->build_sess);
+    snmp_sess_init(&p->parse_sess);
+    return p;
+}
+
+void
+netsnmp_poller_free(netsnmp_poller *p)
+{
+    netsnmp_poller_target *t, *tnext;
+    netsnmp_poller_req *req;
+    size_t          i;
+    int             f, s;
+
+    if (p == NULL)
+        return;
+
+    if (p->hash) {
+        for (i = 0; i < p->hash_size; i++) {
+            while ((req = p->hash[i]) != NULL) {
+                p->hash[i] = req->hash_next;
+                if (req->callback)
+                    req->callback(NETSNMP_CALLBACK_OP_DISCONNECT,
+                                  req->target, (int) req->reqid, NULL,
+                                  req->magic);
+                _req_free(req);
+            }
+        }
+        free(p->hash);
+    }
+    for (t = p->targets; t; t = tnext) {
+        tnext = t->next;
+        while ((req = t->queue_head) != NULL) {
+            t->queue_head = req->queue_next;
+            if (req->callback)
+                req->callback(NETSNMP_CALLBACK_OP_DISCONNECT, t,
+                              (int) req->reqid, NULL, req->magic);
+            _req_free(req);
+        }
+        free(t->peername);
+        free(t->community);
+        free(t);
+    }
+    for (f = 0; f < 2; f++)
+        for (s = 0; s < p->nsocks[f]; s++)
+            close(p->socks[f][s]);
+    free(p->rxbuf);
+    free(p->txbuf);
+    free(p);
+}
+
+static int
+_open_sockets(netsnmp_poller *p, int idx, int family)
+{
+    int             sock, rcvbuf = POLLER_RCVBUF;
+
+    while (p->nsocks[idx] < p->config.sockets) {
+        sock = socket(family, SOCK_DGRAM, 0);
+        if (sock < 0) {
+            snmp_log_perror("netsnmp_poller: socket");
+            return p->nsocks[idx] ? 0 : -1;
+        }
+        netsnmp_set_non_blocking_mode(sock, 1);
+        setsockopt(sock, SOL_SOCKET, SO_RCVBUF, (void *) &rcvbuf,
+                   sizeof(rcvbuf));
+        p->socks[idx][p->nsocks[idx]++] = sock;
+    }
+    return 0;
+}
+
+/**
+ * Add a target.
+ *
+ * @param peername Agent address: "host", "host:port", "udp:host:port" or
+ *                 (with IPv6 support) "udp6:[addr]:port".
+ * @param version  SNMP_VERSION_1 or SNMP_VERSION_2c.
+ *
+ * @return The new target, or NULL if the address could not be resolved.
+ */
+netsnmp_poller_target *
+netsnmp_poller_add_target(netsnmp_poller *p, const char *peername,
+                          long version, const char *community, void *magic)
+{
+    netsnmp_poller_target *t;
+    const char     *name = peername;
+    int             ipv6 = 0;
+
+    if (version != SNMP_VERSION_1 && version != SNMP_VERSION_2c) {
+        snmp_log(LOG_ERR, "netsnmp_poller: %s: only SNMPv1 and SNMPv2c "
+                 "are supported\n", peername);
+        return NULL;
+    }
+
+    if (strncasecmp(name, "udp:", 4) == 0)
+        name += 4;
+    else if (strncasecmp(name, "udp6:", 5) == 0) {
+        name += 5;
+        ipv6 = 1;
+    } else if (strncasecmp(name, "udpv6:", 6) == 0) {
+        name += 6;
+        ipv6 = 1;
+    } else if (strncasecmp(name, "udpipv6:", 8) == 0) {
+        name += 8;
+        ipv6 = 1;
+    } else if (*name == '[')
+        ipv6 = 1;
+
+    t = SNMP_MALLOC_TYPEDEF(netsnmp_poller_target);
+    if (t == NULL)
+        return NULL;
+
+    if (!ipv6) {
+        if (!netsnmp_sockaddr_in2(&t->addr.sin, name, NULL))
+            goto bad_address;
+        t->addr_len = sizeof(t->addr.sin);
+        t->af_idx = AF_IDX_INET;
+        if (_open_sockets(p, AF_IDX_INET, AF_INET) < 0)
+            goto fail;
+    } else {
+#ifdef NETSNMP_TRANSPORT_UDPIPV6_DOMAIN
+        if (!netsnmp_sockaddr_in6_2(&t->addr.sin6, name, NULL))
+            goto bad_address;
+        t->addr_len = sizeof(t->addr.sin6);
+        t->af_idx = AF_IDX_INET6;
+        if (_open_sockets(p, AF_IDX_INET6, AF_INET6) < 0)
+            goto fail;
+#else
+        goto bad_address;
+#endif
+    }
+
+    t->peername = strdup(peername);
+    t->community_len = community ? strlen(community) : 0;
+    t->community = (u_char *) strdup(community ? community : "");
+    if (t->peername == NULL || t->community == NULL) {
+        free(t->peername);
+        free(t->community);
+        goto fail;
+    }
+    t->magic = magic;
+    t->version = version;
+    t->timeout = p->config.timeout;
+    t->retries = p->config.retries;
+    t->next = p->targets;
+    p->targets = t;
+    return t;
+
+  bad_address:
+    snmp_log(LOG_ERR, "netsnmp_poller: cannot resolve %s\n", peername);
+  fail:
+    free(t);
+    return NULL;
+}
+
+const char *
+netsnmp_poller_target_name(netsnmp_poller_target *t)
+{
+    return t->peername;
+}
+
+void *
+netsnmp_poller_target_magic(netsnmp_poller_target *t)
+{
+    return t->magic;
+}
+
+/**
+ * Override the poller's default timeout (in microseconds) and retries
+ * for one target.  Negative values leave the setting unchanged.
+ */
+void
+netsnmp_poller_target_set_timeout(netsnmp_poller_target *t, long timeout,
+                                  int retries)
+{
+    if (timeout > 0)
+        t->timeout = timeout;
+    if (retries >= 0)
+        t->retries = retries;
+}
+
+/**
+ * Queue a request for a target.  The request is sent as soon as the
+ * limits allow.
+ *
+ * @return The request ID if the PDU could be encoded, in which case the
+ * PDU is freed; zero otherwise, in which case the caller must free it.
+ */
+int
+netsnmp_poller_send(netsnmp_poller *p, netsnmp_poller_target *t,
+                    netsnmp_pdu *pdu, netsnmp_poller_callback *callback,
+                    void *magic)
+{
+    netsnmp_poller_req *req;
+    u_char         *packet;
+    size_t          length, offset = 0;
+    long            reqid;
+    int             rc;
+
+    req = SNMP_MALLOC_TYPEDEF(netsnmp_poller_req);
+    if (req == NULL)
+        return 0;
+
+    pdu->version = t->version;
+    pdu->reqid = snmp_get_next_reqid();
+    p->build_sess.version = t->version;
+    p->build_sess.community = t->community;
+    p->build_sess.community_len = t->community_len;
+
+#ifdef NETSNMP_USE_REVERSE_ASNENCODING
+    if (!netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID,
+                                NETSNMP_DS_LIB_REVERSE_ENCODE))
+        pdu->flags |= UCD_MSG_FLAG_FORWARD_ENCODE;
+    if (!(pdu->flags & UCD_MSG_FLAG_FORWARD_ENCODE)) {
+        rc = snmp_build(&p->txbuf, &p->txbuf_len, &offset, &p->build_sess,
+                        pdu);
+        packet = p->txbuf + p->txbuf_len - offset;
+        length = offset;
+    } else {
+#endif
+        length = p->txbuf_len;
+        rc = snmp_build(&p->txbuf, &length, &offset, &p->build_sess, pdu);
+        packet = p->txbuf;
+#ifdef NETSNMP_USE_REVERSE_ASNENCODING
+    }
+#endif
+    p->build_sess.community = NULL;
+    p->build_sess.community_len = 0;
+    if (rc != 0) {
+        DEBUGMSGTL(("snmp_poller", "cannot encode request for %s: %s\n",
+                    t->peername, snmp_api_errstring(p->build_sess.s_snmp_errno)));
+        free(req);
+        return 0;
+    }
+
+    req->packet = netsnmp_memdup(packet, length);
+    if (req->packet == NULL) {
+        free(req);
+        return 0;
+    }
+    req->packet_len = length;
+    req->reqid = reqid = pdu->reqid;
+    req->target = t;
+    req->tries_left = t->retries;
+    req->callback = callback;
+    req->magic = magic;
+    snmp_free_pdu(pdu);
+
+    if (t->queue_tail)
+        t->queue_tail->queue_next = req;
+    else
+        t->queue_head = req;
+    t->queue_tail = req;
+    p->queued++;
+
+    _target_schedule(p, t, _poller_now(p));
+    _dispatch(p, _poller_now(p));
+    return (int) reqid;         /* req may be gone already */
+}
+
+/**
+ * Like snmp_select_info(): add the poller's sockets to @p fdset and lower
+ * @p timeout (clearing @p block) if the poller needs to run before then.
+ */
+void
+netsnmp_poller_select_info(netsnmp_poller *p, int *numfds, fd_set *fdset,
+                           struct timeval *timeout, int *block)
+{
+    u_long          now = _poller_now(p);
+    long            delay, d;
+    int             f, s;
+
+    for (f = 0; f < 2; f++) {
+        for (s = 0; s < p->nsocks[f]; s++) {
+            FD_SET(p->socks[f][s], fdset);
+            if (p->socks[f][s] >= *numfds)
+                *numfds = p->socks[f][s] + 1;
+        }
+    }
+
+    delay = _timer_next(p, now);
+    if (p->ready_head && p->config.rate &&
+        (!p->config.max_inflight ||
+         p->inflight < p->config.max_inflight)) {
+        _refill_credit(p, now);
+        d = p->credit >= 1000 ? 0 :
+            (1000 - p->credit + p->config.rate - 1) / p->config.rate;
+        if (delay < 0 || d < delay)
+            delay = d;
+    }
+    if (delay < 0)
+        return;
+    if (*block || delay / 1000 < timeout->tv_sec ||
+        (delay / 1000 == timeout->tv_sec &&
+         (delay % 1000) * 1000 < timeout->tv_usec)) {
+        timeout->tv_sec = delay / 1000;
+        timeout->tv_usec = (delay % 1000) * 1000;
+        *block = 0;
+    }
+}
+
+static int
+_same_address(netsnmp_poller_target *t, const struct sockaddr *from,
+              socklen_t from_len)
+{
+    if (from->sa_family != t->addr.sa.sa_family)
+        return 0;
+    if (from->sa_family == AF_INET)
+        return ((const struct sockaddr_in *) from)->sin_port ==
+            t->addr.sin.sin_port &&
+            ((const struct sockaddr_in *) from)->sin_addr.s_addr ==
+            t->addr.sin.sin_addr.s_addr;
+#ifdef NETSNMP_TRANSPORT_UDPIPV6_DOMAIN
+    if (from->sa_family == AF_INET6)
+        return ((const struct sockaddr_in6 *) from)->sin6_port ==
+            t->addr.sin6.sin6_port &&
+            memcmp(&((const struct sockaddr_in6 *) from)->sin6_addr,
+                   &t->addr.sin6.sin6_addr, sizeof(struct in6_addr)) == 0;
+#endif
+    return 0;
+}
+
+static void
+_handle_packet(netsnmp_poller *p, const struct sockaddr *from,
+               socklen_t from_len, size_t length, u_long now)
+{
+    netsnmp_poller_req *req;
+    netsnmp_pdu    *pdu;
+    u_char         *data;
+    u_char          type;
+    size_t          len = length;
+    long            version = -1;
+
+    /*
+     * peek at the version: only community based responses can be ours
+     */
+    data = asn_parse_sequence(p->rxbuf, &len, &type,
+                              (ASN_SEQUENCE | ASN_CONSTRUCTOR), "version");
+    if (data == NULL ||
+        asn_parse_int(data, &len, &type, &version, sizeof(version)) == NULL
+        || (version != SNMP_VERSION_1 && version != SNMP_VERSION_2c)) {
+        p->stats.unmatched++;
+        return;
+    }
+
+    pdu = SNMP_MALLOC_TYPEDEF(netsnmp_pdu);
+    if (pdu == NULL)
+        return;
+    if (snmp_parse(NULL, &p->parse_sess, pdu, p->rxbuf, length) != 0 ||
+        pdu->command != SNMP_MSG_RESPONSE ||
+        (req = _hash_find(p, pdu->reqid)) == NULL ||
+        req->target->version != pdu->version ||
+        !_same_address(req->target, from, from_len)) {
+        DEBUGMSGTL(("snmp_poller", "dropping unmatched packet\n"));
+        p->stats.unmatched++;
+        snmp_free_pdu(pdu);
+        return;
+    }
+    p->stats.received++;
+    _req_complete(p, req, NETSNMP_CALLBACK_OP_RECEIVED_MESSAGE, pdu, now);
+    snmp_free_pdu(pdu);
+}
+
+/**
+ * Read and dispatch the responses waiting on the poller's sockets in
+ * @p fdset.
+ */
+void
+netsnmp_poller_read(netsnmp_poller *p, fd_set *fdset)
+{
+    union {
+        struct sockaddr     sa;
+        struct sockaddr_in  sin;
+#ifdef NETSNMP_TRANSPORT_UDPIPV6_DOMAIN
+        struct sockaddr_in6 sin6;
+#endif
+    }               from;
+    socklen_t       from_len;
+    ssize_t         n;
+    int             f, s, i;
+
+    for (f = 0; f < 2; f++) {
+        for (s = 0; s < p->nsocks[f]; s++) {
+            if (!FD_ISSET(p->socks[f][s], fdset))
+                continue;
+            for (i = 0; i < POLLER_READ_BATCH; i++) {
+                from_len = sizeof(from);
+                n = recvfrom(p->socks[f][s], (void *) p->rxbuf,
+                             p->rxbuf_len, 0, &from.sa, &from_len);
+                if (n < 0) {
+                    if (errno == EINTR)
+                        continue;
+                    break;
+                }
+                _handle_packet(p, &from.sa, from_len, n, _poller_now(p));
+            }
+        }
+    }
+    _dispatch(p, _poller_now(p));
+}
+
+/**
+ * Run expired timers (retransmissions, timeouts, deferred sends) and send
+ * whatever the limits now allow.
+ */
+void
+netsnmp_poller_timeout(netsnmp_poller *p)
+{
+    u_long          now = _poller_now(p);
+
+    _wheel_run(p, now);
+    _dispatch(p, now);
+}
+
+/**
+ * @return The number of requests queued or outstanding.
+ */
+int
+netsnmp_poller_pending(netsnmp_poller *p)
+{
+    return p->queued + p->inflight;
+}
+
+/**
+ * Process events until all requests have completed.
+ *
+ * @return 0, or -1 if select() failed.
+ */
+int
+netsnmp_poller_run(netsnmp_poller *p)
+{
+    fd_set          fdset;
+    struct timeval  timeout;
+    int             numfds, block, count;
+
+    while (netsnmp_poller_pending(p) > 0) {
+        numfds = 0;
+        block = 1;
+        timeout.tv_sec = timeout.tv_usec = 0;
+        FD_ZERO(&fdset);
+        netsnmp_poller_select_info(p, &numfds, &fdset, &timeout, &block);
+        count = select(numfds, &fdset, NULL, NULL, block ? NULL : &timeout);
+        if (count > 0)
+            netsnmp_poller_read(p, &fdset);
+        else if (count < 0 && errno != EINTR) {
+            snmp_log_perror("netsnmp_poller_run: select");
+            return -1;
+        }
+        netsnmp_poller_timeout(p);
+    }
+    return 0;
+}
+
+const netsnmp_poller_stats *
+netsnmp_poller_get_stats(netsnmp_poller *p)
+{
+    return &p->stats;
+}
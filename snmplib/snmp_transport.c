@@ -61,6 +61,9 @@
 #ifdef NETSNMP_TRANSPORT_UNIX_DOMAIN
 #include <net-snmp/library/snmpUnixDomain.h>
 #endif
+#ifdef NETSNMP_TRANSPORT_SHMRING_DOMAIN
+#include <net-snmp/library/snmpShmRingDomain.h>
+#endif
 #ifdef NETSNMP_TRANSPORT_AAL5PVC_DOMAIN
 #include <net-snmp/library/snmpAAL5PVCDomain.h>
 #endif
@@ -0,0 +1,1216 @@
+/*
+ * Shared memory ring transport.
+ *
+ * This is a Unix domain stream transport which, once connected, can move
+ * the message traffic into a pair of single-producer/single-consumer rings
+ * in shared memory, with eventfd wakeups.  It is meant for AgentX between
+ * a master agent and subagents on the same host, where the socket round
+ * trip dominates the cost of a delegated request.
+ *
+ * The client creates the rings (a sealed memfd) and two eventfds, and
+ * offers them to the server over the freshly connected socket, dressed up
+ * as an AgentX Ping so that a plain unix: master just answers it with a
+ * notOpen error.  The client doesn't wait for the answer: until it comes,
+ * messages go over the socket, and if the server took the rings the first
+ * marker in the ring accounts for them.  A server listening on a shm:
+ * address maps the rings and answers with a successful Response, after
+ * which both ends select on their receive eventfd; it accepts plain Unix
+ * domain clients as usual.
+ *
+ * The socket stays open while the rings are in use: it is watched to
+ * detect the peer going away, and carries any message which doesn't fit
+ * in the ring (signalled, in order, by a marker in the ring).  Whatever
+ * arrives on it is read into a buffer right away, so that the receive
+ * path never has to wait for it, and whatever the socket won't take yet
+ * is kept in a buffer until it becomes writable, so that the send path
+ * never has to wait either.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE             /* memfd_create(), F_ADD_SEALS */
+#endif
+
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-features.h>
+
+#include <sys/types.h>
+#include <net-snmp/library/snmpShmRingDomain.h>
+
+#include <stddef.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#else
+#include <strings.h>
+#endif
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+
+#include <net-snmp/types.h>
+#include <net-snmp/output_api.h>
+#include <net-snmp/config_api.h>
+
+#include <net-snmp/library/snmp_transport.h>
+#include <net-snmp/library/snmpUnixDomain.h>
+#include <net-snmp/library/fd_event_manager.h>
+#include <net-snmp/library/system.h>
+#include <net-snmp/library/tools.h>
+
+const oid netsnmp_ShmRingDomain[] = { TRANSPORT_DOMAIN_SHMRING };
+static netsnmp_tdomain shmringDomain;
+
+/*
+ * Ring control block.  head is only written by the producer and tail (and
+ * normally waiting) only by the consumer, so keep them on separate cache
+ * lines.
+ */
+typedef struct shmring_ctl_s {
+    uint32_t        head;
+    uint32_t        blocked;        /* producer is short of room, wants a
+                                     * wakeup once the consumer made some */
+    uint8_t         pad1[56];
+    uint32_t        tail;
+    uint32_t        waiting;        /* consumer is idle, wants a wakeup */
+    uint8_t         pad2[56];
+} shmring_ctl;
+
+/*
+ * Each message in a ring is preceded by an entry header, and entries are
+ * 8 byte aligned so that a header never straddles the end of the ring.
+ */
+typedef struct shmring_entry_s {
+    uint32_t        len;
+    uint32_t        type;
+} shmring_entry;
+
+#define SHMRING_ENTRY_DATA      1
+#define SHMRING_ENTRY_WRAP      2       /* skip to the start of the ring */
+#define SHMRING_ENTRY_SOCKET    3       /* message follows on the socket */
+
+#define SHMRING_ALIGN(x)        (((x) + 7) & ~7U)
+#define SHMRING_DATA_OFFSET     4096
+#define SHMRING_MAP_SIZE(size)  (SHMRING_DATA_OFFSET + 2 * (size_t)(size))
+#define SHMRING_MIN_SIZE        4096
+#define SHMRING_MAX_SIZE        (64 * 1024 * 1024)
+#define SHMRING_SOCK_BUF_MIN    4096
+
+/*
+ * The offer (client to server) is an AgentX Ping with session ID 0, the
+ * ring protocol version as transaction ID and SHMRING_MAGIC as packet ID;
+ * it carries the memfd and the two eventfds.  The answer is the Response
+ * to it, with error 0 if the server took the rings.
+ */
+#define SHMRING_AGENTX_HDR_LEN  20
+#define SHMRING_AGENTX_RES_LEN  8       /* sysUpTime, error, index */
+#define SHMRING_AGENTX_PING     13
+#define SHMRING_AGENTX_RESPONSE 18
+#define SHMRING_AGENTX_NBO      0x10    /* NETWORK_BYTE_ORDER flag */
+#define SHMRING_AGENTX_NOT_OPEN 257
+
+#define SHMRING_MAGIC           0x4e535267      /* "NSRg" */
+#define SHMRING_VERSION         2
+
+#define SHMRING_STATE_HELLO     0       /* accepted, nothing received yet */
+#define SHMRING_STATE_PLAIN     1       /* using the socket */
+#define SHMRING_STATE_RING      2       /* using the rings */
+#define SHMRING_STATE_OFFERED   3       /* waiting for the server's answer */
+
+/*
+ * This is the structure we use to hold transport-specific data.
+ */
+typedef struct netsnmp_shmring_data_s {
+    int             state;
+    int             sock;           /* connected socket, once known */
+    int             rx_efd;
+    int             tx_efd;
+    int             sock_watched;
+    int             sock_write_watched;
+    int             peer_gone;
+    uint32_t        size;
+    u_char         *map;
+    shmring_ctl    *rx;
+    shmring_ctl    *tx;
+    u_char         *rx_data;
+    u_char         *tx_data;
+    uint32_t        rx_offset;      /* delivered part of current entry */
+    uint32_t        sock_pending;   /* bytes still to read from socket */
+    uint32_t        tx_unannounced; /* sent on the socket, no marker yet */
+    u_char         *sock_buf;       /* read from the socket, not yet used */
+    uint32_t        sock_buf_start;
+    uint32_t        sock_buf_len;
+    uint32_t        sock_buf_size;
+    u_char         *tx_sock_buf;    /* for the socket, not yet sent */
+    uint32_t        tx_sock_start;
+    uint32_t        tx_sock_len;
+    uint32_t        tx_sock_size;
+    u_char          answer[SHMRING_AGENTX_HDR_LEN + SHMRING_AGENTX_RES_LEN];
+    uint32_t        answer_len;     /* bytes of the answer read so far */
+} netsnmp_shmring_data;
+
+static void
+_shmring_data_init(netsnmp_shmring_data *d)
+{
+    memset(d, 0x0, sizeof(*d));
+    d->state = SHMRING_STATE_HELLO;
+    d->sock = d->rx_efd = d->tx_efd = -1;
+}
+
+/*
+ * Accepted transports are copies of the listening one, and only get their
+ * socket after the copy; pick it up (for the underlying unix transport
+ * too) the first time we see it.
+ */
+static void
+_shmring_adopt_sock(netsnmp_transport *t)
+{
+    netsnmp_shmring_data *d = (netsnmp_shmring_data *) t->data;
+
+    if (d->sock < 0 && !(t->flags & NETSNMP_TRANSPORT_FLAG_LISTEN)) {
+        d->sock = t->sock;
+        if (t->base_transport)
+            t->base_transport->sock = t->sock;
+    }
+}
+
+static void
+_shmring_wake(int efd)
+{
+    uint64_t        one = 1;
+
+    if (write(efd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+        DEBUGMSGTL(("netsnmp_shmring", "wakeup fd %d failed: %s\n", efd,
+                    strerror(errno)));
+}
+
+static void
+_shmring_put32(u_char *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+/*
+ * Fetch a 32 bit (or, with len 2, 16 bit) field of an AgentX PDU, in the
+ * byte order given by its header.
+ */
+static uint32_t
+_shmring_get_int(const u_char *pdu, int offset, int len)
+{
+    const u_char   *p = pdu + offset;
+    uint32_t        v = 0;
+    int             i;
+
+    for (i = 0; i < len; i++)
+        v = (v << 8) | p[(pdu[2] & SHMRING_AGENTX_NBO) ? i : len - 1 - i];
+    return v;
+}
+
+static void
+_shmring_agentx_header(u_char *p, int type, uint32_t transid, uint32_t len)
+{
+    p[0] = 1;                   /* AgentX version */
+    p[1] = type;
+    p[2] = SHMRING_AGENTX_NBO;
+    p[3] = 0;
+    _shmring_put32(p + 4, 0);   /* session ID */
+    _shmring_put32(p + 8, transid);
+    _shmring_put32(p + 12, SHMRING_MAGIC);
+    _shmring_put32(p + 16, len);
+}
+
+static void _shmring_sock_event(int fd, void *data);
+
+static void
+_shmring_watch(netsnmp_transport *t)
+{
+    netsnmp_shmring_data *d = (netsnmp_shmring_data *) t->data;
+
+    if (register_readfd(d->sock, _shmring_sock_event, t) == FD_REGISTERED_OK)
+        d->sock_watched = 1;
+}
+
+/*
+ * Called from the external fd event loop when the socket becomes readable
+ * while the rings are in use: either a message is being passed over the
+ * socket, which is read into sock_buf for the receive path, or the peer
+ * has gone.  Once a ring's worth is buffered, the socket is left alone
+ * until the receive path has caught up.
+ */
+static void
+_shmring_sock_event(int fd, void *data)
+{
+    netsnmp_transport    *t = (netsnmp_transport *) data;
+    netsnmp_shmring_data *d = (netsnmp_shmring_data *) t->data;
+    u_char               *p = NULL;
+    uint32_t              size;
+    int                   rc;
+
+    if (d->sock_buf_start) {
+        memmove(d->sock_buf, d->sock_buf + d->sock_buf_start,
+                d->sock_buf_len);
+        d->sock_buf_start = 0;
+    }
+    if (d->sock_buf_len == d->sock_buf_size) {
+        size = d->sock_buf_size ? 2 * d->sock_buf_size : SHMRING_SOCK_BUF_MIN;
+        if (d->sock_buf_size < d->size)
+            p = realloc(d->sock_buf, size);
+        if (NULL == p) {
+            unregister_readfd(fd);
+            d->sock_watched = 0;
+            return;
+        }
+        d->sock_buf = p;
+        d->sock_buf_size = size;
+    }
+
+    do {
+        rc = recv(fd, d->sock_buf + d->sock_buf_len,
+                  d->sock_buf_size - d->sock_buf_len, MSG_DONTWAIT);
+    } while (rc < 0 && errno == EINTR);
+    if (rc > 0) {
+        d->sock_buf_len += rc;
+        if (d->sock_pending)
+            _shmring_wake(d->rx_efd);
+        return;
+    }
+    if (rc < 0 && errno == EAGAIN)
+        return;
+
+    DEBUGMSGTL(("netsnmp_shmring", "peer on fd %d went away\n", fd));
+    unregister_readfd(fd);
+    d->sock_watched = 0;
+    d->peer_gone = 1;
+    _shmring_wake(d->rx_efd);
+}
+
+static void _shmring_sock_writable(int fd, void *data);
+
+/*
+ * Send as much of what is kept for the socket as it takes right now, and
+ * have the rest sent once it becomes writable.  Returns -1 if the peer
+ * has gone.
+ */
+static int
+_shmring_flush(netsnmp_transport *t)
+{
+    netsnmp_shmring_data *d = (netsnmp_shmring_data *) t->data;
+    int                   rc;
+
+    while (d->tx_sock_len) {
+        rc = send(d->sock, d->tx_sock_buf + d->tx_sock_start, d->tx_sock_len,
+                  MSG_DONTWAIT);
+        if (rc < 0 && errno == EINTR)
+            continue;
+        if (rc < 0 && errno == EAGAIN) {
+            if (!d->sock_write_watched &&
+                register_writefd(d->sock, _shmring_sock_writable, t) ==
+                FD_REGISTERED_OK)
+                d->sock_write_watched = 1;
+            return 0;
+        }
+        if (rc < 0) {
+            DEBUGMSGTL(("netsnmp_shmring", "send fd %d: %s\n", d->sock,
+                        strerror(errno)));
+            d->tx_sock_len = 0;
+            d->peer_gone = 1;
+            _shmring_wake(d->rx_efd);
+            break;
+        }
+        d->tx_sock_start += rc;
+        d->tx_sock_len -= rc;
+    }
+    d->tx_sock_start = 0;
+    if (d->sock_write_watched) {
+        unregister_writefd(d->sock);
+        d->sock_write_watched = 0;
+    }
+    return d->peer_gone ? -1 : 0;
+}
+
+/*
+ * Called from the external fd event loop when the socket can take more of
+ * what is kept for it.
+ */
+static void
+_shmring_sock_writable(int fd, void *data)
+{
+    _shmring_flush((netsnmp_transport *) data);
+}
+
+/*
+ * Keep a message for the socket, after anything kept already.  The peer
+ * may never read again, so don't keep more than the largest ring would
+ * hold.
+ */
+static int
+_shmring_keep(netsnmp_shmring_data *d, const void *buf, uint32_t len)
+{
+    u_char         *p;
+    uint32_t        size;
+
+    if (len > SHMRING_MAX_SIZE - d->tx_sock_len)
+        return -1;
+    if (d->tx_sock_start) {
+        memmove(d->tx_sock_buf, d->tx_sock_buf + d->tx_sock_start,
+                d->tx_sock_len);
+        d->tx_sock_start = 0;
+    }
+    if (d->tx_sock_len + len > d->tx_sock_size) {
+        size = d->tx_sock_size ? d->tx_sock_size : SHMRING_SOCK_BUF_MIN;
+        while (size < d->tx_sock_len + len)
+            size *= 2;
+        p = realloc(d->tx_sock_buf, size);
+        if (NULL == p)
+            return -1;
+        d->tx_sock_buf = p;
+        d->tx_sock_size = size;
+    }
+    memcpy(d->tx_sock_buf + d->tx_sock_len, buf, len);
+    d->tx_sock_len += len;
+    return 0;
+}
+
+/*
+ * Map the rings.  The client produces into the first ring and consumes
+ * from the second one; the server the other way around.
+ */
+static int
+_shmring_map(netsnmp_shmring_data *d, int memfd, uint32_t size, int client)
+{
+    shmring_ctl    *first, *second;
+
+    d->map = mmap(NULL, SHMRING_MAP_SIZE(size), PROT_READ | PROT_WRITE,
+                  MAP_SHARED, memfd, 0);
+    if (MAP_FAILED == d->map) {
+        DEBUGMSGTL(("netsnmp_shmring", "mmap failed: %s\n", strerror(errno)));
+        d->map = NULL;
+        return -1;
+    }
+    d->size = size;
+    first = (shmring_ctl *) d->map;
+    second = first + 1;
+    if (client) {
+        d->tx = first;
+        d->rx = second;
+        d->tx_data = d->map + SHMRING_DATA_OFFSET;
+        d->rx_data = d->tx_data + size;
+    } else {
+        d->rx = first;
+        d->tx = second;
+        d->rx_data = d->map + SHMRING_DATA_OFFSET;
+        d->tx_data = d->rx_data + size;
+    }
+    return 0;
+}
+
+/*
+ * Switch a connected transport over to the rings.
+ */
+static void
+_shmring_start(netsnmp_transport *t)
+{
+    netsnmp_shmring_data *d = (netsnmp_shmring_data *) t->data;
+
+    d->state = SHMRING_STATE_RING;
+    t->sock = d->rx_efd;
+    _shmring_watch(t);
+    DEBUGMSGTL(("netsnmp_shmring", "socket %d using rings (%u bytes), "
+                "rx fd %d\n", d->sock, d->size, d->rx_efd));
+}
+
+/*
+ * Drop the rings, leaving the socket alone.
+ */
+static void
+_shmring_release(netsnmp_shmring_data *d)
+{
+    if (d->sock_watched) {
+        unregister_readfd(d->sock);
+        d->sock_watched = 0;
+    }
+    if (d->sock_write_watched) {
+        unregister_writefd(d->sock);
+        d->sock_write_watched = 0;
+    }
+    if (d->map) {
+        munmap(d->map, SHMRING_MAP_SIZE(d->size));
+        d->map = NULL;
+        d->rx = d->tx = NULL;
+    }
+    if (d->rx_efd >= 0) {
+        close(d->rx_efd);
+        d->rx_efd = -1;
+    }
+    if (d->tx_efd >= 0) {
+        close(d->tx_efd);
+        d->tx_efd = -1;
+    }
+    SNMP_FREE(d->sock_buf);
+    d->sock_buf_start = d->sock_buf_len = d->sock_buf_size = 0;
+    SNMP_FREE(d->tx_sock_buf);
+    d->tx_sock_start = d->tx_sock_len = d->tx_sock_size = 0;
+}
+
+static int
+_shmring_send_fds(int sock, const void *data, size_t len, const int *fds,
+                  int nfds)
+{
+    struct msghdr   msg;
+    struct iovec    iov;
+    union {
+        struct cmsghdr  cm;
+        char            control[CMSG_SPACE(3 * sizeof(int))];
+    } ctl;
+    int             rc;
+
+    memset(&msg, 0x0, sizeof(msg));
+    iov.iov_base = NETSNMP_REMOVE_CONST(void *, data);
+    iov.iov_len = len;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (nfds > 0) {
+        struct cmsghdr *cm;
+
+        memset(&ctl, 0x0, sizeof(ctl));
+        msg.msg_control = ctl.control;
+        msg.msg_controllen = CMSG_SPACE(nfds * sizeof(int));
+        cm = CMSG_FIRSTHDR(&msg);
+        cm->cmsg_level = SOL_SOCKET;
+        cm->cmsg_type = SCM_RIGHTS;
+        cm->cmsg_len = CMSG_LEN(nfds * sizeof(int));
+        memcpy(CMSG_DATA(cm), fds, nfds * sizeof(int));
+    }
+    do {
+        rc = sendmsg(sock, &msg, 0);
+    } while (rc < 0 && errno == EINTR);
+
+    return rc == (int) len ? 0 : -1;
+}
+
+/*
+ * Client side: offer the rings to the server.  The answer is picked up by
+ * the receive path.
+ */
+static int
+_shmring_offer(netsnmp_transport *t)
+{
+#ifdef MFD_ALLOW_SEALING
+    netsnmp_shmring_data *d = (netsnmp_shmring_data *) t->data;
+    u_char                ping[SHMRING_AGENTX_HDR_LEN];
+    int                   fds[3], memfd, rc;
+    uint32_t              size = NETSNMP_SHMRING_SIZE;
+
+    if (size < SHMRING_MIN_SIZE || size > SHMRING_MAX_SIZE ||
+        (size & (size - 1))) {
+        snmp_log(LOG_ERR, "shm: invalid ring size %u\n", size);
+        return -1;
+    }
+
+    memfd = memfd_create("netsnmp-shmring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (memfd < 0) {
+        DEBUGMSGTL(("netsnmp_shmring", "memfd_create failed: %s\n",
+                    strerror(errno)));
+        return -1;
+    }
+    if (ftruncate(memfd, SHMRING_MAP_SIZE(size)) < 0 ||
+        fcntl(memfd, F_ADD_SEALS,
+              F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0 ||
+        _shmring_map(d, memfd, size, 1) < 0) {
+        DEBUGMSGTL(("netsnmp_shmring", "couldn't set up rings: %s\n",
+                    strerror(errno)));
+        close(memfd);
+        return -1;
+    }
+    d->rx->waiting = d->tx->waiting = 1;
+
+    d->tx_efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    d->rx_efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (d->tx_efd < 0 || d->rx_efd < 0) {
+        close(memfd);
+        return -1;
+    }
+
+    _shmring_agentx_header(ping, SHMRING_AGENTX_PING, SHMRING_VERSION, 0);
+    fds[0] = memfd;
+    fds[1] = d->tx_efd;
+    fds[2] = d->rx_efd;
+    rc = _shmring_send_fds(d->sock, ping, sizeof(ping), fds, 3);
+    close(memfd);
+    if (rc < 0)
+        return -1;
+
+    d->state = SHMRING_STATE_OFFERED;
+    return 0;
+#else
+    return -1;
+#endif /* MFD_ALLOW_SEALING */
+}
+
+/*
+ * Server side: check and map the rings offered by a client.
+ */
+static int
+_shmring_accept_offer(netsnmp_shmring_data *d, uint32_t version,
+                      const int *fds)
+{
+#ifdef F_GET_SEALS
+    struct stat     st;
+    uint32_t        size;
+    int             seals;
+
+    if (version != SHMRING_VERSION)
+        return -1;
+
+    /*
+     * the client must not be able to shrink the memory under our feet
+     */
+    seals = fcntl(fds[0], F_GET_SEALS);
+    if (seals < 0 || !(seals & F_SEAL_SHRINK) || fstat(fds[0], &st) < 0 ||
+        st.st_size < SHMRING_MAP_SIZE(SHMRING_MIN_SIZE) ||
+        st.st_size > SHMRING_MAP_SIZE(SHMRING_MAX_SIZE)) {
+        DEBUGMSGTL(("netsnmp_shmring", "unusable ring memory offered\n"));
+        return -1;
+    }
+    size = (st.st_size - SHMRING_DATA_OFFSET) / 2;
+    if ((size & (size - 1)) || (size_t) st.st_size != SHMRING_MAP_SIZE(size))
+        return -1;
+    if (fcntl(fds[1], F_SETFL, O_NONBLOCK) < 0 ||
+        fcntl(fds[2], F_SETFL, O_NONBLOCK) < 0)
+        return -1;
+
+    if (_shmring_map(d, fds[0], size, 0) < 0)
+        return -1;
+    d->rx_efd = fds[1];
+    d->tx_efd = fds[2];
+    return 0;
+#else
+    return -1;
+#endif /* F_GET_SEALS */
+}
+
+/*
+ * Server side: the first read on an accepted connection is either a ring
+ * offer, or the start of the normal message traffic.
+ */
+static int
+_shmring_recv_first(netsnmp_transport *t, void *buf, int size,
+                    void **opaque, int *olength)
+{
+    netsnmp_shmring_data *d = (netsnmp_shmring_data *) t->data;
+    struct msghdr         msg;
+    struct iovec          iov;
+    struct cmsghdr       *cm;
+    union {
+        struct cmsghdr  cm;
+        char            control[CMSG_SPACE(3 * sizeof(int))];
+    } ctl;
+    u_char                answer[SHMRING_AGENTX_HDR_LEN +
+                                 SHMRING_AGENTX_RES_LEN];
+    int                   fds[3], nfds = 0, rc, i, status;
+
+    memset(&msg, 0x0, sizeof(msg));
+    iov.iov_base = buf;
+    iov.iov_len = size;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctl.control;
+    msg.msg_controllen = sizeof(ctl.control);
+    do {
+        rc = recvmsg(d->sock, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+    } while (rc < 0 && errno == EINTR);
+    if (rc < 0)
+        return rc;
+
+    for (cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+        int n;
+
+        if (cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS)
+            continue;
+        n = (cm->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (i = 0; i < n; ++i) {
+            int fd;
+
+            memcpy(&fd, CMSG_DATA(cm) + i * sizeof(int), sizeof(int));
+            if (nfds < 3)
+                fds[nfds++] = fd;
+            else
+                close(fd);
+        }
+    }
+
+    if (rc == SHMRING_AGENTX_HDR_LEN &&
+        ((u_char *) buf)[1] == SHMRING_AGENTX_PING &&
+        _shmring_get_int(buf, 4, 4) == 0 &&
+        _shmring_get_int(buf, 12, 4) == SHMRING_MAGIC &&
+        _shmring_get_int(buf, 16, 4) == 0) {
+        uint32_t        version = _shmring_get_int(buf, 8, 4);
+
+        if (3 == nfds && 0 == _shmring_accept_offer(d, version, fds)) {
+            close(fds[0]);
+            status = 0;
+        } else {
+            /*
+             * tell the client to use the socket, like a plain master would
+             */
+            for (i = 0; i < nfds; ++i)
+                close(fds[i]);
+            status = SHMRING_AGENTX_NOT_OPEN;
+        }
+        memset(answer, 0x0, sizeof(answer));
+        _shmring_agentx_header(answer, SHMRING_AGENTX_RESPONSE, version,
+                               SHMRING_AGENTX_RES_LEN);
+        answer[SHMRING_AGENTX_HDR_LEN + 4] = status >> 8;
+        answer[SHMRING_AGENTX_HDR_LEN + 5] = status & 0xff;
+        if (_shmring_send_fds(d->sock, answer, sizeof(answer), NULL, 0) < 0)
+            return -1;
+        if (0 == status)
+            _shmring_start(t);
+        else
+            d->state = SHMRING_STATE_PLAIN;
+        t->flags |= NETSNMP_TRANSPORT_FLAG_EMPTY_PKT;
+        return 0;
+    }
+
+    /*
+     * a plain client: hand over the data like the unix transport would
+     */
+    for (i = 0; i < nfds; ++i)
+        close(fds[i]);
+    d->state = SHMRING_STATE_PLAIN;
+    if (rc > 0) {
+        socklen_t       tolen = sizeof(struct sockaddr_un);
+        struct sockaddr *to = calloc(1, tolen);
+
+        if (to != NULL && getsockname(d->sock, to, &tolen) == 0) {
+            *opaque = to;
+            *olength = sizeof(struct sockaddr_un);
+        } else
+            free(to);
+    }
+    return rc;
+}
+
+/*
+ * Client side: read the server's answer to the offer, without waiting for
+ * the rest of it.  Returns 1 while it is incomplete or once it has been
+ * dealt with, else what recv() returned.
+ */
+static int
+_shmring_recv_answer(netsnmp_transport *t)
+{
+    netsnmp_shmring_data *d = (netsnmp_shmring_data *) t->data;
+    u_char                junk[64];
+    uint32_t              len;
+    int                   rc;
+
+    for (;;) {
+        len = SHMRING_AGENTX_HDR_LEN;
+        if (d->answer_len >= SHMRING_AGENTX_HDR_LEN)
+            len += _shmring_get_int(d->answer, 16, 4);
+        if (d->answer_len >= len)
+            break;
+        if (d->answer_len < sizeof(d->answer))
+            rc = recv(d->sock, d->answer + d->answer_len,
+                      SNMP_MIN(len, sizeof(d->answer)) - d->answer_len,
+                      MSG_DONTWAIT);
+        else
+            rc = recv(d->sock, junk, SNMP_MIN(len - d->answer_len,
+                                              sizeof(junk)), MSG_DONTWAIT);
+        if (rc < 0 && errno == EINTR)
+            continue;
+        if (rc < 0 && errno == EAGAIN)
+            return 1;
+        if (rc <= 0)
+            return rc;
+        d->answer_len += rc;
+    }
+
+    if (d->answer[1] == SHMRING_AGENTX_RESPONSE &&
+        _shmring_get_int(d->answer, 12, 4) == SHMRING_MAGIC &&
+        len >= sizeof(d->answer) &&
+        _shmring_get_int(d->answer, SHMRING_AGENTX_HDR_LEN + 4, 2) == 0) {
+        _shmring_start(t);
+        return 1;
+    }
+    DEBUGMSGTL(("netsnmp_shmring", "ring offer declined on fd %d\n",
+                d->sock));
+    _shmring_release(d);
+    d->state = SHMRING_STATE_PLAIN;
+    return 1;
+}
+
+/*
+ * Queue a message (or a marker, if buf is NULL) in the transmit ring,
+ * leaving at least reserve bytes free.  Returns 0 if there isn't room.
+ */
+static int
+_shmring_put(netsnmp_shmring_data *d, uint32_t type, const void *buf,
+             uint32_t len, uint32_t reserve)
+{
+    shmring_entry   entry;
+    uint32_t        head, tail, pos, pad = 0, need;
+
+    need = sizeof(entry) + (buf ? SHMRING_ALIGN(len) : 0);
+    if (need > d->size)
+        return 0;
+    head = d->tx->head;
+    tail = __atomic_load_n(&d->tx->tail, __ATOMIC_ACQUIRE);
+    pos = head & (d->size - 1);
+    if (pos + need > d->size)
+        pad = d->size - pos;
+    if ((head - tail) + pad + need + reserve > d->size)
+        return 0;
+
+    if (pad) {
+        entry.len = pad - sizeof(entry);
+        entry.type = SHMRING_ENTRY_WRAP;
+        memcpy(d->tx_data + pos, &entry, sizeof(entry));
+        head += pad;
+        pos = 0;
+    }
+    entry.len = len;
+    entry.type = type;
+    memcpy(d->tx_data + pos, &entry, sizeof(entry));
+    if (buf)
+        memcpy(d->tx_data + pos + sizeof(entry), buf, len);
+    __atomic_store_n(&d->tx->head, head + need, __ATOMIC_RELEASE);
+
+    return 1;
+}
+
+/*
+ * Put a marker for the bytes sent on the socket in the ring.  If there is
+ * no room, the peer wakes us up once it has read some more, and the next
+ * receive or send tries again; until then nothing else goes in the ring.
+ */
+static void
+_shmring_announce(netsnmp_shmring_data *d)
+{
+    if (0 == d->tx_unannounced)
+        return;
+    if (!_shmring_put(d, SHMRING_ENTRY_SOCKET, NULL, d->tx_unannounced, 0)) {
+        __atomic_store_n(&d->tx->blocked, 1, __ATOMIC_SEQ_CST);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (!_shmring_put(d, SHMRING_ENTRY_SOCKET, NULL, d->tx_unannounced,
+                          0)) {
+            DEBUGMSGTL(("netsnmp_shmring", "ring full on fd %d\n", d->sock));
+            return;
+        }
+    }
+    d->tx_unannounced = 0;
+    __atomic_store_n(&d->tx->waiting, 0, __ATOMIC_SEQ_CST);
+    _shmring_wake(d->tx_efd);
+}
+
+/*
+ * Copy as many queued messages as fit into buf.  The peer may scribble
+ * over the ring at any time, so everything read from it is checked.
+ */
+static int
+_shmring_get(netsnmp_transport *t, u_char *buf, int size)
+{
+    netsnmp_shmring_data *d = (netsnmp_shmring_data *) t->data;
+    shmring_entry         entry;
+    uint32_t              head, tail, pos, avail, n;
+    int                   copied = 0;
+
+    while (copied < size) {
+        if (d->sock_pending) {
+            if (0 == d->sock_buf_len)
+                break;          /* the socket watcher wakes us up */
+            n = SNMP_MIN(d->sock_pending, d->sock_buf_len);
+            n = SNMP_MIN(n, (uint32_t)(size - copied));
+            memcpy(buf + copied, d->sock_buf + d->sock_buf_start, n);
+            d->sock_buf_start += n;
+            d->sock_buf_len -= n;
+            copied += n;
+            d->sock_pending -= n;
+            if (!d->sock_watched && !d->peer_gone)
+                _shmring_watch(t);
+            continue;
+        }
+
+        tail = d->rx->tail;
+        head = __atomic_load_n(&d->rx->head, __ATOMIC_ACQUIRE);
+        if (head == tail)
+            break;
+        pos = tail & (d->size - 1);
+        if (head - tail > d->size || head - tail < sizeof(entry))
+            goto corrupt;
+        memcpy(&entry, d->rx_data + pos, sizeof(entry));
+
+        switch (entry.type) {
+        case SHMRING_ENTRY_WRAP:
+            if (entry.len != d->size - pos - sizeof(entry))
+                goto corrupt;
+            tail += d->size - pos;
+            break;
+
+        case SHMRING_ENTRY_DATA:
+            if (entry.len > d->size - pos - sizeof(entry) ||
+                sizeof(entry) + SHMRING_ALIGN(entry.len) > head - tail ||
+                d->rx_offset > entry.len)
+                goto corrupt;
+            avail = entry.len - d->rx_offset;
+            n = SNMP_MIN(avail, (uint32_t)(size - copied));
+            memcpy(buf + copied,
+                   d->rx_data + pos + sizeof(entry) + d->rx_offset, n);
+            copied += n;
+            if (n < avail) {
+                d->rx_offset += n;      /* rest goes in the next read */
+                return copied;
+            }
+            d->rx_offset = 0;
+            tail += sizeof(entry) + SHMRING_ALIGN(entry.len);
+            break;
+
+        case SHMRING_ENTRY_SOCKET:
+            d->sock_pending = entry.len;
+            tail += sizeof(entry);
+            break;
+
+        default:
+            goto corrupt;
+        }
+        __atomic_store_n(&d->rx->tail, tail, __ATOMIC_RELEASE);
+    }
+    return copied;
+
+  corrupt:
+    snmp_log(LOG_ERR, "shm: corrupt ring from peer on fd %d\n", d->sock);
+    d->peer_gone = 1;
+    return copied;
+}
+
+/*
+ * Before going back to select, either make sure we'll be woken up again
+ * for data we haven't read yet, or tell the peer that we want a wakeup.
+ */
+static void
+_shmring_rx_idle(netsnmp_shmring_data *d)
+{
+    if (d->sock_pending && !d->sock_buf_len && !d->peer_gone)
+        return;                 /* the socket watcher wakes us up */
+    if (!d->sock_pending && !d->peer_gone) {
+        __atomic_store_n(&d->rx->waiting, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&d->rx->head, __ATOMIC_SEQ_CST) == d->rx->tail)
+            return;
+    }
+    _shmring_wake(d->rx_efd);
+}
+
+static int
+netsnmp_shmring_recv(netsnmp_transport *t, void *buf, int size,
+                     void **opaque, int *olength)
+{
+    netsnmp_shmring_data *d;
+    netsnmp_transport    *base = t ? t->base_transport : NULL;
+    uint64_t              count;
+    uint32_t              tail;
+    int                   rc;
+
+    if (NULL == base || NULL == t->data)
+        return -1;
+    d = (netsnmp_shmring_data *) t->data;
+    *opaque = NULL;
+    *olength = 0;
+    _shmring_adopt_sock(t);
+
+    switch (d->state) {
+    case SHMRING_STATE_HELLO:
+        return _shmring_recv_first(t, buf, size, opaque, olength);
+    case SHMRING_STATE_PLAIN:
+        return base->f_recv(base, buf, size, opaque, olength);
+    case SHMRING_STATE_OFFERED:
+        rc = _shmring_recv_answer(t);
+        if (rc <= 0)
+            return rc;
+        if (d->state == SHMRING_STATE_RING)
+            _shmring_announce(d);
+        t->flags |= NETSNMP_TRANSPORT_FLAG_EMPTY_PKT;
+        return 0;
+    }
+
+    if (read(d->rx_efd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+        DEBUGMSGTL(("netsnmp_shmring", "read fd %d: %s\n", d->rx_efd,
+                    strerror(errno)));
+    _shmring_announce(d);
+    tail = d->rx->tail;
+    rc = _shmring_get(t, buf, size);
+    if (d->rx->tail != tail) {
+        /*
+         * pairs with the producer setting blocked in _shmring_announce()
+         */
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (__atomic_exchange_n(&d->rx->blocked, 0, __ATOMIC_SEQ_CST))
+            _shmring_wake(d->tx_efd);
+    }
+    _shmring_rx_idle(d);
+    DEBUGMSGTL(("netsnmp_shmring", "recv fd %d got %d bytes\n", t->sock, rc));
+    if (0 == rc && !d->peer_gone)
+        t->flags |= NETSNMP_TRANSPORT_FLAG_EMPTY_PKT;  /* spurious wakeup */
+    return rc;
+}
+
+static int
+netsnmp_shmring_send(netsnmp_transport *t, const void *buf, int size,
+                     void **opaque, int *olength)
+{
+    netsnmp_shmring_data *d;
+    netsnmp_transport    *base = t ? t->base_transport : NULL;
+    int                   rc;
+
+    if (NULL == base || NULL == t->data || size < 0)
+        return -1;
+    d = (netsnmp_shmring_data *) t->data;
+    _shmring_adopt_sock(t);
+
+    if (d->state == SHMRING_STATE_OFFERED) {
+        /*
+         * no answer yet: use the socket, and if the server takes the
+         * rings, account for this in the first marker
+         */
+        rc = base->f_send(base, buf, size, opaque, olength);
+        if (rc > 0)
+            d->tx_unannounced += rc;
+        return rc;
+    }
+    if (d->state != SHMRING_STATE_RING)
+        return base->f_send(base, buf, size, opaque, olength);
+    if (d->peer_gone) {
+        errno = EPIPE;
+        return -1;
+    }
+    if ((uint32_t) size > 0xffffffffU - d->tx_unannounced) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+
+    DEBUGMSGTL(("netsnmp_shmring", "send %d bytes on fd %d\n", size,
+                d->sock));
+    _shmring_announce(d);
+    if (0 == d->tx_unannounced &&
+        _shmring_put(d, SHMRING_ENTRY_DATA, buf, size, sizeof(shmring_entry))) {
+        if (__atomic_exchange_n(&d->tx->waiting, 0, __ATOMIC_SEQ_CST))
+            _shmring_wake(d->tx_efd);
+        return size;
+    }
+
+    /*
+     * too big, the peer is behind, or earlier messages still wait for
+     * their marker: send it over the socket, and announce it in the ring
+     * so that it is read in order.  Whatever the socket doesn't take now
+     * is kept, and sent once it becomes writable.
+     */
+    if (_shmring_keep(d, buf, size) < 0) {
+        errno = ENOBUFS;
+        return -1;
+    }
+    d->tx_unannounced += size;
+    if (_shmring_flush(t) < 0) {
+        errno = EPIPE;
+        return -1;
+    }
+    _shmring_announce(d);
+    return size;
+}
+
+static int
+netsnmp_shmring_close(netsnmp_transport *t)
+{
+    netsnmp_shmring_data *d;
+    netsnmp_transport    *base = t ? t->base_transport : NULL;
+    int                   rc = -1;
+
+    if (NULL == t || NULL == t->data)
+        return -1;
+    d = (netsnmp_shmring_data *) t->data;
+    _shmring_adopt_sock(t);
+
+    _shmring_release(d);
+    if (base && base->sock >= 0)
+        rc = base->f_close(base);
+    t->sock = -1;
+    return rc;
+}
+
+static int
+netsnmp_shmring_accept(netsnmp_transport *t)
+{
+    netsnmp_transport *base = t ? t->base_transport : NULL;
+
+    if (NULL == base)
+        return -1;
+    return base->f_accept(base);
+}
+
+/*
+ * The accepted transport is a copy of the listening one: start it off
+ * with fresh state.
+ */
+static int
+netsnmp_shmring_copy(const netsnmp_transport *oldt, netsnmp_transport *newt)
+{
+    if (newt->data)
+        _shmring_data_init((netsnmp_shmring_data *) newt->data);
+    return 0;
+}
+
+static char *
+netsnmp_shmring_fmtaddr(netsnmp_transport *t, const void *data, int len)
+{
+    netsnmp_transport *base = t ? t->base_transport : NULL;
+
+    if (base && base->f_fmtaddr)
+        return base->f_fmtaddr(base, data, len);
+    return strdup("Local IPC: unknown");
+}
+
+static void
+netsnmp_shmring_get_taddr(netsnmp_transport *t, void **addr, size_t *addr_len)
+{
+    *addr_len = t->remote_length;
+    *addr = netsnmp_memdup(t->remote, *addr_len);
+}
+
+/*
+ * Open a shared memory ring transport.  Local is TRUE for the (listening)
+ * server side.  A client that can't get the server to use the rings keeps
+ * using the socket.
+ */
+
+netsnmp_transport *
+netsnmp_shmring_transport(const struct sockaddr_un *addr, int local)
+{
+    netsnmp_transport    *t, *base;
+    netsnmp_shmring_data *d;
+
+    base = netsnmp_unix_transport(addr, local);
+    if (NULL == base)
+        return NULL;
+
+    t = SNMP_MALLOC_TYPEDEF(netsnmp_transport);
+    d = SNMP_MALLOC_TYPEDEF(netsnmp_shmring_data);
+    if (NULL == t || NULL == d) {
+        free(t);
+        free(d);
+        base->f_close(base);
+        netsnmp_transport_free(base);
+        return NULL;
+    }
+    _shmring_data_init(d);
+
+    t->domain = netsnmp_ShmRingDomain;
+    t->domain_length = OID_LENGTH(netsnmp_ShmRingDomain);
+    t->data = d;
+    t->data_length = sizeof(*d);
+    t->base_transport = base;
+    t->sock = base->sock;
+    t->flags = base->flags;
+    t->msgMaxSize = base->msgMaxSize;
+    if (base->local) {
+        t->local = netsnmp_memdup(base->local, base->local_length);
+        t->local_length = base->local_length;
+    }
+    if (base->remote) {
+        t->remote = netsnmp_memdup(base->remote, base->remote_length);
+        t->remote_length = base->remote_length;
+    }
+
+    t->f_recv      = netsnmp_shmring_recv;
+    t->f_send      = netsnmp_shmring_send;
+    t->f_close     = netsnmp_shmring_close;
+    t->f_accept    = netsnmp_shmring_accept;
+    t->f_copy      = netsnmp_shmring_copy;
+    t->f_fmtaddr   = netsnmp_shmring_fmtaddr;
+    t->f_get_taddr = netsnmp_shmring_get_taddr;
+
+    if (local)
+        return t;
+
+    d->sock = base->sock;
+    if (_shmring_offer(t) < 0) {
+        DEBUGMSGTL(("netsnmp_shmring", "using the unix socket for %s\n",
+                    addr->sun_path));
+        _shmring_release(d);
+        d->state = SHMRING_STATE_PLAIN;
+    }
+    return t;
+}
+
+netsnmp_transport *
+netsnmp_shmring_create_tstring(const char *string, int local,
+                               const char *default_target)
+{
+    struct sockaddr_un addr;
+
+    if (string && *string != '\0') {
+    } else if (default_target && *default_target != '\0') {
+        string = default_target;
+    }
+
+    if ((string != NULL && *string != '\0') &&
+        (strlen(string) < sizeof(addr.sun_path))) {
+        addr.sun_family = AF_UNIX;
+        memset(addr.sun_path, 0, sizeof(addr.sun_path));
+        strlcpy(addr.sun_path, string, sizeof(addr.sun_path));
+        return netsnmp_shmring_transport(&addr, local);
+    } else {
+        if (string != NULL && *string != '\0') {
+            snmp_log(LOG_ERR, "Path too long for shm transport\n");
+        }
+        return NULL;
+    }
+}
+
+netsnmp_transport *
+netsnmp_shmring_create_ostring(const void *ostring, size_t o_len, int local)
+{
+    struct sockaddr_un addr;
+
+    if (o_len > 0 && o_len < (sizeof(addr.sun_path) - 1)) {
+        addr.sun_family = AF_UNIX;
+        memset(addr.sun_path, 0, sizeof(addr.sun_path));
+        strlcpy(addr.sun_path, ostring, sizeof(addr.sun_path));
+        return netsnmp_shmring_transport(&addr, local);
+    } else {
+        if (o_len > 0) {
+            snmp_log(LOG_ERR, "Path too long for shm transport\n");
+        }
+    }
+    return NULL;
+}
+
+void
+netsnmp_shmring_ctor(void)
+{
+    shmringDomain.name = netsnmp_ShmRingDomain;
+    shmringDomain.name_length = OID_LENGTH(netsnmp_ShmRingDomain);
+    shmringDomain.prefix = calloc(3, sizeof(char *));
+    if (!shmringDomain.prefix) {
+        snmp_log(LOG_ERR, "calloc() failed - out of memory\n");
+        return;
+    }
+    shmringDomain.prefix[0] = "shm";
+    shmringDomain.prefix[1] = "shmring";
+
+    shmringDomain.f_create_from_tstring_new = netsnmp_shmring_create_tstring;
+    shmringDomain.f_create_from_ostring     = netsnmp_shmring_create_ostring;
+
+    netsnmp_tdomain_register(&shmringDomain);
+}
@@ -0,0 +1,76 @@
+/* HEADER Testing container merge */
+
+static const char test_name[] = "container-merge-test";
+static const oid live_oids[] = { 1, 3, 5, 7, 9 };
+static const oid fresh_oids[] = { 2, 3, 7, 9, 11, 12 };
+netsnmp_container *live, *fresh;
+netsnmp_container_merge_stats stats;
+netsnmp_index *ip, *kept[2], key;
+oid key_oid;
+int i, rc;
+
+init_snmp(test_name);
+
+/*
+ * each item is a netsnmp_index followed by its (single) oid, so that the
+ * default free_item (free) releases it.
+ */
+#define NEW_ITEM(v) do {                                                \
+        ip = calloc(1, sizeof(netsnmp_index) + sizeof(oid));            \
+        ip->oids = (oid *)(ip + 1);                                     \
+        ip->oids[0] = (v);                                              \
+        ip->len = 1;                                                    \
+    } while (0)
+
+live = netsnmp_container_find("test_live:table_container");
+live->compare = netsnmp_compare_netsnmp_index;
+fresh = netsnmp_container_find("test_fresh:table_container");
+fresh->compare = netsnmp_compare_netsnmp_index;
+
+for (i = 0; i < sizeof(live_oids)/sizeof(live_oids[0]); ++i) {
+    NEW_ITEM(live_oids[i]);
+    CONTAINER_INSERT(live, ip);
+}
+for (i = 0; i < sizeof(fresh_oids)/sizeof(fresh_oids[0]); ++i) {
+    NEW_ITEM(fresh_oids[i]);
+    CONTAINER_INSERT(fresh, ip);
+}
+
+key.oids = &key_oid;
+key.len = 1;
+key_oid = 3;
+kept[0] = CONTAINER_FIND(live, &key);
+key_oid = 7;
+kept[1] = CONTAINER_FIND(live, &key);
+
+rc = netsnmp_container_merge(live, fresh, NULL, NULL, &stats);
+OKF(rc == 0, ("merge succeeded"));
+OKF(stats.unchanged == 3, ("3 unchanged items (%d)", (int)stats.unchanged));
+OKF(stats.changed == 0, ("no changed items (%d)", (int)stats.changed));
+OKF(stats.added == 3, ("3 added items (%d)", (int)stats.added));
+OKF(stats.deleted == 2, ("2 deleted items (%d)", (int)stats.deleted));
+OKF(CONTAINER_SIZE(fresh) == 0, ("fresh container is empty"));
+OKF(CONTAINER_SIZE(live) == 6,
+    ("live container has 6 items (%d)", (int)CONTAINER_SIZE(live)));
+
+for (i = 0; i < sizeof(fresh_oids)/sizeof(fresh_oids[0]); ++i) {
+    key_oid = fresh_oids[i];
+    ip = CONTAINER_FIND(live, &key);
+    OKF(ip != NULL, ("item %d present after merge", (int)fresh_oids[i]));
+}
+key_oid = 1;
+OKF(CONTAINER_FIND(live, &key) == NULL, ("item 1 removed"));
+key_oid = 3;
+OKF(CONTAINER_FIND(live, &key) == kept[0], ("item 3 kept in place"));
+key_oid = 7;
+OKF(CONTAINER_FIND(live, &key) == kept[1], ("item 7 kept in place"));
+
+/* merging an empty snapshot removes everything */
+rc = netsnmp_container_merge(live, fresh, NULL, NULL, &stats);
+OKF(rc == 0 && stats.deleted == 6 && CONTAINER_SIZE(live) == 0,
+    ("merge with empty snapshot empties live container"));
+
+CONTAINER_FREE(fresh);
+CONTAINER_FREE(live);
+
+snmp_shutdown(test_name);
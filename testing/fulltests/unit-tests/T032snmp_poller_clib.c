@@ -0,0 +1,106 @@
+/* HEADER Testing the multi-target poller */
+
+static const char test_name[] = "snmp-poller-test";
+static const oid sysDescr[] = { 1, 3, 6, 1, 2, 1, 1, 1, 0 };
+netsnmp_poller_config config;
+netsnmp_poller *poller;
+netsnmp_poller_target *target;
+const netsnmp_poller_stats *stats;
+netsnmp_pdu *pdu;
+struct sockaddr_in agent_addr, from;
+socklen_t from_len;
+u_char packet[1500], *cp, type;
+size_t len;
+long version;
+u_char community[64];
+size_t community_len;
+char peer[64];
+int agent, spoofer, i, rc, received;
+ssize_t n;
+
+init_snmp(test_name);
+
+/*
+ * A UDP socket that plays the agent: the test reads the requests from it
+ * and answers them by hand.
+ */
+agent = socket(AF_INET, SOCK_DGRAM, 0);
+spoofer = socket(AF_INET, SOCK_DGRAM, 0);
+memset(&agent_addr, 0, sizeof(agent_addr));
+agent_addr.sin_family = AF_INET;
+agent_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+OK(bind(agent, (struct sockaddr *) &agent_addr, sizeof(agent_addr)) == 0,
+   "bind fake agent");
+from_len = sizeof(agent_addr);
+getsockname(agent, (struct sockaddr *) &agent_addr, &from_len);
+snprintf(peer, sizeof(peer), "127.0.0.1:%d", ntohs(agent_addr.sin_port));
+
+memset(&config, 0, sizeof(config));
+config.timeout = 50000;
+config.retries = 2;
+config.target_inflight = 5000;
+poller = netsnmp_poller_create(&config);
+OK(poller != NULL, "poller created");
+target = netsnmp_poller_add_target(poller, peer, SNMP_VERSION_2c, "public",
+                                   NULL);
+OK(target != NULL, "target added");
+stats = netsnmp_poller_get_stats(poller);
+
+/* an agent that never answers: two retries, then a timeout */
+pdu = snmp_pdu_create(SNMP_MSG_GET);
+snmp_add_null_var(pdu, sysDescr, OID_LENGTH(sysDescr));
+OK(netsnmp_poller_send(poller, target, pdu, NULL, NULL) > 0, "request queued");
+OK(netsnmp_poller_run(poller) == 0, "poller ran");
+OKF(stats->sent == 1 && stats->retries == 2 && stats->timeouts == 1,
+    ("sent %lu, retries %lu, timeouts %lu", stats->sent, stats->retries,
+     stats->timeouts));
+received = 0;
+while (recv(agent, packet, sizeof(packet), MSG_DONTWAIT) > 0)
+    received++;
+OKF(received == 3, ("agent saw %d copies of the request", received));
+
+/*
+ * answer a request: turn the GET into a RESPONSE by rewriting the PDU
+ * tag.  A copy from another address must not be accepted.
+ */
+pdu = snmp_pdu_create(SNMP_MSG_GET);
+snmp_add_null_var(pdu, sysDescr, OID_LENGTH(sysDescr));
+OK(netsnmp_poller_send(poller, target, pdu, NULL, NULL) > 0, "request queued");
+from_len = sizeof(from);
+n = recvfrom(agent, packet, sizeof(packet), 0, (struct sockaddr *) &from,
+             &from_len);
+OK(n > 0, "agent got request");
+len = n;
+cp = asn_parse_sequence(packet, &len, &type,
+                        ASN_SEQUENCE | ASN_CONSTRUCTOR, "message");
+cp = asn_parse_int(cp, &len, &type, &version, sizeof(version));
+community_len = sizeof(community);
+cp = asn_parse_string(cp, &len, &type, community, &community_len);
+OK(cp != NULL && version == SNMP_VERSION_2c && community_len == 6 &&
+   memcmp(community, "public", 6) == 0, "request is v2c/public");
+OK(cp != NULL && *cp == SNMP_MSG_GET, "request is a GET");
+*cp = SNMP_MSG_RESPONSE;
+sendto(spoofer, packet, n, 0, (struct sockaddr *) &from, from_len);
+sendto(agent, packet, n, 0, (struct sockaddr *) &from, from_len);
+OK(netsnmp_poller_run(poller) == 0, "poller ran");
+OKF(stats->received == 1 && stats->unmatched == 1 && stats->timeouts == 1,
+    ("received %lu, unmatched %lu, timeouts %lu", stats->received,
+     stats->unmatched, stats->timeouts));
+
+/* many outstanding requests at once (hash table growth, timer wheel) */
+netsnmp_poller_target_set_timeout(target, 20000, 0);
+for (i = 0, rc = 1; i < 5000 && rc > 0; i++) {
+    pdu = snmp_pdu_create(SNMP_MSG_GET);
+    snmp_add_null_var(pdu, sysDescr, OID_LENGTH(sysDescr));
+    rc = netsnmp_poller_send(poller, target, pdu, NULL, NULL);
+}
+OK(rc > 0, "5000 requests queued");
+OK(netsnmp_poller_pending(poller) == 5000, "5000 requests pending");
+OK(netsnmp_poller_run(poller) == 0, "poller ran");
+OKF(stats->timeouts == 5001, ("timeouts %lu", stats->timeouts));
+OK(netsnmp_poller_pending(poller) == 0, "nothing pending");
+
+netsnmp_poller_free(poller);
+close(agent);
+close(spoofer);
+snmp_shutdown(test_name);
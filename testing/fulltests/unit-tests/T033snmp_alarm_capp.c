@@ -0,0 +1,210 @@
+/*
+ * HEADER Testing snmp_alarm scheduling with 100000 alarms
+ *
+ * Registers a large number of alarms and checks that they fire in order,
+ * that repeating, reset and unregistered alarms behave, and reports how
+ * long registering, resetting, firing and unregistering took.  The number
+ * of alarms can be passed as the first argument for benchmarking.
+ */
+
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-includes.h>
+#include <net-snmp/library/testing.h>
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+NETSNMP_IMPORT struct snmp_alarm *sa_find_specific(unsigned int clientreg);
+
+#define NALARMS 100000
+
+static int      fired, out_of_order, repeat_fired;
+static struct timeval last_due;
+static unsigned int self_unreg;
+static unsigned long rnd = 1;
+
+static unsigned int
+next_random(void)
+{
+    rnd = rnd * 1103515245 + 12345;
+    return (unsigned int) (rnd >> 16) & 0x7fff;
+}
+
+/*
+ * clientarg points to the time the alarm was due; alarms must fire in that
+ * order.
+ */
+static void
+order_callback(unsigned int clientreg, void *clientarg)
+{
+    struct timeval *due = (struct timeval *) clientarg;
+
+    if (timercmp(due, &last_due, <))
+        out_of_order++;
+    last_due = *due;
+    fired++;
+}
+
+static void
+repeat_callback(unsigned int clientreg, void *clientarg)
+{
+    if (++repeat_fired == 3)
+        snmp_alarm_unregister(clientreg);
+}
+
+static void
+self_unregister_callback(unsigned int clientreg, void *clientarg)
+{
+    self_unreg = clientreg;
+    snmp_alarm_unregister(clientreg);
+}
+
+static void
+never_callback(unsigned int clientreg, void *clientarg)
+{
+    fired++;
+}
+
+static long
+elapsed_ms(const struct timeval *start)
+{
+    struct timeval  now, diff;
+
+    netsnmp_get_monotonic_clock(&now);
+    NETSNMP_TIMERSUB(&now, start, &diff);
+    return diff.tv_sec * 1000 + diff.tv_usec / 1000;
+}
+
+/*
+ * Run alarms until none is left or until timeout_ms passed.
+ */
+static void
+run_until_idle(long timeout_ms)
+{
+    struct timeval  start, delta;
+
+    netsnmp_get_monotonic_clock(&start);
+    while (get_next_alarm_delay_time(&delta) &&
+           elapsed_ms(&start) < timeout_ms) {
+        if (delta.tv_sec > 0 || delta.tv_usec > 0)
+            usleep(delta.tv_sec * 1000000 + delta.tv_usec);
+        run_alarms();
+    }
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct timeval  t, start, delta;
+    struct timeval *due;
+    struct snmp_alarm *sa;
+    unsigned int   *regs, reg, first;
+    int             nalarms = NALARMS, i, missing;
+
+    if (argc > 1)
+        nalarms = atoi(argv[1]);
+
+    netsnmp_ds_set_boolean(NETSNMP_DS_LIBRARY_ID,
+                           NETSNMP_DS_LIB_ALARM_DONT_USE_SIG, 1);
+    init_snmp("snmp-alarm-test");
+
+    regs = calloc(nalarms, sizeof(*regs));
+    due = calloc(nalarms, sizeof(*due));
+
+    /*
+     * one-shot alarms due within 200ms, in random order
+     */
+    netsnmp_get_monotonic_clock(&start);
+    for (i = 0; i < nalarms; i++) {
+        t.tv_sec = 0;
+        t.tv_usec = (next_random() % 2000) * 100 + 1;
+        regs[i] = snmp_alarm_register_hr(t, 0, order_callback, &due[i]);
+        sa = sa_find_specific(regs[i]);
+        if (sa)
+            due[i] = sa->t_nextM;
+    }
+    printf("# registered %d alarms in %ld ms\n", nalarms, elapsed_ms(&start));
+    for (missing = 0, i = 0; i < nalarms; i++)
+        if (regs[i] == 0 || sa_find_specific(regs[i]) == NULL)
+            missing++;
+    OKF(missing == 0, ("all alarms registered (%d missing)", missing));
+
+    netsnmp_get_monotonic_clock(&start);
+    run_until_idle(30000);
+    printf("# fired %d alarms in %ld ms\n", fired, elapsed_ms(&start));
+    OKF(fired == nalarms, ("all alarms fired (%d of %d)", fired, nalarms));
+    OKF(out_of_order == 0, ("alarms fired in order (%d out of order)",
+                            out_of_order));
+    OKF(sa_find_specific(regs[0]) == NULL,
+        ("one-shot alarms are removed after firing"));
+
+    /*
+     * repeating alarm that unregisters itself after three runs, and an
+     * alarm unregistering itself in its first run
+     */
+    t.tv_sec = 0;
+    t.tv_usec = 1000;
+    snmp_alarm_register_hr(t, SA_REPEAT, repeat_callback, NULL);
+    reg = snmp_alarm_register_hr(t, 0, self_unregister_callback, NULL);
+    run_until_idle(5000);
+    OKF(repeat_fired == 3, ("repeating alarm fired %d times", repeat_fired));
+    OKF(self_unreg == reg && sa_find_specific(reg) == NULL,
+        ("alarm unregistered itself"));
+
+    /*
+     * long-running alarms: reset them all, then check which one is next and
+     * unregister them
+     */
+    fired = 0;
+    netsnmp_get_monotonic_clock(&start);
+    for (i = 0; i < nalarms; i++)
+        regs[i] = snmp_alarm_register(1000 + next_random(), SA_REPEAT,
+                                      never_callback, NULL);
+    printf("# registered %d repeating alarms in %ld ms\n", nalarms,
+           elapsed_ms(&start));
+
+    netsnmp_get_monotonic_clock(&start);
+    for (i = 0; i < nalarms; i++)
+        snmp_alarm_reset(regs[i]);
+    printf("# reset %d alarms in %ld ms\n", nalarms, elapsed_ms(&start));
+
+    netsnmp_get_monotonic_clock(&start);
+    for (i = 0; i < nalarms; i++)
+        run_alarms();
+    printf("# %d idle run_alarms() calls in %ld ms\n", nalarms,
+           elapsed_ms(&start));
+    OKF(fired == 0, ("no alarm fired early (%d fired)", fired));
+
+    /*
+     * give one alarm the shortest interval; it must be the next one
+     */
+    first = nalarms / 2;
+    sa = sa_find_specific(regs[first]);
+    if (sa)
+        sa->t.tv_sec = 500;
+    snmp_alarm_reset(regs[first]);
+    OKF(get_next_alarm_delay_time(&delta) == (int) regs[first] &&
+        delta.tv_sec < 500,
+        ("reset alarm with the shortest interval is the next one"));
+
+    netsnmp_get_monotonic_clock(&start);
+    for (i = 0; i < nalarms; i += 2)
+        snmp_alarm_unregister(regs[i]);
+    for (i = 1; i < nalarms; i += 2)
+        snmp_alarm_unregister(regs[i]);
+    printf("# unregistered %d alarms in %ld ms\n", nalarms,
+           elapsed_ms(&start));
+    OKF(get_next_alarm_delay_time(&delta) == 0, ("no alarms left"));
+
+    snmp_alarm_unregister_all();
+    snmp_shutdown("snmp-alarm-test");
+    free(regs);
+    free(due);
+
+    PLAN(__test_counter);
+    return 0;
+}
@@ -0,0 +1,214 @@
+/*
+ * HEADER Testing many outstanding requests on one session
+ *
+ * Sends a large number of asynchronous requests to a fake agent that
+ * answers only those with an even request id, and checks that every
+ * answered request is matched and every other one is retransmitted once
+ * and then times out.  The number of requests can be passed as the first
+ * argument for benchmarking.
+ */
+
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-includes.h>
+#include <net-snmp/library/testing.h>
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#ifdef HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#endif
+#ifdef HAVE_SYS_SELECT_H
+#include <sys/select.h>
+#endif
+
+#define NREQUESTS 20000
+
+static const oid sysDescr[] = { 1, 3, 6, 1, 2, 1, 1, 1, 0 };
+static int      received, timed_out, resent, mismatched;
+
+static int
+response_callback(int op, netsnmp_session *sp, int reqid,
+                  netsnmp_pdu *pdu, void *magic)
+{
+    switch (op) {
+    case NETSNMP_CALLBACK_OP_RECEIVED_MESSAGE:
+        if (reqid % 2 != 0 || pdu->reqid != reqid)
+            mismatched++;
+        received++;
+        break;
+    case NETSNMP_CALLBACK_OP_TIMED_OUT:
+        if (reqid % 2 == 0)
+            mismatched++;
+        timed_out++;
+        break;
+    case NETSNMP_CALLBACK_OP_RESEND:
+        resent++;
+        break;
+    }
+    return 1;
+}
+
+/*
+ * Answer the requests waiting on the fake agent socket that have an even
+ * request id, by turning them into responses.
+ */
+static void
+answer_requests(int agent)
+{
+    u_char          packet[1500], community[64], *cp, *pdu_cp, type;
+    struct sockaddr_in from;
+    socklen_t       from_len;
+    size_t          len, community_len;
+    long            version, reqid;
+    ssize_t         n;
+
+    for (;;) {
+        from_len = sizeof(from);
+        n = recvfrom(agent, packet, sizeof(packet), MSG_DONTWAIT,
+                     (struct sockaddr *) &from, &from_len);
+        if (n <= 0)
+            return;
+        len = n;
+        cp = asn_parse_sequence(packet, &len, &type,
+                                ASN_SEQUENCE | ASN_CONSTRUCTOR, "message");
+        cp = asn_parse_int(cp, &len, &type, &version, sizeof(version));
+        community_len = sizeof(community);
+        cp = asn_parse_string(cp, &len, &type, community, &community_len);
+        if (cp == NULL || *cp != SNMP_MSG_GET)
+            continue;
+        pdu_cp = cp;
+        cp = asn_parse_header(cp, &len, &type);
+        cp = asn_parse_int(cp, &len, &type, &reqid, sizeof(reqid));
+        if (cp == NULL || reqid % 2 != 0)
+            continue;
+        *pdu_cp = SNMP_MSG_RESPONSE;
+        sendto(agent, packet, n, 0, (struct sockaddr *) &from, from_len);
+    }
+}
+
+/*
+ * Let the fake agent answer, then read all responses that arrived and
+ * handle timeouts, waiting at most wait_us for something to happen.
+ */
+static void
+pump(struct session_list *ss, int agent, long wait_us)
+{
+    struct timeval  tv;
+    fd_set          fdset;
+    int             numfds, block, count;
+
+    answer_requests(agent);
+    do {
+        numfds = 0;
+        block = 0;
+        FD_ZERO(&fdset);
+        tv.tv_sec = 0;
+        tv.tv_usec = wait_us;
+        snmp_sess_select_info(ss, &numfds, &fdset, &tv, &block);
+        FD_SET(agent, &fdset);
+        if (agent >= numfds)
+            numfds = agent + 1;
+        count = select(numfds, &fdset, NULL, NULL, &tv);
+        if (count > 0) {
+            snmp_sess_read(ss, &fdset);
+            answer_requests(agent);
+        }
+        snmp_sess_timeout(ss);
+        wait_us = 0;
+    } while (count > 0);
+}
+
+int
+main(int argc, char *argv[])
+{
+    netsnmp_session session;
+    struct session_list *ss;
+    netsnmp_pdu    *pdu;
+    struct sockaddr_in agent_addr;
+    socklen_t       addr_len;
+    struct timeval  start, now, tv;
+    char            peer[64];
+    int             nrequests = NREQUESTS, even = 0, sent = 0, agent;
+    int             i, reqid;
+
+    if (argc > 1)
+        nrequests = atoi(argv[1]);
+
+    init_snmp("snmp-api-requests-test");
+
+    agent = socket(AF_INET, SOCK_DGRAM, 0);
+    memset(&agent_addr, 0, sizeof(agent_addr));
+    agent_addr.sin_family = AF_INET;
+    agent_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    OK(bind(agent, (struct sockaddr *) &agent_addr, sizeof(agent_addr)) == 0,
+       "bind fake agent");
+    i = 4 * 1024 * 1024;
+    setsockopt(agent, SOL_SOCKET, SO_RCVBUF, &i, sizeof(i));
+    addr_len = sizeof(agent_addr);
+    getsockname(agent, (struct sockaddr *) &agent_addr, &addr_len);
+    snprintf(peer, sizeof(peer), "udp:127.0.0.1:%d",
+             ntohs(agent_addr.sin_port));
+
+    snmp_sess_init(&session);
+    session.version = SNMP_VERSION_2c;
+    session.community = (u_char *) strdup("public");
+    session.community_len = 6;
+    session.peername = peer;
+    session.timeout = 500000;
+    session.retries = 1;
+    ss = snmp_sess_open(&session);
+    OK(ss != NULL, "session opened");
+    free(session.community);
+    if (ss == NULL)
+        return 1;
+
+    netsnmp_get_monotonic_clock(&start);
+    for (i = 0; i < nrequests; i++) {
+        pdu = snmp_pdu_create(SNMP_MSG_GET);
+        snmp_add_null_var(pdu, sysDescr, OID_LENGTH(sysDescr));
+        reqid = pdu->reqid;
+        if (snmp_sess_async_send(ss, pdu, response_callback, NULL) == 0) {
+            snmp_free_pdu(pdu);
+            continue;
+        }
+        sent++;
+        if (reqid % 2 == 0)
+            even++;
+        if (i % 32 == 31)
+            pump(ss, agent, 0);
+    }
+    OKF(sent == nrequests, ("%d of %d requests sent", sent, nrequests));
+
+    while (received + timed_out < sent) {
+        netsnmp_get_monotonic_clock(&now);
+        if (now.tv_sec - start.tv_sec > 30)
+            break;
+        pump(ss, agent, 10000);
+    }
+    netsnmp_get_monotonic_clock(&now);
+    NETSNMP_TIMERSUB(&now, &start, &tv);
+    printf("# %d requests handled in %ld ms\n", sent,
+           (long) (tv.tv_sec * 1000 + tv.tv_usec / 1000));
+
+    OKF(received == even, ("%d of %d answered requests matched",
+                           received, even));
+    OKF(timed_out == sent - even, ("%d of %d unanswered requests timed out",
+                                   timed_out, sent - even));
+    OKF(resent == sent - even, ("%d of %d unanswered requests resent",
+                                resent, sent - even));
+    OKF(mismatched == 0, ("%d requests got the wrong outcome", mismatched));
+
+    snmp_sess_close(ss);
+    close(agent);
+    snmp_shutdown("snmp-api-requests-test");
+
+    PLAN(__test_counter);
+    return 0;
+}
@@ -0,0 +1,213 @@
+/*
+ * HEADER Testing ID generators and sessions used from several threads
+ *
+ * Draws request ids from several threads at once and checks that they are
+ * unique, then has each thread send asynchronous requests on its own
+ * session and reports the throughput for one thread and for all threads.
+ * The number of threads and of requests per thread can be passed as
+ * arguments for benchmarking.  Needs --enable-reentrant.
+ */
+
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-includes.h>
+#include <net-snmp/library/testing.h>
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#ifdef HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#endif
+
+#if defined(NETSNMP_REENTRANT) && defined(HAVE_PTHREAD_H)
+
+#include <pthread.h>
+
+#define MAX_THREADS 64
+#define NTHREADS    4
+#define NREQUESTS   20000
+
+static const oid sysDescr[] = { 1, 3, 6, 1, 2, 1, 1, 1, 0 };
+
+struct thread_data {
+    pthread_t       thread;
+    void           *ss;
+    long           *ids;
+    int             count;
+    int             sent;
+};
+
+static int
+compare_ids(const void *a, const void *b)
+{
+    long            x = *(const long *) a, y = *(const long *) b;
+
+    return x < y ? -1 : x > y;
+}
+
+static void    *
+draw_ids(void *arg)
+{
+    struct thread_data *td = arg;
+    int             i;
+
+    for (i = 0; i < td->count; i++)
+        td->ids[i] = snmp_get_next_reqid();
+    return NULL;
+}
+
+static void    *
+send_requests(void *arg)
+{
+    struct thread_data *td = arg;
+    netsnmp_pdu    *pdu;
+    int             i;
+
+    for (i = 0; i < td->count; i++) {
+        pdu = snmp_pdu_create(SNMP_MSG_GET);
+        snmp_add_null_var(pdu, sysDescr, OID_LENGTH(sysDescr));
+        if (snmp_sess_async_send(td->ss, pdu, NULL, NULL) == 0) {
+            snmp_free_pdu(pdu);
+            continue;
+        }
+        td->sent++;
+    }
+    return NULL;
+}
+
+static long
+elapsed_us(const struct timeval *start)
+{
+    struct timeval  now, diff;
+
+    netsnmp_get_monotonic_clock(&now);
+    NETSNMP_TIMERSUB(&now, start, &diff);
+    return diff.tv_sec * 1000000 + diff.tv_usec;
+}
+
+/*
+ * Run fn in nthreads threads; return the time it took in microseconds.
+ */
+static long
+run_threads(struct thread_data *td, int nthreads, void *(*fn) (void *))
+{
+    struct timeval  start;
+    int             i;
+
+    netsnmp_get_monotonic_clock(&start);
+    for (i = 0; i < nthreads; i++)
+        pthread_create(&td[i].thread, NULL, fn, &td[i]);
+    for (i = 0; i < nthreads; i++)
+        pthread_join(td[i].thread, NULL);
+    return elapsed_us(&start);
+}
+
+int
+main(int argc, char *argv[])
+{
+    static struct thread_data td[MAX_THREADS];
+    netsnmp_session session;
+    struct sockaddr_in sink_addr;
+    socklen_t       addr_len;
+    char            peer[64];
+    long           *ids, us_one, us_all;
+    int             nthreads = NTHREADS, count = NREQUESTS, sink;
+    int             i, total, duplicates, opened, sent;
+
+    if (argc > 1)
+        nthreads = atoi(argv[1]);
+    if (argc > 2)
+        count = atoi(argv[2]);
+    if (nthreads < 1 || nthreads > MAX_THREADS)
+        nthreads = NTHREADS;
+
+    init_snmp("mt-sessions-test");
+
+    /*
+     * request ids drawn concurrently must all be different
+     */
+    total = nthreads * count;
+    ids = calloc(total, sizeof(*ids));
+    for (i = 0; i < nthreads; i++) {
+        td[i].ids = ids + i * count;
+        td[i].count = count;
+    }
+    us_all = run_threads(td, nthreads, draw_ids);
+    printf("# %d threads drew %d request ids in %ld us\n", nthreads, total,
+           us_all);
+    qsort(ids, total, sizeof(*ids), compare_ids);
+    for (duplicates = 0, i = 1; i < total; i++)
+        if (ids[i] == ids[i - 1])
+            duplicates++;
+    OKF(duplicates == 0 && ids[0] > 0,
+        ("%d duplicate request ids among %d", duplicates, total));
+    free(ids);
+
+    /*
+     * one session per thread, all sending to a socket that never answers
+     */
+    sink = socket(AF_INET, SOCK_DGRAM, 0);
+    memset(&sink_addr, 0, sizeof(sink_addr));
+    sink_addr.sin_family = AF_INET;
+    sink_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(sink, (struct sockaddr *) &sink_addr, sizeof(sink_addr));
+    addr_len = sizeof(sink_addr);
+    getsockname(sink, (struct sockaddr *) &sink_addr, &addr_len);
+    snprintf(peer, sizeof(peer), "udp:127.0.0.1:%d",
+             ntohs(sink_addr.sin_port));
+
+    snmp_sess_init(&session);
+    session.version = SNMP_VERSION_2c;
+    session.community = (u_char *) "public";
+    session.community_len = 6;
+    session.peername = peer;
+    session.timeout = 60 * 1000000L;
+    session.retries = 0;
+    for (opened = 0, i = 0; i < nthreads; i++) {
+        td[i].ss = snmp_sess_open(&session);
+        if (td[i].ss)
+            opened++;
+    }
+    OKF(opened == nthreads, ("%d of %d sessions opened", opened, nthreads));
+    if (opened != nthreads)
+        return 1;
+
+    us_one = run_threads(td, 1, send_requests);
+    printf("# 1 thread sent %d requests in %ld us (%ld/s)\n", td[0].sent,
+           us_one, us_one ? td[0].sent * 1000000L / us_one : 0);
+
+    for (i = 0; i < nthreads; i++)
+        td[i].sent = 0;
+    us_all = run_threads(td, nthreads, send_requests);
+    for (sent = 0, i = 0; i < nthreads; i++)
+        sent += td[i].sent;
+    printf("# %d threads sent %d requests in %ld us (%ld/s)\n", nthreads,
+           sent, us_all, us_all ? sent * 1000000L / us_all : 0);
+    OKF(sent == total, ("%d of %d requests sent", sent, total));
+
+    for (i = 0; i < nthreads; i++)
+        snmp_sess_close(td[i].ss);
+    close(sink);
+    snmp_shutdown("mt-sessions-test");
+
+    PLAN(__test_counter);
+    return 0;
+}
+
+#else /* NETSNMP_REENTRANT && HAVE_PTHREAD_H */
+
+int
+main(int argc, char *argv[])
+{
+    OK(1, "skipped: not built with --enable-reentrant");
+    PLAN(__test_counter);
+    return 0;
+}
+
+#endif /* NETSNMP_REENTRANT && HAVE_PTHREAD_H */
@@ -0,0 +1,221 @@
+/*
+ * HEADER Testing snmptrapd compiled log formats
+ *
+ * Compiles a number of snmptrapd format strings and checks what they
+ * produce for a synthetic notification, including the JSON-lines output.
+ * Then formats many traps by parsing the format string each time and
+ * with the compiled format and a reused buffer, and reports the time
+ * taken by both.  The number of traps can be passed as the first argument
+ * for benchmarking.
+ */
+
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-includes.h>
+#include <net-snmp/library/testing.h>
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+/*
+ * The formatting code is part of snmptrapd, not of a library.
+ */
+#include "../../../apps/snmptrapd_log.c"
+
+#define NTRAPS 20000
+
+const char     *
+trap_description(int trap)
+{
+    return "Cold Start";
+}
+
+static const oid sysUpTime[] = { 1, 3, 6, 1, 2, 1, 1, 3, 0 };
+static const oid snmpTrapOID[] = { 1, 3, 6, 1, 6, 3, 1, 1, 4, 1, 0 };
+static const oid coldStart[] = { 1, 3, 6, 1, 6, 3, 1, 1, 5, 1 };
+static const oid sysContact[] = { 1, 3, 6, 1, 2, 1, 1, 4, 0 };
+static const oid ifIndex[] = { 1, 3, 6, 1, 2, 1, 2, 2, 1, 1, 7 };
+static const oid ifPhysAddress[] = { 1, 3, 6, 1, 2, 1, 2, 2, 1, 6, 7 };
+
+static netsnmp_pdu *
+make_trap(void)
+{
+    netsnmp_pdu    *pdu;
+    u_long          uptime = 12345;
+    long            index = 7;
+    const u_char    mac[] = { 0x00, 0x1b, 0x2c, 0xff, 0x10, 0x01 };
+
+    pdu = snmp_pdu_create(SNMP_MSG_TRAP2);
+    pdu->version = SNMP_VERSION_2c;
+    pdu->community = (u_char *) strdup("public");
+    pdu->community_len = 6;
+    snmp_pdu_add_variable(pdu, sysUpTime, OID_LENGTH(sysUpTime),
+                          ASN_TIMETICKS, &uptime, sizeof(uptime));
+    snmp_pdu_add_variable(pdu, snmpTrapOID, OID_LENGTH(snmpTrapOID),
+                          ASN_OBJECT_ID, coldStart, sizeof(coldStart));
+    snmp_pdu_add_variable(pdu, sysContact, OID_LENGTH(sysContact),
+                          ASN_OCTET_STR, "say \"hi\"\n", 9);
+    snmp_pdu_add_variable(pdu, ifIndex, OID_LENGTH(ifIndex),
+                          ASN_INTEGER, &index, sizeof(index));
+    snmp_pdu_add_variable(pdu, ifPhysAddress, OID_LENGTH(ifPhysAddress),
+                          ASN_OCTET_STR, mac, sizeof(mac));
+    return pdu;
+}
+
+/*
+ * Format a trap with a freshly compiled format and return the result.
+ */
+static char    *
+format(const char *format_str, netsnmp_pdu *pdu)
+{
+    netsnmp_trapd_format *fmt;
+    u_char         *buf = NULL;
+    size_t          buf_len = 0, out_len = 0;
+
+    fmt = netsnmp_trapd_format_compile(format_str);
+    if (fmt == NULL)
+        return NULL;
+    if (!realloc_format_compiled_trap(&buf, &buf_len, &out_len, 1, fmt,
+                                      pdu, NULL))
+        SNMP_FREE(buf);
+    netsnmp_trapd_format_free(fmt);
+    return (char *) buf;
+}
+
+static void
+check(const char *format_str, netsnmp_pdu *pdu, const char *expected)
+{
+    char           *out = format(format_str, pdu);
+
+    OKF(out && strcmp(out, expected) == 0,
+        ("format \"%s\" gives \"%s\"", format_str, out ? out : "(null)"));
+    free(out);
+}
+
+static void
+check_contains(const char *out, const char *expected)
+{
+    OKF(out && strstr(out, expected) != NULL,
+        ("JSON output contains %s", expected));
+}
+
+static long
+elapsed_ms(const struct timeval *start)
+{
+    struct timeval  now, tv;
+
+    netsnmp_get_monotonic_clock(&now);
+    NETSNMP_TIMERSUB(&now, start, &tv);
+    return (long) (tv.tv_sec * 1000 + tv.tv_usec / 1000);
+}
+
+int
+main(int argc, char *argv[])
+{
+    static const char bench_format[] =
+        "%.4y-%.2m-%.2l %.2h:%.2j:%.2k %B [%b]:\n%v\n";
+    netsnmp_trapd_format *fmt;
+    netsnmp_trapd_format_buf *fb;
+    netsnmp_pdu    *pdu;
+    struct timeval  start;
+    u_char         *buf;
+    size_t          buf_len, out_len;
+    char           *out, expected[64];
+    time_t          now;
+    int             ntraps = NTRAPS, i, failed;
+
+    if (argc > 1)
+        ntraps = atoi(argv[1]);
+
+    netsnmp_ds_set_int(NETSNMP_DS_LIBRARY_ID,
+                       NETSNMP_DS_LIB_OID_OUTPUT_FORMAT,
+                       NETSNMP_OID_OUTPUT_NUMERIC);
+    netsnmp_ds_set_boolean(NETSNMP_DS_LIBRARY_ID,
+                           NETSNMP_DS_LIB_QUICK_PRINT, 1);
+    init_snmp("trapd-format-test");
+    pdu = make_trap();
+
+    check("no commands\n", pdu, "no commands\n");
+    check("\\t\\\\%%\\q", pdu, "\t\\%\\q");
+    check("[%6s][%-4w][%.3W]", pdu, "[     1][0000][Col]");
+    check("%B %b", pdu, "<UNKNOWN> <UNKNOWN>");
+    check("%V;%v", pdu,
+          ".1.3.6.1.2.1.1.3.0 0:0:02:03.45;"
+          ".1.3.6.1.6.3.1.1.4.1.0 .1.3.6.1.6.3.1.1.5.1;"
+          ".1.3.6.1.2.1.1.4.0 say \"hi\"\n;"
+          ".1.3.6.1.2.1.2.2.1.1.7 7;"
+          ".1.3.6.1.2.1.2.2.1.6.7 0:1b:2c:ff:10:1");
+    check("%V|%#.20v", pdu, "|.1.3.6.1.2.1.1.3.0 ");
+    check("%V\\t%", pdu, "");
+
+    time(&now);
+    strftime(expected, sizeof(expected), "%Y", localtime(&now));
+    check("%.4y", pdu, expected);
+
+    out = format("json", pdu);
+    OK(out && out[0] == '{' && strcmp(out + strlen(out) - 3, "]}\n") == 0 &&
+       strchr(out, '\n') == out + strlen(out) - 1,
+       "JSON output is one object on one line");
+    check_contains(out, "\"host\":\"<UNKNOWN>\",\"address\":\"<UNKNOWN>\","
+                   "\"pdu\":\"TRAP2\",\"version\":\"2c\","
+                   "\"community\":\"public\"");
+    check_contains(out, "\"trapOID\":\".1.3.6.1.6.3.1.1.5.1\"");
+    check_contains(out, "{\"oid\":\".1.3.6.1.2.1.1.3.0\","
+                   "\"type\":\"timeticks\",\"value\":12345}");
+    check_contains(out, "\"value\":\"say \\\"hi\\\"\\n\"");
+    check_contains(out, "{\"oid\":\".1.3.6.1.2.1.2.2.1.1.7\","
+                   "\"type\":\"integer\",\"value\":7}");
+    check_contains(out, "\"value\":\"001b2cff1001\",\"encoding\":\"hex\"");
+    free(out);
+
+    /*
+     * parse the format string for every trap, as snmptrapd used to
+     */
+    failed = 0;
+    netsnmp_get_monotonic_clock(&start);
+    for (i = 0; i < ntraps; i++) {
+        buf_len = 64;
+        out_len = 0;
+        buf = calloc(buf_len, 1);
+        if (!realloc_format_trap(&buf, &buf_len, &out_len, 1, bench_format,
+                                 pdu, NULL))
+            failed++;
+        free(buf);
+    }
+    printf("# %d traps formatted from the format string in %ld ms\n",
+           ntraps, elapsed_ms(&start));
+
+    fmt = netsnmp_trapd_format_compile(bench_format);
+    netsnmp_get_monotonic_clock(&start);
+    for (i = 0; i < ntraps; i++) {
+        fb = netsnmp_trapd_format_buffer();
+        if (!realloc_format_compiled_trap(&fb->buf, &fb->buf_len,
+                                          &fb->out_len, 1, fmt, pdu, NULL))
+            failed++;
+    }
+    printf("# %d traps formatted from the compiled format in %ld ms\n",
+           ntraps, elapsed_ms(&start));
+    netsnmp_trapd_format_free(fmt);
+
+    fmt = netsnmp_trapd_format_compile("json");
+    netsnmp_get_monotonic_clock(&start);
+    for (i = 0; i < ntraps; i++) {
+        fb = netsnmp_trapd_format_buffer();
+        if (!realloc_format_compiled_trap(&fb->buf, &fb->buf_len,
+                                          &fb->out_len, 1, fmt, pdu, NULL))
+            failed++;
+    }
+    printf("# %d traps formatted as JSON in %ld ms\n",
+           ntraps, elapsed_ms(&start));
+    netsnmp_trapd_format_free(fmt);
+    OKF(failed == 0, ("%d traps could not be formatted", failed));
+
+    snmp_free_pdu(pdu);
+    snmp_shutdown("trapd-format-test");
+
+    PLAN(__test_counter);
+    return 0;
+}
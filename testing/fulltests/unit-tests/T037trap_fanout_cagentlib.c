@@ -0,0 +1,169 @@
+/*
+ * HEADER Testing encode-once notification fan-out
+ *
+ * Checks that a notification built from shared encoded varbinds is the
+ * same as one encoded the usual way, in both encoding directions, and
+ * that a notification reaches each of many local trap sinks.  Then sends
+ * notifications to all the sinks, encoding the varbinds for every sink
+ * and once for all of them, and reports the time taken by both.  The
+ * number of notifications can be passed as the first argument for
+ * benchmarking.
+ */
+
+#define NSINKS 100
+
+static const oid snmpTrapOID[] = { 1, 3, 6, 1, 6, 3, 1, 1, 4, 1, 0 };
+static const oid linkDown[] = { 1, 3, 6, 1, 6, 3, 1, 1, 5, 3 };
+static const oid sysUpTime[] = { 1, 3, 6, 1, 2, 1, 1, 3, 0 };
+static const oid ifIndex[] = { 1, 3, 6, 1, 2, 1, 2, 2, 1, 1, 7 };
+static const oid ifDescr[] = { 1, 3, 6, 1, 2, 1, 2, 2, 1, 2, 7 };
+static const oid ifAdminStatus[] = { 1, 3, 6, 1, 2, 1, 2, 2, 1, 7, 7 };
+static const oid ifOperStatus[] = { 1, 3, 6, 1, 2, 1, 2, 2, 1, 8, 7 };
+static const oid ifAlias[] = { 1, 3, 6, 1, 2, 1, 31, 1, 1, 1, 18, 7 };
+netsnmp_session  sess, *sinks[NSINKS];
+netsnmp_pdu     *pdu, *plain, *shared;
+netsnmp_variable_list *vars = NULL;
+struct sockaddr_in addr;
+socklen_t        addr_len = sizeof(addr);
+struct timeval   start, now, diff;
+u_char          *pkt[2], *data[2], rbuf[1500];
+size_t           pkt_len[2], offset[2];
+char             peer[64];
+long             index = 7, up = 2, down = 2;
+u_long           uptime = 12345;
+int              ntraps = 500, reverse, once, sock, i, j, received, failed;
+
+if (argc > 1)
+    ntraps = atoi(argv[1]);
+
+init_snmp("trap-fanout-test");
+
+snmp_varlist_add_variable(&vars, snmpTrapOID, OID_LENGTH(snmpTrapOID),
+                          ASN_OBJECT_ID, linkDown, sizeof(linkDown));
+snmp_varlist_add_variable(&vars, ifIndex, OID_LENGTH(ifIndex),
+                          ASN_INTEGER, &index, sizeof(index));
+snmp_varlist_add_variable(&vars, ifDescr, OID_LENGTH(ifDescr),
+                          ASN_OCTET_STR, "GigabitEthernet0/7", 18);
+snmp_varlist_add_variable(&vars, ifAdminStatus, OID_LENGTH(ifAdminStatus),
+                          ASN_INTEGER, &up, sizeof(up));
+snmp_varlist_add_variable(&vars, ifOperStatus, OID_LENGTH(ifOperStatus),
+                          ASN_INTEGER, &down, sizeof(down));
+snmp_varlist_add_variable(&vars, ifAlias, OID_LENGTH(ifAlias),
+                          ASN_OCTET_STR, "uplink to core switch", 21);
+
+/*
+ * the same packet is built with and without shared varbinds
+ */
+snmp_sess_init(&sess);
+sess.version = SNMP_VERSION_2c;
+sess.community = (u_char *) "public";
+sess.community_len = 6;
+for (reverse = 0; reverse <= 1; reverse++) {
+    netsnmp_ds_set_boolean(NETSNMP_DS_LIBRARY_ID,
+                           NETSNMP_DS_LIB_REVERSE_ENCODE, reverse);
+    pdu = snmp_pdu_create(SNMP_MSG_TRAP2);
+    pdu->version = SNMP_VERSION_2c;
+    pdu->reqid = 1234;
+    snmp_varlist_add_variable(&pdu->variables, sysUpTime,
+                              OID_LENGTH(sysUpTime), ASN_TIMETICKS,
+                              &uptime, sizeof(uptime));
+    pdu->variables->next_variable = snmp_clone_varbind(vars);
+    plain = snmp_clone_pdu(pdu);
+    OK(snmp_pdu_encode_varbinds(pdu) == 0, "varbinds encoded");
+    shared = snmp_clone_pdu(pdu);
+    OK(shared && shared->varbind_encoding == NULL,
+       "encoding not copied by snmp_clone_pdu()");
+    snmp_pdu_share_varbind_encoding(shared, pdu);
+    snmp_free_pdu(pdu);
+
+    for (i = 0; i < 2; i++) {
+        pkt_len[i] = SNMP_MAX_MSG_SIZE;
+        offset[i] = 0;
+        pkt[i] = malloc(pkt_len[i]);
+        if (snmp_build(&pkt[i], &pkt_len[i], &offset[i], &sess,
+                       i ? shared : plain) != 0) {
+            pkt_len[i] = 0;
+            data[i] = pkt[i];
+        } else if (offset[i]) {
+            data[i] = pkt[i] + pkt_len[i] - offset[i];
+            pkt_len[i] = offset[i];
+        } else
+            data[i] = pkt[i];
+    }
+    OKF(pkt_len[0] != 0 && pkt_len[0] == pkt_len[1] &&
+        memcmp(data[0], data[1], pkt_len[0]) == 0,
+        ("%s encoded packets of %d and %d bytes are the same",
+         reverse ? "reverse" : "forward", (int) pkt_len[0],
+         (int) pkt_len[1]));
+    free(pkt[0]);
+    free(pkt[1]);
+    snmp_free_pdu(plain);
+    snmp_free_pdu(shared);
+}
+
+/*
+ * all the sinks send to one local socket
+ */
+sock = socket(AF_INET, SOCK_DGRAM, 0);
+memset(&addr, 0, sizeof(addr));
+addr.sin_family = AF_INET;
+addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+OK(sock >= 0 && bind(sock, (struct sockaddr *) &addr, sizeof(addr)) == 0 &&
+   getsockname(sock, (struct sockaddr *) &addr, &addr_len) == 0,
+   "local trap receiver");
+snprintf(peer, sizeof(peer), "udp:127.0.0.1:%d", ntohs(addr.sin_port));
+
+failed = 0;
+for (i = 0; i < NSINKS; i++) {
+    snmp_sess_init(&sess);
+    sess.peername = peer;
+    sess.version = SNMP_VERSION_2c;
+    sess.community = (u_char *) "public";
+    sess.community_len = 6;
+    sinks[i] = snmp_open(&sess);
+    if (!sinks[i] ||
+        !add_trap_session(sinks[i], SNMP_MSG_TRAP2, 0, SNMP_VERSION_2c))
+        failed++;
+}
+OKF(failed == 0, ("%d sinks could not be opened", failed));
+
+send_v2trap(vars);
+received = 0;
+while (recv(sock, rbuf, sizeof(rbuf), MSG_DONTWAIT) > 0)
+    if (rbuf[0] == (ASN_SEQUENCE | ASN_CONSTRUCTOR))
+        received++;
+OKF(received == NSINKS, ("%d of %d sinks got the notification", received,
+                         NSINKS));
+
+/*
+ * the same fan-out, without and with shared varbinds
+ */
+pdu = snmp_pdu_create(SNMP_MSG_TRAP2);
+snmp_varlist_add_variable(&pdu->variables, sysUpTime, OID_LENGTH(sysUpTime),
+                          ASN_TIMETICKS, &uptime, sizeof(uptime));
+pdu->variables->next_variable = snmp_clone_varbind(vars);
+for (once = 0; once <= 1; once++) {
+    netsnmp_get_monotonic_clock(&start);
+    for (i = 0; i < ntraps; i++) {
+        plain = snmp_clone_pdu(pdu);
+        if (once)
+            snmp_pdu_encode_varbinds(plain);
+        for (j = 0; j < NSINKS; j++)
+            send_trap_to_sess(sinks[j], plain);
+        snmp_free_pdu(plain);
+        while (recv(sock, rbuf, sizeof(rbuf), MSG_DONTWAIT) > 0)
+            ;
+    }
+    netsnmp_get_monotonic_clock(&now);
+    NETSNMP_TIMERSUB(&now, &start, &diff);
+    printf("# %d notifications to %d sinks, varbinds encoded %s, "
+           "in %ld ms\n", ntraps, NSINKS,
+           once ? "once" : "for every sink",
+           (long) (diff.tv_sec * 1000 + diff.tv_usec / 1000));
+}
+snmp_free_pdu(pdu);
+
+snmpd_free_trapsinks();
+close(sock);
+snmp_free_varbind(vars);
+snmp_shutdown("trap-fanout-test");
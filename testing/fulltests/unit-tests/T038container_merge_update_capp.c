@@ -0,0 +1,119 @@
+/*
+ * HEADER Testing container merge of changed items
+ *
+ * Merges a snapshot in which one row changed, one is unchanged, one is new
+ * and one is gone, and checks that the changed row is updated in place
+ * through the update callback rather than replaced.
+ */
+
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-includes.h>
+#include <net-snmp/library/testing.h>
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+typedef struct test_row_s {
+    netsnmp_index   index;
+    oid             key;
+    long            value;
+} test_row;
+
+static int      updates, releases;
+
+static test_row *
+new_row(oid key, long value)
+{
+    test_row       *row = calloc(1, sizeof(*row));
+
+    row->index.oids = &row->key;
+    row->index.len = 1;
+    row->key = key;
+    row->value = value;
+    return row;
+}
+
+static test_row *
+find_row(netsnmp_container *c, oid key)
+{
+    netsnmp_index   idx;
+
+    idx.oids = &key;
+    idx.len = 1;
+    return (test_row *) CONTAINER_FIND(c, &idx);
+}
+
+static int
+update_row(void *live_item, void *fresh_item, void *ctx)
+{
+    test_row       *live = live_item, *fresh = fresh_item;
+
+    updates++;
+    if (live->value == fresh->value)
+        return 0;
+    live->value = fresh->value;
+    return 1;
+}
+
+static void
+release_row(void *item, void *ctx)
+{
+    releases++;
+    free(item);
+}
+
+static const netsnmp_container_merge_ops ops = {
+    update_row, NULL, release_row, release_row
+};
+
+int
+main(int argc, char *argv[])
+{
+    netsnmp_container *live, *fresh;
+    netsnmp_container_merge_stats stats;
+    test_row       *kept[2], *row;
+    int             rc;
+
+    init_snmp("container-merge-update-test");
+
+    live = netsnmp_container_find("test_live:table_container");
+    live->compare = netsnmp_compare_netsnmp_index;
+    fresh = netsnmp_container_find("test_fresh:table_container");
+    fresh->compare = netsnmp_compare_netsnmp_index;
+
+    CONTAINER_INSERT(live, new_row(1, 10));
+    CONTAINER_INSERT(live, new_row(2, 20));
+    CONTAINER_INSERT(live, new_row(3, 30));
+    CONTAINER_INSERT(fresh, new_row(2, 25));
+    CONTAINER_INSERT(fresh, new_row(3, 30));
+    CONTAINER_INSERT(fresh, new_row(4, 40));
+    kept[0] = find_row(live, 2);
+    kept[1] = find_row(live, 3);
+
+    rc = netsnmp_container_merge(live, fresh, &ops, NULL, &stats);
+    OKF(rc == 0, ("merge succeeded"));
+    OKF(updates == 2, ("update called for the 2 common rows (%d)", updates));
+    OKF(stats.changed == 1, ("1 changed row (%d)", (int) stats.changed));
+    OKF(stats.unchanged == 1, ("1 unchanged row (%d)", (int) stats.unchanged));
+    OKF(stats.added == 1, ("1 added row (%d)", (int) stats.added));
+    OKF(stats.deleted == 1, ("1 deleted row (%d)", (int) stats.deleted));
+    OKF(releases == 3, ("3 rows released (%d)", releases));
+
+    row = find_row(live, 2);
+    OKF(row == kept[0] && row->value == 25,
+        ("row 2 updated in place (%ld)", row ? row->value : -1));
+    row = find_row(live, 3);
+    OKF(row == kept[1] && row->value == 30, ("row 3 kept in place"));
+    row = find_row(live, 4);
+    OKF(row != NULL && row->value == 40, ("row 4 added"));
+    OKF(find_row(live, 1) == NULL, ("row 1 removed"));
+
+    CONTAINER_FREE_ALL(live, NULL);
+    CONTAINER_FREE(live);
+    CONTAINER_FREE(fresh);
+    snmp_shutdown("container-merge-update-test");
+
+    PLAN(__test_counter);
+    return 0;
+}
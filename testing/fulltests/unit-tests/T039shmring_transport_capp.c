@@ -0,0 +1,210 @@
+/*
+ * HEADER Testing the shared memory ring transport
+ *
+ * Connects a client to a shm: server and has the client send, before the
+ * server reads anything, a message while the offer is unanswered and then
+ * enough to fill the ring up to the last byte, so that later messages go
+ * over the socket without room for their marker, and then more than the
+ * socket takes, which must not block.  Checks that the server gets
+ * everything in order and sees the client go away.  Needs the ShmRing
+ * transport.
+ */
+
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-includes.h>
+#include <net-snmp/library/testing.h>
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef NETSNMP_TRANSPORT_SHMRING_DOMAIN
+
+#include <sys/un.h>
+#include <net-snmp/library/snmpShmRingDomain.h>
+#include <net-snmp/library/fd_event_manager.h>
+
+#define BIG_MSG         8184    /* takes 8192 bytes of ring */
+#define SMALL_MSG       100
+#define SOCKET_MSGS     128     /* a MB, more than any socket buffer */
+
+static u_char  *expected;
+static size_t   expected_len;
+
+/*
+ * Send a message of len bytes, remembering what the server should get.
+ */
+static int
+send_msg(netsnmp_transport *t, int len)
+{
+    u_char         *buf = malloc(len);
+    void           *opaque = NULL;
+    int             olength = 0, i, rc;
+
+    for (i = 0; i < len; i++)
+        buf[i] = (expected_len + i) * 7 + 1;
+    rc = t->f_send(t, buf, len, &opaque, &olength);
+    if (rc == len) {
+        expected = realloc(expected, expected_len + len);
+        memcpy(expected + expected_len, buf, len);
+        expected_len += len;
+    }
+    free(buf);
+    return rc;
+}
+
+/*
+ * Wait up to ms milliseconds for the transport (or one of the sockets it
+ * watches), and read from it once.  Returns what f_recv() returned, -2
+ * if nothing happened or -3 if nothing was delivered.
+ */
+static int
+pump(netsnmp_transport *t, u_char *buf, int size, int ms)
+{
+    fd_set          readfds, writefds, exceptfds;
+    struct timeval  tv;
+    void           *opaque = NULL;
+    int             numfds = 0, count, olength = 0, rc;
+
+    FD_ZERO(&readfds);
+    FD_ZERO(&writefds);
+    FD_ZERO(&exceptfds);
+    netsnmp_external_event_info(&numfds, &readfds, &writefds, &exceptfds);
+    FD_SET(t->sock, &readfds);
+    if (t->sock >= numfds)
+        numfds = t->sock + 1;
+    tv.tv_sec = ms / 1000;
+    tv.tv_usec = (ms % 1000) * 1000;
+    count = select(numfds, &readfds, &writefds, &exceptfds, &tv);
+    if (count <= 0)
+        return -2;
+    netsnmp_dispatch_external_events(&count, &readfds, &writefds, &exceptfds);
+    if (!FD_ISSET(t->sock, &readfds))
+        return -2;
+    rc = t->f_recv(t, buf, size, &opaque, &olength);
+    free(opaque);
+    if (0 == rc && t->flags & NETSNMP_TRANSPORT_FLAG_EMPTY_PKT)
+        rc = -3;
+    t->flags &= ~NETSNMP_TRANSPORT_FLAG_EMPTY_PKT;
+    return rc;
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct sockaddr_un addr;
+    netsnmp_transport *srv, *cli, *acc;
+    u_char         *got, buf[65536];
+    size_t          got_len = 0, used;
+    int             fd, sock, sent = 0, msgs = 0, i, rc;
+
+    init_snmp("shmring-test");
+
+    memset(&addr, 0x0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "/tmp/shmring-test-%d",
+             (int) getpid());
+    unlink(addr.sun_path);
+
+    srv = netsnmp_shmring_transport(&addr, 1);
+    OK(srv != NULL, "server listening");
+    cli = netsnmp_shmring_transport(&addr, 0);
+    OK(cli != NULL, "client connected without waiting for the server");
+    if (srv == NULL || cli == NULL)
+        goto done;
+    fd = srv->f_accept(srv);
+    acc = netsnmp_transport_copy(srv);
+    acc->sock = fd;
+    acc->flags &= ~NETSNMP_TRANSPORT_FLAG_LISTEN;
+
+    /*
+     * goes over the socket, and is accounted for by the first marker
+     */
+    OK(send_msg(cli, SMALL_MSG) == SMALL_MSG, "sent before the answer");
+
+    rc = pump(acc, buf, sizeof(buf), 1000);
+    OKF(rc == -3, ("server took the offer (%d)", rc));
+    sock = cli->sock;
+    rc = pump(cli, buf, sizeof(buf), 1000);
+    OKF(rc == -3 && cli->sock != sock, ("client switched to the rings (%d)",
+                                       rc));
+
+    /*
+     * fill the ring, after the first marker, up to the last byte
+     */
+    for (used = 8; used + BIG_MSG + 16 <= NETSNMP_SHMRING_SIZE;
+         used += BIG_MSG + 8, msgs++)
+        sent += send_msg(cli, BIG_MSG) == BIG_MSG;
+    sent += send_msg(cli, NETSNMP_SHMRING_SIZE - used - 16) ==
+        (int) (NETSNMP_SHMRING_SIZE - used - 16);
+    msgs++;
+    for (i = 0; i < 3; i++, msgs++)
+        sent += send_msg(cli, SMALL_MSG) == SMALL_MSG;
+    OKF(sent == msgs, ("%d of %d messages sent with the ring full", sent,
+                       msgs));
+
+    /*
+     * the server still isn't reading: the rest is kept by the client
+     */
+    for (i = 0, sent = 0; i < SOCKET_MSGS; i++)
+        sent += send_msg(cli, BIG_MSG) == BIG_MSG;
+    OKF(sent == SOCKET_MSGS, ("%d of %d messages sent with the socket full",
+                              sent, SOCKET_MSGS));
+
+    got = malloc(expected_len);
+    for (i = 0; i < 1000 && got_len < expected_len; i++) {
+        rc = pump(acc, buf, sizeof(buf), 100);
+        if (rc > 0) {
+            if (got_len + rc > expected_len)
+                break;
+            memcpy(got + got_len, buf, rc);
+            got_len += rc;
+        } else if (rc != -2 && rc != -3)
+            break;
+        pump(cli, buf, sizeof(buf), 0);
+    }
+    OKF(got_len == expected_len, ("server got %d of %d bytes",
+                                  (int) got_len, (int) expected_len));
+    OK(got_len == expected_len && memcmp(got, expected, got_len) == 0,
+       "server got the messages in order");
+    free(got);
+
+    cli->f_close(cli);
+    netsnmp_transport_free(cli);
+    for (i = 0; i < 20; i++)
+        if ((rc = pump(acc, buf, sizeof(buf), 100)) >= -1)
+            break;
+    OKF(rc == 0, ("server saw the client go away (%d)", rc));
+
+    acc->f_close(acc);
+    netsnmp_transport_free(acc);
+  done:
+    if (srv) {
+        srv->f_close(srv);
+        netsnmp_transport_free(srv);
+    }
+    unlink(addr.sun_path);
+    free(expected);
+    snmp_shutdown("shmring-test");
+
+    PLAN(__test_counter);
+    return 0;
+}
+
+#else /* NETSNMP_TRANSPORT_SHMRING_DOMAIN */
+
+int
+main(int argc, char *argv[])
+{
+    OK(1, "skipped: not built with the ShmRing transport");
+    PLAN(__test_counter);
+    return 0;
+}
+
+#endif /* NETSNMP_TRANSPORT_SHMRING_DOMAIN */
@@ -86,6 +86,7 @@ int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
     pdu->securityNameLen = 0;
     pdu->transport_data = NULL;
     pdu->transport_data_length = 0;
+    pdu->varbind_encoding = NULL;
     pdu->variables = &var1;
     snmp_input(op, &sess, 0/*ignored*/, pdu, &transport);
 